@@ -0,0 +1,45 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+/* Helpers shared by the micro benchmarks, which are linked with benchmark.c instead of main.c. */
+
+/**
+ * \return Seconds from an unspecified starting point, for measuring elapsed time.
+ */
+double monotonic_seconds(void);
+
+/**
+ * \brief Reads an optional positional integer argument.
+ *
+ * \param index Position of the argument, 1 for the first one.
+ * \return The argument, or default_value if it was not given.
+ */
+int benchmark_arg(int argc, char **argv, int index, int default_value);
+
+/**
+ * \brief Prints the usage line of a benchmark to stderr.
+ *
+ * \param arguments Description of the arguments, for example "[iterations]".
+ */
+void benchmark_usage(const char *program, const char *arguments);
+
+#endif /* __BENCHMARK_H__ */
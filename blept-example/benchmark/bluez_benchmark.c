@@ -0,0 +1,341 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file bluez_benchmark.c
+ * \brief Runs blept end to end against the BlueZ simulator on a private D-Bus.
+ *
+ * The benchmark starts a private bus daemon, exports the simulated adapter and devices on it and
+ * runs ble_start against the bus. Edge Core is replaced by the functions of pt_edge.h below, which
+ * register devices immediately and record the values blept publishes. The simulated
+ * characteristic values carry the time they were generated, so the latency from a notification
+ * to its publish is measured per value.
+ *
+ * Usage: blept-bluez-benchmark [devices] [characteristics per device] [notify interval ms]
+ *                              [duration s] [connect latency ms] [read latency ms] [max connecting]
+ */
+
+#include "devices.h"
+#include "pt_ble.h"
+#include "pt_edge.h"
+#include "simulator/bluez_simulator.h"
+
+#include <mbed-trace/mbed_trace.h>
+#include "common/edge_trace.h"
+
+#include <gio/gio.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_GROUP "bench"
+
+#define BENCHMARK_DEFAULT_DEVICES 200
+#define BENCHMARK_DEFAULT_CHARACTERISTICS 4
+#define BENCHMARK_DEFAULT_NOTIFY_INTERVAL_MS 100
+#define BENCHMARK_DEFAULT_DURATION_S 30
+#define BENCHMARK_DEFAULT_CONNECT_LATENCY_MS 50
+#define BENCHMARK_DEFAULT_READ_LATENCY_MS 10
+#define BENCHMARK_DEFAULT_MAX_CONNECTING 4
+
+volatile int global_keep_running = 0;
+
+typedef struct {
+    GMutex mutex;
+    GHashTable *created_devices;  /* device ids known to the mock Edge */
+    int expected_devices;
+    int registered_devices;
+    gint64 start_time;
+    gint64 all_registered_time;
+    gint64 first_value_time;
+    gint64 last_value_time;
+    GArray *latencies_us;         /* gint64 latency of each received characteristic value */
+} mock_edge_t;
+
+static mock_edge_t mock_edge;
+
+// ============================================================================
+// Edge Core stand-in, implements pt_edge.h
+// ============================================================================
+
+bool edge_add_resource(const char *device_id,
+                       const uint16_t object_id,
+                       const uint16_t instance_id,
+                       const uint16_t resource_id,
+                       const char *resource_name,
+                       const Lwm2mResourceType type,
+                       const uint8_t operations,
+                       const uint8_t *value,
+                       const uint32_t value_size)
+{
+    return true;
+}
+
+void edge_set_resource_value(const char *device_id,
+                             const uint16_t object_id,
+                             const uint16_t instance_id,
+                             const uint16_t resource_id,
+                             const uint8_t *value,
+                             const uint32_t value_size)
+{
+    gint64 now, stamp, latency;
+
+    if (object_id != IPSO_OID_BLE_SERVICE || value_size != BLUEZ_SIMULATOR_VALUE_SIZE) {
+        return;
+    }
+    now = g_get_monotonic_time();
+    memcpy(&stamp, value, sizeof(stamp));
+    latency = now - stamp;
+
+    g_mutex_lock(&mock_edge.mutex);
+    if (mock_edge.first_value_time == 0) {
+        mock_edge.first_value_time = now;
+    }
+    mock_edge.last_value_time = now;
+    g_array_append_val(mock_edge.latencies_us, latency);
+    g_mutex_unlock(&mock_edge.mutex);
+}
+
+void unregister_devices()
+{
+    g_idle_add(pt_ble_g_main_quit_loop, NULL);
+}
+
+void write_value_failure(const char *device_id, void *userdata)
+{
+}
+
+void write_value_success(const char *device_id, void *userdata)
+{
+}
+
+void start_protocol_translator_api(protocol_translator_api_start_ctx_t *ctx)
+{
+}
+
+void stop_protocol_translator_api()
+{
+}
+
+void stop_protocol_translator_api_thread()
+{
+}
+
+bool edge_is_connected()
+{
+    return true;
+}
+
+void edge_write_values(const char *device_id)
+{
+}
+
+bool edge_device_exists(const char *device_id)
+{
+    bool exists;
+    g_mutex_lock(&mock_edge.mutex);
+    exists = g_hash_table_contains(mock_edge.created_devices, device_id);
+    g_mutex_unlock(&mock_edge.mutex);
+    return exists;
+}
+
+static gboolean mock_edge_device_registered(gpointer device_id)
+{
+    struct ble_device *ble;
+
+    devices_mutex_lock();
+    ble = devices_find_device_by_device_id(device_id);
+    if (ble != NULL) {
+        device_set_registered(ble, true);
+        g_mutex_lock(&mock_edge.mutex);
+        mock_edge.registered_devices++;
+        if (mock_edge.registered_devices == mock_edge.expected_devices) {
+            mock_edge.all_registered_time = g_get_monotonic_time();
+        }
+        g_mutex_unlock(&mock_edge.mutex);
+    }
+    devices_mutex_unlock();
+    free(device_id);
+    return G_SOURCE_REMOVE;
+}
+
+void edge_register_device(const char *device_id)
+{
+    g_idle_add(mock_edge_device_registered, strdup(device_id));
+}
+
+void pt_edge_del_device(struct ble_device *ble)
+{
+    devices_del_device(ble);
+}
+
+bool edge_unregister_device(struct ble_device *dev, bool remove_device_context)
+{
+    g_mutex_lock(&mock_edge.mutex);
+    g_hash_table_remove(mock_edge.created_devices, dev->device_id);
+    g_mutex_unlock(&mock_edge.mutex);
+    if (remove_device_context) {
+        pt_edge_del_device(dev);
+    } else {
+        device_set_registered(dev, false);
+    }
+    return true;
+}
+
+connection_id_t edge_get_connection_id()
+{
+    return 1;
+}
+
+bool edge_create_device(const char *device_id,
+                        const char *manufacturer,
+                        const char *model_number,
+                        const char *serial_number,
+                        const char *device_type,
+                        uint32_t lifetime,
+                        pt_resource_callback reboot_callback)
+{
+    g_mutex_lock(&mock_edge.mutex);
+    g_hash_table_add(mock_edge.created_devices, g_strdup(device_id));
+    g_mutex_unlock(&mock_edge.mutex);
+    return true;
+}
+
+// ============================================================================
+// Benchmark
+// ============================================================================
+
+static gboolean benchmark_stop(gpointer data)
+{
+    (void) data;
+    global_keep_running = 0;
+    pt_ble_g_main_quit_loop(NULL);
+    return G_SOURCE_REMOVE;
+}
+
+static gint benchmark_compare_latency(gconstpointer a, gconstpointer b)
+{
+    gint64 la = *(const gint64 *) a;
+    gint64 lb = *(const gint64 *) b;
+    return (la > lb) - (la < lb);
+}
+
+static void benchmark_print_results(struct bluez_simulator *sim, const struct bluez_simulator_config *config)
+{
+    guint count = mock_edge.latencies_us->len;
+    uint64_t sent = bluez_simulator_notifications_sent(sim);
+    double seconds = (mock_edge.last_value_time - mock_edge.first_value_time) / 1e6;
+
+    printf("devices: %d, characteristics per device: %d, notify interval: %d ms\n",
+           config->device_count, config->characteristic_count, config->notify_interval_ms);
+    if (mock_edge.all_registered_time != 0) {
+        printf("discovery and registration of all devices: %.1f ms\n",
+               (mock_edge.all_registered_time - mock_edge.start_time) / 1e3);
+    } else {
+        printf("registered devices: %d of %d\n", mock_edge.registered_devices, mock_edge.expected_devices);
+    }
+    printf("notifications sent: %" PRIu64 ", values published: %u\n", sent, count);
+    if (count == 0) {
+        return;
+    }
+    printf("values published per second: %.0f\n", seconds > 0 ? count / seconds : 0);
+
+    g_array_sort(mock_edge.latencies_us, benchmark_compare_latency);
+    printf("latency from notification to publish: median %.1f ms, p99 %.1f ms, max %.1f ms\n",
+           g_array_index(mock_edge.latencies_us, gint64, count / 2) / 1e3,
+           g_array_index(mock_edge.latencies_us, gint64, (guint) (count * 0.99)) / 1e3,
+           g_array_index(mock_edge.latencies_us, gint64, count - 1) / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    struct bluez_simulator_config config;
+    struct bluez_simulator *sim;
+    GTestDBus *bus;
+    int duration_s, max_connecting;
+    int ret_val;
+
+    config.adapter = "hci0";
+    config.device_count = argc > 1 ? atoi(argv[1]) : BENCHMARK_DEFAULT_DEVICES;
+    config.characteristic_count = argc > 2 ? atoi(argv[2]) : BENCHMARK_DEFAULT_CHARACTERISTICS;
+    config.notify_interval_ms = argc > 3 ? atoi(argv[3]) : BENCHMARK_DEFAULT_NOTIFY_INTERVAL_MS;
+    duration_s = argc > 4 ? atoi(argv[4]) : BENCHMARK_DEFAULT_DURATION_S;
+    config.connect_latency_ms = argc > 5 ? atoi(argv[5]) : BENCHMARK_DEFAULT_CONNECT_LATENCY_MS;
+    config.read_latency_ms = argc > 6 ? atoi(argv[6]) : BENCHMARK_DEFAULT_READ_LATENCY_MS;
+    max_connecting = argc > 7 ? atoi(argv[7]) : BENCHMARK_DEFAULT_MAX_CONNECTING;
+    if (config.device_count <= 0 || config.characteristic_count <= 0 || config.notify_interval_ms <= 0 ||
+        duration_s <= 0 || config.connect_latency_ms < 0 || config.read_latency_ms < 0 || max_connecting <= 0) {
+        fprintf(stderr,
+                "Usage: %s [devices] [characteristics per device] [notify interval ms] [duration s] "
+                "[connect latency ms] [read latency ms] [max connecting]\n",
+                argv[0]);
+        return 1;
+    }
+
+    edge_trace_init(0);
+    // Per value debug traces would dominate the measurement.
+    mbed_trace_config_set(TRACE_ACTIVE_LEVEL_WARN);
+
+    g_mutex_init(&mock_edge.mutex);
+    mock_edge.created_devices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    mock_edge.latencies_us = g_array_new(FALSE, FALSE, sizeof(gint64));
+    mock_edge.expected_devices = config.device_count;
+
+    bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+    config.bus_address = g_test_dbus_get_bus_address(bus);
+
+    sim = bluez_simulator_start(&config);
+    if (sim == NULL) {
+        tr_err("Could not start the BlueZ simulator");
+        g_test_dbus_down(bus);
+        g_object_unref(bus);
+        return 1;
+    }
+
+    global_keep_running = 1;
+    devices_init();
+    g_timeout_add_seconds(duration_s, benchmark_stop, NULL);
+    mock_edge.start_time = g_get_monotonic_time();
+
+    ret_val = ble_start("bench",
+                        config.adapter,
+                        config.bus_address,
+                        0,               /* clear_device_cache */
+                        NULL,            /* extended_discovery_file_path */
+                        1,               /* service_based_discovery */
+                        5000,            /* write_timeout_ms */
+                        max_connecting,
+                        NULL);           /* gatt_cache_dir */
+    if (ret_val != 0) {
+        tr_err("ble_start returned error code %d", ret_val);
+    }
+
+    benchmark_print_results(sim, &config);
+
+    bluez_simulator_stop(sim);
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+    g_array_free(mock_edge.latencies_us, TRUE);
+    g_hash_table_destroy(mock_edge.created_devices);
+    g_mutex_clear(&mock_edge.mutex);
+    return ret_val;
+}
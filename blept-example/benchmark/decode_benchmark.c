@@ -0,0 +1,105 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file decode_benchmark.c
+ * \brief Measures characteristic value decoding for every VALUE_FORMAT_* presentation format.
+ *
+ * Usage: blept-decode-benchmark [iterations]
+ */
+
+#include "benchmark/benchmark.h"
+#include "devices.h"
+#include "pt_ble_translations.h"
+#include "pt_ble_supported_translations.h"
+
+#include <mbed-trace/mbed_trace.h>
+#include "common/edge_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRACE_GROUP "bench"
+
+#define BENCHMARK_DEFAULT_ITERATIONS 1000000
+
+static const char *value_format_names[] = {
+    "RESERVED1", "BOOLEAN", "UINT2", "UINT4", "UINT8", "UINT12", "UINT16", "UINT24", "UINT32",
+    "UINT48", "UINT64", "UINT128", "INT8", "INT12", "INT16", "INT24", "INT32", "INT48", "INT64",
+    "INT128", "FLOAT32_IEEE754", "FLOAT64_IEEE754", "SFLOAT16_IEEE11073", "FLOAT32_IEEE11073",
+    "IEEE20601", "UTF8", "UTF16", "OPAQUE"
+};
+
+static void benchmark_format(const value_format_t format, const int exponent, const int iterations)
+{
+    ble_services_characteristic_value_format_t format_descriptor = {
+        .format = format,
+        .exponent = exponent,
+        .namespace = VALUE_NAMESPACE_BLUETOOTH_SIG
+    };
+    double scale = ble_services_power_of_ten(exponent);
+    uint8_t value[4];
+    uint8_t decoded[BLE_DECODED_VALUE_MAX_SIZE];
+    size_t decoded_len = sizeof(decoded);
+    uint32_t checksum = 0;
+    double start, elapsed;
+    int i;
+
+    if (!ble_services_decode_formatted_value(&format_descriptor, scale, (const uint8_t *) "\0\0\0\0", 4,
+                                             decoded, &decoded_len, NULL)) {
+        printf("%-20s %4d  unsupported\n", value_format_names[format], exponent);
+        return;
+    }
+
+    start = monotonic_seconds();
+    for (i = 0; i < iterations; i++) {
+        value[0] = (uint8_t) i;
+        value[1] = (uint8_t)(i >> 8);
+        value[2] = (uint8_t)(i >> 16);
+        value[3] = (uint8_t)(i >> 24);
+        decoded_len = sizeof(decoded);
+        ble_services_decode_formatted_value(&format_descriptor, scale, value, sizeof(value),
+                                            decoded, &decoded_len, NULL);
+        checksum += decoded[0];
+    }
+    elapsed = monotonic_seconds() - start;
+
+    printf("%-20s %4d  %8.1f ns/value  (%u)\n",
+           value_format_names[format], exponent, elapsed * 1e9 / iterations, checksum & 0xff);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = benchmark_arg(argc, argv, 1, BENCHMARK_DEFAULT_ITERATIONS);
+    int format;
+
+    if (iterations <= 0) {
+        benchmark_usage(argv[0], "[iterations]");
+        return 1;
+    }
+    edge_trace_init(0);
+
+    printf("%-20s %4s  %d iterations\n", "format", "exp", iterations);
+    for (format = VALUE_FORMAT_BOOLEAN; format < VALUE_FORMAT_RESERVED2; format++) {
+        benchmark_format(format, 0, iterations);
+        benchmark_format(format, -2, iterations);
+    }
+    return 0;
+}
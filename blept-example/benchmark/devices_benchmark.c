@@ -0,0 +1,198 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file devices_benchmark.c
+ * \brief Measures contention on the device table.
+ *
+ * A number of fake devices (MEPT_BLE_ADD_FAKE_DEVICES) are linked into the device table and
+ * worker threads update characteristic values of random devices, the same way the read and
+ * notify callbacks and the Edge resource callback do. The run is repeated with the lookups
+ * done under the global devices mutex and through the sharded device table.
+ *
+ * Usage: blept-devices-benchmark [devices] [threads] [operations per thread]
+ */
+
+#include "benchmark/benchmark.h"
+#include "devices.h"
+
+#include <mbed-trace/mbed_trace.h>
+#include "common/edge_trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_GROUP "bench"
+
+#define BENCHMARK_DEFAULT_DEVICES 64
+#define BENCHMARK_DEFAULT_THREADS 4
+#define BENCHMARK_DEFAULT_OPERATIONS 200000
+// Iterations of busy work standing in for decoding and translating a value
+#define BENCHMARK_WORK_ITERATIONS 200
+
+typedef enum {
+    BENCHMARK_GLOBAL_LOCK,
+    BENCHMARK_SHARDED
+} benchmark_mode_t;
+
+typedef struct {
+    benchmark_mode_t mode;
+    char **device_ids;
+    int device_count;
+    int operations;
+    unsigned int seed;
+} benchmark_worker_t;
+
+static void benchmark_update_value(struct ble_device *ble, int value)
+{
+    struct ble_gatt_char *gattchar = &(ble->attrs.services[0].chars[0]);
+    volatile int work = value;
+    int i;
+
+    for (i = 0; i < BENCHMARK_WORK_ITERATIONS; i++) {
+        work = work * 31 + i;
+    }
+    memcpy(gattchar->value, &value, sizeof(value));
+    gattchar->value_length = sizeof(value);
+    ble->values_dirty = true;
+}
+
+static void *benchmark_worker(void *arg)
+{
+    benchmark_worker_t *worker = arg;
+    int i;
+
+    for (i = 0; i < worker->operations; i++) {
+        const char *device_id = worker->device_ids[rand_r(&worker->seed) % worker->device_count];
+        struct ble_device *ble;
+
+        if (worker->mode == BENCHMARK_GLOBAL_LOCK) {
+            devices_mutex_lock();
+            ble = devices_find_device_by_device_id(device_id);
+            device_mutex_lock(ble);
+            benchmark_update_value(ble, i);
+            device_mutex_unlock(ble);
+            devices_mutex_unlock();
+        } else {
+            ble = devices_acquire_device_by_device_id(device_id);
+            device_mutex_lock(ble);
+            benchmark_update_value(ble, i);
+            device_mutex_unlock(ble);
+            devices_release_device(ble);
+        }
+    }
+    return NULL;
+}
+
+static double benchmark_run(benchmark_mode_t mode, char **device_ids, int device_count, int thread_count, int operations)
+{
+    pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+    benchmark_worker_t *workers = calloc(thread_count, sizeof(benchmark_worker_t));
+    double start, elapsed;
+    int i;
+
+    if (threads == NULL || workers == NULL) {
+        tr_err("Could not allocate the benchmark threads");
+        free(threads);
+        free(workers);
+        return 0;
+    }
+
+    start = monotonic_seconds();
+    for (i = 0; i < thread_count; i++) {
+        workers[i].mode = mode;
+        workers[i].device_ids = device_ids;
+        workers[i].device_count = device_count;
+        workers[i].operations = operations;
+        workers[i].seed = i + 1;
+        pthread_create(&threads[i], NULL, benchmark_worker, &workers[i]);
+    }
+    for (i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    elapsed = monotonic_seconds() - start;
+
+    free(threads);
+    free(workers);
+    return elapsed > 0 ? (double) thread_count * operations / elapsed : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int device_count = benchmark_arg(argc, argv, 1, BENCHMARK_DEFAULT_DEVICES);
+    int thread_count = benchmark_arg(argc, argv, 2, BENCHMARK_DEFAULT_THREADS);
+    int operations = benchmark_arg(argc, argv, 3, BENCHMARK_DEFAULT_OPERATIONS);
+    struct ble_device **devices;
+    char **device_ids;
+    double global_ops, sharded_ops;
+    int i;
+
+    if (device_count <= 0 || thread_count <= 0 || operations <= 0) {
+        benchmark_usage(argv[0], "[devices] [threads] [operations per thread]");
+        return 1;
+    }
+
+    edge_trace_init(0);
+    devices_init();
+
+    devices = calloc(device_count, sizeof(struct ble_device *));
+    device_ids = calloc(device_count, sizeof(char *));
+    if (devices == NULL || device_ids == NULL) {
+        tr_err("Could not allocate the fake devices");
+        return 1;
+    }
+
+    for (i = 0; i < device_count; i++) {
+        char addr[18];
+        char device_id[64];
+        char path[64];
+
+        snprintf(addr, sizeof(addr), "00:00:00:00:%02X:%02X", (i >> 8) & 0xff, i & 0xff);
+        devices_make_device_id(device_id, sizeof(device_id), "BLE", addr, "bench");
+        snprintf(path, sizeof(path), "/org/bluez/bench/dev%d", i);
+
+        devices[i] = device_create(addr);
+        devices[i]->dbus_path = strdup(path);
+        struct ble_gatt_char_info info = {FAKE_SRVC1_UUID, path, FAKE_CHAR1_UUID, path,
+                                          BLE_GATT_PROP_PERM_READ | BLE_GATT_PROP_PERM_WRITE, 0, NULL};
+        device_set_gatt_characteristics(devices[i], &info, 1);
+        devices_link_device(devices[i], device_id);
+        device_ids[i] = devices[i]->device_id;
+    }
+
+    global_ops = benchmark_run(BENCHMARK_GLOBAL_LOCK, device_ids, device_count, thread_count, operations);
+    sharded_ops = benchmark_run(BENCHMARK_SHARDED, device_ids, device_count, thread_count, operations);
+
+    printf("devices: %d, threads: %d, operations per thread: %d\n", device_count, thread_count, operations);
+    printf("global devices mutex: %12.0f ops/s\n", global_ops);
+    printf("sharded device table: %12.0f ops/s (%.2fx)\n",
+           sharded_ops, global_ops > 0 ? sharded_ops / global_ops : 0);
+
+    devices_mutex_lock();
+    for (i = 0; i < device_count; i++) {
+        devices_del_device(devices[i]);
+    }
+    devices_mutex_unlock();
+    free(devices);
+    free(device_ids);
+    return 0;
+}
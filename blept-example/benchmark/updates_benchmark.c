@@ -0,0 +1,228 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file updates_benchmark.c
+ * \brief Measures the characteristic value update path.
+ *
+ * Fake devices (MEPT_BLE_ADD_FAKE_DEVICES) with several characteristics receive value updates
+ * the way notifications and read completions deliver them. The run is repeated with the
+ * characteristic looked up by device address and dbus path and with it resolved through a
+ * ble_char_handle. Values are published once per characteristic per poll tick, the benchmark
+ * also prints how many updates were coalesced by the batching.
+ *
+ * Usage: blept-updates-benchmark [devices] [characteristics per device] [updates] [updates per tick]
+ */
+
+#include "benchmark/benchmark.h"
+#include "devices.h"
+
+#include <mbed-trace/mbed_trace.h>
+#include "common/edge_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_GROUP "bench"
+
+#define BENCHMARK_DEFAULT_DEVICES 64
+#define BENCHMARK_DEFAULT_CHARACTERISTICS 8
+#define BENCHMARK_DEFAULT_UPDATES 2000000
+#define BENCHMARK_DEFAULT_UPDATES_PER_TICK 4096
+
+typedef enum {
+    BENCHMARK_PATH_LOOKUP,
+    BENCHMARK_HANDLE
+} benchmark_mode_t;
+
+typedef struct {
+    struct ble_device **devices;
+    struct ble_char_handle **handles;
+    int device_count;
+    int char_count;
+    int updates;
+    int updates_per_tick;
+    long publishes;
+} benchmark_t;
+
+// The lookup the notify handler and the read callback did before handles: device by address, then
+// the characteristic by comparing dbus paths. Returns the characteristic with the device mutex held.
+static struct ble_gatt_char *benchmark_lookup_by_path(struct ble_device *target, int srvc, int ch)
+{
+    const char *path = target->attrs.services[srvc].chars[ch].dbus_path;
+    struct ble_device *ble;
+    int s, c;
+
+    devices_mutex_lock();
+    ble = devices_find_device_by_address(target->attrs.addr);
+    device_mutex_lock(ble);
+    devices_mutex_unlock();
+    for (s = 0; s < ble->attrs.services_count; s++) {
+        for (c = 0; c < ble->attrs.services[s].chars_count; c++) {
+            if (strcmp(ble->attrs.services[s].chars[c].dbus_path, path) == 0) {
+                return &(ble->attrs.services[s].chars[c]);
+            }
+        }
+    }
+    device_mutex_unlock(ble);
+    return NULL;
+}
+
+// Publishes the dirty characteristics of every device, as the poll tick does.
+static void benchmark_tick(benchmark_t *bench)
+{
+    int i, s, c;
+
+    for (i = 0; i < bench->device_count; i++) {
+        struct ble_device *ble = bench->devices[i];
+        if (!ble->values_dirty) {
+            continue;
+        }
+        for (s = 0; s < ble->attrs.services_count; s++) {
+            for (c = 0; c < ble->attrs.services[s].chars_count; c++) {
+                if (ble->attrs.services[s].chars[c].value_dirty) {
+                    ble->attrs.services[s].chars[c].value_dirty = false;
+                    bench->publishes++;
+                }
+            }
+        }
+        ble->values_dirty = false;
+    }
+}
+
+static double benchmark_run(benchmark_t *bench, benchmark_mode_t mode)
+{
+    unsigned int seed = 1;
+    double start, elapsed;
+    int i;
+
+    bench->publishes = 0;
+    start = monotonic_seconds();
+    for (i = 0; i < bench->updates; i++) {
+        int index = rand_r(&seed) % (bench->device_count * bench->char_count);
+        struct ble_device *ble = bench->devices[index / bench->char_count];
+        struct ble_gatt_char *gattchar;
+        uint16_t value = (uint16_t) i;
+
+        if (mode == BENCHMARK_PATH_LOOKUP) {
+            gattchar = benchmark_lookup_by_path(ble, 0, index % bench->char_count);
+        } else {
+            gattchar = device_char_handle_lock(bench->handles[index]);
+        }
+        if (gattchar != NULL) {
+            device_store_characteristic_value(gattchar, (const uint8_t *) &value, sizeof(value));
+            gattchar->value_dirty = true;
+            ble->values_dirty = true;
+            device_mutex_unlock(ble);
+        }
+        if ((i + 1) % bench->updates_per_tick == 0) {
+            benchmark_tick(bench);
+        }
+    }
+    benchmark_tick(bench);
+    elapsed = monotonic_seconds() - start;
+    return elapsed > 0 ? bench->updates / elapsed : 0;
+}
+
+int main(int argc, char **argv)
+{
+    benchmark_t bench;
+    struct ble_gatt_char_info *infos;
+    char **paths;
+    double path_ups, handle_ups;
+    int i, ch;
+
+    bench.device_count = benchmark_arg(argc, argv, 1, BENCHMARK_DEFAULT_DEVICES);
+    bench.char_count = benchmark_arg(argc, argv, 2, BENCHMARK_DEFAULT_CHARACTERISTICS);
+    bench.updates = benchmark_arg(argc, argv, 3, BENCHMARK_DEFAULT_UPDATES);
+    bench.updates_per_tick = benchmark_arg(argc, argv, 4, BENCHMARK_DEFAULT_UPDATES_PER_TICK);
+    if (bench.device_count <= 0 || bench.char_count <= 0 || bench.updates <= 0 || bench.updates_per_tick <= 0) {
+        benchmark_usage(argv[0], "[devices] [characteristics per device] [updates] [updates per tick]");
+        return 1;
+    }
+
+    edge_trace_init(0);
+    devices_init();
+
+    bench.devices = calloc(bench.device_count, sizeof(struct ble_device *));
+    bench.handles = calloc(bench.device_count * bench.char_count, sizeof(struct ble_char_handle *));
+    infos = calloc(bench.char_count, sizeof(struct ble_gatt_char_info));
+    paths = calloc(bench.char_count, sizeof(char *));
+    if (bench.devices == NULL || bench.handles == NULL || infos == NULL || paths == NULL) {
+        tr_err("Could not allocate the fake devices");
+        return 1;
+    }
+
+    for (i = 0; i < bench.device_count; i++) {
+        char addr[18];
+        char device_id[64];
+        char path[64];
+
+        snprintf(addr, sizeof(addr), "00:00:00:00:%02X:%02X", (i >> 8) & 0xff, i & 0xff);
+        devices_make_device_id(device_id, sizeof(device_id), "BLE", addr, "bench");
+        snprintf(path, sizeof(path), "/org/bluez/bench/dev%d/service0001", i);
+
+        bench.devices[i] = device_create(addr);
+        for (ch = 0; ch < bench.char_count; ch++) {
+            paths[ch] = malloc(strlen(path) + 16);
+            sprintf(paths[ch], "%s/char%04x", path, ch + 1);
+            infos[ch] = (struct ble_gatt_char_info) {FAKE_SRVC1_UUID, path,
+                                                     ch % 2 ? FAKE_CHAR2_UUID : FAKE_CHAR1_UUID, paths[ch],
+                                                     BLE_GATT_PROP_PERM_READ | BLE_GATT_PROP_PERM_NOTIFY,
+                                                     ch + 1, NULL};
+        }
+        device_set_gatt_characteristics(bench.devices[i], infos, bench.char_count);
+        for (ch = 0; ch < bench.char_count; ch++) {
+            free(paths[ch]);
+        }
+        devices_mutex_lock();
+        devices_link_device(bench.devices[i], device_id);
+        devices_mutex_unlock();
+        for (ch = 0; ch < bench.char_count; ch++) {
+            bench.handles[i * bench.char_count + ch] = device_char_handle_new(bench.devices[i], 0, ch);
+        }
+    }
+    free(infos);
+    free(paths);
+
+    path_ups = benchmark_run(&bench, BENCHMARK_PATH_LOOKUP);
+    handle_ups = benchmark_run(&bench, BENCHMARK_HANDLE);
+
+    printf("devices: %d, characteristics per device: %d, updates: %d, updates per tick: %d\n",
+           bench.device_count, bench.char_count, bench.updates, bench.updates_per_tick);
+    printf("lookup by dbus path: %12.0f updates/s\n", path_ups);
+    printf("characteristic handle: %12.0f updates/s (%.2fx)\n",
+           handle_ups, path_ups > 0 ? handle_ups / path_ups : 0);
+    printf("publishes: %ld for %d updates (%.1f%% coalesced)\n",
+           bench.publishes, bench.updates, 100.0 * (bench.updates - bench.publishes) / bench.updates);
+
+    for (i = 0; i < bench.device_count * bench.char_count; i++) {
+        device_char_handle_free(bench.handles[i]);
+    }
+    devices_mutex_lock();
+    for (i = 0; i < bench.device_count; i++) {
+        devices_del_device(bench.devices[i]);
+    }
+    devices_mutex_unlock();
+    free(bench.devices);
+    free(bench.handles);
+    return 0;
+}
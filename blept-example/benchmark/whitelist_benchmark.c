@@ -0,0 +1,134 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file whitelist_benchmark.c
+ * \brief Measures the device name matching of the extended discovery whitelist.
+ *
+ * A whitelist with the given number of names, every fourth of them an exact name, is matched
+ * against random device names. The run is repeated with the names compared one by one with
+ * strstr and strcmp, as the whitelist was matched before, and with the compiled whitelist.
+ *
+ * Usage: blept-whitelist-benchmark [whitelist names] [lookups]
+ */
+
+#include "benchmark/benchmark.h"
+#include "pt_ble_whitelist.h"
+
+#include <mbed-trace/mbed_trace.h>
+#include "common/edge_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_GROUP "bench"
+
+#define BENCHMARK_DEFAULT_NAMES 5000
+#define BENCHMARK_DEFAULT_LOOKUPS 200000
+#define BENCHMARK_NAME_SIZE 32
+
+typedef struct {
+    char (*names)[BENCHMARK_NAME_SIZE];
+    bool *partial;
+    int name_count;
+    char (*devices)[BENCHMARK_NAME_SIZE];
+    int lookups;
+} benchmark_t;
+
+static bool benchmark_match_linear(const benchmark_t *bench, const char *device)
+{
+    int i;
+    for (i = 0; i < bench->name_count; i++) {
+        if (bench->partial[i] ? strstr(device, bench->names[i]) != NULL : strcmp(device, bench->names[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    benchmark_t bench;
+    struct ble_whitelist *whitelist;
+    unsigned int seed = 1;
+    double start, linear_s, compiled_s;
+    int linear_matches = 0, compiled_matches = 0;
+    int i;
+
+    bench.name_count = benchmark_arg(argc, argv, 1, BENCHMARK_DEFAULT_NAMES);
+    bench.lookups = benchmark_arg(argc, argv, 2, BENCHMARK_DEFAULT_LOOKUPS);
+    if (bench.name_count <= 0 || bench.lookups <= 0) {
+        benchmark_usage(argv[0], "[whitelist names] [lookups]");
+        return 1;
+    }
+
+    edge_trace_init(0);
+
+    bench.names = calloc(bench.name_count, BENCHMARK_NAME_SIZE);
+    bench.partial = calloc(bench.name_count, sizeof(bool));
+    bench.devices = calloc(bench.lookups, BENCHMARK_NAME_SIZE);
+    whitelist = ble_whitelist_new();
+    if (bench.names == NULL || bench.partial == NULL || bench.devices == NULL || whitelist == NULL) {
+        tr_err("Could not allocate the whitelist");
+        return 1;
+    }
+    for (i = 0; i < bench.name_count; i++) {
+        bench.partial[i] = (i % 4) != 0;
+        snprintf(bench.names[i], BENCHMARK_NAME_SIZE, bench.partial[i] ? "Sensor %06x" : "Thermometer %06x",
+                 rand_r(&seed) & 0xffffff);
+        ble_whitelist_add(whitelist, bench.names[i], bench.partial[i]);
+    }
+    ble_whitelist_compile(whitelist);
+    // Half of the devices are whitelisted, the rest have names that share the prefixes.
+    for (i = 0; i < bench.lookups; i++) {
+        if (i % 2) {
+            snprintf(bench.devices[i], BENCHMARK_NAME_SIZE, "%s%s", bench.names[rand_r(&seed) % bench.name_count],
+                     i % 4 == 1 ? "" : " v2");
+        } else {
+            snprintf(bench.devices[i], BENCHMARK_NAME_SIZE, "Sensor %06x-b", rand_r(&seed) & 0xffffff);
+        }
+    }
+
+    start = monotonic_seconds();
+    for (i = 0; i < bench.lookups; i++) {
+        linear_matches += benchmark_match_linear(&bench, bench.devices[i]);
+    }
+    linear_s = monotonic_seconds() - start;
+
+    start = monotonic_seconds();
+    for (i = 0; i < bench.lookups; i++) {
+        compiled_matches += ble_whitelist_match(whitelist, bench.devices[i]);
+    }
+    compiled_s = monotonic_seconds() - start;
+
+    printf("whitelist names: %d, lookups: %d\n", bench.name_count, bench.lookups);
+    printf("linear strstr/strcmp: %10.0f lookups/s (%d matches)\n",
+           linear_s > 0 ? bench.lookups / linear_s : 0, linear_matches);
+    printf("compiled whitelist: %10.0f lookups/s (%d matches, %.1fx)\n",
+           compiled_s > 0 ? bench.lookups / compiled_s : 0, compiled_matches,
+           compiled_s > 0 ? linear_s / compiled_s : 0);
+
+    ble_whitelist_free(whitelist);
+    free(bench.names);
+    free(bench.partial);
+    free(bench.devices);
+    return linear_matches == compiled_matches ? 0 : 1;
+}
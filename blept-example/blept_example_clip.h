@@ -41,7 +41,10 @@ typedef struct {
     char *edge_domain_socket;
     char *endpoint_postfix;
     char *extended_discovery_file;
+    char *gatt_cache_dir;
+    char *max_connecting;
     char *protocol_translator_name;
+    char *write_timeout;
     /* special */
     const char *usage_pattern;
     const char *help_message;
@@ -51,7 +54,7 @@ const char help_message[] =
 "BLE Protocol Translator Example.\n"
 "\n"
 "Usage:\n"
-"  blept-example --protocol-translator-name <name> [--endpoint-postfix <name>] [--edge-domain-socket <domain-socket>] [--color-log] [--bluetooth-interface <bluetooth-interface>] [--address <dbus-address>] [--clear-cache] [--extended-discovery-file <string>]\n"
+"  blept-example --protocol-translator-name <name> [--endpoint-postfix <name>] [--edge-domain-socket <domain-socket>] [--color-log] [--bluetooth-interface <bluetooth-interface>] [--address <dbus-address>] [--clear-cache] [--extended-discovery-file <string>] [--write-timeout <milliseconds>] [--max-connecting <count>] [--gatt-cache-dir <directory>]\n"
 "  blept-example --help\n"
 "\n"
 "Options:\n"
@@ -60,7 +63,7 @@ const char help_message[] =
 "  -e --endpoint-postfix <postfix>            Name for the endpoint postfix [default: -0]\n"
 "  --edge-domain-socket <string>              Edge Core domain socket path [default: /tmp/edge.sock].\n"
 "  --color-log                                Use ANSI colors in log.\n"
-"  -b --bluetooth-interface <string>          HCI transport interface [default: hci0].\n"
+"  -b --bluetooth-interface <string>          HCI transport interfaces, separated by commas [default: hci0].\n"
 "  -a --address <string>                      DBus server address [default: unix:path=/var/run/dbus/system_bus_socket].\n"
 "  -c --clear-cache                           Clear BlueZ device cache before starting active scan.\n"
 "  -d --extended-discovery-file <string>      Path to extended discovery configuration file. When using this option, BLE Protocol Translator Example\n"
@@ -68,14 +71,19 @@ const char help_message[] =
 "                                             list. Each entry in the list contains a match string `name`. It may be a full match or partial match,\n"
 "                                             specified by the `partial-match` name-value. If partial match is used, a substring in the `name` value\n"
 "                                             is enough to be able to connect the device. Otherwise the name needs to match exactly to connect the\n"
-"                                             device. The file is in json format.\n"
+"                                             device. An entry with `\"advertisement\" : 1` is read from its advertised sensor values\n"
+"                                             instead of being connected to, if it advertises a supported format. The file is in json format.\n"
 "                                             Example: '{\"whitelisted-devices\":[{\"name\":\"Thunder Sense\", \"partial-match\" : 1}]}'\n"
 "                                             Note: using extended discovery mode disables the default mode to discover devices based on supported advertised services.\n"
+"  -w --write-timeout <milliseconds>          Timeout for writing a BLE characteristic [default: 10000].\n"
+"  -m --max-connecting <count>                Maximum number of BLE connections being set up at the same time on each interface [default: 2].\n"
+"  -g --gatt-cache-dir <directory>            Directory where the discovered GATT services and characteristics of each device are cached.\n"
+"                                             A cached device is not rediscovered when it reconnects or the translator restarts.\n"
 "";
 
 const char usage_pattern[] =
 "Usage:\n"
-"  blept-example --protocol-translator-name <name> [--endpoint-postfix <name>] [--edge-domain-socket <domain-socket>] [--color-log] [--bluetooth-interface <bluetooth-interface>] [--address <dbus-address>] [--clear-cache] [--extended-discovery-file <string>]\n"
+"  blept-example --protocol-translator-name <name> [--endpoint-postfix <name>] [--edge-domain-socket <domain-socket>] [--color-log] [--bluetooth-interface <bluetooth-interface>] [--address <dbus-address>] [--clear-cache] [--extended-discovery-file <string>] [--write-timeout <milliseconds>] [--max-connecting <count>] [--gatt-cache-dir <directory>]\n"
 "  blept-example --help";
 
 typedef struct {
@@ -316,9 +324,18 @@ int elems_to_args(Elements *elements, DocoptArgs *args, bool help,
         } else if (!strcmp(option->olong, "--extended-discovery-file")) {
             if (option->argument)
                 args->extended_discovery_file = option->argument;
+        } else if (!strcmp(option->olong, "--gatt-cache-dir")) {
+            if (option->argument)
+                args->gatt_cache_dir = option->argument;
+        } else if (!strcmp(option->olong, "--max-connecting")) {
+            if (option->argument)
+                args->max_connecting = option->argument;
         } else if (!strcmp(option->olong, "--protocol-translator-name")) {
             if (option->argument)
                 args->protocol_translator_name = option->argument;
+        } else if (!strcmp(option->olong, "--write-timeout")) {
+            if (option->argument)
+                args->write_timeout = option->argument;
         }
     }
     /* commands */
@@ -340,7 +357,8 @@ int elems_to_args(Elements *elements, DocoptArgs *args, bool help,
 DocoptArgs docopt(int argc, char *argv[], bool help, const char *version) {
     DocoptArgs args = {
         0, 0, 0, (char*) "unix:path=/var/run/dbus/system_bus_socket", (char*)
-        "hci0", (char*) "/tmp/edge.sock", (char*) "-0", NULL, NULL,
+        "hci0", (char*) "/tmp/edge.sock", (char*) "-0", NULL, NULL, (char*) "2", NULL,
+        (char*) "10000",
         usage_pattern, help_message
     };
     Tokens ts;
@@ -357,9 +375,12 @@ DocoptArgs docopt(int argc, char *argv[], bool help, const char *version) {
         {NULL, "--edge-domain-socket", 1, 0, NULL},
         {"-e", "--endpoint-postfix", 1, 0, NULL},
         {"-d", "--extended-discovery-file", 1, 0, NULL},
-        {"-n", "--protocol-translator-name", 1, 0, NULL}
+        {"-g", "--gatt-cache-dir", 1, 0, NULL},
+        {"-m", "--max-connecting", 1, 0, NULL},
+        {"-n", "--protocol-translator-name", 1, 0, NULL},
+        {"-w", "--write-timeout", 1, 0, NULL}
     };
-    Elements elements = {0, 0, 9, commands, arguments, options};
+    Elements elements = {0, 0, 12, commands, arguments, options};
 
     ts = tokens_new(argc, argv);
     if (parse_args(&ts, &elements))
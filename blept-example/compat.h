@@ -6,13 +6,12 @@
 
 #define FORMATTED_UUID_LEN 36
 
-#define JSON_DEVICE_FMT "{\"services\":["
-#define JSON_SRVC_FMT "%s{\"uuid\":\"%s\",\"path\":\"/%d/%d\",\"characteristics\":["
-#define JSON_CHAR_FMT "%s{\"uuid\":\"%s\",\"path\":\"/%d/%d/%d\"}"
+/* Fragments of the introspection document, see json_list_device_services() */
+#define JSON_DEVICE_BEGIN "{\"services\":["
+#define JSON_UUID_BEGIN "{\"uuid\":\""
+#define JSON_PATH_BEGIN "\",\"path\":\"/"
+#define JSON_SRVC_CHARS_BEGIN "\",\"characteristics\":["
+#define JSON_CHAR_END "\"}"
 #define JSON_ARRAY_END "]}"
 
-#define JSON_FORMATTED_DEV_LEN (sizeof(JSON_DEVICE_FMT) + sizeof(JSON_ARRAY_END)) /* sizeof includes terminating zero for string literals */
-#define JSON_FORMATTED_SRVC_LEN (FORMATTED_UUID_LEN + sizeof(JSON_SRVC_FMT) + sizeof(JSON_ARRAY_END)) /* slightly overshot but convenient calculation */
-#define JSON_FORMATTED_CHAR_LEN (FORMATTED_UUID_LEN + sizeof(JSON_CHAR_FMT) + sizeof(JSON_ARRAY_END))
-
 #endif /* __MEPT_BLE_COMPAT_H */
@@ -27,6 +27,8 @@
 #include <pt-client-2/pt_api.h>
 #include <pt-client-2/pt_device_object.h>
 #include "pt_ble_translations.h"
+#include "pt_ble_scheduler.h"
+#include "pt_ble_adapters.h"
 
 #include <string.h>
 #include <assert.h>
@@ -166,15 +168,7 @@ ble_device_list_t *devices_get_list()
  */
 struct ble_device *devices_find_device_by_dbus_path(const char *dbus_path)
 {
-    struct ble_device *ble = NULL;
-
-    ns_list_foreach(struct ble_device, dev, devices_get_list())
-    {
-        if (0 == strcmp(dev->dbus_path, dbus_path)) {
-            ble = dev;
-            break;
-        }
-    }
+    struct ble_device *ble = g_hash_table_lookup(global_devices.by_dbus_path, dbus_path);
 
     tr_debug("< devices_find_device_by_dbus_path dbus_path: '%s' device: %p", dbus_path, ble);
 
@@ -190,27 +184,39 @@ struct ble_device *devices_find_device_by_dbus_path(const char *dbus_path)
  */
 struct ble_device *devices_find_device_by_device_id(const char *device_id)
 {
-    struct ble_device *ble = NULL;
-
-    ns_list_foreach(struct ble_device, dev, devices_get_list()) {
-        if (0 == strcmp(dev->device_id, device_id)) {
-            ble = dev;
-            break;
-        }
-    }
+    struct ble_device *ble = g_hash_table_lookup(global_devices.by_device_id, device_id);
 
     tr_debug("< devices_find_device_by_device_id device_id: '%s' device: %p", device_id, ble);
 
     return ble;
 }
 
+/**
+ * \brief Find the device by Bluetooth address from the devices list.
+ *
+ * \param address The Bluetooth address, for example "12:34:56:78:9A:BC".
+ * \return The device if found.\n
+ *         NULL is returned if the device is not found.
+ */
+struct ble_device *devices_find_device_by_address(const char *address)
+{
+    struct ble_device *ble = g_hash_table_lookup(global_devices.by_address, address);
+
+    tr_debug("< devices_find_device_by_address address: '%s' device: %p", address, ble);
+
+    return ble;
+}
+
 static void device_free_char(struct ble_gatt_char *chara)
 {
-#if 1 == EXPERIMENTAL_NOTIFY_CHARACTERISTIC_SUPPORT
-    ble_characteristic_stop_notify_proxy(chara);
-#endif // EXPERIMENTAL_NOTIFY_CHARACTERISTIC_SUPPORT
-    free(chara->dbus_path);
-    free(chara->value);
+    if (chara->proxy != NULL) {
+        ble_characteristic_stop_notify_proxy(chara);
+        g_object_unref(chara->proxy);
+    }
+    if (chara->value_on_heap) {
+        free(chara->value);
+    }
+    free(chara->translations);
 }
 
 static void device_free_service(struct ble_gatt_service *service)
@@ -219,8 +225,6 @@ static void device_free_service(struct ble_gatt_service *service)
     for (i = 0; i < service->chars_count; i++) {
         device_free_char(service->chars + i);
     }
-    free(service->dbus_path);
-    free(service->chars);
 }
 
 static void device_free_services(struct ble_device *ble)
@@ -229,41 +233,177 @@ static void device_free_services(struct ble_device *ble)
     for (i = 0; i < ble->attrs.services_count; i++) {
         device_free_service(ble->attrs.services + i);
     }
-    free(ble->attrs.services);
+    // The per characteristic translation arrays are gone, so drop the index too. Until it is
+    // rebuilt the translations are found by searching the list.
+    free(ble->translation_index);
+    ble->translation_index = NULL;
+    ble->translation_index_count = 0;
+    free(ble->attrs.arena);
+    ble->attrs.arena = NULL;
+    ble->attrs.generation++;
+    ble->attrs.services = NULL;
+    ble->attrs.services_count = 0;
 }
 
 void device_stop_retry_timer(struct ble_device *ble)
 {
-    if (0 != ble->retry_timer_source) {
-        g_source_remove(ble->retry_timer_source);
-        ble->retry_timer_source = 0;
+    if (ble->dbus_path != NULL) {
+        ble_scheduler_cancel_reconnect(ble->dbus_path);
     }
 }
 
 static void device_free(struct ble_device *ble)
 {
-    free(ble->dbus_path);
     device_stop_retry_timer(ble);
+    free(ble->dbus_path);
     if (ble->proxy != NULL) {
         tr_debug("deleting device proxy %p for device %p device_id: '%s'", ble->proxy, ble, ble->device_id);
         g_object_unref(ble->proxy);
     }
+    ns_list_foreach_safe(struct ble_write_request, request, &ble->write_queue) {
+        ns_list_remove(&ble->write_queue, request);
+        device_free_characteristic_write(request);
+    }
     device_free_services(ble);
     ble_services_free_translation_contexts(ble);
     free(ble->json_list);
     free(ble->device_id);
+    pthread_mutex_destroy(&ble->mutex);
     free(ble);
 }
 
+static struct mept_devices_shard *devices_get_shard(const char *device_id)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*device_id) {
+        hash ^= (uint8_t) *device_id++;
+        hash *= 16777619u;
+    }
+    return &(global_devices.shards[hash % DEVICES_SHARD_COUNT]);
+}
+
+struct ble_device *devices_acquire_device_by_device_id(const char *device_id)
+{
+    struct ble_device *ble = NULL;
+    struct mept_devices_shard *shard = devices_get_shard(device_id);
+
+    pthread_mutex_lock(&shard->mutex);
+    ble = g_hash_table_lookup(shard->devices, device_id);
+    if (ble != NULL) {
+        ble->refcount++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+
+    return ble;
+}
+
+void devices_retain_device(struct ble_device *ble)
+{
+    struct mept_devices_shard *shard = devices_get_shard(ble->device_id);
+
+    pthread_mutex_lock(&shard->mutex);
+    assert(ble->refcount > 0);
+    ble->refcount++;
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+struct ble_char_handle *device_char_handle_new(struct ble_device *ble, int srvc, int ch)
+{
+    struct ble_char_handle *handle;
+
+    // Only devices in the device table are reference counted.
+    if (ble->device_id == NULL) {
+        return NULL;
+    }
+    handle = malloc(sizeof(struct ble_char_handle));
+    if (handle == NULL) {
+        return NULL;
+    }
+    devices_retain_device(ble);
+    handle->device = ble;
+    handle->generation = ble->attrs.generation;
+    handle->srvc = srvc;
+    handle->ch = ch;
+    return handle;
+}
+
+void device_char_handle_free(struct ble_char_handle *handle)
+{
+    if (handle != NULL) {
+        devices_release_device(handle->device);
+        free(handle);
+    }
+}
+
+struct ble_gatt_char *device_char_handle_lock(const struct ble_char_handle *handle)
+{
+    struct ble_device *ble = handle->device;
+
+    device_mutex_lock(ble);
+    if (ble->attrs.generation != handle->generation ||
+        handle->srvc >= ble->attrs.services_count ||
+        handle->ch >= ble->attrs.services[handle->srvc].chars_count) {
+        device_mutex_unlock(ble);
+        return NULL;
+    }
+    return &(ble->attrs.services[handle->srvc].chars[handle->ch]);
+}
+
+void devices_release_device(struct ble_device *ble)
+{
+    struct mept_devices_shard *shard = devices_get_shard(ble->device_id);
+    bool last_reference;
+
+    pthread_mutex_lock(&shard->mutex);
+    last_reference = (--ble->refcount == 0);
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (last_reference) {
+        tr_debug("Freeing released device %p device_id: '%s'", ble, ble->device_id);
+        device_free(ble);
+    }
+}
+
 void devices_del_device(struct ble_device *ble)
 {
     tr_debug("> devices_del_device %p device_id: '%s'", ble, ble->device_id);
 
-    //TODO: Be sure that device mutex is not in locked state.
-    pthread_mutex_destroy(&ble->mutex);
-
     ns_list_remove(devices_get_list(), ble);
-    device_free(ble);
+    // The notification handlers hold references to the device, drop them so it can be freed.
+    device_mutex_lock(ble);
+    for (int srvc = 0; srvc < ble->attrs.services_count; srvc++) {
+        for (int ch = 0; ch < ble->attrs.services[srvc].chars_count; ch++) {
+            ble_characteristic_stop_notify_proxy(&(ble->attrs.services[srvc].chars[ch]));
+        }
+    }
+    device_mutex_unlock(ble);
+    // Only remove index entries pointing to this device, a stale duplicate must not drop the live one.
+    if (ble->dbus_path != NULL && g_hash_table_lookup(global_devices.by_dbus_path, ble->dbus_path) == ble) {
+        g_hash_table_remove(global_devices.by_dbus_path, ble->dbus_path);
+    }
+    if (g_hash_table_lookup(global_devices.by_address, ble->attrs.addr) == ble) {
+        g_hash_table_remove(global_devices.by_address, ble->attrs.addr);
+    }
+    if (ble->adapter_assigned) {
+        ble_adapters_release(ble->adapter);
+        ble->adapter_assigned = false;
+    }
+    if (ble->device_id != NULL) {
+        struct mept_devices_shard *shard = devices_get_shard(ble->device_id);
+        if (g_hash_table_lookup(global_devices.by_device_id, ble->device_id) == ble) {
+            g_hash_table_remove(global_devices.by_device_id, ble->device_id);
+        }
+        pthread_mutex_lock(&shard->mutex);
+        if (g_hash_table_lookup(shard->devices, ble->device_id) == ble) {
+            g_hash_table_remove(shard->devices, ble->device_id);
+        }
+        pthread_mutex_unlock(&shard->mutex);
+        // Drop the reference of the device table, the device is freed once acquirers are done with it.
+        devices_release_device(ble);
+    } else {
+        device_free(ble);
+    }
 }
 
 static pt_status_t
@@ -305,10 +445,39 @@ void devices_link_device(struct ble_device *entry, const char *device_id)
     assert(entry != NULL);
     entry->device_id = strdup(device_id);
     ns_list_add_to_end(&(global_devices.devices), entry);
+    g_hash_table_replace(global_devices.by_device_id, entry->device_id, entry);
+    g_hash_table_replace(global_devices.by_address, entry->attrs.addr, entry);
+    if (entry->dbus_path != NULL) {
+        g_hash_table_replace(global_devices.by_dbus_path, entry->dbus_path, entry);
+    }
+
+    struct mept_devices_shard *shard = devices_get_shard(entry->device_id);
+    pthread_mutex_lock(&shard->mutex);
+    entry->refcount = 1;
+    g_hash_table_replace(shard->devices, entry->device_id, entry);
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+void devices_set_dbus_path(struct ble_device *ble, const char *dbus_path)
+{
+    char *new_path = strdup(dbus_path);
+    if (new_path == NULL) {
+        tr_err("Could not change the dbus path of %s", ble->device_id);
+        return;
+    }
+    if (ble->dbus_path != NULL) {
+        if (g_hash_table_lookup(global_devices.by_dbus_path, ble->dbus_path) == ble) {
+            g_hash_table_remove(global_devices.by_dbus_path, ble->dbus_path);
+        }
+        free(ble->dbus_path);
+    }
+    ble->dbus_path = new_path;
+    g_hash_table_replace(global_devices.by_dbus_path, ble->dbus_path, ble);
 }
 
 int devices_init()
 {
+    int i;
     //init our device list and mutex
     ns_list_init(&(global_devices.devices));
     pthread_mutexattr_t Attr;
@@ -316,6 +485,14 @@ int devices_init()
     pthread_mutexattr_settype(&Attr, PTHREAD_MUTEX_RECURSIVE);
     pthread_mutex_init(&global_devices.mutex, &Attr);
 
+    global_devices.by_device_id = g_hash_table_new(g_str_hash, g_str_equal);
+    global_devices.by_dbus_path = g_hash_table_new(g_str_hash, g_str_equal);
+    global_devices.by_address = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = 0; i < DEVICES_SHARD_COUNT; i++) {
+        global_devices.shards[i].devices = g_hash_table_new(g_str_hash, g_str_equal);
+        pthread_mutex_init(&global_devices.shards[i].mutex, NULL);
+    }
+
     return 0;
 }
 
@@ -346,6 +523,7 @@ struct ble_device *device_create(const char *addr)
     strncpy(ble->attrs.addr, addr, sizeof ble->attrs.addr);
     device_update_last_connected_timestamp(ble);
     ns_list_init(&(ble->translations));
+    ns_list_init(&(ble->write_queue));
 
     //init our mutex
     pthread_mutexattr_t Attr;
@@ -358,100 +536,254 @@ struct ble_device *device_create(const char *addr)
     return ble;
 }
 
-/*  Returns the service structure of the ble device with the given uuid,
- *  creating and adding it if necessary
+// BlueZ names characteristic objects after the attribute handle, e.g. .../service000a/char000b.
+static uint16_t handle_from_characteristic_path(const char *char_dbus_path)
+{
+    const char *name = strrchr(char_dbus_path, '/');
+    if (name == NULL || strncmp(name, "/char", 5) != 0) {
+        return 0;
+    }
+    return (uint16_t) strtoul(name + 5, NULL, 16);
+}
+
+#define DEVICE_ARENA_ALIGN(size) (((size) + 7) & ~(size_t) 7)
+
+/* Bump allocator over the attribute arena of a device. The layout is computed before the arena is
+ * allocated, so it never runs out.
  */
-static struct ble_gatt_service *get_service(struct ble_device *ble,
-                                            const char *uuid)
+struct device_arena {
+    uint8_t *next;
+    uint8_t *end;
+};
+
+static void *device_arena_take(struct device_arena *arena, size_t size)
 {
-    int svc;
+    void *ret = arena->next;
+    arena->next += DEVICE_ARENA_ALIGN(size);
+    assert(arena->next <= arena->end);
+    return ret;
+}
 
-    for (svc = 0; svc < ble->attrs.services_count; svc++ ) {
-        if (0 == strncmp(ble->attrs.services[svc].uuid, uuid, sizeof ble->attrs.services[svc].uuid)) {
-            return &(ble->attrs.services[svc]);
+static char *device_arena_strdup(struct device_arena *arena, const char *str)
+{
+    size_t length = strlen(str) + 1;
+    char *ret = device_arena_take(arena, length);
+    memcpy(ret, str, length);
+    return ret;
+}
+
+// Size of the value buffer of a characteristic, from its translation format if it has a fixed size.
+static size_t device_characteristic_value_size(const struct ble_characteristic *descriptor,
+                                               BLE_DATATYPE dtype,
+                                               size_t dsize)
+{
+    if (descriptor != NULL) {
+        size_t format_size = ble_services_value_format_size(descriptor->value_format_descriptor.format);
+        if (format_size > 0) {
+            return format_size;
         }
     }
-
-    svc = ble->attrs.services_count;
-    ble->attrs.services_count++;
-    // BUG: we lose the previous pointer if realloc fails, causing a memory leak
-    ble->attrs.services = realloc(ble->attrs.services,
-                                  ble->attrs.services_count * sizeof (struct ble_gatt_service));
-
-    assert(NULL != ble->attrs.services);
-    memset(&ble->attrs.services[ble->attrs.services_count - 1], 0, sizeof(struct ble_gatt_service));
-    strncpy(ble->attrs.services[svc].uuid, uuid, FORMATTED_UUID_LEN);
-
-    return &(ble->attrs.services[svc]);
-}
-
-static struct ble_gatt_char *add_char_to_service(struct ble_gatt_service *srvc,
-                                                 const char *uuid,
-                                                 const char *dbus_path,
-                                                 int properties,
-                                                 BLE_DATATYPE dtype,
-                                                 size_t dsize,
-                                                 uint16_t resource_id,
-                                                 GDBusProxy *proxy)
-{
-    tr_debug("    add_char_to_service uuid: %s, dbus_path: %s, proxy: %p", uuid, dbus_path, proxy);
-    int ch = srvc->chars_count;
-    // BUG: we lose the previous pointer if realloc fails, causing a memory leak
-    srvc->chars = realloc(srvc->chars, (ch + 1) * sizeof(struct ble_gatt_char));
-    assert(NULL != srvc->chars);
-    memset(&srvc->chars[ch], 0, sizeof(struct ble_gatt_char));
-    srvc->chars_count++;
-    srvc->chars[ch].properties = properties;
-    strncpy(srvc->chars[ch].uuid, uuid, sizeof(srvc->chars[ch].uuid));
-    if (dbus_path != NULL) {
-        srvc->chars[ch].dbus_path = (char *)malloc(strlen(dbus_path) + 1);
-        assert(srvc->chars[ch].dbus_path != NULL);
-        strcpy(srvc->chars[ch].dbus_path, dbus_path);
-    }
-    srvc->chars[ch].value = (uint8_t *)malloc(dsize);
-    assert(srvc->chars[ch].value != NULL);
-    memset(srvc->chars[ch].value, 0, dsize);
-    srvc->chars[ch].value_length = 0;
-    srvc->chars[ch].value_size = dsize;
-    srvc->chars[ch].dtype = dtype;
-    srvc->chars[ch].proxy = proxy;
-    /*Note: Need to insure resource id's are unque for a given service
-      If no resource_id is specified firm map code this is done by setting
-      resource id equal to the index int the characteristic array.*/
-    if (resource_id != 0) {
-        srvc->chars[ch].resource_id = resource_id;
-    } else {
-        srvc->chars[ch].resource_id = (uint16_t)ch;
+    if (dtype != BLE_STRUCT) {
+        return dsize;
     }
+    return BLE_DEFAULT_VALUE_SIZE;
+}
 
-    return &(srvc->chars[ch]);
+// Returns the index of the first characteristic with the same service UUID as infos[index].
+static int device_first_of_service(const struct ble_gatt_char_info *infos, int index)
+{
+    int i;
+    for (i = 0; i < index; i++) {
+        if (0 == strncmp(infos[i].srvc_uuid, infos[index].srvc_uuid, FORMATTED_UUID_LEN)) {
+            return i;
+        }
+    }
+    return index;
 }
 
-struct ble_gatt_char * device_add_gatt_characteristic(struct ble_device *ble,
-                                                      const char *srvc_uuid,
-                                                      const char *srvc_dbus_path,
-                                                      const char *char_uuid,
-                                                      const char *char_dbus_path,
-                                                      int char_properties,
-                                                      GDBusProxy *proxy)
+int device_set_gatt_characteristics(struct ble_device *ble, const struct ble_gatt_char_info *infos, int count)
 {
-    BLE_DATATYPE dtype;
-    size_t dsize;
-    uint16_t resource_id = 0;
-    struct ble_gatt_service *srvc = get_service(ble, srvc_uuid);
-    struct ble_gatt_char *ret;
+    struct device_arena arena;
+    BLE_DATATYPE *dtypes;
+    size_t *value_sizes;
+    uint16_t *resource_ids;
+    const struct ble_characteristic **descriptors;
+    int *service_of;
+    int services_count = 0;
+    size_t arena_size;
+    int i, svc;
+
+    tr_debug("--> device_set_gatt_characteristics(%p, %d)", ble, count);
+    device_free_services(ble);
+    if (count == 0) {
+        return 0;
+    }
 
+    dtypes = calloc(count, sizeof(BLE_DATATYPE));
+    value_sizes = calloc(count, sizeof(size_t));
+    resource_ids = calloc(count, sizeof(uint16_t));
+    descriptors = calloc(count, sizeof(struct ble_characteristic *));
+    service_of = calloc(count, sizeof(int));
+    if (!dtypes || !value_sizes || !resource_ids || !descriptors || !service_of) {
+        goto error;
+    }
 
-    if (srvc && srvc->dbus_path == NULL) {
-        srvc->dbus_path = strdup(srvc_dbus_path);
+    // Compute the layout: services and characteristics first, then the strings and value buffers.
+    arena_size = 0;
+    for (i = 0; i < count; i++) {
+        size_t dsize;
+        int first = device_first_of_service(infos, i);
+        if (first == i) {
+            service_of[i] = services_count++;
+            arena_size += DEVICE_ARENA_ALIGN(strlen(infos[i].srvc_dbus_path) + 1);
+        } else {
+            service_of[i] = service_of[first];
+        }
+        map_uuid_to_datatype(infos[i].char_uuid, &dtypes[i], &dsize, &resource_ids[i]);
+        descriptors[i] = ble_services_get_characteristic_descriptor_by_uuids(infos[i].srvc_uuid, infos[i].char_uuid);
+        value_sizes[i] = device_characteristic_value_size(descriptors[i], dtypes[i], dsize);
+        arena_size += DEVICE_ARENA_ALIGN(strlen(infos[i].char_dbus_path) + 1);
+        arena_size += DEVICE_ARENA_ALIGN(value_sizes[i]);
     }
+    arena_size += DEVICE_ARENA_ALIGN(services_count * sizeof(struct ble_gatt_service));
+    arena_size += DEVICE_ARENA_ALIGN(count * sizeof(struct ble_gatt_char));
 
-    tr_debug("--> device_add_gatt_characteristic(%p, %s, %s, %s, %d)", ble, srvc_uuid, char_uuid, char_dbus_path, char_properties);
-    map_uuid_to_datatype(char_uuid, &dtype, &dsize, &resource_id);
-    ret = add_char_to_service(srvc, char_uuid, char_dbus_path, char_properties, dtype, dsize, resource_id, proxy);
-    tr_debug("<-- device_add_gatt_characteristic");
+    ble->attrs.arena = calloc(1, arena_size);
+    if (ble->attrs.arena == NULL) {
+        goto error;
+    }
+    arena.next = ble->attrs.arena;
+    arena.end = arena.next + arena_size;
 
-    return ret;
+    ble->attrs.services = device_arena_take(&arena, services_count * sizeof(struct ble_gatt_service));
+    ble->attrs.services_count = services_count;
+    struct ble_gatt_char *chars = device_arena_take(&arena, count * sizeof(struct ble_gatt_char));
+
+    // Each service gets a contiguous run of characteristics.
+    for (i = 0; i < count; i++) {
+        ble->attrs.services[service_of[i]].chars_count++;
+    }
+    for (svc = 0; svc < services_count; svc++) {
+        ble->attrs.services[svc].chars = chars;
+        chars += ble->attrs.services[svc].chars_count;
+        ble->attrs.services[svc].chars_count = 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        struct ble_gatt_service *srvc = &ble->attrs.services[service_of[i]];
+        int ch = srvc->chars_count++;
+        struct ble_gatt_char *c = &srvc->chars[ch];
+
+        if (ch == 0) {
+            strncpy(srvc->uuid, infos[i].srvc_uuid, FORMATTED_UUID_LEN);
+            srvc->dbus_path = device_arena_strdup(&arena, infos[i].srvc_dbus_path);
+        }
+        tr_debug("    add characteristic uuid: %s, dbus_path: %s, proxy: %p, value size: %zu",
+                 infos[i].char_uuid, infos[i].char_dbus_path, infos[i].proxy, value_sizes[i]);
+        c->properties = infos[i].properties;
+        strncpy(c->uuid, infos[i].char_uuid, FORMATTED_UUID_LEN);
+        c->dbus_path = device_arena_strdup(&arena, infos[i].char_dbus_path);
+        c->handle = infos[i].handle != 0 ? infos[i].handle : handle_from_characteristic_path(infos[i].char_dbus_path);
+        c->value = device_arena_take(&arena, value_sizes[i]);
+        c->value_size = value_sizes[i];
+        c->dtype = dtypes[i];
+        c->proxy = infos[i].proxy;
+        /*Note: Need to insure resource id's are unque for a given service
+          If no resource_id is specified firm map code this is done by setting
+          resource id equal to the index int the characteristic array.*/
+        c->resource_id = resource_ids[i] != 0 ? resource_ids[i] : (uint16_t) ch;
+        c->descriptor = descriptors[i];
+        if (c->descriptor != NULL && c->descriptor->poll_interval_ms != 0) {
+            c->poll_interval_ms = c->descriptor->poll_interval_ms;
+        } else {
+            c->poll_interval_ms = BLE_DEFAULT_POLL_INTERVAL_MS;
+        }
+    }
+    tr_debug("<-- device_set_gatt_characteristics %d services, arena %zu bytes", services_count, arena_size);
+
+    free(dtypes);
+    free(value_sizes);
+    free(resource_ids);
+    free(descriptors);
+    free(service_of);
+    return 0;
+
+error:
+    tr_err("Out of memory adding %d characteristics to %s", count, ble->attrs.addr);
+    free(dtypes);
+    free(value_sizes);
+    free(resource_ids);
+    free(descriptors);
+    free(service_of);
+    return -1;
+}
+
+void device_store_characteristic_value(struct ble_gatt_char *ch, const uint8_t *data, size_t size)
+{
+    if (size > BLE_MAX_VALUE_SIZE) {
+        size = BLE_MAX_VALUE_SIZE;
+    }
+    if (size > ch->value_size) {
+        uint8_t *value = ch->value_on_heap ? realloc(ch->value, size) : malloc(size);
+        if (value == NULL) {
+            tr_err("Out of memory storing %zu bytes for characteristic %s", size, ch->dbus_path);
+            size = ch->value_size;
+        } else {
+            ch->value = value;
+            ch->value_size = size;
+            ch->value_on_heap = true;
+        }
+    }
+    if (size > 0) {
+        memcpy(ch->value, data, size);
+    }
+    ch->value_length = size;
+}
+
+static bool device_add_characteristic_resource(struct ble_device *ble, const int instance, const struct ble_gatt_char *c)
+{
+    uint8_t ops = 0;
+    if (c->properties & BLE_GATT_PROP_PERM_READ) {
+        ops |= OPERATION_READ;
+    }
+    if (c->properties & BLE_GATT_PROP_PERM_WRITE) {
+        ops |= OPERATION_WRITE;
+    }
+    tr_info("    mapping ble char %s into lwm2m resource /%d/%d/%d with RW properties %d",
+            c->dbus_path,
+            IPSO_OID_BLE_SERVICE,
+            instance,
+            c->resource_id,
+            ops);
+    Lwm2mResourceType rtype;
+    switch (c->dtype) {
+    case BLE_BOOLEAN:
+        rtype = LWM2M_BOOLEAN;
+        break;
+    case BLE_INTEGER:
+        rtype = LWM2M_INTEGER;
+        break;
+    case BLE_FLOAT:
+        rtype = LWM2M_FLOAT;
+        break;
+    case BLE_STRING:
+        rtype = LWM2M_STRING;
+        break;
+    case BLE_STRUCT:
+    default:
+        rtype = LWM2M_OPAQUE;
+        break;
+    }
+
+    return edge_add_resource(ble->device_id,
+                             IPSO_OID_BLE_SERVICE,
+                             instance,
+                             c->resource_id,
+                             /* resource name */ NULL,
+                             rtype,
+                             ops,
+                             c->value,
+                             c->value_size);
 }
 
 /* converts BLE services/characteristics to PT LwM2M resources */
@@ -475,48 +807,7 @@ int device_add_resources_from_gatt(struct ble_device *ble)
             c = &s->chars[j];
             tr_info("        characteristic UUID=%s, OID=/%d/%d/%d",
                     c->uuid, IPSO_OID_BLE_SERVICE, instance, j);
-            uint8_t ops = 0;
-            if (c->properties & BLE_GATT_PROP_PERM_READ) {
-                ops |= OPERATION_READ;
-            }
-            if (c->properties & BLE_GATT_PROP_PERM_WRITE) {
-                ops |= OPERATION_WRITE;
-            }
-            tr_info("    mapping ble char %s into lwm2m resource /%d/%d/%d with RW properties %d",
-                    c->dbus_path,
-                    IPSO_OID_BLE_SERVICE,
-                    instance,
-                    c->resource_id,
-                    ops);
-            Lwm2mResourceType rtype;
-            switch (c->dtype) {
-            case BLE_BOOLEAN:
-                rtype = LWM2M_BOOLEAN;
-                break;
-            case BLE_INTEGER:
-                rtype = LWM2M_INTEGER;
-                break;
-            case BLE_FLOAT:
-                rtype = LWM2M_FLOAT;
-                break;
-            case BLE_STRING:
-                rtype = LWM2M_STRING;
-                break;
-            case BLE_STRUCT:
-            default:
-                rtype = LWM2M_OPAQUE;
-                break;
-            }
-
-            if (!edge_add_resource(ble->device_id,
-                                   IPSO_OID_BLE_SERVICE,
-                                   instance,
-                                   c->resource_id,
-                                   /* resource name */ NULL,
-                                   rtype,
-                                   ops,
-                                   c->value,
-                                   c->value_size)) {
+            if (!device_add_characteristic_resource(ble, instance, c)) {
                 tr_err("    Failed to create resource /%d/%d for service UUID %s",
                        IPSO_OID_BLE_SERVICE,
                        instance,
@@ -527,19 +818,17 @@ int device_add_resources_from_gatt(struct ble_device *ble)
     }
 
     tr_info("    adding introspection resource");
-    assert(ble->json_list == NULL);
-    ble->json_list = json_list_device_services(ble);
-    // BUG: This somehow causes our json_list buffer to become corrupted
-    // TODO: Investigate and re-enable the map.
-    if (!edge_add_resource(ble->device_id,
-                           IPSO_OID_BLE_INTROSPECT,
-                           0,
-                           0,
-                           /* resource name */ NULL,
-                           LWM2M_STRING,
-                           OPERATION_READ,
-                           (uint8_t *)ble->json_list,
-                           strlen(ble->json_list) + 1)) {
+    size_t json_list_length;
+    const char *json_list = device_get_json_list(ble, &json_list_length);
+    if (json_list == NULL || !edge_add_resource(ble->device_id,
+                                                IPSO_OID_BLE_INTROSPECT,
+                                                0,
+                                                0,
+                                                /* resource name */ NULL,
+                                                LWM2M_STRING,
+                                                OPERATION_READ,
+                                                (const uint8_t *) json_list,
+                                                json_list_length + 1)) {
         tr_err("    Failed to create introspection resource /%d/0/0", IPSO_OID_BLE_INTROSPECT);
     }
 
@@ -547,6 +836,48 @@ int device_add_resources_from_gatt(struct ble_device *ble)
     return 0;
 }
 
+/* Adds the resources and known translations of the characteristics that follow the first
+ * services_count services and the first chars_count[i] characteristics of each of them. */
+int device_add_appended_characteristics(struct ble_device *ble, int services_count, const int *chars_count)
+{
+    struct ble_attrs *attrs = &ble->attrs;
+    size_t json_list_length;
+    const char *json_list;
+
+    tr_debug("--> device_add_appended_characteristics device_id: '%s'", ble->device_id);
+    for (int i = 0; i < attrs->services_count; ++i) {
+        struct ble_gatt_service *s = &attrs->services[i];
+        bool new_service = i >= services_count;
+        bool supported = ble_services_is_supported_service(s->uuid);
+
+        if (new_service && supported) {
+            ble_services_construct_service(ble, i);
+        }
+        for (int j = new_service ? 0 : chars_count[i]; j < s->chars_count; ++j) {
+            if (!device_add_characteristic_resource(ble, i, &s->chars[j])) {
+                tr_err("    Failed to create resource /%d/%d for service UUID %s", IPSO_OID_BLE_SERVICE, i, s->uuid);
+                continue;
+            }
+            if (supported && s->chars[j].descriptor != NULL) {
+                ble_services_construct_characteristic(ble, i, j);
+            }
+        }
+    }
+    ble_services_build_translation_index(ble);
+
+    json_list = device_get_json_list(ble, &json_list_length);
+    if (json_list != NULL) {
+        edge_set_resource_value(ble->device_id,
+                                IPSO_OID_BLE_INTROSPECT,
+                                0,
+                                0,
+                                (const uint8_t *) json_list,
+                                json_list_length + 1);
+    }
+    tr_debug("<-- device_add_appended_characteristics");
+    return 0;
+}
+
 /* Translates known BLE services/characteristics to PT LwM2M representation */
 int device_add_known_translations_from_gatt(struct ble_device *ble)
 {
@@ -572,7 +903,7 @@ int device_add_known_translations_from_gatt(struct ble_device *ble)
         // Construct local characteristic translations for this service
         for (int j = 0; j < s->chars_count; ++j) {
             c = &s->chars[j];
-            if (!ble_services_is_supported_characteristic(s->uuid, c->uuid)) {
+            if (c->descriptor == NULL) {
                 continue;
             }
 
@@ -580,15 +911,17 @@ int device_add_known_translations_from_gatt(struct ble_device *ble)
         }
     }
 
+    ble_services_build_translation_index(ble);
+
     tr_debug("<-- device_add_known_translations_from_gatt");
     return 0;
 }
 
-static void set_local_characteristic_value(struct ble_device *ble,
-                                           const int          svc,
-                                           const int          ch,
-                                           const uint8_t     *val,
-                                           const size_t       sz)
+void device_update_characteristic_resource_value(struct ble_device *ble,
+                                                 const int          svc,
+                                                 const int          ch,
+                                                 const uint8_t     *val,
+                                                 const size_t       sz)
 {
     if ((ble == NULL) ||
         (svc >= ble->attrs.services_count) ||
@@ -597,32 +930,72 @@ static void set_local_characteristic_value(struct ble_device *ble,
     }
     struct ble_gatt_char *charact = &(ble->attrs.services[svc].chars[ch]);
 
-    if (sz < charact->value_size) {
-        memset(charact->value, 0, charact->value_size);
-        memcpy(charact->value, val, sz);
+    edge_set_resource_value(ble->device_id, IPSO_OID_BLE_SERVICE, svc, charact->resource_id, val, sz);
+}
+
+static struct ble_write_request *device_find_queued_write(struct ble_device *ble, const int sv_idx, const int ch_idx)
+{
+    ns_list_foreach(struct ble_write_request, request, &ble->write_queue) {
+        if (request->sv_idx == sv_idx && request->ch_idx == ch_idx) {
+            return request;
+        }
+    }
+    return NULL;
+}
+
+/* Queues a write to a characteristic. A write to the same characteristic that is still waiting
+ * in the queue is replaced, so a burst of writes only sends the latest value to the device.
+ */
+static int device_queue_characteristic_write(struct ble_device *ble,
+                                             const int sv_idx,
+                                             const int ch_idx,
+                                             const uint8_t *value,
+                                             const size_t value_size)
+{
+    struct ble_write_request *request = device_find_queued_write(ble, sv_idx, ch_idx);
+    uint8_t *value_copy = malloc(value_size > 0 ? value_size : 1);
+    if (value_copy == NULL) {
+        tr_err("Could not allocate memory for characteristic write");
+        return -1;
+    }
+    memcpy(value_copy, value, value_size);
+
+    if (request != NULL) {
+        tr_debug("Coalescing queued write to %s", ble->attrs.services[sv_idx].chars[ch_idx].dbus_path);
+        free(request->value);
     } else {
-        memcpy(charact->value, val, charact->value_size);
+        request = calloc(1, sizeof(struct ble_write_request));
+        if (request == NULL) {
+            tr_err("Could not allocate memory for characteristic write");
+            free(value_copy);
+            return -1;
+        }
+        request->sv_idx = sv_idx;
+        request->ch_idx = ch_idx;
+        ns_list_add_to_end(&ble->write_queue, request);
     }
-    charact->value_length = sz;
+    request->value = value_copy;
+    request->value_size = value_size;
 
-    // We need to inform edge pt of new value
-    edge_set_resource_value(ble->device_id, IPSO_OID_BLE_SERVICE, svc, charact->resource_id, val, sz);
+    ble_schedule_write_queue(ble->device_id);
+    return 0;
 }
 
-void device_update_characteristic_resource_value(struct ble_device *ble,
-                                                 const int          svc,
-                                                 const int          ch,
-                                                 const uint8_t     *val,
-                                                 const size_t       sz)
+struct ble_write_request *device_pop_characteristic_write(struct ble_device *ble)
 {
-    if ((ble == NULL) ||
-        (svc >= ble->attrs.services_count) ||
-        (ch >= ble->attrs.services[svc].chars_count)) {
-        return;
+    struct ble_write_request *request = ns_list_get_first(&ble->write_queue);
+    if (request != NULL) {
+        ns_list_remove(&ble->write_queue, request);
     }
-    struct ble_gatt_char *charact = &(ble->attrs.services[svc].chars[ch]);
+    return request;
+}
 
-    edge_set_resource_value(ble->device_id, IPSO_OID_BLE_SERVICE, svc, charact->resource_id, val, sz);
+void device_free_characteristic_write(struct ble_write_request *request)
+{
+    if (request != NULL) {
+        free(request->value);
+        free(request);
+    }
 }
 
 int device_write_characteristic(struct ble_device *ble,
@@ -637,26 +1010,27 @@ int device_write_characteristic(struct ble_device *ble,
             // Update reosurces under any translated objects
             struct translation_context *ctx = ble_services_find_translation_context(ble, object_id, instance_id, resource_id);
             if (ctx) {
+                struct ble_gatt_char *charact = &(ble->attrs.services[ctx->sv_idx].chars[ctx->ch_idx]);
+                // Encode on top of a write that is still queued, so that coalesced writes to different
+                // parts of the same characteristic (e.g. bitfields) are all preserved.
+                struct ble_write_request *queued = device_find_queued_write(ble, ctx->sv_idx, ctx->ch_idx);
                 uint8_t *translated_value = NULL;
                 size_t translated_value_size = 0;
                 // Encode the lwm2m value representation into gatt characteristic representation
                 ble_services_encode_characteristic_value(ble,
                                                          ctx,
-                                                         ble->attrs.services[ctx->sv_idx].chars[ctx->ch_idx].value,
-                                                         ble->attrs.services[ctx->sv_idx].chars[ctx->ch_idx].value_size,
+                                                         queued ? queued->value : charact->value,
+                                                         queued ? queued->value_size : charact->value_size,
                                                          value,
                                                          value_size,
                                                          &translated_value,
                                                          &translated_value_size);
                 if (translated_value != NULL) {
-                    // Write into gatt characteristic
-                    int rc = ble_write_characteristic(ble->attrs.services[ctx->sv_idx].chars[ctx->ch_idx].dbus_path,
-                                                      translated_value,
-                                                      translated_value_size);
-                    if (rc == 0) {
-                        // Update resource value in the service object
-                        set_local_characteristic_value(ble, ctx->sv_idx, ctx->ch_idx, value, value_size);
-                    }
+                    int rc = device_queue_characteristic_write(ble,
+                                                               ctx->sv_idx,
+                                                               ctx->ch_idx,
+                                                               translated_value,
+                                                               translated_value_size);
                     free(translated_value);
 
                     return rc;
@@ -670,6 +1044,10 @@ int device_write_characteristic(struct ble_device *ble,
             int ccnt = ble->attrs.services[instance_id].chars_count;
             int char_idx = 0;
 
+            // Unless the uuid mapping assigns one, the resource id is the characteristic index
+            if (resource_id < ccnt && ble->attrs.services[instance_id].chars[resource_id].resource_id == resource_id) {
+                return device_queue_characteristic_write(ble, instance_id, resource_id, value, value_size);
+            }
             while (char_idx < ccnt) {
                 if (ble->attrs.services[instance_id].chars[char_idx].resource_id == resource_id) {
                     break;
@@ -677,22 +1055,7 @@ int device_write_characteristic(struct ble_device *ble,
                 char_idx++;
             }
             if (char_idx < ccnt) {
-                int rc = ble_write_characteristic(ble->attrs.services[instance_id].chars[char_idx].dbus_path,
-                                                  value, value_size);
-                if (rc == 0) {
-                    set_local_characteristic_value(ble, instance_id, char_idx, value, value_size);
-                    // Update the translation object value if this is supported characteristic
-                    if (ble_services_is_supported_characteristic(ble->attrs.services[instance_id].uuid,
-                                                                 ble->attrs.services[instance_id].chars[char_idx].uuid)) {
-                        ble_services_decode_and_write_characteristic_translation(ble,
-                                                                                 instance_id,
-                                                                                 char_idx,
-                                                                                 value,
-                                                                                 value_size);
-                    }
-                }
-
-                return rc;
+                return device_queue_characteristic_write(ble, instance_id, char_idx, value, value_size);
             }
         }
     }
@@ -714,44 +1077,104 @@ void device_register_device(struct ble_device *dev)
     }
 }
 
-char *json_list_device_services(struct ble_device *ble)
+/* Writes the introspection document. Without a buffer only the length is counted, so the same code
+ * measures the document and then fills an allocation of the exact size.
+ */
+struct device_json_writer {
+    char *buf;
+    size_t length;
+};
+
+static void device_json_append(struct device_json_writer *writer, const char *str, size_t length)
+{
+    if (writer->buf != NULL) {
+        memcpy(writer->buf + writer->length, str, length);
+    }
+    writer->length += length;
+}
+
+#define device_json_append_literal(writer, literal) device_json_append((writer), (literal), sizeof(literal) - 1)
+
+static void device_json_append_uint(struct device_json_writer *writer, unsigned int value)
+{
+    char digits[10];
+    size_t count = 0;
+    do {
+        digits[sizeof(digits) - 1 - count++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    device_json_append(writer, digits + sizeof(digits) - count, count);
+}
+
+static void device_json_write_services(const struct ble_device *ble, struct device_json_writer *writer)
 {
-    int srvc = 0, ch = 0;
+    int srvc, ch;
 
-    if (ble != NULL && ble->attrs.services != NULL) {
-        for (srvc = 0; srvc < ble->attrs.services_count; srvc++) {
-            ch += ble->attrs.services[srvc].chars_count;
+    device_json_append_literal(writer, JSON_DEVICE_BEGIN);
+    for (srvc = 0; srvc < ble->attrs.services_count; srvc++) {
+        const struct ble_gatt_service *service = &ble->attrs.services[srvc];
+        if (srvc > 0) {
+            device_json_append_literal(writer, ",");
+        }
+        device_json_append_literal(writer, JSON_UUID_BEGIN);
+        device_json_append(writer, service->uuid, strlen(service->uuid));
+        device_json_append_literal(writer, JSON_PATH_BEGIN);
+        device_json_append_uint(writer, IPSO_OID_BLE_SERVICE);
+        device_json_append_literal(writer, "/");
+        device_json_append_uint(writer, srvc);
+        device_json_append_literal(writer, JSON_SRVC_CHARS_BEGIN);
+        for (ch = 0; ch < service->chars_count; ch++) {
+            const struct ble_gatt_char *characteristic = &service->chars[ch];
+            if (ch > 0) {
+                device_json_append_literal(writer, ",");
+            }
+            device_json_append_literal(writer, JSON_UUID_BEGIN);
+            device_json_append(writer, characteristic->uuid, strlen(characteristic->uuid));
+            device_json_append_literal(writer, JSON_PATH_BEGIN);
+            device_json_append_uint(writer, IPSO_OID_BLE_SERVICE);
+            device_json_append_literal(writer, "/");
+            device_json_append_uint(writer, srvc);
+            device_json_append_literal(writer, "/");
+            device_json_append_uint(writer, characteristic->resource_id);
+            device_json_append_literal(writer, JSON_CHAR_END);
         }
+        device_json_append_literal(writer, JSON_ARRAY_END);
     }
-    int retsize = JSON_FORMATTED_DEV_LEN + JSON_FORMATTED_SRVC_LEN * srvc + JSON_FORMATTED_CHAR_LEN * ch;
-    char *retval = malloc(retsize);
-    if (retval == NULL) {
+    device_json_append_literal(writer, JSON_ARRAY_END);
+}
+
+char *json_list_device_services(struct ble_device *ble, size_t *length)
+{
+    struct device_json_writer writer = {NULL, 0};
+
+    device_json_write_services(ble, &writer);
+    writer.buf = malloc(writer.length + 1);
+    if (writer.buf == NULL) {
         tr_err("Could not allocate memory for JSON string");
         return NULL;
     }
+    writer.length = 0;
+    device_json_write_services(ble, &writer);
+    writer.buf[writer.length] = '\0';
+    tr_debug("Wrote %zu bytes into json", writer.length);
 
-    strncpy(retval, JSON_DEVICE_FMT, retsize);
-    retval[retsize - 1] = 0; // strncpy does not terminate the string if it overflows
-    for (srvc = 0; srvc < ble->attrs.services_count; srvc++) {
-        snprintf(retval + strlen(retval), retsize - strlen(retval),
-                 JSON_SRVC_FMT,
-                 srvc > 0 ? "," : "",
-                 ble->attrs.services[srvc].uuid,
-                 IPSO_OID_BLE_SERVICE,
-                 srvc);
-        for (ch = 0; ch < ble->attrs.services[srvc].chars_count; ch++) {
-            snprintf(retval + strlen(retval), retsize - strlen(retval),
-                     JSON_CHAR_FMT,
-                     ch > 0 ? "," : "",
-                     ble->attrs.services[srvc].chars[ch].uuid,
-                     IPSO_OID_BLE_SERVICE,
-                     srvc,
-                     ble->attrs.services[srvc].chars[ch].resource_id);
-        }
-        strncat(retval, JSON_ARRAY_END, retsize - strlen(retval) - 1);
+    if (length != NULL) {
+        *length = writer.length;
     }
-    strncat(retval, JSON_ARRAY_END, retsize - strlen(retval) - 1);
-    tr_debug("Wrote %zu bytes into json", strlen(retval));
+    return writer.buf;
+}
 
-    return retval;
+const char *device_get_json_list(struct ble_device *ble, size_t *length)
+{
+    if (ble->json_list == NULL || ble->json_list_generation != ble->attrs.generation) {
+        char *json_list = json_list_device_services(ble, &ble->json_list_length);
+        if (json_list == NULL) {
+            return NULL;
+        }
+        free(ble->json_list);
+        ble->json_list = json_list;
+        ble->json_list_generation = ble->attrs.generation;
+    }
+    *length = ble->json_list_length;
+    return ble->json_list;
 }
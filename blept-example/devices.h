@@ -28,6 +28,8 @@
 #include <ns_list.h>
 
 #define BLE_ADDRESS_MAX_LENGTH 20
+// Read interval for characteristics that cannot notify and have no interval in their translation
+#define BLE_DEFAULT_POLL_INTERVAL_MS 5000
 #define BLE_DEVICE_FLAG_REGISTERED (1 << 0)
 #define BLE_DEVICE_FLAG_CONNECTED  (1 << 1)
 
@@ -35,6 +37,7 @@
 #define BLE_GATT_PROP_PERM_READ    (1 << 0)
 #define BLE_GATT_PROP_PERM_WRITE   (1 << 1)
 #define BLE_GATT_PROP_PERM_NOTIFY  (1 << 2)
+#define BLE_GATT_PROP_PERM_INDICATE (1 << 7)
 
 /* BLE GATT Encryption flags */
 #define BLE_GATT_PROP_ENC_NONE     (1 << 2)
@@ -78,6 +81,16 @@ struct ble_gatt_char {
     uint8_t *value;
     size_t value_size; //allocated size for value
     size_t value_length; //actual length of store data (<= value_size)
+    bool value_on_heap; // the value outgrew its arena buffer and was moved to the heap
+    bool value_dirty; // the value changed and the resources are updated on the next poll tick
+    uint32_t poll_interval_ms; // used only while the characteristic is not notifying
+    gint64 next_poll_time; // monotonic time in microseconds, 0 until the first read is issued
+    gulong notify_handler_id;
+    bool notifying; // BlueZ reports an active notify or indicate session
+    const struct ble_characteristic *descriptor; // translation descriptor, NULL if not translated
+    // Translations of this characteristic, filled by ble_services_build_translation_index()
+    struct translation_context **translations;
+    int translations_count;
 };
 
 struct ble_gatt_service {
@@ -91,6 +104,27 @@ struct ble_attrs {
     int services_count;
     struct ble_gatt_service *services;
     char addr[BLE_ADDRESS_MAX_LENGTH + 1];
+    // One allocation holding the services, characteristics, dbus paths and value buffers
+    void *arena;
+    // Incremented whenever the attributes are freed, invalidates ble_char_handle indices
+    uint32_t generation;
+};
+
+/* Value buffers are sized from the characteristic format. Characteristics without a fixed size start
+ * with the payload of the default ATT MTU and move to the heap when a longer value arrives.
+ */
+#define BLE_DEFAULT_VALUE_SIZE 20
+#define BLE_MAX_VALUE_SIZE 512
+
+/* A discovered characteristic passed to device_set_gatt_characteristics() */
+struct ble_gatt_char_info {
+    const char *srvc_uuid;
+    const char *srvc_dbus_path;
+    const char *char_uuid;
+    const char *char_dbus_path;
+    int properties;
+    uint16_t handle; // 0 to take the handle from the dbus path
+    GDBusProxy *proxy;
 };
 
 struct translation_context {
@@ -100,14 +134,31 @@ struct translation_context {
     uint32_t characteristic_extra_flags;
     int ch_idx;
     int sv_idx;
+    const struct ble_characteristic *characteristic_descriptor;
+    // 10^exponent of the descriptor value format, resolved with the descriptor
+    double value_scale;
     ns_list_link_t link;
 };
 
 typedef NS_LIST_HEAD(struct translation_context, link) translation_context_list_t;
 
+/* A characteristic write waiting to be sent to the device */
+struct ble_write_request {
+    int sv_idx;
+    int ch_idx;
+    uint8_t *value;
+    size_t value_size;
+    ns_list_link_t link;
+};
+
+typedef NS_LIST_HEAD(struct ble_write_request, link) ble_write_queue_t;
+
 struct ble_device {
     pthread_mutex_t mutex;
     ns_list_link_t link;
+    // References held by the device table and by devices_acquire_device_by_device_id() callers,
+    // protected by the shard mutex. The device is freed when the last reference is released.
+    int refcount;
     // Used to remove the context when we cannot connect for a long time.
     uint64_t last_connected_timestamp_secs;
     // When the device is connected, we register it.
@@ -118,25 +169,65 @@ struct ble_device {
     GDBusProxy *proxy;
     struct ble_attrs attrs;
     char *dbus_path;
+    // Introspection document, built by device_get_json_list() for the attributes of json_list_generation
     char *json_list;
+    size_t json_list_length;
+    uint32_t json_list_generation;
     ble_device_type device_type;
     translation_context_list_t translations;
-    guint retry_timer_source;
+    // Translations sorted by packed object, instance and resource id for binary search.
+    // NULL when not built, then the translations list is searched.
+    struct translation_context **translation_index;
+    int translation_index_count;
     int connection_retries;
+    // Adapter the device connects through, counted in its load while adapter_assigned is set.
+    int adapter;
+    bool adapter_assigned;
     bool services_resolved;
+    // The device moved to another adapter, the characteristics still have the object paths of the old one.
+    bool attributes_stale;
+    // Set when a characteristic value changed and the values have not been written to Edge yet.
+    bool values_dirty;
+    // The device is queued to the publisher thread, see ble_publisher_publish().
+    bool publish_pending;
+    // Writes are sent to the device one at a time in queue order.
+    ble_write_queue_t write_queue;
+    bool write_in_flight;
 };
 
 typedef NS_LIST_HEAD(struct ble_device, link) ble_device_list_t;
 
+#define DEVICES_SHARD_COUNT 16
+
+/* Devices hashed by device id. A shard mutex is only held for the lookup itself,
+ * so lookups of different devices do not serialize on the global devices mutex.
+ */
+struct mept_devices_shard {
+    GHashTable *devices;
+    pthread_mutex_t mutex;
+};
+
 struct mept_devices {
     ble_device_list_t devices;
+    // Indexes into the device list, the keys are owned by the devices.
+    GHashTable *by_device_id;
+    GHashTable *by_dbus_path;
+    GHashTable *by_address;
+    // Protects the device list, the indexes and the device life cycle (create, discover, delete).
     pthread_mutex_t mutex;
+    struct mept_devices_shard shards[DEVICES_SHARD_COUNT];
 };
 
 int devices_init();
 
 void devices_link_device(struct ble_device *entry, const char *device_id);
 
+/**
+ * \brief Changes the DBUS object path of a device, for example when it moves to another adapter.
+ *        Must be called with the devices mutex held.
+ */
+void devices_set_dbus_path(struct ble_device *ble, const char *dbus_path);
+
 void devices_free();
 
 pthread_mutex_t *devices_get_mutex();
@@ -182,6 +273,36 @@ ble_device_list_t *devices_get_list();
 
 struct ble_device *devices_find_device_by_dbus_path(const char *dbus_path);
 struct ble_device *devices_find_device_by_device_id(const char *device_id);
+struct ble_device *devices_find_device_by_address(const char *address);
+
+/* Finds a device and takes a reference to it without taking the global devices mutex.
+ * The device stays valid until devices_release_device() is called, even if it is deleted
+ * meanwhile. Lock the device mutex to access its state. Returns NULL if not found.
+ */
+struct ble_device *devices_acquire_device_by_device_id(const char *device_id);
+void devices_release_device(struct ble_device *ble);
+/* Takes another reference to a device that the caller already holds a reference to or that is
+ * protected by the global devices mutex.
+ */
+void devices_retain_device(struct ble_device *ble);
+
+/* Identifies a characteristic across asynchronous calls, so completions do not look the device up
+ * again by id or by dbus path. The handle holds a reference to the device.
+ */
+struct ble_char_handle {
+    struct ble_device *device;
+    uint32_t generation;
+    int srvc;
+    int ch;
+};
+
+struct ble_char_handle *device_char_handle_new(struct ble_device *ble, int srvc, int ch);
+void device_char_handle_free(struct ble_char_handle *handle);
+
+/* Locks the device of the handle and returns the characteristic. Returns NULL without holding the
+ * lock if the attributes of the device were rebuilt since the handle was created.
+ */
+struct ble_gatt_char *device_char_handle_lock(const struct ble_char_handle *handle);
 
 /* free */
 void devices_del_device(struct ble_device *);
@@ -221,18 +342,44 @@ void device_set_connected(struct ble_device *ble, bool is_connected);
 
 struct ble_device *device_create(const char *addr);
 
-struct ble_gatt_char * device_add_gatt_characteristic(struct ble_device *ble,
-                                                      const char *srvc_uuid,
-                                                      const char *srvc_dbus_path,
-                                                      const char *char_uuid,
-                                                      const char *char_dbus_path,
-                                                      int char_properties,
-                                                      GDBusProxy *proxy);
+/**
+ * \brief Sets the services and characteristics of a device from a complete discovery.
+ *
+ *        The counts are known up front, so the services, characteristics, dbus paths and value
+ *        buffers are laid out in a single arena. Characteristics are grouped by service UUID in the
+ *        order they are given. Any previous attributes of the device are freed.
+ *
+ * \param ble The device. Must be called with the device mutex held.
+ * \param infos The discovered characteristics.
+ * \param count Number of entries in infos.
+ * \return 0 on success. On success the device owns the proxies, on failure the caller keeps them.
+ */
+int device_set_gatt_characteristics(struct ble_device *ble, const struct ble_gatt_char_info *infos, int count);
+
+/**
+ * \brief Stores a value read from, notified by or written to a characteristic. A value longer than
+ *        the arena buffer moves the characteristic to a heap buffer, values longer than
+ *        BLE_MAX_VALUE_SIZE are truncated.
+ */
+void device_store_characteristic_value(struct ble_gatt_char *ch, const uint8_t *data, size_t size);
 
 int device_add_resources_from_gatt(struct ble_device *ble);
 
 int device_add_known_translations_from_gatt(struct ble_device *ble);
 
+/**
+ * \brief Adds the resources and known translations of characteristics that were appended with
+ *        device_set_gatt_characteristics() after the existing ones, and updates the introspection
+ *        resource. The existing characteristics must keep their service and characteristic indices.
+ *
+ * \param services_count Number of services before the characteristics were appended.
+ * \param chars_count Number of characteristics in each of those services.
+ */
+int device_add_appended_characteristics(struct ble_device *ble, int services_count, const int *chars_count);
+
+/* Queues a write for the characteristic mapped to the resource. Returns 0 when the write was queued,
+ * the result of the write itself is handled asynchronously in the BLE event loop.
+ */
 int device_write_characteristic(struct ble_device *ble,
                                 const uint16_t object_id,
                                 const uint16_t instance_id,
@@ -240,6 +387,10 @@ int device_write_characteristic(struct ble_device *ble,
                                 const uint8_t *value,
                                 const size_t value_size);
 
+/* Removes and returns the next queued write, or NULL if the queue is empty. */
+struct ble_write_request *device_pop_characteristic_write(struct ble_device *ble);
+void device_free_characteristic_write(struct ble_write_request *request);
+
 void device_update_ble_characteristics(struct ble_device *ble);
 void device_update_characteristic_resource_value(struct ble_device *ble,
                                                  const int          svc,
@@ -251,8 +402,22 @@ void device_register_device(struct ble_device *dev);
 
 /* return a malloc-ed string containing the json representation of a device's services and characteristics
  * according to the documentation in https://github.com/PelionIoT/ble-lwm2m-translation/blob/master/README.md
+ * The document is measured and then written in two linear passes, into an allocation of the exact size.
  * It is up to the caller to free() the string when no longer needed.
+ *
+ * \param length If not NULL, set to the length of the string without the terminating zero.
+ */
+char *json_list_device_services(struct ble_device *ble, size_t *length);
+
+/**
+ * \brief Returns the introspection document of a device, see json_list_device_services().
+ *        The document is owned by the device. It is built when first requested and rebuilt
+ *        only after the GATT attributes of the device have been replaced.
+ *        Must be called with the device mutex held.
+ *
+ * \param length Set to the length of the document without the terminating zero.
+ * \return The document, or NULL if out of memory.
  */
-char *json_list_device_services(struct ble_device *ble);
+const char *device_get_json_list(struct ble_device *ble, size_t *length);
 
 #endif /* MEPT_DEVICES_H */
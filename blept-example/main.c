@@ -90,6 +90,18 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    int write_timeout_ms = atoi(args.write_timeout);
+    if (write_timeout_ms <= 0) {
+        fprintf(stderr, "The --write-timeout parameter must be a positive number of milliseconds.\n");
+        return 1;
+    }
+
+    int max_connecting = atoi(args.max_connecting);
+    if (max_connecting <= 0) {
+        fprintf(stderr, "The --max-connecting parameter must be a positive number.\n");
+        return 1;
+    }
+
     tr_info("Starting mept-ble MbedEdge Protocol Translator for BLE");
     tr_info("Version: %s", VERSION_STRING);
     tr_info("Binary built at: " __DATE__ " " __TIME__);
@@ -118,7 +130,10 @@ int main(int argc, char **argv)
                             args.address,
                             args.clear_cache,
                             args.extended_discovery_file,
-                            service_based_discovery);
+                            service_based_discovery,
+                            write_timeout_ms,
+                            max_connecting,
+                            args.gatt_cache_dir);
     if (0 != ret_val) {
         tr_err("ble_start returned error code %d", ret_val);
     }
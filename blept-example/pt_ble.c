@@ -37,11 +37,16 @@
 #include <termios.h>
 #include <signal.h>
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
-#include "common/read_file.h"
-#include "jansson.h"
 
 #include "pt_ble_translations.h"
+#include "pt_ble_scheduler.h"
+#include "pt_ble_gatt_cache.h"
+#include "pt_ble_advertisement.h"
+#include "pt_ble_whitelist.h"
+#include "pt_ble_adapters.h"
+#include "pt_ble_publisher.h"
 
 // ============================================================================
 // Enums, Structs and Defines
@@ -52,6 +57,7 @@
 #define GATT_SERVICE_IFACE "org.bluez.GattService1"
 #define GATT_CHARACTERISTIC_IFACE "org.bluez.GattCharacteristic1"
 #define DBUS_PROPERTIES_IFACE "org.freedesktop.DBus.Properties"
+#define OBJECT_MANAGER_IFACE "org.freedesktop.DBus.ObjectManager"
 #define POWERED_PROPERTY "Powered"
 #define OBJ_PATH_GAS "/service000c/char000d"
 #define OBJ_PATH_HUMIDITY "/service000f/char0010"
@@ -62,44 +68,55 @@
 #define MAX_PATH_LENGTH 256
 #define MAX_VALUE_STRING_LENGTH 10
 #define TRACE_GROUP "BLE"
-#define BLE_VALUE_READ_INTERVAL 5000
-#define BLE_RETRY_SLEEP_TIME_INITIAL_SECS 4
+#define BLE_POLL_TICK_INTERVAL 1000 // Granularity of the per-characteristic poll intervals
 #define BLE_MAX_BACK_OFF_TIME_SECS 300 // After this the device gets unregistered
-#define BLE_SLEEP_TIME_MULTIPLIER 2
 #define MAX_CONNECTION_RETRY_TIME_SECONDS (3600 * 24)
 #define BLE_MAX_CONNECTION_RETRIES 10000             // some upper limit just to prevent integer overflow
-#define EXPERIMENTAL_ADVERTISEMENT_SUPPORT_ENABLED 0 // the feature is not ready yet.
 #define BLUEZ_RECONNECT_RETRY_TIME_SECONDS 3         // Connection retry is tried in case the bluetooth daemon dies.
 // ============================================================================
 // Global Variables
 // ============================================================================
 
-typedef struct device_conf_entry {
-    ns_list_link_t link;
-    char *name;
-    bool partial_match;
-} device_conf_entry_t;
-
-typedef NS_LIST_HEAD(device_conf_entry_t, link) device_conf_list_t;
-
 static struct config {
     const char *postfix;
-    const char *adapter;
     guint g_source_id_1;
     GMainLoop *g_loop;
     GDBusConnection *connection;
-    char bluez_hci_path[64];
-    device_conf_list_t *white_list_entries;
+    GDBusObjectManager *bluez_manager;
+    struct ble_whitelist *whitelist;
     int service_based_discovery;
+    GHashTable *proxy_cache; // characteristic dbus path -> GDBusProxy, see ble_characteristic_proxy_get
+    int write_timeout_ms;
 } g_config;
 
+static pthread_mutex_t g_proxy_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Incremented when cached proxies are dropped, a proxy created meanwhile may be stale
+static guint g_proxy_cache_generation = 0;
+
+// Characteristics collected for a device before they are swapped into its attributes.
+struct ble_gatt_discovery {
+    struct ble_gatt_char_info *infos;
+    int count;
+    GPtrArray *strings; // owns the strings the infos point to
+};
+
 // ============================================================================
 // Static functions
 // ============================================================================
-static void ble_discover_characteristics(struct ble_device *ble_dev);
+static bool ble_discover_characteristics(const char *dbus_path, const char *addr, struct ble_gatt_discovery *discovery);
+static void ble_characteristic_value_updated(struct ble_device *ble, int srvc, int ch);
+static bool ble_load_characteristics_from_cache(const char *dbus_path,
+                                                const char *addr,
+                                                struct ble_gatt_discovery *discovery);
+static void ble_gatt_discovery_init(struct ble_gatt_discovery *discovery);
+static void ble_gatt_discovery_clear(struct ble_gatt_discovery *discovery);
+static bool ble_gatt_discovery_apply(struct ble_device *ble_dev, struct ble_gatt_discovery *discovery);
+static void ble_rebind_characteristics(struct ble_device *ble_dev);
 static void ble_proxy_connect(GDBusProxy *devProxy);
 static void ble_start_reconnection_timer_or_unregister_device(struct ble_device *ble_dev);
-static void device_conf_list_free(device_conf_list_t *list);
+static void ble_assign_adapter(struct ble_device *ble_dev);
+static void ble_start_notifications_for_device(struct ble_device *ble_dev);
+static void ble_reset_characteristics_for_device(struct ble_device *ble_dev);
 
 // ============================================================================
 // Code
@@ -303,6 +320,98 @@ bool ble_set_property(const char *dbus_path, const char *dbus_interface, const c
     return ret;
 }
 
+/**
+ * \brief Returns a referenced proxy for the characteristic at a dbus path.
+ *        The proxy is created on the first request and cached, so later reads and writes
+ *        do not pay for a synchronous introspection round trip. The proxy is created without
+ *        holding the cache mutex, so other threads are not kept waiting behind the DBus call.
+ *        The caller must release the returned proxy with g_object_unref().
+ */
+static GDBusProxy *ble_characteristic_proxy_get(const char *characteristic_path, GError **err)
+{
+    GDBusProxy *proxy;
+    GDBusProxy *cached;
+    guint generation;
+
+    pthread_mutex_lock(&g_proxy_cache_mutex);
+    if (g_config.proxy_cache == NULL) {
+        g_config.proxy_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+    }
+    proxy = g_hash_table_lookup(g_config.proxy_cache, characteristic_path);
+    if (proxy != NULL) {
+        g_object_ref(proxy);
+    }
+    generation = g_proxy_cache_generation;
+    pthread_mutex_unlock(&g_proxy_cache_mutex);
+    if (proxy != NULL) {
+        return proxy;
+    }
+
+    assert(g_config.connection != NULL);
+    proxy = g_dbus_proxy_new_sync(g_config.connection,
+                                  G_DBUS_PROXY_FLAGS_NONE,
+                                  NULL,
+                                  BLUEZ_NAME,
+                                  characteristic_path,
+                                  GATT_CHARACTERISTIC_IFACE,
+                                  NULL,
+                                  err);
+    if (proxy == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_proxy_cache_mutex);
+    // Another thread may have cached a proxy for the same path meanwhile, use that one.
+    cached = g_config.proxy_cache != NULL ? g_hash_table_lookup(g_config.proxy_cache, characteristic_path) : NULL;
+    if (cached != NULL) {
+        g_object_unref(proxy);
+        proxy = g_object_ref(cached);
+    } else if (g_config.proxy_cache != NULL && generation == g_proxy_cache_generation) {
+        g_hash_table_insert(g_config.proxy_cache, g_strdup(characteristic_path), g_object_ref(proxy));
+    }
+    pthread_mutex_unlock(&g_proxy_cache_mutex);
+
+    return proxy;
+}
+
+static gboolean ble_proxy_cache_path_is_below(gpointer key, gpointer value, gpointer user_data)
+{
+    const char *path = key;
+    const char *object_path = user_data;
+    size_t length = strlen(object_path);
+    (void)value;
+
+    return strncmp(path, object_path, length) == 0 && (path[length] == '\0' || path[length] == '/');
+}
+
+// Drops the cached proxies of an object and of all objects below it, e.g. a removed device.
+static void ble_characteristic_proxy_cache_invalidate(const char *object_path)
+{
+    pthread_mutex_lock(&g_proxy_cache_mutex);
+    if (g_config.proxy_cache != NULL) {
+        g_proxy_cache_generation++;
+        guint removed = g_hash_table_foreach_remove(g_config.proxy_cache,
+                                                    ble_proxy_cache_path_is_below,
+                                                    (gpointer) object_path);
+        if (removed > 0) {
+            tr_debug("Dropped %u cached characteristic proxies under %s", removed, object_path);
+        }
+    }
+    pthread_mutex_unlock(&g_proxy_cache_mutex);
+}
+
+// The cached proxies are bound to the DBus connection, so they are dropped with it.
+static void ble_characteristic_proxy_cache_clear(void)
+{
+    pthread_mutex_lock(&g_proxy_cache_mutex);
+    g_proxy_cache_generation++;
+    if (g_config.proxy_cache != NULL) {
+        g_hash_table_destroy(g_config.proxy_cache);
+        g_config.proxy_cache = NULL;
+    }
+    pthread_mutex_unlock(&g_proxy_cache_mutex);
+}
+
 /**
  * \brief check if device object proxy
  *
@@ -355,33 +464,27 @@ out:
 
 static struct ble_device *ble_find_device_from_address(const gchar *bt_address)
 {
-    struct ble_device *ble_dev = NULL;
-    char ble_device_id[BLE_DEVICE_NAME_MAX_LENGTH] = {0};
-    devices_make_device_id(ble_device_id, sizeof(ble_device_id), BLE_DEV, bt_address, g_config.postfix);
-    ble_dev = devices_find_device_by_device_id(ble_device_id);
-    return ble_dev;
+    return devices_find_device_by_address(bt_address);
+}
+
+static void ble_release_locked_device(struct ble_device *ble_dev)
+{
+    device_mutex_unlock(ble_dev);
+    devices_release_device(ble_dev);
 }
 
 // Tries to find a device based on a proxy.  Can return NULL.
 static struct ble_device *ble_find_device_from_proxy(GDBusProxy *proxy)
 {
-    gchar bt_address[BLE_DEVICE_ADDRESS_SIZE] = {0};
-    struct ble_device *ble_dev = NULL;
-
     assert(proxy != NULL);
     assert(G_IS_DBUS_PROXY(proxy));
 
     if (!ble_is_device_interface_proxy(proxy)) {
-        goto out;
-    }
-
-    if (ble_device_proxy_get_address(bt_address, sizeof bt_address, proxy) != 0) {
-        goto out;
+        return NULL;
     }
-    ble_dev = ble_find_device_from_address(bt_address);
 
-out:
-    return ble_dev;
+    // The device object path is indexed, so the Address property does not need to be read.
+    return devices_find_device_by_dbus_path(g_dbus_proxy_get_object_path(proxy));
 }
 
 static void ble_remove_device_done(GObject *source_object,
@@ -425,26 +528,44 @@ static void ble_remove_device_done(GObject *source_object,
     tr_debug("<-- ble_remove_device_done");
 }
 
-void ble_remove_device(struct ble_device *ble_dev)
+// Creates a proxy of the adapter interface, NULL if the adapter is not available.
+static GDBusProxy *ble_adapter_proxy_new(const char *adapter_path)
 {
     GDBusProxy *proxy;
     GError *err = NULL;
-    assert(ble_dev != NULL);
-    device_stop_retry_timer(ble_dev);
 
-    // Method is on the adapter interface.
     assert(g_config.connection != NULL);
     proxy = g_dbus_proxy_new_sync(g_config.connection,
-                                          G_DBUS_PROXY_FLAGS_NONE,
-                                          NULL,
-                                          BLUEZ_NAME,
-                                          g_config.bluez_hci_path,
-                                          ADAPTER_IFACE,
-                                          NULL,
-                                          &err);
+                                  G_DBUS_PROXY_FLAGS_NONE,
+                                  NULL,
+                                  BLUEZ_NAME,
+                                  adapter_path,
+                                  ADAPTER_IFACE,
+                                  NULL,
+                                  &err);
     if (!G_IS_DBUS_PROXY(proxy)) {
         tr_err("Adapter %s interface not available on dbus: %s", ADAPTER_IFACE, err->message);
         g_clear_error(&err);
+        return NULL;
+    }
+    return proxy;
+}
+
+void ble_remove_device(struct ble_device *ble_dev)
+{
+    GDBusProxy *proxy;
+    int adapter;
+    assert(ble_dev != NULL);
+    device_stop_retry_timer(ble_dev);
+
+    // Method is on the interface of the adapter the device object is on.
+    adapter = ble_adapters_index_of_path(ble_dev->dbus_path);
+    if (adapter < 0) {
+        tr_err("Device %s is not on an adapter in use", ble_dev->dbus_path);
+        return;
+    }
+    proxy = ble_adapter_proxy_new(ble_adapters_path(adapter));
+    if (proxy == NULL) {
         return;
     }
 
@@ -498,6 +619,7 @@ static void ble_on_disconnect(GDBusProxy *proxy)
 
     tr_info("BLE device %s disconnected!", ble_dev->attrs.addr);
     device_set_connected(ble_dev, false);
+    ble_reset_characteristics_for_device(ble_dev);
     // Try to reconnect a few times.
     ble_start_reconnection_timer_or_unregister_device(ble_dev);
 out:
@@ -506,6 +628,23 @@ out:
 }
 
 
+// Checks if the device has a characteristic that is read or notifies, i.e. that delivers values.
+static bool ble_device_has_readable_characteristic(const struct ble_device *ble_dev)
+{
+    int srvc, ch;
+
+    for (srvc = 0; srvc < ble_dev->attrs.services_count; srvc++) {
+        const struct ble_gatt_service *gattservice = &(ble_dev->attrs.services[srvc]);
+        for (ch = 0; ch < gattservice->chars_count; ch++) {
+            if (gattservice->chars[ch].properties &
+                (BLE_GATT_PROP_PERM_READ | BLE_GATT_PROP_PERM_NOTIFY | BLE_GATT_PROP_PERM_INDICATE)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 static void ble_on_services_resolved(GDBusProxy *proxy)
 {
     struct ble_device *ble_dev;
@@ -520,20 +659,58 @@ static void ble_on_services_resolved(GDBusProxy *proxy)
 
         ble_dev = ble_find_device_from_proxy(proxy);
         if ((ble_dev != NULL)) {
+            // The attributes are only replaced in the BLE event loop, so they are discovered and
+            // read here without the device mutex. It is taken only to swap the attributes in and
+            // to add the translations, so the PT callbacks of the device do not wait for DBus.
             if (!ble_dev->services_resolved) {
-                tr_info("Discovering BLE properties");
-                ble_discover_characteristics(ble_dev);
+                struct ble_gatt_discovery discovery;
+                bool from_cache;
+                bool discovered;
+
+                ble_gatt_discovery_init(&discovery);
+                discovered = from_cache = ble_load_characteristics_from_cache(ble_dev->dbus_path,
+                                                                              ble_dev->attrs.addr,
+                                                                              &discovery);
+                if (!from_cache) {
+                    tr_info("Discovering BLE properties");
+                    ble_gatt_discovery_clear(&discovery);
+                    ble_gatt_discovery_init(&discovery);
+                    discovered = ble_discover_characteristics(ble_dev->dbus_path, ble_dev->attrs.addr, &discovery);
+                }
+                if (discovered) {
+                    device_mutex_lock(ble_dev);
+                    ble_gatt_discovery_apply(ble_dev, &discovery);
+                    device_mutex_unlock(ble_dev);
+                }
+                ble_gatt_discovery_clear(&discovery);
+                if (!from_cache && ble_dev->attrs.services_count > 0) {
+                    ble_gatt_cache_store(ble_dev);
+                }
+                if (!ble_device_has_readable_characteristic(ble_dev)) {
+                    ble_scheduler_no_first_value(ble_dev->dbus_path);
+                }
                 ble_debug_print_device(ble_dev);
 
                 /* convert BLE properties to PT resources */
                 device_add_resources_from_gatt(ble_dev);
+                device_mutex_lock(ble_dev);
                 device_add_known_translations_from_gatt(ble_dev);
 
                 // TODO: We register this late because the resources must
                 // all be present at registration time.  Try to figure out why.
                 ble_dev->services_resolved = true;
+                device_mutex_unlock(ble_dev);
+            } else if (ble_dev->attributes_stale) {
+                ble_rebind_characteristics(ble_dev);
             }
+            device_mutex_lock(ble_dev);
+            ble_start_notifications_for_device(ble_dev);
             device_register_device(ble_dev);
+            // Send the writes that waited for the reconnection.
+            if (!ns_list_is_empty(&ble_dev->write_queue)) {
+                ble_schedule_write_queue(ble_dev->device_id);
+            }
+            device_mutex_unlock(ble_dev);
         } else {
             tr_warn("Resolved services on a device that we don't know about?");
         }
@@ -542,13 +719,180 @@ static void ble_on_services_resolved(GDBusProxy *proxy)
     }
 }
 
-#if 1 == EXPERIMENTAL_ADVERTISEMENT_SUPPORT_ENABLED
-static void ble_handle_advertisement(GDBusProxy *proxy, GVariant *advertisement_data)
+// Creates the characteristics of an advertising device from the values of its first advertisement.
+// Must be called with the device mutex held.
+static void ble_add_characteristics_from_advertisement(struct ble_device *ble, const struct ble_advertisement *adv)
 {
-    devices_mutex_lock();
+    struct ble_gatt_char_info infos[BLE_ADVERTISEMENT_MAX_VALUES];
+    char char_paths[BLE_ADVERTISEMENT_MAX_VALUES][MAX_PATH_LENGTH];
+    char srvc_path[MAX_PATH_LENGTH];
+    int i;
 
-    struct ble_device *ble = ble_find_device_from_proxy(proxy);
-    if (edge_is_connected() && !edge_device_exists(ble->device_id)) {
+    // BlueZ has no objects for advertised values, the paths only identify them in the introspection.
+    snprintf(srvc_path, sizeof(srvc_path), "%s/advertisement", ble->dbus_path);
+    for (i = 0; i < adv->count; i++) {
+        snprintf(char_paths[i], sizeof(char_paths[i]), "%s/char%04x", srvc_path, i);
+        infos[i].srvc_uuid = adv->values[i].srvc_uuid;
+        infos[i].srvc_dbus_path = srvc_path;
+        infos[i].char_uuid = adv->values[i].char_uuid;
+        infos[i].char_dbus_path = char_paths[i];
+        infos[i].properties = BLE_GATT_PROP_PERM_READ;
+        infos[i].handle = i;
+        infos[i].proxy = NULL;
+    }
+    if (device_set_gatt_characteristics(ble, infos, adv->count) != 0) {
+        tr_error("Failed to add advertised characteristics of %s, out of memory?", ble->attrs.addr);
+        return;
+    }
+    device_add_resources_from_gatt(ble);
+    device_add_known_translations_from_gatt(ble);
+    ble->services_resolved = true;
+}
+
+static bool ble_has_characteristic(const struct ble_device *ble, const char *char_uuid)
+{
+    int srvc, ch;
+
+    for (srvc = 0; srvc < ble->attrs.services_count; srvc++) {
+        const struct ble_gatt_service *gattservice = &(ble->attrs.services[srvc]);
+        for (ch = 0; ch < gattservice->chars_count; ch++) {
+            if (strcasecmp(gattservice->chars[ch].uuid, char_uuid) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Appends characteristics for the values that were not in the earlier advertisements of the device,
+// devices may send their sensors in alternating advertisements. The existing characteristics keep
+// their indices, so their resources and translations stay valid. Must be called with the device
+// mutex held.
+static void ble_add_new_characteristics_from_advertisement(struct ble_device *ble, const struct ble_advertisement *adv)
+{
+    struct ble_gatt_char_info infos[BLE_ADVERTISEMENT_MAX_VALUES];
+    char srvc_uuids[BLE_ADVERTISEMENT_MAX_VALUES][FORMATTED_UUID_LEN + 1];
+    char char_uuids[BLE_ADVERTISEMENT_MAX_VALUES][FORMATTED_UUID_LEN + 1];
+    char char_paths[BLE_ADVERTISEMENT_MAX_VALUES][MAX_PATH_LENGTH];
+    uint8_t values[BLE_ADVERTISEMENT_MAX_VALUES][BLE_ADVERTISEMENT_VALUE_MAX_SIZE];
+    size_t value_lengths[BLE_ADVERTISEMENT_MAX_VALUES];
+    int chars_count[BLE_ADVERTISEMENT_MAX_VALUES];
+    int services_count = ble->attrs.services_count;
+    char srvc_path[MAX_PATH_LENGTH];
+    int count = 0;
+    int existing;
+    int i, srvc, ch;
+
+    for (i = 0; i < adv->count; i++) {
+        if (!ble_has_characteristic(ble, adv->values[i].char_uuid)) {
+            break;
+        }
+    }
+    if (i == adv->count) {
+        return;
+    }
+
+    snprintf(srvc_path, sizeof(srvc_path), "%s/advertisement", ble->dbus_path);
+    // The existing characteristics first, in the same order. Their strings and values live in the
+    // arena that device_set_gatt_characteristics() frees, so they are copied here.
+    for (srvc = 0; srvc < services_count && count < BLE_ADVERTISEMENT_MAX_VALUES; srvc++) {
+        struct ble_gatt_service *gattservice = &(ble->attrs.services[srvc]);
+        chars_count[srvc] = gattservice->chars_count;
+        for (ch = 0; ch < gattservice->chars_count && count < BLE_ADVERTISEMENT_MAX_VALUES; ch++) {
+            struct ble_gatt_char *gattchar = &(gattservice->chars[ch]);
+            snprintf(srvc_uuids[count], sizeof(srvc_uuids[count]), "%s", gattservice->uuid);
+            snprintf(char_uuids[count], sizeof(char_uuids[count]), "%s", gattchar->uuid);
+            snprintf(char_paths[count], sizeof(char_paths[count]), "%s", gattchar->dbus_path);
+            value_lengths[count] = MIN(gattchar->value_length, sizeof(values[count]));
+            memcpy(values[count], gattchar->value, value_lengths[count]);
+            infos[count].srvc_uuid = srvc_uuids[count];
+            infos[count].srvc_dbus_path = srvc_path;
+            infos[count].char_uuid = char_uuids[count];
+            infos[count].char_dbus_path = char_paths[count];
+            infos[count].properties = gattchar->properties;
+            infos[count].handle = gattchar->handle;
+            infos[count].proxy = NULL;
+            count++;
+        }
+    }
+    existing = count;
+
+    for (i = 0; i < adv->count && count < BLE_ADVERTISEMENT_MAX_VALUES; i++) {
+        int j;
+        for (j = 0; j < count; j++) {
+            if (strcasecmp(infos[j].char_uuid, adv->values[i].char_uuid) == 0) {
+                break;
+            }
+        }
+        if (j < count) {
+            continue;
+        }
+        snprintf(char_paths[count], sizeof(char_paths[count]), "%s/char%04x", srvc_path, count);
+        infos[count].srvc_uuid = adv->values[i].srvc_uuid;
+        infos[count].srvc_dbus_path = srvc_path;
+        infos[count].char_uuid = adv->values[i].char_uuid;
+        infos[count].char_dbus_path = char_paths[count];
+        infos[count].properties = BLE_GATT_PROP_PERM_READ;
+        infos[count].handle = count;
+        infos[count].proxy = NULL;
+        count++;
+    }
+    if (count == existing) {
+        return;
+    }
+
+    tr_info("Adding %d advertised characteristics to %s", count - existing, ble->attrs.addr);
+    if (device_set_gatt_characteristics(ble, infos, count) != 0) {
+        tr_error("Failed to add advertised characteristics of %s, out of memory?", ble->attrs.addr);
+        // The translations refer to the characteristics that were just freed.
+        ble_services_free_translation_contexts(ble);
+        return;
+    }
+    i = 0;
+    for (srvc = 0; srvc < services_count; srvc++) {
+        struct ble_gatt_service *gattservice = &(ble->attrs.services[srvc]);
+        for (ch = 0; ch < chars_count[srvc] && i < existing; ch++, i++) {
+            device_store_characteristic_value(&gattservice->chars[ch], values[i], value_lengths[i]);
+        }
+    }
+    device_add_appended_characteristics(ble, services_count, chars_count);
+    // Registering again publishes the new resources of a registered device.
+    if (device_is_registered(ble)) {
+        edge_register_device(ble->device_id);
+    }
+}
+
+// Stores the advertised values in the characteristics with the same UUIDs.
+// Must be called with the device mutex held.
+static void ble_update_characteristics_from_advertisement(struct ble_device *ble, const struct ble_advertisement *adv)
+{
+    int i, srvc, ch;
+
+    for (i = 0; i < adv->count; i++) {
+        for (srvc = 0; srvc < ble->attrs.services_count; srvc++) {
+            struct ble_gatt_service *gattservice = &(ble->attrs.services[srvc]);
+            for (ch = 0; ch < gattservice->chars_count; ch++) {
+                struct ble_gatt_char *gattchar = &(gattservice->chars[ch]);
+                if (strcasecmp(gattchar->uuid, adv->values[i].char_uuid) == 0) {
+                    device_store_characteristic_value(gattchar, adv->values[i].value, adv->values[i].value_size);
+                    ble_characteristic_value_updated(ble, srvc, ch);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * \brief Updates the resources of an advertising device from decoded advertisement values.
+ *        The resources are created from the values of the first advertisement that is decoded,
+ *        values of other sensors that appear in later advertisements are added to them.
+ *        The devices mutex must be held.
+ */
+static void ble_update_from_advertisement(struct ble_device *ble, struct ble_advertisement *adv)
+{
+    tr_debug("Advertisement of %s in %s format with %d values", ble->attrs.addr, adv->format, adv->count);
+
+    if (!edge_device_exists(ble->device_id)) {
         /* create the Edge PT device context */
         if (!devices_create_pt_device(ble->device_id,              /* device ID */
                                       "ARM",                       /* manufacturer */
@@ -556,26 +900,75 @@ static void ble_handle_advertisement(GDBusProxy *proxy, GVariant *advertisement_
                                       ble->attrs.addr,             /* serial number */
                                       "mept-ble-advertisement")) { /* device type */
             tr_err("Failed to create pt device context");
-            devices_del_device(ble);
-            goto out;
-        }
-        else {
-            tr_debug("Created GAP advertising device %s", ble->device_id);
+            return;
         }
+        tr_debug("Created GAP advertising device %s", ble->device_id);
     }
 
-    if (edge_device_exists(ble->device_id)) {
-        if (!device_is_registered(ble)) {
-            device_register_device(ble);
-        }
+    device_mutex_lock(ble);
+    if (!ble->services_resolved) {
+        ble_add_characteristics_from_advertisement(ble, adv);
+    } else {
+        ble_add_new_characteristics_from_advertisement(ble, adv);
+    }
+    ble_update_characteristics_from_advertisement(ble, adv);
+    device_register_device(ble);
+    device_mutex_unlock(ble);
+}
+
+// Updates an advertising device from its ServiceData and ManufacturerData properties.
+static void ble_handle_advertisement(GDBusProxy *proxy)
+{
+    struct ble_advertisement adv;
+    GVariant *service_data;
+    GVariant *manufacturer_data;
+
+    devices_mutex_lock();
+    struct ble_device *ble = ble_find_device_from_proxy(proxy);
+    if (ble == NULL || ble->device_type != BLE_DEVICE_GAP_ADVERTISEMENT_ONLY || !edge_is_connected()) {
+        devices_mutex_unlock();
+        return;
+    }
 
-        // TODO: Parse advertisement data and update resources
+    service_data = g_dbus_proxy_get_cached_property(proxy, "ServiceData");
+    manufacturer_data = g_dbus_proxy_get_cached_property(proxy, "ManufacturerData");
+    // Only decodable data is rate limited, other advertisements of the device do not delay it.
+    if (ble_advertisement_parse(service_data, manufacturer_data, &adv) &&
+        ble_advertisement_accept(ble->attrs.addr, service_data, manufacturer_data)) {
+        ble_update_from_advertisement(ble, &adv);
     }
 
-out:
+    if (service_data) {
+        g_variant_unref(service_data);
+    }
+    if (manufacturer_data) {
+        g_variant_unref(manufacturer_data);
+    }
     devices_mutex_unlock();
 }
-#endif
+
+// Updates an advertising device from a change that was held back by the rate limit, once the
+// minimum interval has passed. The devices mutex must be held.
+static void ble_handle_pending_advertisement(struct ble_device *ble)
+{
+    struct ble_advertisement adv;
+    GVariant *service_data;
+    GVariant *manufacturer_data;
+
+    if (!ble_advertisement_take_pending(ble->attrs.addr, &service_data, &manufacturer_data)) {
+        return;
+    }
+    if (ble_advertisement_parse(service_data, manufacturer_data, &adv)) {
+        ble_update_from_advertisement(ble, &adv);
+    }
+
+    if (service_data) {
+        g_variant_unref(service_data);
+    }
+    if (manufacturer_data) {
+        g_variant_unref(manufacturer_data);
+    }
+}
 
 static void ble_properties_changed(GDBusProxy *proxy, GVariant *changed_properties, GStrv invalidated_properties, gpointer user_data)
 {
@@ -611,29 +1004,23 @@ static void ble_properties_changed(GDBusProxy *proxy, GVariant *changed_properti
                 tr_debug("    %s: ServicesResolved -> 0", g_dbus_proxy_get_object_path(proxy));
             }
         }
-#if 1 == EXPERIMENTAL_ADVERTISEMENT_SUPPORT_ENABLED
-        // Experimental advertisement support
-        if (strncmp(key, "ServiceData", sizeof("ServiceData")) == 0) {
-            char *servicedata = g_variant_print(value, TRUE);
-            tr_debug("    %s: ServiceData -> %s", g_dbus_proxy_get_object_path(proxy), servicedata);
-            g_free(servicedata);
-
-            ble_handle_advertisement(proxy, value);
+        if (strcmp(key, "ServiceData") == 0 || strcmp(key, "ManufacturerData") == 0) {
+            ble_handle_advertisement(proxy);
         }
-#endif
         g_variant_unref(value);
         g_free(s);
     }
 }
 
-static void ble_create_device_context(GDBusProxy *proxy, ble_device_type device_type)
+// Returns the context of the device, which may be tracked already, or NULL on failure.
+static struct ble_device *ble_create_device_context(GDBusProxy *proxy, ble_device_type device_type)
 {
     char ble_device_id[BLE_DEVICE_NAME_MAX_LENGTH] = {0};
     char bt_address[BLE_DEVICE_ADDRESS_SIZE] = {0};
     struct ble_device *ble_dev = NULL;
 
     if (ble_device_proxy_get_address(bt_address, sizeof bt_address, proxy) != 0) {
-        return;
+        return NULL;
     }
     tr_info("----> ble_create_device_context %s.", bt_address);
 
@@ -646,7 +1033,7 @@ static void ble_create_device_context(GDBusProxy *proxy, ble_device_type device_
     devices_mutex_unlock();
     if (NULL != ble_dev) {
         tr_debug("    Device id %s already tracked.", ble_device_id);
-        return;
+        return ble_dev;
     }
     tr_debug("    Device is new.");
 
@@ -654,7 +1041,7 @@ static void ble_create_device_context(GDBusProxy *proxy, ble_device_type device_
     ble_dev = device_create(bt_address);
     if (NULL == ble_dev) {
         tr_err("Failed to allocate ble device context.");
-        return;
+        return NULL;
     }
     tr_debug("    Device context created.");
 
@@ -673,74 +1060,45 @@ static void ble_create_device_context(GDBusProxy *proxy, ble_device_type device_
     devices_link_device(ble_dev, ble_device_id);
     devices_mutex_unlock();
     tr_info("<---- ble_create_device_context device: %p device_id: '%s' bt_address: %s.", ble_dev, ble_dev->device_id, bt_address);
+    return ble_dev;
 }
 
-// Used to count the timeout in milliseconds for the retry with count starting from 1
-static uint32_t ble_back_off_time_in_ms(int32_t retry_index)
-{
-    assert(retry_index > 0);
-    int32_t sleep_time = BLE_RETRY_SLEEP_TIME_INITIAL_SECS;
-
-    while (retry_index > 1 && (sleep_time < BLE_MAX_BACK_OFF_TIME_SECS)) {
-        sleep_time = sleep_time + sleep_time * BLE_SLEEP_TIME_MULTIPLIER;
-        retry_index--;
-    }
-
-    return sleep_time * 1000;
-}
-
-static gboolean ble_retry_connect(gpointer data)
-{
-    struct ble_device *ble_dev = (struct ble_device *) data;
-    tr_debug("--> ble_retry_connect device_id: '%s' proxy: %p", ble_dev->device_id, ble_dev->proxy);
-    ble_proxy_connect(ble_dev->proxy);
-    ble_dev->retry_timer_source = 0;
-    tr_debug("<-- ble_retry_connect");
-    return G_SOURCE_REMOVE;
-}
-
+// Unregisters a device that has been unreachable for too long, otherwise asks the scheduler
+// for a jittered reconnection.
 static void ble_start_reconnection_timer_or_unregister_device(struct ble_device *ble_dev)
 {
-    if (0 == ble_dev->retry_timer_source) {
-        bool remove_device_context = false;
-        if (ble_dev->connection_retries < BLE_MAX_CONNECTION_RETRIES) {
-            ble_dev->connection_retries += 1;
-        }
-        tr_debug("--> ble_start_reconnection_timer_or_unregister_device device id: '%s' retry index: %d",
-                 ble_dev->device_id,
-                 ble_dev->connection_retries);
-
-        uint32_t retry_time_out_in_ms = ble_back_off_time_in_ms(ble_dev->connection_retries);
-        uint64_t duration_since_connection_seconds = devices_duration_in_sec_since_last_connection(ble_dev);
-
-        if (retry_time_out_in_ms > (BLE_MAX_BACK_OFF_TIME_SECS * 1000)) {
-            remove_device_context = (duration_since_connection_seconds >= MAX_CONNECTION_RETRY_TIME_SECONDS);
-            if (duration_since_connection_seconds >= BLE_MAX_BACK_OFF_TIME_SECS) {
-                // Unregister the device, because it's not reachable.
-                tr_err("    Unregistering device: '%s' due to maximum retry time in seconds: %d",
-                       ble_dev->device_id,
-                       BLE_MAX_BACK_OFF_TIME_SECS);
-                bool call_succeeded = edge_unregister_device(ble_dev, remove_device_context);
-                if (!call_succeeded && remove_device_context) {
-                    pt_edge_del_device(ble_dev);
-                }
-            }
+    uint32_t delay_ms;
+    uint64_t duration_since_connection_seconds = devices_duration_in_sec_since_last_connection(ble_dev);
+    bool remove_device_context = (duration_since_connection_seconds >= MAX_CONNECTION_RETRY_TIME_SECONDS);
+
+    if (ble_dev->connection_retries < BLE_MAX_CONNECTION_RETRIES) {
+        ble_dev->connection_retries += 1;
+    }
+    tr_debug("--> ble_start_reconnection_timer_or_unregister_device device id: '%s' retry index: %d",
+             ble_dev->device_id,
+             ble_dev->connection_retries);
+
+    if (duration_since_connection_seconds >= BLE_MAX_BACK_OFF_TIME_SECS &&
+        (remove_device_context || device_is_registered(ble_dev))) {
+        // Unregister the device, because it's not reachable.
+        tr_err("    Unregistering device: '%s' due to maximum retry time in seconds: %d",
+               ble_dev->device_id,
+               BLE_MAX_BACK_OFF_TIME_SECS);
+        bool call_succeeded = edge_unregister_device(ble_dev, remove_device_context);
+        if (!call_succeeded && remove_device_context) {
+            pt_edge_del_device(ble_dev);
         }
-        if (!remove_device_context) {
-            tr_info("    retrying in %d ms.", retry_time_out_in_ms);
-            ble_dev->retry_timer_source = g_timeout_add_full(G_PRIORITY_HIGH,
-                                                             retry_time_out_in_ms,
-                                                             ble_retry_connect,
-                                                             ble_dev,
-                                                             NULL);
+    }
+    if (!remove_device_context) {
+        // The adapter the device connected through may have better alternatives by now.
+        ble_assign_adapter(ble_dev);
+        if (ble_scheduler_request_reconnect(ble_dev->proxy, &delay_ms)) {
+            tr_info("    retrying in %u ms.", (unsigned int) delay_ms);
+        } else {
+            tr_debug("    reconnection already scheduled");
         }
-        tr_debug("<-- ble_start_reconnection_timer_or_unregister_device");
-    } else {
-        tr_debug("ble_start_reconnection_timer_or_unregister_device (timer already running) device id: '%s' retry "
-                 "index: %d",
-                 ble_dev->device_id,
-                 ble_dev->connection_retries);
     }
+    tr_debug("<-- ble_start_reconnection_timer_or_unregister_device");
 }
 
 static void ble_connect_done(GObject *source_object, GAsyncResult *res, gpointer user_data)
@@ -756,6 +1114,8 @@ static void ble_connect_done(GObject *source_object, GAsyncResult *res, gpointer
     assert(user_data == NULL);
 
     ret = g_dbus_proxy_call_finish(proxy, res, &err);
+    // Let the next queued device start connecting while this one resolves its services.
+    ble_scheduler_connect_finished(g_dbus_proxy_get_object_path(proxy), err == NULL);
     devices_mutex_lock();
     ble_dev = ble_find_device_from_proxy(proxy);
     if (ble_dev) {
@@ -893,6 +1253,105 @@ static GDBusProxy *ble_create_device_proxy(const char *addr)
     return devProxy;
 }
 
+// RSSI of a device on an adapter, BLE_ADAPTERS_RSSI_NOT_SEEN if the adapter has no object for it.
+static int16_t ble_device_rssi_on_adapter(const struct ble_device *ble_dev, int adapter)
+{
+    char path[MAX_PATH_LENGTH];
+    GDBusInterface *iface;
+    GVariant *rssi;
+    int16_t ret = BLE_ADAPTERS_RSSI_UNKNOWN;
+
+    if (g_config.bluez_manager == NULL ||
+        !ble_adapters_device_path(path, sizeof(path), ble_dev->dbus_path, adapter)) {
+        return BLE_ADAPTERS_RSSI_NOT_SEEN;
+    }
+    iface = g_dbus_object_manager_get_interface(g_config.bluez_manager, path, DEVICE_IFACE);
+    if (iface == NULL) {
+        return BLE_ADAPTERS_RSSI_NOT_SEEN;
+    }
+    // BlueZ drops the RSSI of a device it has not heard from during the current discovery.
+    rssi = g_dbus_proxy_get_cached_property(G_DBUS_PROXY(iface), "RSSI");
+    if (rssi != NULL) {
+        if (g_variant_is_of_type(rssi, G_VARIANT_TYPE_INT16)) {
+            ret = g_variant_get_int16(rssi);
+        }
+        g_variant_unref(rssi);
+    }
+    g_object_unref(iface);
+    return ret;
+}
+
+// Moves a device to its object on another adapter. Must be called with the devices mutex held.
+static bool ble_move_device_to_adapter(struct ble_device *ble_dev, int adapter)
+{
+    char path[MAX_PATH_LENGTH];
+    GDBusProxy *proxy;
+
+    if (!ble_adapters_device_path(path, sizeof(path), ble_dev->dbus_path, adapter)) {
+        return false;
+    }
+    proxy = ble_create_device_proxy(path);
+    if (proxy == NULL) {
+        return false;
+    }
+    tr_info("Moving device %s from %s to %s", ble_dev->attrs.addr, ble_dev->dbus_path, path);
+    ble_scheduler_cancel(ble_dev->dbus_path);
+    if (ble_dev->proxy != NULL) {
+        g_signal_handlers_disconnect_by_func(ble_dev->proxy, G_CALLBACK(ble_properties_changed), NULL);
+        g_object_unref(ble_dev->proxy);
+    }
+    ble_dev->proxy = proxy;
+    devices_set_dbus_path(ble_dev, path);
+    device_mutex_lock(ble_dev);
+    if (ble_dev->services_resolved) {
+        ble_dev->attributes_stale = true;
+    }
+    device_mutex_unlock(ble_dev);
+    return true;
+}
+
+/**
+ * \brief Chooses the adapter a device connects through from the RSSI on each adapter and the
+ *        number of devices each adapter serves, and moves the device there. Devices are assigned
+ *        when they are first connected and again whenever they have to reconnect, which spreads
+ *        them out as the load changes.
+ */
+static void ble_assign_adapter(struct ble_device *ble_dev)
+{
+    int16_t rssi[BLE_ADAPTERS_MAX];
+    int current, chosen, i;
+
+    devices_mutex_lock();
+    if (ble_dev->adapter_assigned) {
+        ble_adapters_release(ble_dev->adapter);
+        ble_dev->adapter_assigned = false;
+    }
+    current = ble_adapters_index_of_path(ble_dev->dbus_path);
+    if (current < 0) {
+        devices_mutex_unlock();
+        return;
+    }
+    chosen = current;
+    if (ble_adapters_count() > 1) {
+        for (i = 0; i < ble_adapters_count(); i++) {
+            rssi[i] = ble_device_rssi_on_adapter(ble_dev, i);
+        }
+        chosen = ble_adapters_choose(rssi);
+        if (chosen < 0 || (chosen != current && !ble_move_device_to_adapter(ble_dev, chosen))) {
+            chosen = current;
+        }
+        tr_debug("Device %s assigned to %s (RSSI %d, %d devices)",
+                 ble_dev->attrs.addr,
+                 ble_adapters_name(chosen),
+                 rssi[chosen],
+                 ble_adapters_load(chosen));
+    }
+    ble_dev->adapter = chosen;
+    ble_dev->adapter_assigned = true;
+    ble_adapters_assign(chosen);
+    devices_mutex_unlock();
+}
+
 
 /**
  * \brief check if device interface
@@ -958,79 +1417,66 @@ static bool ble_identify_device_services(GDBusProxy *device_proxy)
  *         not identified return one of the other values depending on the type of
  *         identified device.
  */
-static ble_device_type ble_identify_device_using_whitelist(GDBusProxy *device_proxy)
+static ble_device_type ble_identify_device_using_whitelist(GDBusProxy *device_proxy, bool *advertiser)
 {
     tr_debug("ble_identify_device_using_whitelist device_proxy: %p", device_proxy);
     assert(G_IS_DBUS_PROXY(device_proxy));
 
     GVariant *name_prop;
-    GVariant *address_prop = NULL;
     ble_device_type ret = BLE_DEVICE_UNKNOWN;
 
     name_prop = g_dbus_proxy_get_cached_property(device_proxy, "Name");
     if (name_prop && g_variant_type_equal(g_variant_get_type(name_prop), G_VARIANT_TYPE_STRING)) {
         const char *name = g_variant_get_string(name_prop, NULL);
         tr_debug("Trying to identify device with name '%s'", name);
-        if (g_config.white_list_entries) {
-            ns_list_foreach_safe(device_conf_entry_t, entry, g_config.white_list_entries)
-            {
-                if (entry->partial_match) {
-                    if (strstr(name, entry->name)) {
-                        ret = BLE_DEVICE_PERSISTENT_GATT_SERVER;
-                        goto out;
-                    }
-                } else {
-                    // Full match needed
-                    if (0 == strcmp(entry->name, name)) {
-                        ret = BLE_DEVICE_PERSISTENT_GATT_SERVER;
-                        goto out;
-                    }
-                }
-            }
+        if (g_config.whitelist && ble_whitelist_match(g_config.whitelist, name)) {
+            ret = BLE_DEVICE_PERSISTENT_GATT_SERVER;
+            *advertiser = ble_whitelist_match_advertiser(g_config.whitelist, name);
         }
     }
-/* TODO / FIXME: whitelist needs to support configuring experimental advertisement only device */
-#if 1 == EXPERIMENTAL_ADVERTISEMENT_SUPPORT_ENABLED
-    // Experimental advertisement only device support
-    address_prop = g_dbus_proxy_get_cached_property(device_proxy, "Address");
-    if (address_prop && g_variant_type_equal(g_variant_get_type(address_prop), G_VARIANT_TYPE_STRING)) {
-        const char *address = g_variant_get_string(address_prop, NULL);
-        tr_debug("Comparing address %s", address);
-        if (strstr(address, "AC:23:3F:23:C7:E3")) {
-            ret = BLE_DEVICE_GAP_ADVERTISEMENT_ONLY;
-            goto out;
-        }
-    }
-#endif
-
-out:
     if (name_prop) {
         g_variant_unref(name_prop);
     }
-    if (address_prop) {
-        g_variant_unref(address_prop);
-    }
 
     return ret;
 }
 
+// Checks if the device advertises sensor values in a supported format.
+static bool ble_identify_device_advertisement(GDBusProxy *device_proxy)
+{
+    GVariant *service_data = g_dbus_proxy_get_cached_property(device_proxy, "ServiceData");
+    GVariant *manufacturer_data = g_dbus_proxy_get_cached_property(device_proxy, "ManufacturerData");
+    bool supported = ble_advertisement_is_supported(service_data, manufacturer_data);
+
+    if (service_data) {
+        g_variant_unref(service_data);
+    }
+    if (manufacturer_data) {
+        g_variant_unref(manufacturer_data);
+    }
+    return supported;
+}
+
 /**
  * \brief check if device should be connected to
  *
  * This function checks if device should be connected to
  *
  * \params a object to check
+ * \params whitelisted set to true if the device matched the whitelist
  *
  */
-static ble_device_type ble_identify_device_type(const char *path)
+static ble_device_type ble_identify_device_type(const char *path, bool *whitelisted)
 {
     GDBusProxy *devProxy;
     ble_device_type device_type = BLE_DEVICE_UNKNOWN;
+    bool advertiser = false;
     GError *err = NULL;
 
     assert(g_config.connection != NULL);
 
     tr_info("--> ble_identify_device_type path: %s", path);
+    *whitelisted = false;
 
     devProxy = g_dbus_proxy_new_sync(g_config.connection,
                                      G_DBUS_CALL_FLAGS_NONE,
@@ -1054,7 +1500,14 @@ static ble_device_type ble_identify_device_type(const char *path)
             goto out;
         }
     }
-    device_type = ble_identify_device_using_whitelist(devProxy);
+    device_type = ble_identify_device_using_whitelist(devProxy, &advertiser);
+    *whitelisted = (device_type != BLE_DEVICE_UNKNOWN);
+    // A whitelisted device stays a GATT server even if it advertises its values, so its
+    // characteristics remain writable, unless its entry has the `advertisement` option.
+    if ((g_config.service_based_discovery || advertiser) && ble_identify_device_advertisement(devProxy)) {
+        tr_info("    identified supported advertisement data");
+        device_type = BLE_DEVICE_GAP_ADVERTISEMENT_ONLY;
+    }
     if (device_type == BLE_DEVICE_UNKNOWN) {
         tr_info("    device not identified");
     } else {
@@ -1067,61 +1520,134 @@ out:
 }
 
 
-static void get_device_address_from_characteristic_path(const char *path, char *char_device_address)
+static int translate_ble_flags(const gchar **flag_strings)
 {
-    /* dbus paths for characteristics are formatted
-       /org/bluez/hciX/dev_XX_XX_XX_XX_XX_XX/serviceXXXX/charXXXX
-       Here we exploit that format to pull the device address directly form the path
-     */
-    char *dev = strstr(path, "dev_");
-    if (NULL == dev) {
-        tr_err("Malformed characteristic path - %s\r\n", path);
-    } else {
-        strncpy(char_device_address, dev + 4, 17);
-        char_device_address[2] =
-            char_device_address[5] =
-            char_device_address[8] =
-            char_device_address[11] =
-            char_device_address[14] = ':';
-        char_device_address[17] = 0;
-    }
+    int flags = 0;
+    int i;
+
+    for (i = 0; flag_strings[i] != NULL; i++) {
+        const gchar *flag = flag_strings[i];
+        if (strstr(flag, "read") != NULL) {
+            flags |= BLE_GATT_PROP_PERM_READ;
+        }
+        if (strstr(flag, "write") != NULL) {
+            flags |= BLE_GATT_PROP_PERM_WRITE;
+        }
+        if (strstr(flag, "notify") != NULL) {
+            flags |= BLE_GATT_PROP_PERM_NOTIFY;
+        }
+        if (strstr(flag, "indicate") != NULL) {
+            flags |= BLE_GATT_PROP_PERM_INDICATE;
+        }
+    }
+    /*TODO: BLE exposes other flags besides read/write/notify/indicate
+      Need to map those properties to LWM2M properties*/
+
+    return flags;
 }
 
-static int translate_ble_flags(gchar *flags_str)
+static bool ble_characteristic_can_notify(const struct ble_gatt_char *ch)
 {
-    int flags = 0;
+    return (ch->properties & (BLE_GATT_PROP_PERM_NOTIFY | BLE_GATT_PROP_PERM_INDICATE)) != 0;
+}
 
-    if (strstr(flags_str, "read") != NULL) {
-        flags |= BLE_GATT_PROP_PERM_READ;
-    }
-    if (strstr(flags_str, "write") != NULL) {
-        flags |= BLE_GATT_PROP_PERM_WRITE;
+/**
+ * \brief Updates the translated and the raw resources from the value stored in the characteristic.
+ *        Called in the publisher thread with the device mutex held.
+ */
+static void ble_publish_characteristic_value(struct ble_device *ble, int srvc, int ch)
+{
+    struct ble_gatt_service *gattservice = &(ble->attrs.services[srvc]);
+    struct ble_gatt_char *gattchar = &(gattservice->chars[ch]);
+    uint8_t swapped[sizeof(uint64_t)];
+    const uint8_t *value = gattchar->value;
+
+    if (gattchar->descriptor != NULL) {
+        ble_services_decode_and_write_characteristic_translation(ble, srvc, ch, gattchar->value, gattchar->value_length);
     }
-    if (strstr(flags_str, "notify") != NULL) {
-        flags |= BLE_GATT_PROP_PERM_NOTIFY;
+
+    // TODO: endian conversions for other size integers and floats
+    // The stored value stays in device byte order, only the published copy is converted.
+    if (gattchar->dtype == BLE_INTEGER && gattchar->value_length == gattchar->value_size) {
+        switch (gattchar->value_size) {
+        case 2:
+        {
+            uint16_t u16;
+            memcpy(&u16, gattchar->value, sizeof(u16));
+            u16 = htons(u16);
+            memcpy(swapped, &u16, sizeof(u16));
+            value = swapped;
+        }
+        break;
+        case 4:
+        {
+            uint32_t u32;
+            memcpy(&u32, gattchar->value, sizeof(u32));
+            u32 = htonl(u32);
+            memcpy(swapped, &u32, sizeof(u32));
+            value = swapped;
+        }
+        break;
+        case 8:
+        default:
+            break;
+        }
     }
-    /*TODO: BLE exposes other flags besides read/write (e.g. 'indicate')
-      Need to map those properties to LWM2M properties*/
 
-    return flags;
+    // Inform Edge PT of resource value change
+    device_update_characteristic_resource_value(ble, srvc, ch, value, gattchar->value_length);
 }
 
-static int object_on_adapter(const char *objpath, const char *adapter)
+/**
+ * \brief Marks a new characteristic value received from the device. Notifications and reads can
+ *        arrive many times per poll interval, so decoding and the resource updates are deferred to
+ *        the poll tick, which publishes only the latest value of each characteristic.
+ *        Must be called with the device mutex held.
+ */
+static void ble_characteristic_value_updated(struct ble_device *ble, int srvc, int ch)
 {
-    char adapter_path[32];
-    snprintf(adapter_path, sizeof(adapter_path), "/org/bluez/%s/", adapter);
-    return (0 == strncmp(objpath, adapter_path, strlen(adapter_path)));
+    ble->attrs.services[srvc].chars[ch].value_dirty = true;
+    ble->values_dirty = true;
+    ble_scheduler_first_value(ble->dbus_path);
 }
 
-#if 1 == EXPERIMENTAL_NOTIFY_CHARACTERISTIC_SUPPORT
 static void ble_characteristic_properties_changed(GDBusProxy *proxy,
                                                   GVariant *changed_properties,
                                                   GStrv invalidated_properties,
                                                   gpointer user_data)
 {
-    tr_debug("Characteristic properties changed proxy: %p", proxy);
-    tr_debug("Characteristic: %s", g_dbus_proxy_get_object_path(proxy));
-    // TODO: Update translated resource values for this characteristic
+    const gchar *path = g_dbus_proxy_get_object_path(proxy);
+    const struct ble_char_handle *handle = user_data;
+    struct ble_gatt_char *gattchar;
+    gboolean notifying;
+    GVariant *value;
+
+    (void)invalidated_properties;
+
+    gattchar = device_char_handle_lock(handle);
+    if (gattchar == NULL) {
+        tr_debug("Properties changed for stale characteristic %s", path);
+        return;
+    }
+
+    if (g_variant_lookup(changed_properties, "Notifying", "b", &notifying)) {
+        tr_debug("    %s: Notifying -> %d", path, notifying);
+        gattchar->notifying = notifying;
+    }
+
+    // BlueZ also updates the Value property after ReadValue. Those results are handled in the read callback.
+    value = g_variant_lookup_value(changed_properties, "Value", G_VARIANT_TYPE_BYTESTRING);
+    if (value != NULL) {
+        if (gattchar->notifying) {
+            gsize size = 0;
+            const uint8_t *data = g_variant_get_fixed_array(value, &size, sizeof(uint8_t));
+            device_store_characteristic_value(gattchar, data, size);
+            ble_characteristic_value_updated(handle->device, handle->srvc, handle->ch);
+            tr_debug("    Notified value for characteristic %s", path);
+        }
+        g_variant_unref(value);
+    }
+    device_mutex_unlock(handle->device);
 }
 
 static void ble_start_notify_done(GObject *source_object, GAsyncResult *res, gpointer user_data)
@@ -1138,305 +1664,548 @@ static void ble_start_notify_done(GObject *source_object, GAsyncResult *res, gpo
 
     ret = g_dbus_proxy_call_finish(proxy, res, &err);
     if (err == NULL) {
-        gchar *ret_string = g_variant_print(ret, TRUE);
-        if (ret_string != NULL) {
-            tr_debug("    ble_start_notify_done: StartNotify returned %s", ret_string);
-            g_free(ret_string);
-        }
-        if (ret != NULL) {
-            g_variant_unref(ret);
-        }
+        g_variant_unref(ret);
     } else {
         assert(ret == NULL);
+        // The characteristic stays on its poll schedule until the Notifying property turns true.
+        tr_warn("StartNotify failed for %s: %s (%d)", g_dbus_proxy_get_object_path(proxy), err->message, err->code);
+        g_clear_error(&err);
     }
     tr_debug("<-- ble_start_notify_done");
 }
 
-void ble_characteristic_stop_notify_proxy(const struct ble_gatt_char *ch)
+void ble_characteristic_stop_notify_proxy(struct ble_gatt_char *ch)
 {
     assert(ch != NULL);
-    assert(G_IS_DBUS_PROXY(ch->proxy));
-
-    // Configure properties changed signal for getting value notifications from notify characteristics
-    if (ch->properties & BLE_GATT_PROP_PERM_NOTIFY) {
-        tr_debug("Start notify proxy for path %s", ch->dbus_path);
 
-        GError *err = NULL;
-        // Start the notify operations
-        g_dbus_proxy_call_sync(ch->proxy,
-                               "StopNotify",
-                               NULL,
-                               G_DBUS_CALL_FLAGS_NONE,
-                               -1,
-                               NULL,
-                               &err);
-        g_object_unref(ch->proxy);
+    if (ch->proxy == NULL) {
+        return;
     }
-}
-
-static void ble_characteristic_start_notify_proxy(const struct ble_gatt_char *ch)
-{
-    assert(ch != NULL);
     assert(G_IS_DBUS_PROXY(ch->proxy));
 
-    // Configure properties changed signal for getting value notifications from notify characteristics
-    if (ch->properties & BLE_GATT_PROP_PERM_NOTIFY) {
-        tr_debug("Start notify proxy for dbus_path: %s", ch->dbus_path);
-
-        (void)g_signal_connect(ch->proxy,
-                               "g-properties-changed",
-                               G_CALLBACK(ble_characteristic_properties_changed),
-                               NULL);
-
-        // Start the notify operations
+    if (ch->notify_handler_id != 0) {
+        g_signal_handler_disconnect(ch->proxy, ch->notify_handler_id);
+        ch->notify_handler_id = 0;
+    }
+    if (ch->notifying) {
+        tr_debug("Stop notify proxy for dbus_path: %s", ch->dbus_path);
+        // Nobody waits for the result, BlueZ also ends the session when the device disconnects.
         g_dbus_proxy_call(ch->proxy,
-                          "StartNotify",
+                          "StopNotify",
                           NULL,
                           G_DBUS_CALL_FLAGS_NONE,
                           -1,
                           NULL,
-                          ble_start_notify_done,
+                          NULL,
                           NULL);
+        ch->notifying = false;
     }
 }
-#endif // EXPERIMENTAL_NOTIFY_CHARACTERISTIC_SUPPORT
 
-static void process_characteristic_object(GDBusObject *obj, struct ble_device *ble_dev, const char *adapter)
+static void ble_characteristic_start_notify_proxy(struct ble_device *ble, int srvc, int chidx)
 {
+    struct ble_gatt_char *ch = &(ble->attrs.services[srvc].chars[chidx]);
 
-    GError *err = NULL;
-    const gchar *path = NULL;
-    gchar service_path[4096];
-    GDBusProxy *proxy;
-    GDBusProxy *service_proxy = NULL;
-    char *quoted;
-
-    int char_flags = 0;
-    char char_uuid[FORMATTED_UUID_LEN + 1];
-    char srvc_uuid[FORMATTED_UUID_LEN + 1];
-    bool has_uuid = false;
+    if (ch->proxy == NULL || !ble_characteristic_can_notify(ch) || ch->notifying) {
+        return;
+    }
+    assert(G_IS_DBUS_PROXY(ch->proxy));
+    tr_debug("Start notify proxy for dbus_path: %s", ch->dbus_path);
 
-    path = g_dbus_object_get_object_path(obj);
-    if ((NULL != path) && object_on_adapter(path, adapter)) {
+    // Configure properties changed signal for getting value notifications from notify characteristics
+    // The handler resolves the characteristic through a handle instead of searching by dbus path.
+    if (ch->notify_handler_id == 0) {
+        struct ble_char_handle *handle = device_char_handle_new(ble, srvc, chidx);
+        if (handle == NULL) {
+            tr_err("Could not allocate notify handle for %s", ch->dbus_path);
+            return;
+        }
+        ch->notify_handler_id = g_signal_connect_data(ch->proxy,
+                                                      "g-properties-changed",
+                                                      G_CALLBACK(ble_characteristic_properties_changed),
+                                                      handle,
+                                                      (GClosureNotify) device_char_handle_free,
+                                                      0);
+    }
 
-        assert(g_config.connection != NULL);
-        proxy = g_dbus_proxy_new_sync(g_config.connection,
-                                              G_DBUS_CALL_FLAGS_NONE,
-                                              NULL,
-                                              BLUEZ_NAME,
-                                              path,
-                                              GATT_CHARACTERISTIC_IFACE,
-                                              NULL,
-                                              &err);
-        if (!G_IS_DBUS_PROXY(proxy)) {
-            tr_err("Characteristic at dbus path %s, not available: %s", path, err->message);
-            g_clear_error(&err);
-        } else {
-            gchar **property_names;
-            guint n;
-            const gchar *key;
-            GVariant *value;
-            gchar *value_str;
-            char char_device_address[BLE_DEVICE_NAME_MAX_LENGTH];
-
-            get_device_address_from_characteristic_path(path, char_device_address);
-            if (0 == strcmp(char_device_address, ble_dev->attrs.addr)) {
-                tr_info("adding characteristic at path [%s] to ble device [%s]",
-                        path, ble_dev->attrs.addr);
-                property_names = g_dbus_proxy_get_cached_property_names(proxy);
-                for (n = 0; property_names != NULL && property_names[n] != NULL; n++) {
-                    key = property_names[n];
-                    value = g_dbus_proxy_get_cached_property(proxy, key);
-                    value_str = g_variant_print(value, TRUE);
-                    if (0 == strcmp(key, "Flags")) {
-                        char_flags = translate_ble_flags(value_str);
-                    } else if (0 == strcmp(key, "UUID")) {
-                        quoted = strtok(value_str, "'");
-                        strncpy(char_uuid, quoted, sizeof char_uuid);
-                        char_uuid[FORMATTED_UUID_LEN] = 0;
-                        has_uuid = true;
-                    } else if (0 == strcmp(key, "Service")) {
-                        quoted = strtok(value_str, "'");
-                        quoted = strtok(NULL, "'");
-                        strncpy(service_path, quoted, sizeof service_path);
-                        service_path[4095] = 0;
-
-                    } else {
-                        tr_debug("property of ble characteristic [%s -> %s] will not be part of LWM2M resource",
-                                 key, value_str);
-                    }
-
-                    g_variant_unref(value);
-                    g_free(value_str);
-                }
-                g_strfreev(property_names);
+    // Start the notify operations
+    g_dbus_proxy_call(ch->proxy,
+                      "StartNotify",
+                      NULL,
+                      G_DBUS_CALL_FLAGS_NONE,
+                      -1,
+                      NULL,
+                      ble_start_notify_done,
+                      NULL);
+}
 
+// Starts notify sessions for every characteristic of the device that supports it.
+// BlueZ ends the sessions on disconnect, so this is done again after each reconnection.
+static void ble_start_notifications_for_device(struct ble_device *ble_dev)
+{
+    int srvc, ch;
 
-                /* In the event we cannot extract the service uuid, we will store this characteristic
-                   locally under a default service with uuid ffffffff-ffff-ffff-ffff-ffffffffffff*/
-                strncpy(srvc_uuid, "ffffffff-ffff-ffff-ffff-ffffffffffff", sizeof srvc_uuid);
-                assert(g_config.connection != NULL);
-                service_proxy = g_dbus_proxy_new_sync(g_config.connection,
-                                                              G_DBUS_CALL_FLAGS_NONE,
-                                                              NULL,
-                                                              BLUEZ_NAME,
-                                                              service_path,
-                                                              GATT_SERVICE_IFACE,
-                                                              NULL,
-                                                              &err);
-                if (!G_IS_DBUS_PROXY(service_proxy)) {
-                    tr_err("Unable to create proxy for serice %s: %s", service_path, err->message);
-                    g_clear_error(&err);
-                } else {
-                    property_names = g_dbus_proxy_get_cached_property_names(service_proxy);
-                    for (n = 0; property_names != NULL && property_names[n] != NULL; n++) {
-                        key = property_names[n];
-                        value = g_dbus_proxy_get_cached_property(service_proxy, key);
-                        value_str = g_variant_print(value, TRUE);
-                        if (0 == strcmp(key, "UUID")) {
-                            quoted = strtok(value_str, "'");
-                            strncpy(srvc_uuid, quoted, sizeof srvc_uuid);
-                            srvc_uuid[FORMATTED_UUID_LEN] = 0;
-                        } else {
-                            tr_debug("service property  %s -> %s", key, value_str);
-                        }
-                        g_variant_unref(value);
-                        g_free(value_str);
-                    }
-                    g_strfreev(property_names);
-                    g_object_unref(service_proxy);
-                }
-            } /* else {
-                tr_debug("characteristic [%s] belongs to device [%s] - not device [%s]",
-                        path, char_device_address, ble_dev->attrs.addr);
-            } */
+    device_mutex_lock(ble_dev);
+    for (srvc = 0; srvc < ble_dev->attrs.services_count; srvc++) {
+        struct ble_gatt_service *gattservice = &(ble_dev->attrs.services[srvc]);
+        for (ch = 0; ch < gattservice->chars_count; ch++) {
+            ble_characteristic_start_notify_proxy(ble_dev, srvc, ch);
         }
+    }
+    device_mutex_unlock(ble_dev);
+}
 
-        if (has_uuid) {
-            struct ble_gatt_char *ch;
-
-            ch = device_add_gatt_characteristic(ble_dev,
-                                                srvc_uuid,
-                                                service_path,
-                                                char_uuid,
-                                                path,
-                                                char_flags,
-                                                proxy);
+// Forgets the notify sessions and schedules a fresh read of every characteristic after reconnecting.
+static void ble_reset_characteristics_for_device(struct ble_device *ble_dev)
+{
+    int srvc, ch;
 
-            if (ch == NULL) {
-                tr_error("Failed to add gatt characteristic for %s, out of memory?", path);
-            }
-#if 1 == EXPERIMENTAL_NOTIFY_CHARACTERISTIC_SUPPORT
-            else {
-                ble_characteristic_start_notify_proxy(ch);
-            }
-#endif // EXPERIMENTAL_NOTIFY_CHARACTERISTIC_SUPPORT
+    device_mutex_lock(ble_dev);
+    for (srvc = 0; srvc < ble_dev->attrs.services_count; srvc++) {
+        struct ble_gatt_service *gattservice = &(ble_dev->attrs.services[srvc]);
+        for (ch = 0; ch < gattservice->chars_count; ch++) {
+            gattservice->chars[ch].notifying = false;
+            gattservice->chars[ch].next_poll_time = 0;
         }
     }
+    device_mutex_unlock(ble_dev);
 }
 
-static bool ble_is_characteristic(GDBusObject *maybe_characteristic)
+// A characteristic found below the device in the GetManagedObjects reply.
+struct ble_discovered_characteristic {
+    gchar *path;
+    gchar *uuid;
+    gchar *service_path;
+    int flags;
+};
+
+static void ble_discovered_characteristic_clear(gpointer data)
 {
-    GDBusInterface *interface;
-    bool ret = false;
+    struct ble_discovered_characteristic *discovered = data;
+    g_free(discovered->path);
+    g_free(discovered->uuid);
+    g_free(discovered->service_path);
+}
 
-    interface = g_dbus_object_get_interface(
-            (GDBusObject *)maybe_characteristic,
-            GATT_CHARACTERISTIC_IFACE);
-    ret = (interface != NULL);
-    if (interface != NULL) {
-        g_object_unref(interface);
+static gint ble_discovered_characteristic_compare(gconstpointer a, gconstpointer b)
+{
+    const struct ble_discovered_characteristic *lhs = a;
+    const struct ble_discovered_characteristic *rhs = b;
+    return strcmp(lhs->path, rhs->path);
+}
+
+// Returns the UUID of a GATT interface property dictionary or NULL. The string is owned by the caller.
+static gchar *ble_dup_uuid_property(GVariant *properties)
+{
+    const gchar *uuid = NULL;
+    if (!g_variant_lookup(properties, "UUID", "&s", &uuid) || strlen(uuid) != FORMATTED_UUID_LEN) {
+        return NULL;
     }
+    return g_strdup(uuid);
+}
 
-    return ret;
+static void ble_gatt_discovery_init(struct ble_gatt_discovery *discovery)
+{
+    discovery->infos = NULL;
+    discovery->count = 0;
+    discovery->strings = g_ptr_array_new_with_free_func(g_free);
 }
 
-static void ble_handle_characteristic(gpointer data, gpointer user_data)
+// Keeps a string until the discovery is cleared and returns the kept copy.
+static const char *ble_gatt_discovery_keep(struct ble_gatt_discovery *discovery, gchar *string)
 {
-    GDBusObject *object = data;
-    struct ble_device *ble_dev = user_data;
+    g_ptr_array_add(discovery->strings, string);
+    return string;
+}
 
-    assert(object != NULL);
-    assert(ble_dev != NULL);
-    assert(G_IS_OBJECT(object));
+// Releases the proxies that were not taken by the device and the strings.
+static void ble_gatt_discovery_clear(struct ble_gatt_discovery *discovery)
+{
+    int i;
+    for (i = 0; i < discovery->count; i++) {
+        if (discovery->infos[i].proxy != NULL) {
+            g_object_unref(discovery->infos[i].proxy);
+        }
+    }
+    free(discovery->infos);
+    discovery->infos = NULL;
+    discovery->count = 0;
+    g_ptr_array_free(discovery->strings, TRUE);
+    discovery->strings = NULL;
+}
 
-    // TODO: Filter devices based on service/char UUID.
-    if (ble_is_characteristic(object)) {
-        process_characteristic_object(
-                object,
-                ble_dev,
-                g_config.adapter);
+/**
+ * \brief Replaces the attributes of the device with the discovered characteristics.
+ *        On success the device owns the proxies. Must be called with the device mutex held.
+ */
+static bool ble_gatt_discovery_apply(struct ble_device *ble_dev, struct ble_gatt_discovery *discovery)
+{
+    int i;
+    if (discovery->infos == NULL || device_set_gatt_characteristics(ble_dev, discovery->infos, discovery->count) != 0) {
+        tr_error("Failed to add gatt characteristics of %s, out of memory?", ble_dev->attrs.addr);
+        return false;
     }
+    for (i = 0; i < discovery->count; i++) {
+        discovery->infos[i].proxy = NULL;
+    }
+    return true;
 }
 
-static void ble_discover_characteristics(struct ble_device *ble_dev)
+/**
+ * \brief Collects the characteristics of a device from a single GetManagedObjects call.
+ *
+ *        The properties are read from the reply with their D-Bus types. The UUID of each service
+ *        is resolved once from the same reply, so no proxy is created for the services.
+ *        Characteristics are added in object path order, which is the handle order, so the
+ *        resource ids do not depend on the order BlueZ returns the objects in.
+ *        The device is not touched, so this is called without the device mutex.
+ */
+static bool ble_discover_characteristics(const char *dbus_path, const char *addr, struct ble_gatt_discovery *discovery)
 {
-    GError *err;
-    GList *objects = NULL;
+    GError *err = NULL;
+    GVariant *ret;
+    GVariantIter *objects = NULL;
+    const gchar *object_path;
+    GVariant *interfaces;
+    size_t device_path_length = strlen(dbus_path);
+    guint i;
 
-    tr_debug("--> BLE discover characteristics device_id: '%s'", ble_dev->device_id);
-    err = NULL;
+    tr_debug("--> BLE discover characteristics path: '%s'", dbus_path);
     assert(g_config.connection != NULL);
-    GDBusObjectManager *bluez_manager = g_dbus_object_manager_client_new_sync(
-                g_config.connection,
-                G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
-                BLUEZ_NAME,
-                "/",
-                NULL,
-                NULL,
-                NULL,
-                NULL,
-                &err);
-    if (bluez_manager == NULL) {
-        tr_error("Couldn't get object manager to discover characteristics!");
+    ret = g_dbus_connection_call_sync(g_config.connection,
+                                      BLUEZ_NAME,
+                                      "/",
+                                      OBJECT_MANAGER_IFACE,
+                                      "GetManagedObjects",
+                                      NULL,
+                                      G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
+                                      G_DBUS_CALL_FLAGS_NONE,
+                                      -1,
+                                      NULL,
+                                      &err);
+    if (ret == NULL) {
+        tr_error("Couldn't get managed objects to discover characteristics!");
         tr_error("%d %s", err->code, err->message);
-        goto out;
+        g_clear_error(&err);
+        return false;
     }
 
-    objects = g_dbus_object_manager_get_objects(bluez_manager);
-    if (NULL == objects) {
-        tr_err("Manager did not give us objects!");
-        tr_error("%d %s", err->code, err->message);
+    // Service object path -> service UUID
+    GHashTable *service_uuids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    GArray *characteristics = g_array_new(FALSE, FALSE, sizeof(struct ble_discovered_characteristic));
+    g_array_set_clear_func(characteristics, ble_discovered_characteristic_clear);
+
+    g_variant_get(ret, "(a{oa{sa{sv}}})", &objects);
+    while (g_variant_iter_next(objects, "{&o@a{sa{sv}}}", &object_path, &interfaces)) {
+        if (strncmp(object_path, dbus_path, device_path_length) == 0 &&
+            object_path[device_path_length] == '/') {
+            GVariant *properties = g_variant_lookup_value(interfaces, GATT_SERVICE_IFACE, G_VARIANT_TYPE_VARDICT);
+            if (properties != NULL) {
+                gchar *uuid = ble_dup_uuid_property(properties);
+                if (uuid != NULL) {
+                    g_hash_table_insert(service_uuids, g_strdup(object_path), uuid);
+                }
+                g_variant_unref(properties);
+            }
+            properties = g_variant_lookup_value(interfaces, GATT_CHARACTERISTIC_IFACE, G_VARIANT_TYPE_VARDICT);
+            if (properties != NULL) {
+                struct ble_discovered_characteristic discovered = {0};
+                const gchar *service_path = NULL;
+                GVariant *flags = g_variant_lookup_value(properties, "Flags", G_VARIANT_TYPE_STRING_ARRAY);
+                discovered.uuid = ble_dup_uuid_property(properties);
+                if (flags != NULL) {
+                    const gchar **flag_strings = g_variant_get_strv(flags, NULL);
+                    discovered.flags = translate_ble_flags(flag_strings);
+                    g_free(flag_strings);
+                    g_variant_unref(flags);
+                }
+                if (discovered.uuid != NULL && g_variant_lookup(properties, "Service", "&o", &service_path)) {
+                    discovered.path = g_strdup(object_path);
+                    discovered.service_path = g_strdup(service_path);
+                    g_array_append_val(characteristics, discovered);
+                } else {
+                    tr_warn("Characteristic %s has no UUID or service, ignoring it.", object_path);
+                    g_free(discovered.uuid);
+                }
+                g_variant_unref(properties);
+            }
+        }
+        g_variant_unref(interfaces);
+    }
+    g_variant_iter_free(objects);
+
+    g_array_sort(characteristics, ble_discovered_characteristic_compare);
+    discovery->infos = calloc(characteristics->len > 0 ? characteristics->len : 1,
+                              sizeof(struct ble_gatt_char_info));
+    for (i = 0; discovery->infos != NULL && i < characteristics->len; i++) {
+        struct ble_discovered_characteristic *discovered =
+                &g_array_index(characteristics, struct ble_discovered_characteristic, i);
+        struct ble_gatt_char_info *info = &discovery->infos[discovery->count];
+        /* In the event we cannot resolve the service uuid, we will store this characteristic
+           locally under a default service with uuid ffffffff-ffff-ffff-ffff-ffffffffffff*/
+        const gchar *srvc_uuid = g_hash_table_lookup(service_uuids, discovered->service_path);
+        if (srvc_uuid == NULL) {
+            srvc_uuid = "ffffffff-ffff-ffff-ffff-ffffffffffff";
+        }
+
+        GDBusProxy *proxy = ble_characteristic_proxy_get(discovered->path, &err);
+        if (proxy == NULL) {
+            tr_err("Characteristic at dbus path %s, not available: %s", discovered->path, err->message);
+            g_clear_error(&err);
+            continue;
+        }
+        tr_info("adding characteristic at path [%s] to ble device [%s]", discovered->path, addr);
+        // The discovered strings move to the discovery, the array must not free them.
+        info->srvc_uuid = ble_gatt_discovery_keep(discovery, g_strdup(srvc_uuid));
+        info->srvc_dbus_path = ble_gatt_discovery_keep(discovery, discovered->service_path);
+        info->char_uuid = ble_gatt_discovery_keep(discovery, discovered->uuid);
+        info->char_dbus_path = ble_gatt_discovery_keep(discovery, discovered->path);
+        discovered->service_path = NULL;
+        discovered->uuid = NULL;
+        discovered->path = NULL;
+        info->properties = discovered->flags;
+        info->proxy = proxy;
+        discovery->count++;
+    }
+
+    g_array_free(characteristics, TRUE);
+    g_hash_table_destroy(service_uuids);
+    g_variant_unref(ret);
+    tr_debug("<-- ble_discover_characteristics");
+    return discovery->infos != NULL;
+}
+
+// Checks that a characteristic object has the expected UUID.
+static bool ble_characteristic_has_uuid(GDBusProxy *proxy, const char *char_uuid)
+{
+    bool ret = false;
+    GVariant *uuid = g_dbus_proxy_get_cached_property(proxy, "UUID");
+    if (uuid != NULL) {
+        ret = g_variant_is_of_type(uuid, G_VARIANT_TYPE_STRING) &&
+              strcasecmp(g_variant_get_string(uuid, NULL), char_uuid) == 0;
+        g_variant_unref(uuid);
+    }
+    return ret;
+}
+
+// Checks that the characteristic object behind a cached entry still has the cached UUID.
+static bool ble_cached_characteristic_is_valid(GDBusProxy *proxy, const struct ble_gatt_cache_entry *entry)
+{
+    return ble_characteristic_has_uuid(proxy, entry->char_uuid);
+}
+
+/**
+ * \brief Collects the characteristics of a device from the GATT cache instead of enumerating all
+ *        BlueZ objects and creating a service proxy for each characteristic.
+ *        If any cached characteristic is missing or changed, the cache is invalidated and
+ *        nothing is collected. The device is not touched, so this is called without the device
+ *        mutex.
+ *
+ * \return true if the characteristics were collected from the cache.
+ */
+static bool ble_load_characteristics_from_cache(const char *dbus_path,
+                                                const char *addr,
+                                                struct ble_gatt_discovery *discovery)
+{
+    int count = 0;
+    int i;
+    bool valid = true;
+    struct ble_gatt_cache_entry *entries = ble_gatt_cache_load(addr, &count);
+    if (entries == NULL) {
+        return false;
+    }
+
+    discovery->infos = calloc(count, sizeof(struct ble_gatt_char_info));
+    if (discovery->infos == NULL) {
+        valid = false;
         goto out;
     }
+    for (i = 0; i < count && valid; i++) {
+        struct ble_gatt_char_info *info = &discovery->infos[i];
+        GError *err = NULL;
 
-    g_list_foreach(objects, ble_handle_characteristic, ble_dev);
+        info->char_dbus_path = ble_gatt_discovery_keep(discovery, g_strconcat(dbus_path, entries[i].char_path, NULL));
+        info->proxy = ble_characteristic_proxy_get(info->char_dbus_path, &err);
+        discovery->count++;
+        if (info->proxy == NULL || !ble_cached_characteristic_is_valid(info->proxy, &entries[i])) {
+            tr_info("Cached characteristic %s of %s changed.", info->char_dbus_path, addr);
+            ble_characteristic_proxy_cache_invalidate(info->char_dbus_path);
+            valid = false;
+        }
+        g_clear_error(&err);
+        info->srvc_uuid = ble_gatt_discovery_keep(discovery, g_strdup(entries[i].srvc_uuid));
+        info->srvc_dbus_path = ble_gatt_discovery_keep(discovery, g_strconcat(dbus_path, entries[i].srvc_path, NULL));
+        info->char_uuid = ble_gatt_discovery_keep(discovery, g_strdup(entries[i].char_uuid));
+        info->properties = entries[i].properties;
+        info->handle = entries[i].handle;
+    }
+    if (!valid) {
+        ble_gatt_cache_invalidate(addr);
+    } else {
+        tr_info("Adding %d characteristics of %s from the GATT cache", count, addr);
+    }
 
 out:
-    if (err != NULL) {
-        g_clear_error(&err);
+    ble_gatt_cache_entries_free(entries, count);
+    return valid;
+}
+
+// A characteristic of a device that moved to another adapter, copied before the attributes are rebuilt.
+struct ble_rebound_characteristic {
+    char srvc_uuid[FORMATTED_UUID_LEN + 1];
+    char char_uuid[FORMATTED_UUID_LEN + 1];
+    gchar *srvc_path;
+    gchar *char_path;
+    int properties;
+    uint16_t handle;
+    GDBusProxy *proxy;
+};
+
+/**
+ * \brief Points the characteristics of a device that moved to another adapter to the objects
+ *        below the new adapter. The characteristics keep their order, so the resources and
+ *        translations of the device stay valid. If a characteristic is missing on the new adapter,
+ *        the attributes are left as they are and the GATT cache is invalidated.
+ *        Called in the BLE event loop, the device mutex is taken only to swap the attributes.
+ */
+static void ble_rebind_characteristics(struct ble_device *ble_dev)
+{
+    struct ble_rebound_characteristic *chars;
+    struct ble_gatt_char_info *infos = NULL;
+    int count = 0;
+    int i = 0;
+    int srvc, ch;
+    bool valid = true;
+
+    ble_dev->attributes_stale = false;
+    for (srvc = 0; srvc < ble_dev->attrs.services_count; srvc++) {
+        count += ble_dev->attrs.services[srvc].chars_count;
     }
-    if (objects != NULL) {
-        g_list_free_full(objects, g_object_unref);
+    if (count == 0) {
+        return;
     }
-    if (bluez_manager != NULL) {
-        g_object_unref(bluez_manager);
+    chars = calloc(count, sizeof(struct ble_rebound_characteristic));
+    if (chars == NULL) {
+        tr_err("Could not allocate memory to move the characteristics of %s", ble_dev->attrs.addr);
+        return;
     }
+    for (srvc = 0; srvc < ble_dev->attrs.services_count && valid; srvc++) {
+        const struct ble_gatt_service *service = &ble_dev->attrs.services[srvc];
+        for (ch = 0; ch < service->chars_count && valid; ch++, i++) {
+            const struct ble_gatt_char *c = &service->chars[ch];
+            const char *srvc_suffix = strstr(service->dbus_path, "/service");
+            const char *char_suffix = strstr(c->dbus_path, "/service");
+            GError *err = NULL;
 
-    tr_debug("<-- ble_discover_characteristics");
+            if (srvc_suffix == NULL || char_suffix == NULL) {
+                valid = false;
+                break;
+            }
+            strncpy(chars[i].srvc_uuid, service->uuid, FORMATTED_UUID_LEN);
+            strncpy(chars[i].char_uuid, c->uuid, FORMATTED_UUID_LEN);
+            chars[i].srvc_path = g_strconcat(ble_dev->dbus_path, srvc_suffix, NULL);
+            chars[i].char_path = g_strconcat(ble_dev->dbus_path, char_suffix, NULL);
+            chars[i].properties = c->properties;
+            chars[i].handle = c->handle;
+            chars[i].proxy = ble_characteristic_proxy_get(chars[i].char_path, &err);
+            if (chars[i].proxy == NULL || !ble_characteristic_has_uuid(chars[i].proxy, chars[i].char_uuid)) {
+                tr_warn("Characteristic %s of %s is not available on the new adapter.",
+                        chars[i].char_path,
+                        ble_dev->attrs.addr);
+                ble_characteristic_proxy_cache_invalidate(chars[i].char_path);
+                valid = false;
+            }
+            g_clear_error(&err);
+        }
+    }
+    if (!valid) {
+        tr_err("Services of %s differ on the new adapter, the previous characteristics are kept.",
+               ble_dev->attrs.addr);
+        ble_gatt_cache_invalidate(ble_dev->attrs.addr);
+        goto out;
+    }
+
+    infos = calloc(count, sizeof(struct ble_gatt_char_info));
+    for (i = 0; infos != NULL && i < count; i++) {
+        infos[i].srvc_uuid = chars[i].srvc_uuid;
+        infos[i].srvc_dbus_path = chars[i].srvc_path;
+        infos[i].char_uuid = chars[i].char_uuid;
+        infos[i].char_dbus_path = chars[i].char_path;
+        infos[i].properties = chars[i].properties;
+        infos[i].handle = chars[i].handle;
+        infos[i].proxy = chars[i].proxy;
+    }
+    device_mutex_lock(ble_dev);
+    if (infos == NULL || device_set_gatt_characteristics(ble_dev, infos, count) != 0) {
+        device_mutex_unlock(ble_dev);
+        tr_error("Failed to move the characteristics of %s, out of memory?", ble_dev->attrs.addr);
+        goto out;
+    }
+    ble_services_build_translation_index(ble_dev);
+    device_mutex_unlock(ble_dev);
+    // The device owns the proxies now.
+    for (i = 0; i < count; i++) {
+        chars[i].proxy = NULL;
+    }
+    tr_info("Moved %d characteristics of %s to %s", count, ble_dev->attrs.addr, ble_dev->dbus_path);
+
+out:
+    free(infos);
+    for (i = 0; i < count; i++) {
+        if (chars[i].proxy != NULL) {
+            g_object_unref(chars[i].proxy);
+        }
+        g_free(chars[i].srvc_path);
+        g_free(chars[i].char_path);
+    }
+    free(chars);
 }
 
-static void ble_new_device(const char *dbus_path)
+/**
+ * \brief Handles a device object found on the adapter.
+ *
+ * \param dbus_path Object path of the device.
+ * \param known True if BlueZ already knew the device when the translator started. Known and
+ *        whitelisted devices are connected before devices that were found by scanning.
+ */
+static void ble_new_device(const char *dbus_path, bool known)
 {
     tr_info("Discovered device dbus_path: '%s'\n", dbus_path);
 
+    if (ble_adapters_index_of_path(dbus_path) < 0) {
+        tr_debug("Ignoring %s due to not being on an adapter in use.", dbus_path);
+        return;
+    }
     if (global_keep_running) {
         ble_device_type device_type;
-        device_type = ble_identify_device_type(dbus_path);
+        bool whitelisted;
+        device_type = ble_identify_device_type(dbus_path, &whitelisted);
 
         if (device_type != BLE_DEVICE_UNKNOWN) {
             // Create proxy for all device types that are known
             GDBusProxy *proxy = ble_create_device_proxy(dbus_path);
-            ble_create_device_context(proxy, device_type);
+            struct ble_device *ble = ble_create_device_context(proxy, device_type);
+            if (ble != NULL && strcmp(ble->dbus_path, dbus_path) != 0) {
+                // Another adapter sees the device too, it keeps the adapter it was assigned to.
+                tr_debug("    device is tracked through %s", ble->dbus_path);
+                g_object_unref(proxy);
+                return;
+            }
             if (device_type == BLE_DEVICE_PERSISTENT_GATT_SERVER) {
                 tr_info("    device type is persistent GATT server");
-                ble_proxy_connect(proxy);
+                if (ble != NULL && !ble->adapter_assigned) {
+                    ble_assign_adapter(ble);
+                    proxy = ble->proxy;
+                }
+                ble_scheduler_request_connect(proxy,
+                                              (known || whitelisted) ? BLE_SCHEDULER_PRIORITY_HIGH :
+                                                                       BLE_SCHEDULER_PRIORITY_NORMAL);
             }
-#if 1 == EXPERIMENTAL_ADVERTISEMENT_SUPPORT_ENABLED
             else if (device_type == BLE_DEVICE_GAP_ADVERTISEMENT_ONLY) {
                 tr_info("    device type is GAP advertisement only");
+                // The values are read from the advertisements, the device is never connected.
+                ble_handle_advertisement(proxy);
             }
-#endif
         }
     } else {
         tr_debug("   ignoring new device, because shutdown is in progress.");
@@ -1454,14 +2223,45 @@ static void ble_handle_known_device(gpointer data, gpointer user_data)
     (void)user_data;
     if (ble_is_device(object)) {
         const char *path = g_dbus_object_get_object_path(object);
-        if (object_on_adapter(path, g_config.adapter)) {
-            ble_new_device(path);
-        } else {
-            tr_debug("Ignoring %s due to not being on adapter.", path);
+        ble_new_device(path, true);
+    }
+}
+
+
+// Helper function for g_list_foreach, handles devices that were not identified before.
+static void ble_handle_untracked_device(gpointer data, gpointer user_data)
+{
+    GDBusObject *object = data;
+    struct ble_device *ble;
+    (void)user_data;
+
+    if (ble_is_device(object)) {
+        const char *path = g_dbus_object_get_object_path(object);
+        devices_mutex_lock();
+        ble = devices_find_device_by_dbus_path(path);
+        devices_mutex_unlock();
+        if (ble == NULL) {
+            ble_new_device(path, false);
         }
     }
 }
 
+/**
+ * \brief Takes a reloaded whitelist in use. BlueZ does not announce the devices it already
+ *        knows again, so they are identified again to pick up newly whitelisted names.
+ */
+static void ble_whitelist_reloaded(struct ble_whitelist *whitelist, void *userdata)
+{
+    GDBusObjectManager *bluez_manager = userdata;
+    GList *objects;
+
+    ble_whitelist_free(g_config.whitelist);
+    g_config.whitelist = whitelist;
+
+    objects = g_dbus_object_manager_get_objects(bluez_manager);
+    g_list_foreach(objects, ble_handle_untracked_device, NULL);
+    g_list_free_full(objects, g_object_unref);
+}
 
 /**
  * \brief Try to connect to devices that BlueZ already knows about.
@@ -1525,27 +2325,28 @@ void ble_startdiscovery_done(GObject *source_object, GAsyncResult *res, gpointer
 }
 
 /**
- * \brief scan for BLE devices
+ * \brief scan for BLE devices on one adapter
  *
  * This function scanning for BLE devices, calls Bluez Adapter interface
  * functions
  * Have to call SetDiscoveryFilter before Discovering
  *
  * \param bluez_manager, pointer to GDBusObjectManager
+ * \param adapter_path, object path of the adapter
  *
  */
-static int ble_discover(GDBusObjectManager *bluez_manager)
+static int ble_discover_on_adapter(GDBusObjectManager *bluez_manager, const char *adapter_path)
 {
     // FIXME: StopDiscovery is never called. Calling it could free memory leaks!
     int ret = 0;
     GError *err = NULL;
     GVariant *proxy_call;
 
-    tr_debug("--> ble_discover");
+    tr_debug("--> ble_discover_on_adapter %s", adapter_path);
 
     GDBusProxy *proxy = (GDBusProxy *)g_dbus_object_manager_get_interface(
                             bluez_manager,
-                            g_config.bluez_hci_path,
+                            adapter_path,
                             ADAPTER_IFACE);
     if (!G_IS_DBUS_PROXY(proxy)) {
         tr_err("Error: Get device proxy ADAPTER_IFACE failed");
@@ -1610,10 +2411,58 @@ out:
     if (proxy != NULL) {
         g_object_unref(proxy);
     }
-    tr_debug("<-- ble_discover");
+    tr_debug("<-- ble_discover_on_adapter");
     return ret;
 }
 
+/**
+ * \brief Starts discovery on every adapter in use. Each adapter discovers on its own, so the
+ *        devices each of them sees are known when the devices are assigned to adapters.
+ *
+ * \return 0 if discovery started on at least one adapter.
+ */
+static int ble_discover(GDBusObjectManager *bluez_manager)
+{
+    int ret = 0;
+    int started = 0;
+    int i;
+
+    for (i = 0; i < ble_adapters_count(); i++) {
+        int adapter_ret = ble_discover_on_adapter(bluez_manager, ble_adapters_path(i));
+        if (adapter_ret == 0) {
+            started++;
+        } else {
+            tr_err("Could not start discovery on %s", ble_adapters_name(i));
+            ret = adapter_ret;
+        }
+    }
+    return started > 0 ? 0 : ret;
+}
+
+/**
+ * \brief Invalidates the GATT cache of a device when a GATT object below it is added or removed.
+ *
+ *        BlueZ handles the Service Changed indication itself and updates the exported GATT objects.
+ *        While the services of a device are resolved, an added or removed GATT object therefore
+ *        means that the database of the device changed.
+ */
+static void ble_on_gatt_object_changed(const char *object_path)
+{
+    const char *service = strstr(object_path, "/service");
+    if (service == NULL) {
+        return;
+    }
+    gchar *device_path = g_strndup(object_path, service - object_path);
+    devices_mutex_lock();
+    struct ble_device *ble_dev = devices_find_device_by_dbus_path(device_path);
+    if (ble_dev != NULL && ble_dev->services_resolved && ble_services_are_resolved(ble_dev->proxy)) {
+        tr_info("GATT database of %s changed (%s)", ble_dev->attrs.addr, object_path);
+        ble_gatt_cache_invalidate(ble_dev->attrs.addr);
+    }
+    devices_mutex_unlock();
+    g_free(device_path);
+}
+
 static void ble_on_object_added(GDBusObjectManager *manager, GDBusObject *object, gpointer user_data)
 {
     (void)user_data;
@@ -1621,7 +2470,9 @@ static void ble_on_object_added(GDBusObjectManager *manager, GDBusObject *object
     if (ble_is_device(object)) {
         const char *path = g_dbus_object_get_object_path(object);
         tr_info("ble_on_object_added path: '%s'", path);
-        ble_new_device(path);
+        ble_new_device(path, false);
+    } else {
+        ble_on_gatt_object_changed(g_dbus_object_get_object_path(object));
     }
 }
 
@@ -1635,10 +2486,15 @@ static void ble_on_object_removed(GDBusObjectManager *manager, GDBusObject *obje
     tr_info("Removed object at %s (owner %s)", object_path, owner);
     struct ble_device *ble_dev = NULL;
 
+    ble_characteristic_proxy_cache_invalidate(object_path);
+    ble_scheduler_cancel(object_path);
+    ble_on_gatt_object_changed(object_path);
+
     devices_mutex_lock();
-    // Check if the Bluez hci interface was removed.
+    // Check if the Bluez hci interface of an adapter in use was removed.
     // This happens for example, if the bluetooth daemon crashes.
-    if (!strcmp(g_config.bluez_hci_path, object_path)) {
+    int adapter = ble_adapters_index_of_path(object_path);
+    if (adapter >= 0 && !strcmp(ble_adapters_path(adapter), object_path)) {
         tr_debug("Restarting g_main loop");
         g_main_loop_quit(g_config.g_loop);
     } else {
@@ -1646,6 +2502,7 @@ static void ble_on_object_removed(GDBusObjectManager *manager, GDBusObject *obje
         if (ble_dev == NULL) {
             tr_debug("    Can't find device for %s", object_path);
         } else {
+            ble_advertisement_forget(ble_dev->attrs.addr);
             bool call_succeeded = edge_unregister_device(ble_dev, true /* remove_context */);
             if (!call_succeeded) {
                 pt_edge_del_device(ble_dev);
@@ -1656,14 +2513,14 @@ static void ble_on_object_removed(GDBusObjectManager *manager, GDBusObject *obje
     g_free(owner);
 }
 
-// Read all characteristics for a connected device.
-void ble_read_all_characteristics_for_device(struct ble_device *ble)
+// Issues reads for the characteristics of a connected device that are due. Characteristics with an
+// active notify session are read once to get the initial value and after that they update on change.
+static void ble_poll_characteristics_for_device(struct ble_device *ble, gint64 now)
 {
     int srvc, ch;
-    tr_debug("---> ble_read_all_characteristics_for_device device_id: '%s'", ble->device_id);
     if (!ble_device_is_connected(ble->proxy)) {
         tr_debug("    Trying to read a disconnected device.");
-        goto exit_label;
+        return;
     }
 
     for (srvc = 0; srvc < ble->attrs.services_count; srvc++) {
@@ -1671,41 +2528,69 @@ void ble_read_all_characteristics_for_device(struct ble_device *ble)
         for (ch = 0; ch < gattservice->chars_count; ch++) {
             struct ble_gatt_char *gattchar = &(gattservice->chars[ch]);
             if ((gattchar->properties & BLE_GATT_PROP_PERM_READ) == 0) {
-                tr_debug("    Skipping characteristic %s", gattchar->dbus_path);
+                continue;
             }
-            else {
-                ble_read_characteristic_async(gattchar->dbus_path, ble->device_id, srvc, ch);
+            if (gattchar->next_poll_time != 0 && (gattchar->notifying || now < gattchar->next_poll_time)) {
+                continue;
+            }
+            gattchar->next_poll_time = now + (gint64) gattchar->poll_interval_ms * 1000;
+            ble_read_characteristic_async(ble, srvc, ch);
+        }
+    }
+}
+
+// Publishes the latest value of each characteristic that changed since the device was last published
+// and writes the values to Edge in one batch. Runs in the publisher thread, see ble_publisher_start().
+static void ble_publish_dirty_characteristics(struct ble_device *ble)
+{
+    int srvc, ch;
+    for (srvc = 0; srvc < ble->attrs.services_count; srvc++) {
+        struct ble_gatt_service *gattservice = &(ble->attrs.services[srvc]);
+        for (ch = 0; ch < gattservice->chars_count; ch++) {
+            if (gattservice->chars[ch].value_dirty) {
+                gattservice->chars[ch].value_dirty = false;
+                ble_publish_characteristic_value(ble, srvc, ch);
             }
         }
     }
-exit_label:
-    tr_debug("<--- ble_read_all_characteristics_for_device device_id: '%s'", ble->device_id);
+    device_write_values_to_pt(ble);
 }
 
-static gboolean ble_read_everything(gpointer data)
+static gboolean ble_poll_characteristics(gpointer data)
 {
     (void)data;
+    gint64 now = g_get_monotonic_time();
 
     if (!global_keep_running) {
         tr_debug("Main thread is shutting down, return without doing anything");
         return G_SOURCE_REMOVE;
     }
 
-    tr_debug("Reading all the things.");
-
     //lock the list before the loop
     devices_mutex_lock();
 
     ns_list_foreach_safe(struct ble_device, ble, devices_get_list()) {
-        if (device_is_registered(ble) && device_is_connected(ble)) {
-            // TODO: handle lwm2m subscription -> GATT notify
-            ble_read_all_characteristics_for_device(ble);
-            device_write_values_to_pt(ble);
+        if (ble->device_type == BLE_DEVICE_GAP_ADVERTISEMENT_ONLY && edge_is_connected()) {
+            ble_handle_pending_advertisement(ble);
+        }
+        // Advertising devices are never connected, but their values are published the same way.
+        if (device_is_registered(ble) &&
+            (device_is_connected(ble) || ble->device_type == BLE_DEVICE_GAP_ADVERTISEMENT_ONLY)) {
+            device_mutex_lock(ble);
+            if (device_is_connected(ble)) {
+                ble_poll_characteristics_for_device(ble, now);
+            }
+            // Values received since the previous tick from reads and notifications are translated
+            // and written to Edge in the publisher thread.
+            if (ble->values_dirty) {
+                ble_publisher_publish(ble);
+            }
+            device_mutex_unlock(ble);
         } else {
-            tr_info("device '%s' is registered: %d and connected: %d",
-                    ble->attrs.addr,
-                    device_is_registered(ble),
-                    device_is_connected(ble));
+            tr_debug("device '%s' is registered: %d and connected: %d",
+                     ble->attrs.addr,
+                     device_is_registered(ble),
+                     device_is_connected(ble));
         }
     }
 
@@ -1717,37 +2602,23 @@ static gboolean ble_read_everything(gpointer data)
 
 static void ble_clear_device_cache(GDBusObjectManager *object_manager)
 {
-    GDBusProxy *proxy = NULL;
+    GDBusProxy *proxies[BLE_ADAPTERS_MAX] = {NULL};
     GList *objects = NULL;
     GError *err = NULL;
     GList *iterator = NULL;
     GDBusObject *device = NULL;
     GVariant *result = NULL;
     const char *device_path = NULL;
+    int adapter;
 
     tr_debug("--> ble_clear_device_cache");
 
     assert(g_config.connection != NULL);
     assert(object_manager != NULL);
 
-    proxy = g_dbus_proxy_new_sync(g_config.connection,
-                                  G_DBUS_PROXY_FLAGS_NONE,
-                                  NULL,
-                                  BLUEZ_NAME,
-                                  g_config.bluez_hci_path,
-                                  ADAPTER_IFACE,
-                                  NULL,
-                                  &err);
-    if (!G_IS_DBUS_PROXY(proxy)) {
-        tr_err("Adapter %s interface not available on dbus: %s", ADAPTER_IFACE, err->message);
-        g_clear_error(&err);
-        goto out;
-    }
-
     objects = g_dbus_object_manager_get_objects(object_manager);
 
     if (!objects) {
-        g_object_unref(proxy);
         goto out;
     }
 
@@ -1755,8 +2626,19 @@ static void ble_clear_device_cache(GDBusObjectManager *object_manager)
         device = iterator->data;
         device_path = g_dbus_object_get_object_path(device);
         if (device_path && ble_is_device(device)) {
+            // The device is removed through the adapter it is on.
+            adapter = ble_adapters_index_of_path(device_path);
+            if (adapter < 0) {
+                continue;
+            }
+            if (proxies[adapter] == NULL) {
+                proxies[adapter] = ble_adapter_proxy_new(ble_adapters_path(adapter));
+                if (proxies[adapter] == NULL) {
+                    continue;
+                }
+            }
             tr_info("Removing device at %s", device_path);
-            result = g_dbus_proxy_call_sync(proxy,
+            result = g_dbus_proxy_call_sync(proxies[adapter],
                                             "RemoveDevice",
                                             g_variant_new("(o)", device_path),
                                             G_DBUS_CALL_FLAGS_NONE,
@@ -1774,7 +2656,11 @@ static void ble_clear_device_cache(GDBusObjectManager *object_manager)
     }
 
     g_list_free_full(objects, g_object_unref);
-    g_object_unref(proxy);
+    for (adapter = 0; adapter < BLE_ADAPTERS_MAX; adapter++) {
+        if (proxies[adapter] != NULL) {
+            g_object_unref(proxies[adapter]);
+        }
+    }
 out:
     tr_debug("<-- ble_clear_device_cache");
 
@@ -1894,10 +2780,10 @@ out:
     return ret;
 }
 
-gboolean ble_adapter_is_powered()
+gboolean ble_adapter_is_powered(const char *adapter_path)
 {
     gboolean powered = false;
-    GVariant *prop = ble_get_property(g_config.bluez_hci_path, ADAPTER_IFACE, POWERED_PROPERTY);
+    GVariant *prop = ble_get_property(adapter_path, ADAPTER_IFACE, POWERED_PROPERTY);
     if (prop && g_variant_is_of_type(prop, G_VARIANT_TYPE_BOOLEAN)) {
         powered = g_variant_get_boolean(prop);
         g_variant_unref(prop);
@@ -1905,94 +2791,16 @@ gboolean ble_adapter_is_powered()
     return powered;
 }
 
-gboolean ble_adapter_set_powered(gboolean powered)
+gboolean ble_adapter_set_powered(const char *adapter_path, gboolean powered)
 {
     bool ret = false;
     GVariant *value = g_variant_new("b", powered);
-    if (ble_set_property(g_config.bluez_hci_path, ADAPTER_IFACE, POWERED_PROPERTY, value)) {
+    if (ble_set_property(adapter_path, ADAPTER_IFACE, POWERED_PROPERTY, value)) {
         ret = true;
     }
     return ret;
 }
 
-device_conf_list_t *device_conf_list_read(const char *file_path)
-{
-    device_conf_list_t *devices_list = NULL;
-    json_t *json = NULL;
-    uint8_t *data = NULL;
-    if (file_path) {
-        size_t bytes_read = 0;
-
-        if (0 == edge_read_file(file_path, &data, &bytes_read)) {
-            json_error_t error;
-            json_t *json = json_loads((const char *) data, 0, &error);
-            if (json != NULL) {
-                json_t *devices = json_object_get(json, "whitelisted-devices");
-                if (NULL == devices) {
-                    tr_err("Cannot find 'whitelisted-devices' in '%s'", file_path);
-                    goto exit_label;
-                }
-                size_t index;
-                json_t *entry;
-                devices_list = calloc(1, sizeof(device_conf_list_t));
-                ns_list_init(devices_list);
-
-                json_array_foreach(devices, index, entry)
-                {
-                    json_t *json_name = json_object_get(entry, "name");
-                    if (!json_name) {
-                        tr_err("Cannot find name-value pair for 'name' in device entry");
-                        goto error_exit;
-                    }
-                    if (!json_is_string(json_name)) {
-                        tr_err("Value for key 'name' is not a string");
-                        goto error_exit;
-                    }
-                    bool partial = true;
-                    json_t *partial_json = json_object_get(entry, "partial-match");
-                    if (partial_json) {
-                        if (json_is_integer(partial_json)) {
-                            partial = (bool) json_integer_value(partial_json);
-                        } else {
-                            tr_err("Value for 'partial-match' is not integer");
-                            goto error_exit;
-                        }
-                    }
-                    device_conf_entry_t *device_conf_entry = calloc(1, sizeof(device_conf_entry_t));
-                    device_conf_entry->partial_match = partial;
-                    device_conf_entry->name = strdup(json_string_value(json_name));
-                    ns_list_add_to_end(devices_list, device_conf_entry);
-                }
-            } else {
-                tr_err("Jansson cannot parse '%s' error: '%s' on line: %d", file_path, error.text, error.line);
-            }
-        } else {
-            tr_err("Cannot read the file '%s'", file_path);
-        }
-    }
-    goto exit_label;
-error_exit:
-    device_conf_list_free(devices_list);
-    devices_list = NULL;
-
-exit_label:
-    json_decref(json);
-    free(data);
-    return devices_list;
-}
-
-static void device_conf_list_free(device_conf_list_t *list)
-{
-    if (list) {
-        ns_list_foreach_safe(struct device_conf_entry, dev, list)
-        {
-            free(dev->name);
-            ns_list_remove(list, dev);
-        }
-        free(list);
-    }
-}
-
 /**
  * \brief updates connected BLE devices in loop
  *
@@ -2005,15 +2813,23 @@ int ble_start(const char *postfix,
               const char *address,
               int clear_device_cache,
               const char *extended_discovery_file_path,
-              int service_based_discovery)
+              int service_based_discovery,
+              int write_timeout_ms,
+              int max_connecting,
+              const char *gatt_cache_dir)
 {
     int ret_val = 0;
+    if (!ble_adapters_init(adapter)) {
+        return 1;
+    }
+    ble_gatt_cache_init(gatt_cache_dir);
     if (extended_discovery_file_path) {
-        g_config.white_list_entries = device_conf_list_read(extended_discovery_file_path);
-        if (NULL == g_config.white_list_entries) {
+        g_config.whitelist = ble_whitelist_read(extended_discovery_file_path);
+        if (NULL == g_config.whitelist) {
             tr_err("Couldn't read whitelist even though the extended discovery file is specified!");
-            ret_val = 1;
-            goto out;
+            ble_gatt_cache_init(NULL);
+            ble_adapters_free();
+            return 1;
         }
     }
     bool retry;
@@ -2021,12 +2837,16 @@ int ble_start(const char *postfix,
         tr_debug("--> ble_start extended_discovery_file_path: %s", extended_discovery_file_path);
         GError *err = NULL;
         GDBusObjectManager *bluez_manager = NULL;
+        struct ble_whitelist_watch *whitelist_watch = NULL;
         gulong object_added_signal, object_removed_signal;
+        int i;
 
         g_config.postfix = postfix;
-        g_config.adapter = adapter;
         g_config.service_based_discovery = service_based_discovery;
-        snprintf(g_config.bluez_hci_path, sizeof g_config.bluez_hci_path, "/org/bluez/%s", adapter);
+        g_config.write_timeout_ms = write_timeout_ms;
+        ble_scheduler_init(max_connecting, ble_proxy_connect);
+        ble_publisher_start(ble_publish_dirty_characteristics);
+        ble_advertisement_init(BLE_ADVERTISEMENT_DEFAULT_MIN_INTERVAL_MS);
 
         if (ble_connect_to_dbus(address)) {
             // Error message already printed.
@@ -2061,13 +2881,17 @@ int ble_start(const char *postfix,
         }
         tr_info("created GDBus Bluez interface");
 
-        if (!ble_adapter_is_powered()) {
-            tr_info("powering on BlueZ adapter");
-            if (ble_adapter_set_powered(true)) {
-                tr_info("BlueZ adapter powered on");
-            } else {
-                tr_error("could not power on adapter!");
-                goto out;
+        g_config.bluez_manager = bluez_manager;
+
+        for (i = 0; i < ble_adapters_count(); i++) {
+            if (!ble_adapter_is_powered(ble_adapters_path(i))) {
+                tr_info("powering on BlueZ adapter %s", ble_adapters_name(i));
+                if (ble_adapter_set_powered(ble_adapters_path(i), true)) {
+                    tr_info("BlueZ adapter %s powered on", ble_adapters_name(i));
+                } else {
+                    tr_error("could not power on adapter %s!", ble_adapters_name(i));
+                    goto out;
+                }
             }
         }
 
@@ -2090,10 +2914,16 @@ int ble_start(const char *postfix,
             goto out;
         }
 
-        // Schedule periodic reads of all devices.
+        if (extended_discovery_file_path) {
+            whitelist_watch = ble_whitelist_watch_start(extended_discovery_file_path,
+                                                        ble_whitelist_reloaded,
+                                                        bluez_manager);
+        }
+
+        // Schedule reads of the characteristics that do not notify and flush changed values to Edge.
         g_config.g_source_id_1 = g_timeout_add_full(G_PRIORITY_HIGH,
-                                                    BLE_VALUE_READ_INTERVAL,
-                                                    ble_read_everything,
+                                                    BLE_POLL_TICK_INTERVAL,
+                                                    ble_poll_characteristics,
                                                     NULL,
                                                     NULL);
 
@@ -2104,9 +2934,15 @@ int ble_start(const char *postfix,
         g_signal_handler_disconnect(bluez_manager, object_added_signal);
         g_signal_handler_disconnect(bluez_manager, object_removed_signal);
     out:
+        ble_whitelist_watch_stop(whitelist_watch);
+        ble_publisher_stop();
+        ble_scheduler_free();
+        ble_advertisement_free();
+        ble_characteristic_proxy_cache_clear();
         if (g_config.g_loop != NULL) {
             g_main_loop_unref(g_config.g_loop);
         }
+        g_config.bluez_manager = NULL;
         if (bluez_manager != NULL) {
             g_object_unref(bluez_manager);
         }
@@ -2119,8 +2955,10 @@ int ble_start(const char *postfix,
             sleep(BLUEZ_RECONNECT_RETRY_TIME_SECONDS);
         }
     } while (retry);
-    device_conf_list_free(g_config.white_list_entries);
-    g_config.white_list_entries = NULL;
+    ble_whitelist_free(g_config.whitelist);
+    g_config.whitelist = NULL;
+    ble_gatt_cache_init(NULL);
+    ble_adapters_free();
     tr_debug("<-- ble_start");
     return ret_val;
 }
@@ -2170,15 +3008,7 @@ int ble_read_characteristic(const char *characteristic_path,
         tr_err("Invalid buffer %p size %zu for ble_read_characteristic", data, *size);
     }
 
-    assert(g_config.connection != NULL);
-    charProxy = g_dbus_proxy_new_sync(g_config.connection,
-                                              G_DBUS_PROXY_FLAGS_NONE,
-                                              NULL,
-                                              BLUEZ_NAME,
-                                              characteristic_path,
-                                              GATT_CHARACTERISTIC_IFACE,
-                                              NULL,
-                                              &err);
+    charProxy = ble_characteristic_proxy_get(characteristic_path, &err);
     if (!G_IS_DBUS_PROXY(charProxy)) {
         tr_err("Get characteristic proxy failed: %s (%d)", err->message, err->code);
         rc = err->code;
@@ -2220,75 +3050,43 @@ void ble_read_characteristic_callback(GObject *source_object,
 
     GError *error = NULL;
     GVariant *ret = g_dbus_proxy_call_finish(G_DBUS_PROXY(source_object), res, &error);
-    int ch = read_userdata->ch;
-    int srvc = read_userdata->srvc;
+    int ch = read_userdata->handle->ch;
+    int srvc = read_userdata->handle->srvc;
 
     if (ret != NULL) {
-        devices_mutex_lock();
-        struct ble_device *ble = devices_find_device_by_device_id(read_userdata->device_id);
-        device_mutex_lock(ble);
-        struct ble_gatt_service *gattservice = &(ble->attrs.services[srvc]);
-        struct ble_gatt_char *gattchar = &(gattservice->chars[ch]);
-
-        size_t size = gattchar->value_size;
-        uint8_t *data = gattchar->value;
-
-        parse_result_variant(ret, data, &size);
-        gattchar->value_length = size;
-        g_variant_unref(ret);
-
-        if (ble_services_is_supported_characteristic(gattservice->uuid, gattchar->uuid)) {
-            ble_services_decode_and_write_characteristic_translation(ble, srvc, ch, gattchar->value, size);
+        // Only this device is locked, reads of other devices complete in parallel.
+        struct ble_gatt_char *gattchar = device_char_handle_lock(read_userdata->handle);
+        if (gattchar != NULL) {
+            GVariant *bytes = g_variant_get_child_value(ret, 0);
+            gsize size = 0;
+            const uint8_t *data = g_variant_get_fixed_array(bytes, &size, sizeof(uint8_t));
+
+            device_store_characteristic_value(gattchar, data, size);
+            g_variant_unref(bytes);
+            ble_characteristic_value_updated(read_userdata->handle->device, srvc, ch);
+            tr_debug("    Updated value for characteristic %s", gattchar->dbus_path);
+            device_mutex_unlock(read_userdata->handle->device);
         }
-
-        // TODO: endian conversions for other size integers and floats
-        if (gattchar->dtype == BLE_INTEGER) {
-            switch (gattchar->value_size) {
-            case 2:
-            {
-                uint16_t *u16 = (uint16_t *)gattchar->value;
-                uint16_t host = *u16;
-                *u16 = htons(host);
-            }
-            break;
-            case 4:
-            {
-                uint32_t *u32 = (uint32_t *)gattchar->value;
-                uint32_t host = *u32;
-                *u32 = htonl(host);
-            }
-            break;
-            case 8:
-            default:
-                break;
-            }
-        }
-
-        // Inform Edge PT of resource value change
-        device_update_characteristic_resource_value(ble, srvc, ch, gattchar->value, gattchar->value_length);
-        device_mutex_unlock(ble);
-        devices_mutex_unlock();
-        tr_debug("    Updated value for characteristic %s", gattchar->dbus_path);
+        g_variant_unref(ret);
+    } else {
+        g_clear_error(&error);
     }
-    free(read_userdata->device_id);
+    device_char_handle_free(read_userdata->handle);
     free(read_userdata);
 }
 
-/** Reads asynchronously value from the ble characteristic specified by the
- *  dbus path.
+/** Reads asynchronously value from the ble characteristic. The completion resolves the
+ *  characteristic through a handle captured here, so it does not look the device up again.
  *
- *  characteristic_path
- *       input: the dbus path for the characteristic
- *  device_id
- *       input: the id of the device containing the characteristic
+ *  ble
+ *       input: the device containing the characteristic, its mutex must be held
  *  srvc
  *       input: index of the service in the device's service list
  *  ch
  *       input: index of the characteristic in the device's characteristic list
  */
 
-int ble_read_characteristic_async(char *characteristic_path,
-                                  char *device_id,
+int ble_read_characteristic_async(struct ble_device *ble,
                                   int srvc,
                                   int ch)
 {
@@ -2296,27 +3094,20 @@ int ble_read_characteristic_async(char *characteristic_path,
     GDBusProxy *charProxy;
     GError *err = NULL;
     int rc = 0;
+    const char *characteristic_path = ble->attrs.services[srvc].chars[ch].dbus_path;
 
     if (characteristic_path == NULL) {
         tr_err("Characteristic path for asynchronous read is null");
         rc = -1;
         return rc;
     }
-    if (device_id == NULL) {
+    if (ble->device_id == NULL) {
         tr_err("Device id for asynchronous read is null");
         rc = -2;
         return rc;
     }
 
-    assert(g_config.connection != NULL);
-    charProxy = g_dbus_proxy_new_sync(g_config.connection,
-                                              G_DBUS_PROXY_FLAGS_NONE,
-                                              NULL,
-                                              BLUEZ_NAME,
-                                              characteristic_path,
-                                              GATT_CHARACTERISTIC_IFACE,
-                                              NULL,
-                                              &err);
+    charProxy = ble_characteristic_proxy_get(characteristic_path, &err);
     if (!G_IS_DBUS_PROXY(charProxy)) {
         tr_err("Get characteristic proxy failed: %s (%d)", err->message, err->code);
         rc = err->code;
@@ -2327,9 +3118,15 @@ int ble_read_characteristic_async(char *characteristic_path,
     g_variant_builder_init(&build_opt, G_VARIANT_TYPE("a{sv}"));
 
     struct async_read_userdata *read_userdata = calloc(1, sizeof(struct async_read_userdata));
-    read_userdata->device_id = strdup(device_id);
-    read_userdata->srvc = srvc;
-    read_userdata->ch = ch;
+    if (read_userdata != NULL) {
+        read_userdata->handle = device_char_handle_new(ble, srvc, ch);
+    }
+    if (read_userdata == NULL || read_userdata->handle == NULL) {
+        tr_err("Could not allocate asynchronous read of %s", characteristic_path);
+        free(read_userdata);
+        g_object_unref(charProxy);
+        return -3;
+    }
 
     g_dbus_proxy_call(charProxy,
                             "ReadValue",
@@ -2353,15 +3150,7 @@ int ble_write_characteristic(const char    *characteristic_path,
     GError *err = NULL;
     int rc = 0;
 
-    assert(g_config.connection != NULL);
-    charProxy = g_dbus_proxy_new_sync(g_config.connection,
-                                      G_DBUS_PROXY_FLAGS_NONE,
-                                      NULL,
-                                      BLUEZ_NAME,
-                                      characteristic_path,
-                                      GATT_CHARACTERISTIC_IFACE,
-                                      NULL,
-                                      &err);
+    charProxy = ble_characteristic_proxy_get(characteristic_path, &err);
 
     if (!G_IS_DBUS_PROXY(charProxy)) {
         tr_err("Get characteristic proxy failed: %s (%d)", err->message, err->code);
@@ -2402,3 +3191,137 @@ int ble_write_characteristic(const char    *characteristic_path,
 
     return rc;
 }
+
+// Rewrites the resources from the stored characteristic value without treating it as new data from the device.
+static void ble_characteristic_republish_value(struct ble_device *ble, int srvc, int ch)
+{
+    ble->attrs.services[srvc].chars[ch].value_dirty = true;
+    ble->values_dirty = true;
+}
+
+static void ble_process_write_queue(struct ble_device *ble);
+
+/**
+ * \brief Callback called by the asynchronous dbus write operation
+ */
+static void ble_write_characteristic_callback(GObject *source_object,
+                                              GAsyncResult *res,
+                                              gpointer user_data)
+{
+    struct async_write_userdata *write_userdata = (struct async_write_userdata *) user_data;
+    struct ble_write_request *request = write_userdata->request;
+    GError *error = NULL;
+    GVariant *ret = g_dbus_proxy_call_finish(G_DBUS_PROXY(source_object), res, &error);
+
+    struct ble_device *ble = devices_acquire_device_by_device_id(write_userdata->device_id);
+    if (ble != NULL) {
+        device_mutex_lock(ble);
+        if (request->sv_idx < ble->attrs.services_count &&
+            request->ch_idx < ble->attrs.services[request->sv_idx].chars_count) {
+            struct ble_gatt_char *gattchar = &(ble->attrs.services[request->sv_idx].chars[request->ch_idx]);
+            if (ret != NULL) {
+                device_store_characteristic_value(gattchar, request->value, request->value_size);
+                tr_info("Successfully wrote %zu bytes to BLE characteristic %s", request->value_size, gattchar->dbus_path);
+                ble_characteristic_value_updated(ble, request->sv_idx, request->ch_idx);
+            } else {
+                tr_err("Failed write to %s: %s (%d)", gattchar->dbus_path, error->message, error->code);
+                // Revert the resources to the last value known to be in the device
+                ble_characteristic_republish_value(ble, request->sv_idx, request->ch_idx);
+            }
+        }
+        ble->write_in_flight = false;
+        ble_process_write_queue(ble);
+        ble_release_locked_device(ble);
+    }
+
+    if (ret != NULL) {
+        g_variant_unref(ret);
+    }
+    g_clear_error(&error);
+    device_free_characteristic_write(request);
+    free(write_userdata->device_id);
+    free(write_userdata);
+}
+
+/**
+ * \brief Sends the next queued write of the device unless a write is already in flight.
+ *        Must be called with the device mutex held.
+ */
+static void ble_process_write_queue(struct ble_device *ble)
+{
+    struct ble_write_request *request;
+
+    while (!ble->write_in_flight && (request = device_pop_characteristic_write(ble)) != NULL) {
+        GError *err = NULL;
+        GDBusProxy *charProxy;
+        struct async_write_userdata *write_userdata;
+
+        if (request->sv_idx >= ble->attrs.services_count ||
+            request->ch_idx >= ble->attrs.services[request->sv_idx].chars_count) {
+            device_free_characteristic_write(request);
+            continue;
+        }
+        const char *characteristic_path = ble->attrs.services[request->sv_idx].chars[request->ch_idx].dbus_path;
+
+        charProxy = ble_characteristic_proxy_get(characteristic_path, &err);
+        if (!G_IS_DBUS_PROXY(charProxy)) {
+            tr_err("Get characteristic proxy failed: %s (%d)", err->message, err->code);
+            g_clear_error(&err);
+            device_free_characteristic_write(request);
+            continue;
+        }
+
+        write_userdata = calloc(1, sizeof(struct async_write_userdata));
+        if (write_userdata == NULL || (write_userdata->device_id = strdup(ble->device_id)) == NULL) {
+            tr_err("Could not allocate memory for characteristic write");
+            free(write_userdata);
+            device_free_characteristic_write(request);
+            g_object_unref(charProxy);
+            continue;
+        }
+        write_userdata->request = request;
+
+        GVariant *data_v = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, request->value, request->value_size, 1);
+        // We pass NULL as last parameter to indicate empty options dictionary
+        g_dbus_proxy_call(charProxy,
+                          "WriteValue",
+                          g_variant_new("(@aya{sv})", data_v, NULL),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          g_config.write_timeout_ms,
+                          NULL,
+                          (GAsyncReadyCallback) ble_write_characteristic_callback,
+                          write_userdata);
+        g_object_unref(charProxy);
+        ble->write_in_flight = true;
+    }
+}
+
+static gboolean ble_process_write_queue_cb(gpointer data)
+{
+    char *device_id = data;
+
+    struct ble_device *ble = devices_acquire_device_by_device_id(device_id);
+    if (ble != NULL) {
+        device_mutex_lock(ble);
+        if (device_is_connected(ble)) {
+            ble_process_write_queue(ble);
+        } else if (!ns_list_is_empty(&ble->write_queue)) {
+            // Keep the writes until the device is back, and get it reconnected first.
+            ble_scheduler_pending_writes(ble->dbus_path);
+        }
+        ble_release_locked_device(ble);
+    }
+    free(device_id);
+
+    return G_SOURCE_REMOVE;
+}
+
+void ble_schedule_write_queue(const char *device_id)
+{
+    char *id = strdup(device_id);
+    if (id == NULL) {
+        tr_err("Could not schedule characteristic writes for %s", device_id);
+        return;
+    }
+    g_idle_add(ble_process_write_queue_cb, id);
+}
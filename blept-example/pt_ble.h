@@ -33,14 +33,16 @@ int ble_start(const char *postfix,
               const char *address,
               int clear_device_cache,
               const char *extended_discovery_file_path,
-              int service_based_discovery);
+              int service_based_discovery,
+              int write_timeout_ms,
+              int max_connecting,
+              const char *gatt_cache_dir);
 
 int ble_read_characteristic(const char *characteristic_path,
                             uint8_t    *data,
                             size_t     *size);
 
-int ble_read_characteristic_async(char *characteristic_path,
-                                  char *device_id,
+int ble_read_characteristic_async(struct ble_device *ble,
                                   int srvc,
                                   int ch);
 
@@ -50,11 +52,13 @@ int ble_write_characteristic(const char    *characteristic_path,
 
 bool pt_ble_setup_signals(void);
 gboolean pt_ble_pt_ready(gpointer data);
-int ble_write_characteristic_async(const char    *characteristic_path,
-                                   const uint8_t *data,
-                                   size_t         size);
+/**
+ * \brief Schedules the write queue of a device to be processed in the BLE event loop.
+ *        Can be called from any thread.
+ */
+void ble_schedule_write_queue(const char *device_id);
 
-void ble_characteristic_stop_notify_proxy(const struct ble_gatt_char *ch);
+void ble_characteristic_stop_notify_proxy(struct ble_gatt_char *ch);
 
 void ble_remove_device(struct ble_device *ble_dev);
 
@@ -62,9 +66,12 @@ gboolean pt_ble_graceful_shutdown(gpointer data);
 gboolean pt_ble_g_main_quit_loop(gpointer data);
 
 struct async_read_userdata {
+    struct ble_char_handle *handle;
+};
+
+struct async_write_userdata {
     char *device_id;
-    int srvc;
-    int ch;
+    struct ble_write_request *request;
 };
 
 extern volatile int global_keep_running;
@@ -0,0 +1,175 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file pt_ble_adapters.c
+ * \brief The HCI adapters the translator drives and the number of devices assigned to each.
+ *
+ * BlueZ exports a device object below every adapter that has seen the device, so one device may
+ * have several object paths. The translator connects each device through one of them, chosen
+ * by signal strength and by how many devices the adapter already serves.
+ */
+
+#include "pt_ble_adapters.h"
+
+#include <mbed-trace/mbed_trace.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_GROUP "ble-ad"
+
+#define BLE_ADAPTERS_PATH_PREFIX "/org/bluez/"
+#define BLE_ADAPTERS_NAME_SIZE 16
+
+struct ble_adapter {
+    char name[BLE_ADAPTERS_NAME_SIZE];
+    char path[sizeof(BLE_ADAPTERS_PATH_PREFIX) + BLE_ADAPTERS_NAME_SIZE];
+    size_t path_length;
+    int load;
+};
+
+static struct {
+    struct ble_adapter adapters[BLE_ADAPTERS_MAX];
+    int count;
+} ble_adapters;
+
+bool ble_adapters_init(const char *adapters)
+{
+    const char *name = adapters;
+
+    ble_adapters.count = 0;
+    while (name != NULL && *name != '\0') {
+        const char *end = strchr(name, ',');
+        size_t length = end != NULL ? (size_t) (end - name) : strlen(name);
+
+        if (length == 0 || length >= BLE_ADAPTERS_NAME_SIZE) {
+            tr_err("Invalid Bluetooth interface in '%s'", adapters);
+            return false;
+        }
+        if (ble_adapters.count == BLE_ADAPTERS_MAX) {
+            tr_err("At most %d Bluetooth interfaces are supported", BLE_ADAPTERS_MAX);
+            return false;
+        }
+        struct ble_adapter *adapter = &ble_adapters.adapters[ble_adapters.count++];
+        memcpy(adapter->name, name, length);
+        adapter->name[length] = '\0';
+        snprintf(adapter->path, sizeof(adapter->path), BLE_ADAPTERS_PATH_PREFIX "%s", adapter->name);
+        adapter->path_length = strlen(adapter->path);
+        adapter->load = 0;
+        tr_info("Using Bluetooth interface %s", adapter->name);
+        name = end != NULL ? end + 1 : NULL;
+    }
+    if (ble_adapters.count == 0) {
+        tr_err("No Bluetooth interface given");
+        return false;
+    }
+    return true;
+}
+
+void ble_adapters_free(void)
+{
+    ble_adapters.count = 0;
+}
+
+int ble_adapters_count(void)
+{
+    return ble_adapters.count;
+}
+
+const char *ble_adapters_name(int index)
+{
+    assert(index >= 0 && index < ble_adapters.count);
+    return ble_adapters.adapters[index].name;
+}
+
+const char *ble_adapters_path(int index)
+{
+    assert(index >= 0 && index < ble_adapters.count);
+    return ble_adapters.adapters[index].path;
+}
+
+int ble_adapters_index_of_path(const char *object_path)
+{
+    int i;
+    for (i = 0; i < ble_adapters.count; i++) {
+        const struct ble_adapter *adapter = &ble_adapters.adapters[i];
+        if (strncmp(object_path, adapter->path, adapter->path_length) == 0 &&
+            (object_path[adapter->path_length] == '\0' || object_path[adapter->path_length] == '/')) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool ble_adapters_device_path(char *out, size_t size, const char *device_path, int index)
+{
+    int current = ble_adapters_index_of_path(device_path);
+    if (current < 0 || index < 0 || index >= ble_adapters.count) {
+        return false;
+    }
+    const char *device = device_path + ble_adapters.adapters[current].path_length;
+    int written = snprintf(out, size, "%s%s", ble_adapters.adapters[index].path, device);
+    return written > 0 && (size_t) written < size;
+}
+
+int ble_adapters_choose(const int16_t *rssi)
+{
+    int best = -1;
+    int best_score = 0;
+    int i;
+
+    for (i = 0; i < ble_adapters.count; i++) {
+        if (rssi[i] == BLE_ADAPTERS_RSSI_NOT_SEEN) {
+            continue;
+        }
+        int score = rssi[i] - BLE_ADAPTERS_LOAD_PENALTY_DB * ble_adapters.adapters[i].load;
+        if (best < 0 || score > best_score ||
+            (score == best_score && ble_adapters.adapters[i].load < ble_adapters.adapters[best].load)) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+void ble_adapters_assign(int index)
+{
+    assert(index >= 0 && index < ble_adapters.count);
+    ble_adapters.adapters[index].load++;
+}
+
+void ble_adapters_release(int index)
+{
+    // Devices may outlive the adapter list when the translator shuts down.
+    if (index < 0 || index >= ble_adapters.count) {
+        return;
+    }
+    assert(ble_adapters.adapters[index].load > 0);
+    ble_adapters.adapters[index].load--;
+}
+
+int ble_adapters_load(int index)
+{
+    assert(index >= 0 && index < ble_adapters.count);
+    return ble_adapters.adapters[index].load;
+}
@@ -0,0 +1,104 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef __PT_BLE_ADAPTERS_H__
+#define __PT_BLE_ADAPTERS_H__
+
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+
+#define BLE_ADAPTERS_MAX 8
+
+/* The adapter does not have an object for the device, so it cannot connect to it */
+#define BLE_ADAPTERS_RSSI_NOT_SEEN INT16_MIN
+/* RSSI assumed for a device the adapter knows but has not heard during this discovery */
+#define BLE_ADAPTERS_RSSI_UNKNOWN (-100)
+/* A device assigned to an adapter weighs as much as this many dB of signal strength */
+#define BLE_ADAPTERS_LOAD_PENALTY_DB 6
+
+/**
+ * \brief Sets up the adapters the translator drives.
+ *
+ * \param adapters Comma separated HCI interface names, for example "hci0,hci1".
+ * \return true on success, false if the list is empty or has more than BLE_ADAPTERS_MAX names.
+ */
+bool ble_adapters_init(const char *adapters);
+
+void ble_adapters_free(void);
+
+int ble_adapters_count(void);
+
+/**
+ * \return The interface name of an adapter, for example "hci0".
+ */
+const char *ble_adapters_name(int index);
+
+/**
+ * \return The BlueZ object path of an adapter, for example "/org/bluez/hci0".
+ */
+const char *ble_adapters_path(int index);
+
+/**
+ * \brief Finds the adapter an object path belongs to: the adapter itself or a device or GATT
+ *        object below it.
+ *
+ * \return The adapter index, or -1 if the object is not on a configured adapter.
+ */
+int ble_adapters_index_of_path(const char *object_path);
+
+/**
+ * \brief Builds the object path of the same device on another adapter. BlueZ names device objects
+ *        after the Bluetooth address, so only the adapter part differs.
+ *
+ * \param out Buffer for the path.
+ * \param size Size of the buffer.
+ * \param device_path Object path of the device on any configured adapter.
+ * \param index The adapter.
+ * \return true on success, false if the path is not a device on a configured adapter or does not fit.
+ */
+bool ble_adapters_device_path(char *out, size_t size, const char *device_path, int index);
+
+/**
+ * \brief Chooses the adapter to connect a device through. The score of an adapter is the RSSI it
+ *        receives the device with, less BLE_ADAPTERS_LOAD_PENALTY_DB for each device already
+ *        assigned to it. Ties go to the adapter with fewer devices.
+ *
+ * \param rssi RSSI of the device on each adapter, BLE_ADAPTERS_RSSI_NOT_SEEN if the adapter has no
+ *             object for it.
+ * \return The adapter index, or -1 if no adapter sees the device.
+ */
+int ble_adapters_choose(const int16_t *rssi);
+
+/**
+ * \brief Counts a device connected or connecting through an adapter.
+ */
+void ble_adapters_assign(int index);
+
+/**
+ * \brief Stops counting a device assigned with ble_adapters_assign().
+ */
+void ble_adapters_release(int index);
+
+/**
+ * \return The number of devices assigned to an adapter.
+ */
+int ble_adapters_load(int index);
+
+#endif /* __PT_BLE_ADAPTERS_H__ */
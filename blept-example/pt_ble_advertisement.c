@@ -0,0 +1,412 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file pt_ble_advertisement.c
+ * \brief Decodes sensor values from the ServiceData and ManufacturerData of advertisements.
+ *
+ * The values are converted to the format of the matching Environmental Sensing characteristic,
+ * so advertising devices get the same resources and translations as connected GATT servers.
+ */
+
+#include "pt_ble_advertisement.h"
+#include "devices.h"
+#include "pt_ble_translations.h"
+
+#include <mbed-trace/mbed_trace.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_GROUP "ble-adv"
+
+#define ENVIRONMENTAL_SENSING_SERVICE_UUID "0000181A-0000-1000-8000-00805F9B34FB"
+#define TEMPERATURE_CHARACTERISTIC_UUID "00002A6E-0000-1000-8000-00805F9B34FB"
+#define HUMIDITY_CHARACTERISTIC_UUID "00002A6F-0000-1000-8000-00805F9B34FB"
+#define PRESSURE_CHARACTERISTIC_UUID "00002A6D-0000-1000-8000-00805F9B34FB"
+#define BTHOME_SERVICE_UUID "0000FCD2-0000-1000-8000-00805F9B34FB"
+#define RUUVI_COMPANY_ID 0x0499
+
+typedef bool (*ble_advertisement_decode_cb_t)(const uint8_t *data, size_t size, struct ble_advertisement *adv);
+
+struct ble_advertisement_format {
+    const char *name;
+    const char *service_uuid; /* NULL for manufacturer data formats */
+    uint16_t company_id;
+    ble_advertisement_decode_cb_t decode;
+};
+
+struct ble_advertisement_state {
+    GVariant *service_data;
+    GVariant *manufacturer_data;
+    gint64 accepted_time;
+    bool pending; /* a change arrived within the minimum interval */
+    GVariant *pending_service_data;
+    GVariant *pending_manufacturer_data;
+};
+
+static struct {
+    GHashTable *states; /* address -> struct ble_advertisement_state */
+    gint64 min_interval_us;
+} filter;
+
+static uint32_t ble_advertisement_read_le(const uint8_t *data, size_t size)
+{
+    uint32_t value = 0;
+    size_t i;
+    for (i = size; i > 0; i--) {
+        value = (value << 8) | data[i - 1];
+    }
+    return value;
+}
+
+static uint16_t ble_advertisement_read_be16(const uint8_t *data)
+{
+    return (uint16_t) ((data[0] << 8) | data[1]);
+}
+
+// Adds a value in the little endian format of the characteristic, replacing an earlier value.
+static void ble_advertisement_add_value(struct ble_advertisement *adv,
+                                        const char *char_uuid,
+                                        uint32_t value,
+                                        size_t value_size)
+{
+    struct ble_advertisement_value *v = NULL;
+    int i;
+
+    for (i = 0; i < adv->count; i++) {
+        if (adv->values[i].char_uuid == char_uuid) {
+            v = &adv->values[i];
+        }
+    }
+    if (v == NULL) {
+        if (adv->count == BLE_ADVERTISEMENT_MAX_VALUES) {
+            return;
+        }
+        v = &adv->values[adv->count++];
+    }
+    v->srvc_uuid = ENVIRONMENTAL_SENSING_SERVICE_UUID;
+    v->char_uuid = char_uuid;
+    v->value_size = value_size;
+    for (i = 0; i < (int) value_size; i++) {
+        v->value[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+/* Environmental Sensing service data of custom thermometer firmwares. The 13 byte format has big
+ * endian temperature in 0.1 degC and humidity in percent, the 15 byte format little endian
+ * temperature in 0.01 degC and humidity in 0.01 percent. Both start with the MAC address.
+ */
+static bool ble_advertisement_decode_ess(const uint8_t *data, size_t size, struct ble_advertisement *adv)
+{
+    if (size == 13) {
+        int16_t temperature = (int16_t) ble_advertisement_read_be16(&data[6]);
+        ble_advertisement_add_value(adv, TEMPERATURE_CHARACTERISTIC_UUID, (uint16_t) (temperature * 10), 2);
+        ble_advertisement_add_value(adv, HUMIDITY_CHARACTERISTIC_UUID, data[8] * 100, 2);
+        return true;
+    }
+    if (size == 15) {
+        ble_advertisement_add_value(adv, TEMPERATURE_CHARACTERISTIC_UUID, ble_advertisement_read_le(&data[6], 2), 2);
+        ble_advertisement_add_value(adv, HUMIDITY_CHARACTERISTIC_UUID, ble_advertisement_read_le(&data[8], 2), 2);
+        return true;
+    }
+    return false;
+}
+
+/* Sizes of the BTHome v2 object values by object id, 0 for ids that are not defined.
+ * Parsing stops at the first unknown object because its size is not known.
+ */
+static const uint8_t bthome_object_sizes[] = {
+    1, 1, 2, 2, 3, 3, 2, 2, 2, 1, 3, 3, 2, 2, 2, 1, /* 0x00 - 0x0F */
+    1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x10 - 0x1F */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x20 - 0x2F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 2, 2, 4, 2, /* 0x30 - 0x3F */
+    2, 2, 3, 2, 2, 2, 1, 2, 2, 2, 2, 3, 4, 4, 4, 4, /* 0x40 - 0x4F */
+    4, 2, 2                                         /* 0x50 - 0x52 */
+};
+
+static bool ble_advertisement_decode_bthome(const uint8_t *data, size_t size, struct ble_advertisement *adv)
+{
+    size_t pos = 1;
+
+    if (size < 1) {
+        return false;
+    }
+    // Bit 0 of the device information is encryption, bits 5-7 the version.
+    if ((data[0] & 0x01) != 0 || (data[0] >> 5) != 2) {
+        return false;
+    }
+    while (pos < size) {
+        uint8_t id = data[pos++];
+        size_t length = id < sizeof(bthome_object_sizes) ? bthome_object_sizes[id] : 0;
+        if (length == 0 || pos + length > size) {
+            break;
+        }
+        const uint8_t *value = &data[pos];
+        switch (id) {
+        case 0x02: // temperature, sint16, 0.01 degC
+            ble_advertisement_add_value(adv, TEMPERATURE_CHARACTERISTIC_UUID, ble_advertisement_read_le(value, 2), 2);
+            break;
+        case 0x45: // temperature, sint16, 0.1 degC
+            ble_advertisement_add_value(adv,
+                                        TEMPERATURE_CHARACTERISTIC_UUID,
+                                        (uint16_t) ((int16_t) ble_advertisement_read_le(value, 2) * 10),
+                                        2);
+            break;
+        case 0x03: // humidity, uint16, 0.01 %
+            ble_advertisement_add_value(adv, HUMIDITY_CHARACTERISTIC_UUID, ble_advertisement_read_le(value, 2), 2);
+            break;
+        case 0x2E: // humidity, uint8, 1 %
+            ble_advertisement_add_value(adv, HUMIDITY_CHARACTERISTIC_UUID, value[0] * 100, 2);
+            break;
+        case 0x04: // pressure, uint24, 0.01 hPa which is 1 Pa
+            ble_advertisement_add_value(adv, PRESSURE_CHARACTERISTIC_UUID, ble_advertisement_read_le(value, 3) * 10, 4);
+            break;
+        default:
+            break;
+        }
+        pos += length;
+    }
+    return adv->count > 0;
+}
+
+/* Ruuvi data format 5 (RAWv2): big endian temperature in 0.005 degC, humidity in 0.0025 percent
+ * and pressure in Pa offset by 50000. Unavailable values have all bits set or are 0x8000.
+ */
+static bool ble_advertisement_decode_ruuvi(const uint8_t *data, size_t size, struct ble_advertisement *adv)
+{
+    if (size < 24 || data[0] != 5) {
+        return false;
+    }
+    uint16_t temperature = ble_advertisement_read_be16(&data[1]);
+    uint16_t humidity = ble_advertisement_read_be16(&data[3]);
+    uint16_t pressure = ble_advertisement_read_be16(&data[5]);
+    if (temperature != 0x8000) {
+        ble_advertisement_add_value(adv, TEMPERATURE_CHARACTERISTIC_UUID, (uint16_t) ((int16_t) temperature / 2), 2);
+    }
+    if (humidity != 0xffff) {
+        ble_advertisement_add_value(adv, HUMIDITY_CHARACTERISTIC_UUID, humidity / 4, 2);
+    }
+    if (pressure != 0xffff) {
+        ble_advertisement_add_value(adv, PRESSURE_CHARACTERISTIC_UUID, (pressure + 50000) * 10, 4);
+    }
+    return adv->count > 0;
+}
+
+static const struct ble_advertisement_format ble_advertisement_formats[] = {
+    {"ESS", ENVIRONMENTAL_SENSING_SERVICE_UUID, 0, ble_advertisement_decode_ess},
+    {"BTHome", BTHOME_SERVICE_UUID, 0, ble_advertisement_decode_bthome},
+    {"Ruuvi RAWv2", NULL, RUUVI_COMPANY_ID, ble_advertisement_decode_ruuvi},
+};
+
+#define BLE_ADVERTISEMENT_FORMAT_COUNT (sizeof(ble_advertisement_formats) / sizeof(struct ble_advertisement_format))
+
+static void ble_advertisement_decode(const struct ble_advertisement_format *format,
+                                     GVariant *payload,
+                                     struct ble_advertisement *adv)
+{
+    gsize size = 0;
+    const uint8_t *data;
+
+    if (!g_variant_is_of_type(payload, G_VARIANT_TYPE_BYTESTRING)) {
+        return;
+    }
+    data = g_variant_get_fixed_array(payload, &size, sizeof(uint8_t));
+    if (format->decode(data, size, adv)) {
+        adv->format = format->name;
+    }
+}
+
+bool ble_advertisement_parse(GVariant *service_data, GVariant *manufacturer_data, struct ble_advertisement *adv)
+{
+    GVariantIter iter;
+    GVariant *payload;
+    const gchar *uuid;
+    guint16 company_id;
+    size_t i;
+
+    memset(adv, 0, sizeof(struct ble_advertisement));
+    if (service_data != NULL && g_variant_is_of_type(service_data, G_VARIANT_TYPE("a{sv}"))) {
+        g_variant_iter_init(&iter, service_data);
+        while (g_variant_iter_next(&iter, "{&sv}", &uuid, &payload)) {
+            ble_uuid_t key;
+            if (ble_uuid_parse(uuid, &key)) {
+                for (i = 0; i < BLE_ADVERTISEMENT_FORMAT_COUNT; i++) {
+                    const struct ble_advertisement_format *format = &ble_advertisement_formats[i];
+                    ble_uuid_t format_uuid;
+                    if (format->service_uuid != NULL && ble_uuid_parse(format->service_uuid, &format_uuid) &&
+                        format_uuid.msb == key.msb && format_uuid.lsb == key.lsb) {
+                        ble_advertisement_decode(format, payload, adv);
+                    }
+                }
+            }
+            g_variant_unref(payload);
+        }
+    }
+    if (manufacturer_data != NULL && g_variant_is_of_type(manufacturer_data, G_VARIANT_TYPE("a{qv}"))) {
+        g_variant_iter_init(&iter, manufacturer_data);
+        while (g_variant_iter_next(&iter, "{qv}", &company_id, &payload)) {
+            for (i = 0; i < BLE_ADVERTISEMENT_FORMAT_COUNT; i++) {
+                const struct ble_advertisement_format *format = &ble_advertisement_formats[i];
+                if (format->service_uuid == NULL && format->company_id == company_id) {
+                    ble_advertisement_decode(format, payload, adv);
+                }
+            }
+            g_variant_unref(payload);
+        }
+    }
+    return adv->count > 0;
+}
+
+bool ble_advertisement_is_supported(GVariant *service_data, GVariant *manufacturer_data)
+{
+    struct ble_advertisement adv;
+    return ble_advertisement_parse(service_data, manufacturer_data, &adv);
+}
+
+static void ble_advertisement_variant_set(GVariant **target, GVariant *value)
+{
+    if (*target) {
+        g_variant_unref(*target);
+    }
+    *target = value ? g_variant_ref(value) : NULL;
+}
+
+static void ble_advertisement_clear_pending(struct ble_advertisement_state *state)
+{
+    ble_advertisement_variant_set(&state->pending_service_data, NULL);
+    ble_advertisement_variant_set(&state->pending_manufacturer_data, NULL);
+    state->pending = false;
+}
+
+static void ble_advertisement_state_free(gpointer data)
+{
+    struct ble_advertisement_state *state = data;
+    ble_advertisement_variant_set(&state->service_data, NULL);
+    ble_advertisement_variant_set(&state->manufacturer_data, NULL);
+    ble_advertisement_clear_pending(state);
+    free(state);
+}
+
+void ble_advertisement_init(int min_interval_ms)
+{
+    filter.min_interval_us = (gint64) min_interval_ms * 1000;
+    filter.states = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, ble_advertisement_state_free);
+}
+
+void ble_advertisement_free(void)
+{
+    if (filter.states != NULL) {
+        g_hash_table_destroy(filter.states);
+        filter.states = NULL;
+    }
+}
+
+static bool ble_advertisement_variant_equal(GVariant *a, GVariant *b)
+{
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return g_variant_equal(a, b);
+}
+
+bool ble_advertisement_accept(const char *address, GVariant *service_data, GVariant *manufacturer_data)
+{
+    struct ble_advertisement_state *state;
+    gint64 now = g_get_monotonic_time();
+
+    if (filter.states == NULL) {
+        return true;
+    }
+    state = g_hash_table_lookup(filter.states, address);
+    if (state == NULL) {
+        state = calloc(1, sizeof(struct ble_advertisement_state));
+        if (state == NULL) {
+            tr_err("Could not allocate advertisement state of %s", address);
+            return true;
+        }
+        g_hash_table_insert(filter.states, g_strdup(address), state);
+    } else {
+        if (ble_advertisement_variant_equal(state->service_data, service_data) &&
+            ble_advertisement_variant_equal(state->manufacturer_data, manufacturer_data)) {
+            // The device went back to the published data, an earlier change is stale.
+            ble_advertisement_clear_pending(state);
+            return false;
+        }
+        if (now - state->accepted_time < filter.min_interval_us) {
+            // BlueZ signals only changes, so the latest change is kept and published by
+            // ble_advertisement_take_pending() when the interval ends.
+            ble_advertisement_variant_set(&state->pending_service_data, service_data);
+            ble_advertisement_variant_set(&state->pending_manufacturer_data, manufacturer_data);
+            state->pending = true;
+            return false;
+        }
+    }
+
+    ble_advertisement_variant_set(&state->service_data, service_data);
+    ble_advertisement_variant_set(&state->manufacturer_data, manufacturer_data);
+    ble_advertisement_clear_pending(state);
+    state->accepted_time = now;
+    return true;
+}
+
+bool ble_advertisement_take_pending(const char *address, GVariant **service_data, GVariant **manufacturer_data)
+{
+    struct ble_advertisement_state *state;
+    gint64 now = g_get_monotonic_time();
+
+    if (filter.states == NULL) {
+        return false;
+    }
+    state = g_hash_table_lookup(filter.states, address);
+    if (state == NULL || !state->pending || now - state->accepted_time < filter.min_interval_us) {
+        return false;
+    }
+
+    // The references of the pending data move to the caller.
+    ble_advertisement_variant_set(&state->service_data, state->pending_service_data);
+    ble_advertisement_variant_set(&state->manufacturer_data, state->pending_manufacturer_data);
+    *service_data = state->pending_service_data;
+    *manufacturer_data = state->pending_manufacturer_data;
+    state->pending_service_data = NULL;
+    state->pending_manufacturer_data = NULL;
+    state->pending = false;
+    state->accepted_time = now;
+    return true;
+}
+
+void ble_advertisement_forget(const char *address)
+{
+    if (filter.states != NULL) {
+        g_hash_table_remove(filter.states, address);
+    }
+}
+
+void ble_advertisement_add_service_uuids(GVariantBuilder *builder)
+{
+    size_t i;
+    for (i = 0; i < BLE_ADVERTISEMENT_FORMAT_COUNT; i++) {
+        const char *uuid = ble_advertisement_formats[i].service_uuid;
+        // Services with GATT translations are already in the filter.
+        if (uuid != NULL && !ble_services_is_supported_service(uuid)) {
+            g_variant_builder_add(builder, "s", uuid);
+        }
+    }
+}
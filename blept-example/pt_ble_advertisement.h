@@ -0,0 +1,122 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef __PT_BLE_ADVERTISEMENT_H__
+#define __PT_BLE_ADVERTISEMENT_H__
+
+#include "stdbool.h"
+#include "stdint.h"
+#include "stddef.h"
+#include "glib.h"
+
+/* Minimum time between two accepted advertisements of a device */
+#define BLE_ADVERTISEMENT_DEFAULT_MIN_INTERVAL_MS 5000
+
+#define BLE_ADVERTISEMENT_MAX_VALUES 8
+#define BLE_ADVERTISEMENT_VALUE_MAX_SIZE 4
+
+/* A sensor value carried in an advertisement. The value is encoded in the format of the GATT
+ * characteristic, so it is decoded with the characteristic translation of a connected device.
+ */
+struct ble_advertisement_value {
+    const char *srvc_uuid;
+    const char *char_uuid;
+    uint8_t value[BLE_ADVERTISEMENT_VALUE_MAX_SIZE];
+    size_t value_size;
+};
+
+struct ble_advertisement {
+    const char *format; /* name of the decoded format, for logging */
+    struct ble_advertisement_value values[BLE_ADVERTISEMENT_MAX_VALUES];
+    int count;
+};
+
+/**
+ * \brief Initializes the duplicate and rate filter of the advertisements.
+ *
+ * \param min_interval_ms Minimum time between two accepted advertisements of a device.
+ */
+void ble_advertisement_init(int min_interval_ms);
+
+/**
+ * \brief Frees the filter state of all devices.
+ */
+void ble_advertisement_free(void);
+
+/**
+ * \brief Checks if the advertisement data of a device is in a supported format.
+ *
+ * \param service_data The ServiceData property of the device (a{sv}) or NULL.
+ * \param manufacturer_data The ManufacturerData property of the device (a{qv}) or NULL.
+ * \return true if at least one sensor value can be decoded.
+ */
+bool ble_advertisement_is_supported(GVariant *service_data, GVariant *manufacturer_data);
+
+/**
+ * \brief Decodes the sensor values of the advertisement data of a device.
+ *
+ * \param service_data The ServiceData property of the device (a{sv}) or NULL.
+ * \param manufacturer_data The ManufacturerData property of the device (a{qv}) or NULL.
+ * \param adv Filled with the decoded values.
+ * \return true if at least one sensor value was decoded.
+ */
+bool ble_advertisement_parse(GVariant *service_data, GVariant *manufacturer_data, struct ble_advertisement *adv);
+
+/**
+ * \brief Decides whether the advertisement data of a device is processed. Data identical to the
+ *        last accepted data is dropped, and changed data is accepted at most once per minimum
+ *        interval. A change that arrives within the interval is kept as pending, replacing an
+ *        earlier pending change, see ble_advertisement_take_pending(). Only data that decodes
+ *        should be passed, so undecodable data does not use up the interval.
+ *        Must be called from the BLE event loop.
+ *
+ * \param address Bluetooth address of the device.
+ * \param service_data The ServiceData property of the device (a{sv}) or NULL.
+ * \param manufacturer_data The ManufacturerData property of the device (a{qv}) or NULL.
+ * \return true if the data should be processed.
+ */
+bool ble_advertisement_accept(const char *address, GVariant *service_data, GVariant *manufacturer_data);
+
+/**
+ * \brief Takes the pending advertisement data of a device once the minimum interval since the
+ *        last accepted data has passed. The pending data becomes the accepted data.
+ *        Must be called from the BLE event loop.
+ *
+ * \param address Bluetooth address of the device.
+ * \param service_data Set to the pending ServiceData or NULL. The caller unrefs it.
+ * \param manufacturer_data Set to the pending ManufacturerData or NULL. The caller unrefs it.
+ * \return true if pending data was taken and should be processed.
+ */
+bool ble_advertisement_take_pending(const char *address, GVariant **service_data, GVariant **manufacturer_data);
+
+/**
+ * \brief Forgets the filter state of a removed device.
+ *
+ * \param address Bluetooth address of the device.
+ */
+void ble_advertisement_forget(const char *address);
+
+/**
+ * \brief Adds the service UUIDs of the supported advertisement formats to a discovery filter.
+ *
+ * \param builder Builder of an "as" array.
+ */
+void ble_advertisement_add_service_uuids(GVariantBuilder *builder);
+
+#endif /* __PT_BLE_ADVERTISEMENT_H__ */
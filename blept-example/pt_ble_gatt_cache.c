@@ -0,0 +1,231 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "pt_ble_gatt_cache.h"
+
+#include <mbed-trace/mbed_trace.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "jansson.h"
+
+#define TRACE_GROUP "ble-gatt-cache"
+
+static char *cache_directory = NULL;
+
+static bool ble_gatt_cache_file_path(const char *address, const char *suffix, char *path, size_t size)
+{
+    if (cache_directory == NULL) {
+        return false;
+    }
+    int length = snprintf(path, size, "%s/%s.json%s", cache_directory, address, suffix);
+    return length > 0 && (size_t) length < size;
+}
+
+// Returns the part of an object path below the device object path, or NULL if it is not below it.
+static const char *ble_gatt_cache_relative_path(const char *device_path, const char *path)
+{
+    size_t length = strlen(device_path);
+    if (path == NULL || strncmp(path, device_path, length) != 0 || path[length] != '/') {
+        return NULL;
+    }
+    return path + length;
+}
+
+void ble_gatt_cache_init(const char *directory)
+{
+    free(cache_directory);
+    cache_directory = NULL;
+    if (directory == NULL) {
+        return;
+    }
+    if (mkdir(directory, 0700) != 0 && errno != EEXIST) {
+        tr_err("Cannot create GATT cache directory %s: %s, the cache is disabled.", directory, strerror(errno));
+        return;
+    }
+    cache_directory = strdup(directory);
+    tr_info("GATT cache directory is %s", directory);
+}
+
+bool ble_gatt_cache_store(const struct ble_device *ble)
+{
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    bool ret = false;
+    int srvc, ch;
+
+    if (!ble_gatt_cache_file_path(ble->attrs.addr, "", path, sizeof(path)) ||
+        !ble_gatt_cache_file_path(ble->attrs.addr, ".tmp", tmp_path, sizeof(tmp_path))) {
+        return false;
+    }
+
+    json_t *json = json_object();
+    json_t *characteristics = json_array();
+    json_object_set_new(json, "version", json_integer(BLE_GATT_CACHE_VERSION));
+    json_object_set_new(json, "address", json_string(ble->attrs.addr));
+    json_object_set(json, "characteristics", characteristics);
+
+    for (srvc = 0; srvc < ble->attrs.services_count; srvc++) {
+        const struct ble_gatt_service *gattservice = &ble->attrs.services[srvc];
+        const char *srvc_path = ble_gatt_cache_relative_path(ble->dbus_path, gattservice->dbus_path);
+        for (ch = 0; ch < gattservice->chars_count; ch++) {
+            const struct ble_gatt_char *gattchar = &gattservice->chars[ch];
+            const char *char_path = ble_gatt_cache_relative_path(ble->dbus_path, gattchar->dbus_path);
+            if (srvc_path == NULL || char_path == NULL) {
+                tr_warn("Characteristic %s is not below device %s, not caching the device.",
+                        gattchar->dbus_path,
+                        ble->dbus_path);
+                goto out;
+            }
+            json_t *entry = json_object();
+            json_object_set_new(entry, "service-uuid", json_string(gattservice->uuid));
+            json_object_set_new(entry, "service-path", json_string(srvc_path));
+            json_object_set_new(entry, "uuid", json_string(gattchar->uuid));
+            json_object_set_new(entry, "path", json_string(char_path));
+            json_object_set_new(entry, "properties", json_integer(gattchar->properties));
+            json_object_set_new(entry, "handle", json_integer(gattchar->handle));
+            json_array_append_new(characteristics, entry);
+        }
+    }
+
+    // Replace the file atomically so a crash never leaves a partial cache behind.
+    if (json_dump_file(json, tmp_path, JSON_COMPACT) != 0 || rename(tmp_path, path) != 0) {
+        tr_warn("Cannot write GATT cache %s: %s", path, strerror(errno));
+        unlink(tmp_path);
+        goto out;
+    }
+    tr_debug("Stored GATT cache of %s", ble->attrs.addr);
+    ret = true;
+
+out:
+    json_decref(characteristics);
+    json_decref(json);
+    return ret;
+}
+
+static bool ble_gatt_cache_copy_uuid(json_t *entry, const char *key, char *uuid)
+{
+    json_t *value = json_object_get(entry, key);
+    if (!json_is_string(value) || strlen(json_string_value(value)) != FORMATTED_UUID_LEN) {
+        return false;
+    }
+    memcpy(uuid, json_string_value(value), FORMATTED_UUID_LEN + 1);
+    return true;
+}
+
+static char *ble_gatt_cache_dup_path(json_t *entry, const char *key)
+{
+    json_t *value = json_object_get(entry, key);
+    if (!json_is_string(value) || json_string_value(value)[0] != '/') {
+        return NULL;
+    }
+    return strdup(json_string_value(value));
+}
+
+struct ble_gatt_cache_entry *ble_gatt_cache_load(const char *address, int *count)
+{
+    char path[PATH_MAX];
+    struct ble_gatt_cache_entry *entries = NULL;
+    json_error_t error;
+    size_t index;
+    json_t *entry;
+    int entries_count = 0;
+
+    *count = 0;
+    if (!ble_gatt_cache_file_path(address, "", path, sizeof(path)) || access(path, R_OK) != 0) {
+        return NULL;
+    }
+
+    json_t *json = json_load_file(path, 0, &error);
+    if (json == NULL) {
+        tr_warn("Cannot parse GATT cache '%s' error: '%s' on line: %d", path, error.text, error.line);
+        goto invalid;
+    }
+    json_t *version = json_object_get(json, "version");
+    json_t *cached_address = json_object_get(json, "address");
+    json_t *characteristics = json_object_get(json, "characteristics");
+    if (!json_is_integer(version) || json_integer_value(version) != BLE_GATT_CACHE_VERSION) {
+        tr_info("GATT cache %s has an old version, discarding it.", path);
+        goto invalid;
+    }
+    if (!json_is_string(cached_address) || strcmp(json_string_value(cached_address), address) != 0 ||
+        !json_is_array(characteristics) || json_array_size(characteristics) == 0) {
+        tr_warn("GATT cache %s is not valid, discarding it.", path);
+        goto invalid;
+    }
+
+    entries = calloc(json_array_size(characteristics), sizeof(struct ble_gatt_cache_entry));
+    if (entries == NULL) {
+        goto out;
+    }
+    json_array_foreach(characteristics, index, entry)
+    {
+        struct ble_gatt_cache_entry *e = &entries[entries_count++];
+        json_t *properties = json_object_get(entry, "properties");
+        json_t *handle = json_object_get(entry, "handle");
+        e->srvc_path = ble_gatt_cache_dup_path(entry, "service-path");
+        e->char_path = ble_gatt_cache_dup_path(entry, "path");
+        if (!ble_gatt_cache_copy_uuid(entry, "service-uuid", e->srvc_uuid) ||
+            !ble_gatt_cache_copy_uuid(entry, "uuid", e->char_uuid) ||
+            e->srvc_path == NULL || e->char_path == NULL ||
+            !json_is_integer(properties) || !json_is_integer(handle)) {
+            tr_warn("GATT cache %s has an invalid characteristic entry, discarding it.", path);
+            ble_gatt_cache_entries_free(entries, entries_count);
+            entries = NULL;
+            goto invalid;
+        }
+        e->properties = (int) json_integer_value(properties);
+        e->handle = (uint16_t) json_integer_value(handle);
+    }
+    *count = entries_count;
+    goto out;
+
+invalid:
+    unlink(path);
+out:
+    json_decref(json);
+    return entries;
+}
+
+void ble_gatt_cache_entries_free(struct ble_gatt_cache_entry *entries, int count)
+{
+    int i;
+    if (entries == NULL) {
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        free(entries[i].srvc_path);
+        free(entries[i].char_path);
+    }
+    free(entries);
+}
+
+void ble_gatt_cache_invalidate(const char *address)
+{
+    char path[PATH_MAX];
+    if (ble_gatt_cache_file_path(address, "", path, sizeof(path)) && unlink(path) == 0) {
+        tr_info("Invalidated GATT cache of %s", address);
+    }
+}
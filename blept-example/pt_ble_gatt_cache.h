@@ -0,0 +1,77 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef __PT_BLE_GATT_CACHE_H__
+#define __PT_BLE_GATT_CACHE_H__
+
+#include "stdbool.h"
+#include "stdint.h"
+#include "devices.h"
+
+/* Bumped whenever the layout of the cache file changes, older files are discarded */
+#define BLE_GATT_CACHE_VERSION 1
+
+/* A discovered characteristic. The paths are relative to the device object path. */
+struct ble_gatt_cache_entry {
+    char srvc_uuid[FORMATTED_UUID_LEN + 1];
+    char *srvc_path;
+    char char_uuid[FORMATTED_UUID_LEN + 1];
+    char *char_path;
+    int properties;
+    uint16_t handle;
+};
+
+/**
+ * \brief Sets the directory of the GATT cache. Each device is stored in its own file
+ *        named after the Bluetooth address.
+ *
+ * \param directory The cache directory, created if it does not exist. NULL disables the cache.
+ */
+void ble_gatt_cache_init(const char *directory);
+
+/**
+ * \brief Stores the discovered services and characteristics of a device.
+ *        The order of the characteristics is kept, so the resources and translations built
+ *        from a loaded cache are identical to the ones built from the discovery.
+ *
+ * \param ble The device. Must be called with the device mutex held.
+ * \return true if the cache was written.
+ */
+bool ble_gatt_cache_store(const struct ble_device *ble);
+
+/**
+ * \brief Loads the cached characteristics of a device.
+ *
+ * \param address Bluetooth address of the device.
+ * \param count Set to the number of entries.
+ * \return The entries, to be freed with ble_gatt_cache_entries_free(). NULL if the device is not
+ *         cached or the cache file is invalid.
+ */
+struct ble_gatt_cache_entry *ble_gatt_cache_load(const char *address, int *count);
+
+void ble_gatt_cache_entries_free(struct ble_gatt_cache_entry *entries, int count);
+
+/**
+ * \brief Removes the cache of a device, e.g. after its GATT database changed.
+ *
+ * \param address Bluetooth address of the device.
+ */
+void ble_gatt_cache_invalidate(const char *address);
+
+#endif /* __PT_BLE_GATT_CACHE_H__ */
@@ -0,0 +1,192 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file pt_ble_publisher.c
+ * \brief Publishes characteristic values to Edge in a thread of its own.
+ *
+ * The BLE event loop only collects the values received from the devices. At the poll tick it posts
+ * each device with changed values to the publisher thread as an idle source on the publisher main
+ * context. The publisher locks the device, translates the values and writes them to Edge.
+ */
+
+#include "pt_ble_publisher.h"
+#include "devices.h"
+
+#include <mbed-trace/mbed_trace.h>
+
+#include <assert.h>
+#include <glib.h>
+
+#define TRACE_GROUP "ble-pb"
+
+static struct {
+    GMainContext *context;
+    GMainLoop *loop;
+    GThread *thread;
+    ble_publisher_publish_cb_t publish_cb;
+    // Devices released in the publisher thread, waiting for the BLE event loop to free them
+    GMutex release_lock;
+    GSList *release_queue;
+    guint release_source_id;
+} ble_publisher;
+
+static gpointer ble_publisher_thread(gpointer data)
+{
+    (void) data;
+
+    g_main_context_push_thread_default(ble_publisher.context);
+    tr_info("Publisher thread started");
+    g_main_loop_run(ble_publisher.loop);
+    g_main_context_pop_thread_default(ble_publisher.context);
+    tr_info("Publisher thread stopped");
+    return NULL;
+}
+
+static void ble_publisher_publish_device(struct ble_device *ble)
+{
+    // The device may have been unregistered after it was posted.
+    if (device_is_registered(ble) && ble->values_dirty) {
+        ble->values_dirty = false;
+        ble_publisher.publish_cb(ble);
+    }
+}
+
+static gboolean ble_publisher_dispatch(gpointer data)
+{
+    struct ble_device *ble = data;
+
+    device_mutex_lock(ble);
+    ble->publish_pending = false;
+    ble_publisher_publish_device(ble);
+    device_mutex_unlock(ble);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean ble_publisher_release_in_event_loop(gpointer data)
+{
+    GSList *queue;
+    GSList *item;
+
+    (void) data;
+    g_mutex_lock(&ble_publisher.release_lock);
+    queue = ble_publisher.release_queue;
+    ble_publisher.release_queue = NULL;
+    ble_publisher.release_source_id = 0;
+    g_mutex_unlock(&ble_publisher.release_lock);
+
+    for (item = queue; item != NULL; item = item->next) {
+        devices_release_device(item->data);
+    }
+    g_slist_free(queue);
+    return G_SOURCE_REMOVE;
+}
+
+static void ble_publisher_release(gpointer data)
+{
+    // Freeing a device cancels its reconnection, which must happen in the BLE event loop. The
+    // devices are queued so that ble_publisher_stop() can release them if the loop has stopped.
+    if (g_thread_self() == ble_publisher.thread) {
+        g_mutex_lock(&ble_publisher.release_lock);
+        ble_publisher.release_queue = g_slist_prepend(ble_publisher.release_queue, data);
+        if (ble_publisher.release_source_id == 0) {
+            ble_publisher.release_source_id = g_idle_add(ble_publisher_release_in_event_loop, NULL);
+        }
+        g_mutex_unlock(&ble_publisher.release_lock);
+    } else {
+        devices_release_device(data);
+    }
+}
+
+static gboolean ble_publisher_quit(gpointer data)
+{
+    g_main_loop_quit(data);
+    return G_SOURCE_REMOVE;
+}
+
+bool ble_publisher_start(ble_publisher_publish_cb_t publish_cb)
+{
+    GError *err = NULL;
+
+    assert(ble_publisher.thread == NULL);
+    ble_publisher.publish_cb = publish_cb;
+    ble_publisher.context = g_main_context_new();
+    ble_publisher.loop = g_main_loop_new(ble_publisher.context, FALSE);
+    ble_publisher.thread = g_thread_try_new("blept-publisher", ble_publisher_thread, NULL, &err);
+    if (ble_publisher.thread == NULL) {
+        tr_warn("Could not start the publisher thread, publishing in the BLE event loop: %s", err->message);
+        g_clear_error(&err);
+        g_main_loop_unref(ble_publisher.loop);
+        g_main_context_unref(ble_publisher.context);
+        ble_publisher.loop = NULL;
+        ble_publisher.context = NULL;
+        return false;
+    }
+    return true;
+}
+
+void ble_publisher_stop(void)
+{
+    GSource *source;
+
+    if (ble_publisher.thread == NULL) {
+        return;
+    }
+    // Quit from the publisher context, a quit before the loop runs would be lost.
+    source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_HIGH);
+    g_source_set_callback(source, ble_publisher_quit, ble_publisher.loop, NULL);
+    g_source_attach(source, ble_publisher.context);
+    g_source_unref(source);
+    g_thread_join(ble_publisher.thread);
+    ble_publisher.thread = NULL;
+
+    // Publish the devices that were still queued when the loop quit, so none is left marked as pending.
+    while (g_main_context_iteration(ble_publisher.context, FALSE)) {
+    }
+    // The BLE event loop is no longer run during the shutdown, release the devices it did not get to.
+    if (ble_publisher.release_source_id != 0) {
+        g_source_remove(ble_publisher.release_source_id);
+    }
+    ble_publisher_release_in_event_loop(NULL);
+    g_main_loop_unref(ble_publisher.loop);
+    g_main_context_unref(ble_publisher.context);
+    ble_publisher.loop = NULL;
+    ble_publisher.context = NULL;
+}
+
+void ble_publisher_publish(struct ble_device *ble)
+{
+    GSource *source;
+
+    if (ble_publisher.thread == NULL) {
+        ble_publisher_publish_device(ble);
+        return;
+    }
+    if (ble->publish_pending) {
+        return;
+    }
+    ble->publish_pending = true;
+    devices_retain_device(ble);
+    source = g_idle_source_new();
+    g_source_set_callback(source, ble_publisher_dispatch, ble, ble_publisher_release);
+    g_source_attach(source, ble_publisher.context);
+    g_source_unref(source);
+}
@@ -0,0 +1,59 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef __PT_BLE_PUBLISHER_H__
+#define __PT_BLE_PUBLISHER_H__
+
+#include "stdbool.h"
+
+struct ble_device;
+
+/**
+ * \brief Decodes the changed characteristic values of a device and writes them to Edge.
+ *        Called in the publisher thread with the device mutex held.
+ */
+typedef void (*ble_publisher_publish_cb_t)(struct ble_device *ble);
+
+/**
+ * \brief Starts the publisher thread. It runs its own GLib main context, so translating values and
+ *        the protocol translator API calls do not delay the BlueZ signals and the GATT call
+ *        completions handled in the default main context.
+ *
+ * \param publish_cb Function that publishes the values of a device.
+ * \return true if the thread is running. If it could not be started, devices are published in the
+ *         calling thread and false is returned.
+ */
+bool ble_publisher_start(ble_publisher_publish_cb_t publish_cb);
+
+/**
+ * \brief Stops the publisher thread and waits for it to exit. Devices that are still waiting to be
+ *        published are published in the calling thread. Must be called in the BLE event loop thread
+ *        after the loop has stopped, the devices released by the publisher thread that the loop did
+ *        not get to are released here.
+ */
+void ble_publisher_stop(void);
+
+/**
+ * \brief Passes a device with changed values to the publisher thread. The message holds a reference
+ *        to the device. A device is queued at most once, later changes are published together
+ *        with the queued ones. Must be called with the device mutex held.
+ */
+void ble_publisher_publish(struct ble_device *ble);
+
+#endif /* __PT_BLE_PUBLISHER_H__ */
@@ -0,0 +1,592 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "pt_ble_scheduler.h"
+#include "pt_ble_adapters.h"
+
+#include <mbed-trace/mbed_trace.h>
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_GROUP "ble-sched"
+
+typedef enum {
+    BLE_CONNECT_IDLE,
+    BLE_CONNECT_WAITING, /* in the reconnection heap */
+    BLE_CONNECT_QUEUED,
+    BLE_CONNECT_CONNECTING
+} ble_connect_state_t;
+
+struct ble_connect_entry {
+    char *dbus_path;
+    GDBusProxy *proxy; /* referenced only while waiting or queued */
+    ble_scheduler_priority_t priority;
+    ble_connect_state_t state;
+    int adapter;                  /* index of the adapter of the device object */
+    gint64 first_request_time;
+    bool first_value_received;
+    /* Reconnection state */
+    gint64 reconnect_due;         /* monotonic time of the next attempt while waiting */
+    guint heap_index;             /* position in the reconnection heap while waiting */
+    guint32 reconnect_delay_ms;   /* previous delay, 0 when the device is connected */
+    gint64 disconnect_time;       /* first reconnection request since the last connection */
+    bool reconnecting;            /* the Connect call in flight is a reconnection */
+    bool pending_writes;
+};
+
+/* Each adapter sets up its connections independently of the others */
+struct ble_scheduler_adapter {
+    int connecting;
+    GQueue queues[BLE_SCHEDULER_PRIORITY_COUNT];
+};
+
+static struct {
+    ble_scheduler_connect_cb_t connect_cb;
+    int max_connecting; /* per adapter */
+    struct ble_scheduler_adapter *adapters;
+    int adapter_count;
+    GHashTable *entries; /* dbus path -> struct ble_connect_entry */
+    /* Time to first value of the devices scheduled since the fleet was last idle */
+    GArray *ttfv_ms;
+    int awaiting_first_value;
+    gint64 fleet_start_time;
+    /* Devices waiting to reconnect, a binary min-heap on reconnect_due */
+    GPtrArray *reconnect_heap;
+    guint reconnect_source;
+    unsigned int reconnect_attempts;
+    unsigned int reconnect_successes;
+    gint64 time_to_reconnect_ms[BLE_SCHEDULER_RECONNECT_SAMPLES]; /* ring of the latest samples */
+    unsigned int time_to_reconnect_count;
+} scheduler;
+
+static void ble_scheduler_dispatch(void);
+
+static GQueue *ble_scheduler_queue_of(const struct ble_connect_entry *entry)
+{
+    return &scheduler.adapters[entry->adapter].queues[entry->priority];
+}
+
+static void ble_connect_entry_free(gpointer data)
+{
+    struct ble_connect_entry *entry = data;
+    if (entry->proxy) {
+        g_object_unref(entry->proxy);
+    }
+    free(entry->dbus_path);
+    free(entry);
+}
+
+static gint ble_scheduler_compare_ms(gconstpointer a, gconstpointer b)
+{
+    gint64 lhs = *(const gint64 *) a;
+    gint64 rhs = *(const gint64 *) b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static void ble_scheduler_report_fleet(void)
+{
+    if (scheduler.ttfv_ms->len == 0) {
+        return;
+    }
+    g_array_sort(scheduler.ttfv_ms, ble_scheduler_compare_ms);
+    gint64 median = g_array_index(scheduler.ttfv_ms, gint64, scheduler.ttfv_ms->len / 2);
+    gint64 max = g_array_index(scheduler.ttfv_ms, gint64, scheduler.ttfv_ms->len - 1);
+    gint64 total = (g_get_monotonic_time() - scheduler.fleet_start_time) / 1000;
+    tr_info("Fleet of %u devices delivered first values in %" PRId64 " ms, time to first value median %" PRId64
+            " ms, max %" PRId64 " ms.",
+            scheduler.ttfv_ms->len,
+            total,
+            median,
+            max);
+    g_array_set_size(scheduler.ttfv_ms, 0);
+}
+
+static void ble_scheduler_stop_waiting_first_value(struct ble_connect_entry *entry)
+{
+    entry->first_value_received = true;
+    scheduler.awaiting_first_value--;
+    if (scheduler.awaiting_first_value == 0) {
+        ble_scheduler_report_fleet();
+    }
+}
+
+static struct ble_connect_entry *ble_scheduler_heap_entry(guint index)
+{
+    return g_ptr_array_index(scheduler.reconnect_heap, index);
+}
+
+static void ble_scheduler_heap_set(guint index, struct ble_connect_entry *entry)
+{
+    g_ptr_array_index(scheduler.reconnect_heap, index) = entry;
+    entry->heap_index = index;
+}
+
+static void ble_scheduler_heap_sift_up(guint index)
+{
+    struct ble_connect_entry *entry = ble_scheduler_heap_entry(index);
+    while (index > 0) {
+        guint parent = (index - 1) / 2;
+        if (ble_scheduler_heap_entry(parent)->reconnect_due <= entry->reconnect_due) {
+            break;
+        }
+        ble_scheduler_heap_set(index, ble_scheduler_heap_entry(parent));
+        index = parent;
+    }
+    ble_scheduler_heap_set(index, entry);
+}
+
+static void ble_scheduler_heap_sift_down(guint index)
+{
+    guint len = scheduler.reconnect_heap->len;
+    struct ble_connect_entry *entry = ble_scheduler_heap_entry(index);
+    for (;;) {
+        guint child = 2 * index + 1;
+        if (child >= len) {
+            break;
+        }
+        if (child + 1 < len &&
+            ble_scheduler_heap_entry(child + 1)->reconnect_due < ble_scheduler_heap_entry(child)->reconnect_due) {
+            child++;
+        }
+        if (entry->reconnect_due <= ble_scheduler_heap_entry(child)->reconnect_due) {
+            break;
+        }
+        ble_scheduler_heap_set(index, ble_scheduler_heap_entry(child));
+        index = child;
+    }
+    ble_scheduler_heap_set(index, entry);
+}
+
+static void ble_scheduler_heap_push(struct ble_connect_entry *entry)
+{
+    g_ptr_array_add(scheduler.reconnect_heap, entry);
+    ble_scheduler_heap_sift_up(scheduler.reconnect_heap->len - 1);
+}
+
+static void ble_scheduler_heap_remove(struct ble_connect_entry *entry)
+{
+    guint index = entry->heap_index;
+    struct ble_connect_entry *last = g_ptr_array_remove_index(scheduler.reconnect_heap,
+                                                              scheduler.reconnect_heap->len - 1);
+    if (last != entry) {
+        ble_scheduler_heap_set(index, last);
+        ble_scheduler_heap_sift_up(index);
+        ble_scheduler_heap_sift_down(last->heap_index);
+    }
+}
+
+static gboolean ble_scheduler_reconnect_timeout(gpointer data);
+
+// Arms the single reconnection timer for the earliest due device.
+static void ble_scheduler_arm_reconnect_timer(void)
+{
+    if (scheduler.reconnect_source != 0) {
+        g_source_remove(scheduler.reconnect_source);
+        scheduler.reconnect_source = 0;
+    }
+    if (scheduler.reconnect_heap->len == 0) {
+        return;
+    }
+    gint64 wait_us = ble_scheduler_heap_entry(0)->reconnect_due - g_get_monotonic_time();
+    guint wait_ms = wait_us > 0 ? (guint) ((wait_us + 999) / 1000) : 0;
+    scheduler.reconnect_source = g_timeout_add_full(G_PRIORITY_HIGH, wait_ms, ble_scheduler_reconnect_timeout, NULL, NULL);
+}
+
+static void ble_scheduler_queue_reconnect(struct ble_connect_entry *entry)
+{
+    entry->state = BLE_CONNECT_QUEUED;
+    entry->reconnecting = true;
+    entry->priority = entry->pending_writes ? BLE_SCHEDULER_PRIORITY_PENDING_WRITES : BLE_SCHEDULER_PRIORITY_HIGH;
+    g_queue_push_tail(ble_scheduler_queue_of(entry), entry);
+}
+
+static gboolean ble_scheduler_reconnect_timeout(gpointer data)
+{
+    (void) data;
+    gint64 now = g_get_monotonic_time();
+
+    scheduler.reconnect_source = 0;
+    while (scheduler.reconnect_heap->len > 0 && ble_scheduler_heap_entry(0)->reconnect_due <= now) {
+        struct ble_connect_entry *entry = ble_scheduler_heap_entry(0);
+        ble_scheduler_heap_remove(entry);
+        ble_scheduler_queue_reconnect(entry);
+    }
+    ble_scheduler_arm_reconnect_timer();
+    ble_scheduler_dispatch();
+    return G_SOURCE_REMOVE;
+}
+
+static gint64 ble_scheduler_time_to_reconnect_median(gint64 *max)
+{
+    unsigned int count = MIN(scheduler.time_to_reconnect_count, BLE_SCHEDULER_RECONNECT_SAMPLES);
+    gint64 sorted[BLE_SCHEDULER_RECONNECT_SAMPLES];
+
+    *max = 0;
+    if (count == 0) {
+        return 0;
+    }
+    memcpy(sorted, scheduler.time_to_reconnect_ms, count * sizeof(gint64));
+    qsort(sorted, count, sizeof(gint64), ble_scheduler_compare_ms);
+    *max = sorted[count - 1];
+    return sorted[count / 2];
+}
+
+static void ble_scheduler_record_reconnect(struct ble_connect_entry *entry, bool connected)
+{
+    scheduler.reconnect_attempts++;
+    if (!connected) {
+        return;
+    }
+    scheduler.reconnect_successes++;
+
+    gint64 ttr = (g_get_monotonic_time() - entry->disconnect_time) / 1000;
+    gint64 median, max;
+    scheduler.time_to_reconnect_ms[scheduler.time_to_reconnect_count % BLE_SCHEDULER_RECONNECT_SAMPLES] = ttr;
+    scheduler.time_to_reconnect_count++;
+    median = ble_scheduler_time_to_reconnect_median(&max);
+    tr_info("Device %s reconnected after %" PRId64 " ms. Reconnects succeeded %u of %u, time to reconnect median %"
+            PRId64 " ms, max %" PRId64 " ms.",
+            entry->dbus_path,
+            ttr,
+            scheduler.reconnect_successes,
+            scheduler.reconnect_attempts,
+            median,
+            max);
+}
+
+static void ble_scheduler_dispatch_adapter(struct ble_scheduler_adapter *adapter)
+{
+    while (adapter->connecting < scheduler.max_connecting) {
+        struct ble_connect_entry *entry = NULL;
+        int priority;
+        for (priority = BLE_SCHEDULER_PRIORITY_COUNT - 1; priority >= 0 && entry == NULL; priority--) {
+            entry = g_queue_pop_head(&adapter->queues[priority]);
+        }
+        if (entry == NULL) {
+            break;
+        }
+        GDBusProxy *proxy = entry->proxy;
+        entry->proxy = NULL;
+        entry->state = BLE_CONNECT_CONNECTING;
+        adapter->connecting++;
+        tr_debug("Starting connection to %s (%d/%d in flight, %u queued)",
+                 entry->dbus_path,
+                 adapter->connecting,
+                 scheduler.max_connecting,
+                 adapter->queues[BLE_SCHEDULER_PRIORITY_NORMAL].length +
+                 adapter->queues[BLE_SCHEDULER_PRIORITY_HIGH].length +
+                 adapter->queues[BLE_SCHEDULER_PRIORITY_PENDING_WRITES].length);
+        scheduler.connect_cb(proxy);
+        g_object_unref(proxy);
+    }
+}
+
+static void ble_scheduler_dispatch(void)
+{
+    int i;
+    for (i = 0; i < scheduler.adapter_count; i++) {
+        ble_scheduler_dispatch_adapter(&scheduler.adapters[i]);
+    }
+}
+
+void ble_scheduler_init(int max_connecting, ble_scheduler_connect_cb_t connect_cb)
+{
+    int i, priority;
+    assert(max_connecting > 0);
+    assert(connect_cb != NULL);
+    scheduler.connect_cb = connect_cb;
+    scheduler.max_connecting = max_connecting;
+    scheduler.adapter_count = MAX(ble_adapters_count(), 1);
+    scheduler.adapters = g_new0(struct ble_scheduler_adapter, scheduler.adapter_count);
+    for (i = 0; i < scheduler.adapter_count; i++) {
+        for (priority = 0; priority < BLE_SCHEDULER_PRIORITY_COUNT; priority++) {
+            g_queue_init(&scheduler.adapters[i].queues[priority]);
+        }
+    }
+    scheduler.entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, ble_connect_entry_free);
+    scheduler.ttfv_ms = g_array_new(FALSE, FALSE, sizeof(gint64));
+    scheduler.awaiting_first_value = 0;
+    scheduler.reconnect_heap = g_ptr_array_new();
+    scheduler.reconnect_source = 0;
+}
+
+void ble_scheduler_free(void)
+{
+    struct ble_scheduler_reconnect_metrics metrics;
+    int i, priority;
+
+    if (scheduler.entries == NULL) {
+        return;
+    }
+    ble_scheduler_get_reconnect_metrics(&metrics);
+    if (metrics.attempts > 0) {
+        tr_info("Reconnects succeeded %u of %u, time to reconnect median %" PRId64 " ms, max %" PRId64 " ms.",
+                metrics.successes,
+                metrics.attempts,
+                metrics.time_to_reconnect_median_ms,
+                metrics.time_to_reconnect_max_ms);
+    }
+    if (scheduler.reconnect_source != 0) {
+        g_source_remove(scheduler.reconnect_source);
+        scheduler.reconnect_source = 0;
+    }
+    g_ptr_array_free(scheduler.reconnect_heap, TRUE);
+    scheduler.reconnect_heap = NULL;
+    for (i = 0; i < scheduler.adapter_count; i++) {
+        for (priority = 0; priority < BLE_SCHEDULER_PRIORITY_COUNT; priority++) {
+            g_queue_clear(&scheduler.adapters[i].queues[priority]);
+        }
+    }
+    g_free(scheduler.adapters);
+    scheduler.adapters = NULL;
+    g_hash_table_destroy(scheduler.entries);
+    scheduler.entries = NULL;
+    g_array_free(scheduler.ttfv_ms, TRUE);
+    scheduler.ttfv_ms = NULL;
+}
+
+static struct ble_connect_entry *ble_scheduler_get_entry(const char *dbus_path)
+{
+    struct ble_connect_entry *entry = g_hash_table_lookup(scheduler.entries, dbus_path);
+
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(struct ble_connect_entry));
+        if (entry == NULL) {
+            return NULL;
+        }
+        entry->dbus_path = strdup(dbus_path);
+        entry->state = BLE_CONNECT_IDLE;
+        entry->adapter = MAX(ble_adapters_index_of_path(dbus_path), 0);
+        entry->first_request_time = g_get_monotonic_time();
+        if (scheduler.awaiting_first_value == 0) {
+            scheduler.fleet_start_time = entry->first_request_time;
+        }
+        scheduler.awaiting_first_value++;
+        g_hash_table_insert(scheduler.entries, entry->dbus_path, entry);
+    }
+    return entry;
+}
+
+void ble_scheduler_request_connect(GDBusProxy *proxy, ble_scheduler_priority_t priority)
+{
+    const char *dbus_path = g_dbus_proxy_get_object_path(proxy);
+    struct ble_connect_entry *entry = ble_scheduler_get_entry(dbus_path);
+
+    if (entry == NULL) {
+        tr_err("Could not allocate connection request for %s, connecting immediately.", dbus_path);
+        scheduler.connect_cb(proxy);
+        return;
+    }
+
+    switch (entry->state) {
+    case BLE_CONNECT_CONNECTING:
+        tr_debug("Connection to %s is already in progress.", dbus_path);
+        return;
+    case BLE_CONNECT_WAITING:
+        // An explicit request does not wait for the back-off.
+        ble_scheduler_heap_remove(entry);
+        ble_scheduler_arm_reconnect_timer();
+        entry->state = BLE_CONNECT_QUEUED;
+        entry->priority = entry->pending_writes ? BLE_SCHEDULER_PRIORITY_PENDING_WRITES : priority;
+        g_queue_push_tail(ble_scheduler_queue_of(entry), entry);
+        break;
+    case BLE_CONNECT_QUEUED:
+        if (priority > entry->priority) {
+            g_queue_remove(ble_scheduler_queue_of(entry), entry);
+            entry->priority = priority;
+            g_queue_push_tail(ble_scheduler_queue_of(entry), entry);
+        }
+        return;
+    case BLE_CONNECT_IDLE:
+        entry->proxy = g_object_ref(proxy);
+        entry->priority = priority;
+        entry->state = BLE_CONNECT_QUEUED;
+        g_queue_push_tail(ble_scheduler_queue_of(entry), entry);
+        break;
+    }
+    ble_scheduler_dispatch();
+}
+
+bool ble_scheduler_request_reconnect(GDBusProxy *proxy, uint32_t *delay_ms)
+{
+    const char *dbus_path = g_dbus_proxy_get_object_path(proxy);
+    struct ble_connect_entry *entry = ble_scheduler_get_entry(dbus_path);
+    gint64 now = g_get_monotonic_time();
+    guint32 upper;
+
+    if (entry == NULL) {
+        tr_err("Could not allocate reconnection request for %s", dbus_path);
+        return false;
+    }
+    if (entry->state != BLE_CONNECT_IDLE) {
+        return false;
+    }
+    if (entry->disconnect_time == 0) {
+        entry->disconnect_time = now;
+    }
+    // Decorrelated jitter: the next delay is random between the base and three times the
+    // previous delay, capped. The first delay uses the base as the previous one, so devices that
+    // dropped together do not all retry after the same delay.
+    upper = MAX(entry->reconnect_delay_ms, BLE_SCHEDULER_RECONNECT_BASE_MS) * 3;
+    upper = MIN(upper, BLE_SCHEDULER_RECONNECT_CAP_MS);
+    entry->reconnect_delay_ms = g_random_int_range(BLE_SCHEDULER_RECONNECT_BASE_MS, upper + 1);
+    *delay_ms = entry->reconnect_delay_ms;
+
+    entry->proxy = g_object_ref(proxy);
+    entry->state = BLE_CONNECT_WAITING;
+    entry->reconnect_due = now + (gint64) entry->reconnect_delay_ms * 1000;
+    ble_scheduler_heap_push(entry);
+    if (entry->heap_index == 0) {
+        ble_scheduler_arm_reconnect_timer();
+    }
+    return true;
+}
+
+void ble_scheduler_cancel_reconnect(const char *dbus_path)
+{
+    if (scheduler.entries == NULL) {
+        return;
+    }
+    struct ble_connect_entry *entry = g_hash_table_lookup(scheduler.entries, dbus_path);
+    if (entry == NULL || entry->state != BLE_CONNECT_WAITING) {
+        return;
+    }
+    ble_scheduler_heap_remove(entry);
+    ble_scheduler_arm_reconnect_timer();
+    g_object_unref(entry->proxy);
+    entry->proxy = NULL;
+    entry->state = BLE_CONNECT_IDLE;
+}
+
+void ble_scheduler_pending_writes(const char *dbus_path)
+{
+    if (scheduler.entries == NULL) {
+        return;
+    }
+    struct ble_connect_entry *entry = g_hash_table_lookup(scheduler.entries, dbus_path);
+    if (entry == NULL || entry->pending_writes) {
+        return;
+    }
+    entry->pending_writes = true;
+    if (entry->state == BLE_CONNECT_WAITING) {
+        tr_debug("Writes are pending for %s, reconnecting without waiting for the back-off.", dbus_path);
+        ble_scheduler_heap_remove(entry);
+        ble_scheduler_arm_reconnect_timer();
+        ble_scheduler_queue_reconnect(entry);
+        ble_scheduler_dispatch();
+    } else if (entry->state == BLE_CONNECT_QUEUED && entry->reconnecting) {
+        g_queue_remove(ble_scheduler_queue_of(entry), entry);
+        ble_scheduler_queue_reconnect(entry);
+        ble_scheduler_dispatch();
+    }
+}
+
+void ble_scheduler_connect_finished(const char *dbus_path, bool connected)
+{
+    if (scheduler.entries == NULL) {
+        return;
+    }
+    struct ble_connect_entry *entry = g_hash_table_lookup(scheduler.entries, dbus_path);
+    if (entry == NULL || entry->state != BLE_CONNECT_CONNECTING) {
+        return;
+    }
+    entry->state = BLE_CONNECT_IDLE;
+    scheduler.adapters[entry->adapter].connecting--;
+    if (entry->reconnecting) {
+        ble_scheduler_record_reconnect(entry, connected);
+        entry->reconnecting = false;
+    }
+    if (connected) {
+        entry->disconnect_time = 0;
+        entry->reconnect_delay_ms = 0;
+        entry->pending_writes = false;
+    }
+    tr_debug("Connect call of %s finished after %" PRId64 " ms.",
+             dbus_path,
+             (g_get_monotonic_time() - entry->first_request_time) / 1000);
+    ble_scheduler_dispatch();
+}
+
+void ble_scheduler_cancel(const char *dbus_path)
+{
+    if (scheduler.entries == NULL) {
+        return;
+    }
+    struct ble_connect_entry *entry = g_hash_table_lookup(scheduler.entries, dbus_path);
+    if (entry == NULL) {
+        return;
+    }
+    if (entry->state == BLE_CONNECT_WAITING) {
+        ble_scheduler_heap_remove(entry);
+        ble_scheduler_arm_reconnect_timer();
+    } else if (entry->state == BLE_CONNECT_QUEUED) {
+        g_queue_remove(ble_scheduler_queue_of(entry), entry);
+    } else if (entry->state == BLE_CONNECT_CONNECTING) {
+        scheduler.adapters[entry->adapter].connecting--;
+    }
+    if (!entry->first_value_received) {
+        ble_scheduler_stop_waiting_first_value(entry);
+    }
+    g_hash_table_remove(scheduler.entries, dbus_path);
+    ble_scheduler_dispatch();
+}
+
+void ble_scheduler_first_value(const char *dbus_path)
+{
+    if (scheduler.entries == NULL) {
+        return;
+    }
+    struct ble_connect_entry *entry = g_hash_table_lookup(scheduler.entries, dbus_path);
+    if (entry == NULL || entry->first_value_received) {
+        return;
+    }
+    gint64 ttfv = (g_get_monotonic_time() - entry->first_request_time) / 1000;
+    tr_info("Device %s delivered its first value %" PRId64 " ms after the connection was requested.",
+            dbus_path,
+            ttfv);
+    g_array_append_val(scheduler.ttfv_ms, ttfv);
+    ble_scheduler_stop_waiting_first_value(entry);
+}
+
+void ble_scheduler_no_first_value(const char *dbus_path)
+{
+    if (scheduler.entries == NULL) {
+        return;
+    }
+    struct ble_connect_entry *entry = g_hash_table_lookup(scheduler.entries, dbus_path);
+    if (entry == NULL || entry->first_value_received) {
+        return;
+    }
+    tr_debug("Device %s has no readable or notifying characteristics, not waiting for its first value.", dbus_path);
+    ble_scheduler_stop_waiting_first_value(entry);
+}
+
+void ble_scheduler_get_reconnect_metrics(struct ble_scheduler_reconnect_metrics *metrics)
+{
+    gint64 max;
+    metrics->attempts = scheduler.reconnect_attempts;
+    metrics->successes = scheduler.reconnect_successes;
+    metrics->samples = MIN(scheduler.time_to_reconnect_count, BLE_SCHEDULER_RECONNECT_SAMPLES);
+    metrics->time_to_reconnect_median_ms = ble_scheduler_time_to_reconnect_median(&max);
+    metrics->time_to_reconnect_max_ms = max;
+}
@@ -0,0 +1,154 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef __PT_BLE_SCHEDULER_H__
+#define __PT_BLE_SCHEDULER_H__
+
+#include "stdbool.h"
+#include "stdint.h"
+#include "glib.h"
+#include "gio/gio.h"
+
+/* Bounds of the reconnection delay. Each delay is drawn from [base, 3 * previous delay]. */
+#define BLE_SCHEDULER_RECONNECT_BASE_MS 4000
+#define BLE_SCHEDULER_RECONNECT_CAP_MS 300000
+
+/* Number of most recent reconnections the time to reconnect statistics are computed from */
+#define BLE_SCHEDULER_RECONNECT_SAMPLES 1024
+
+typedef enum {
+    BLE_SCHEDULER_PRIORITY_NORMAL = 0,
+    /* Devices that BlueZ already knows, whitelisted devices and reconnects */
+    BLE_SCHEDULER_PRIORITY_HIGH,
+    /* Reconnects of devices with characteristic writes waiting for the connection */
+    BLE_SCHEDULER_PRIORITY_PENDING_WRITES,
+    BLE_SCHEDULER_PRIORITY_COUNT
+} ble_scheduler_priority_t;
+
+struct ble_scheduler_reconnect_metrics {
+    unsigned int attempts;          /* reconnection Connect calls that completed */
+    unsigned int successes;         /* of which succeeded */
+    unsigned int samples;           /* reconnections the times below are computed from */
+    int64_t time_to_reconnect_median_ms;
+    int64_t time_to_reconnect_max_ms;
+};
+
+/**
+ * \brief Issues the BlueZ Connect call for the device. The scheduler expects
+ *        ble_scheduler_connect_finished() to be called when the call completes.
+ */
+typedef void (*ble_scheduler_connect_cb_t)(GDBusProxy *proxy);
+
+/**
+ * \brief Initializes the connection scheduler.
+ *
+ *        The scheduler bounds the number of Connect calls that are in flight at the same time.
+ *        A slot is released as soon as the Connect call of a device completes, so the connection
+ *        of the next device is set up while BlueZ resolves the services of the previous one.
+ *        Each adapter of ble_adapters_init() has its own queues and slots, the adapter of a request
+ *        is taken from the device object path. All scheduler functions must be called from the
+ *        BLE event loop.
+ *
+ * \param max_connecting Maximum number of Connect calls in flight on each adapter.
+ * \param connect_cb Function that issues the Connect call.
+ */
+void ble_scheduler_init(int max_connecting, ble_scheduler_connect_cb_t connect_cb);
+
+/**
+ * \brief Cancels the queued connections and frees the scheduler state.
+ */
+void ble_scheduler_free(void);
+
+/**
+ * \brief Queues a connection to the device. High priority requests are served before normal
+ *        priority ones. A device that is already queued or connecting is not queued again, but
+ *        its priority may be raised.
+ *
+ * \param proxy The device proxy. The scheduler holds a reference while the request is queued.
+ * \param priority Priority of the request.
+ */
+void ble_scheduler_request_connect(GDBusProxy *proxy, ble_scheduler_priority_t priority);
+
+/**
+ * \brief Schedules a reconnection to a disconnected device. All devices waiting to reconnect
+ *        are kept in one min-heap ordered by their due time and served by a single timer. The
+ *        delay uses decorrelated jitter, so devices that dropped at the same time do not retry
+ *        in lockstep. Due devices are queued like other connection requests and are subject to
+ *        the same bound of Connect calls in flight.
+ *
+ * \param proxy The device proxy. The scheduler holds a reference while the device waits.
+ * \param delay_ms Set to the delay of the reconnection.
+ * \return false if the device already waits for a reconnection or is connecting.
+ */
+bool ble_scheduler_request_reconnect(GDBusProxy *proxy, uint32_t *delay_ms);
+
+/**
+ * \brief Cancels a scheduled reconnection of a device.
+ *
+ * \param dbus_path Object path of the device.
+ */
+void ble_scheduler_cancel_reconnect(const char *dbus_path);
+
+/**
+ * \brief Marks that characteristic writes wait for the device. A device waiting to reconnect
+ *        is queued right away, ahead of devices without pending writes.
+ *
+ * \param dbus_path Object path of the device.
+ */
+void ble_scheduler_pending_writes(const char *dbus_path);
+
+/**
+ * \brief Releases the slot of a completed Connect call and starts the next queued connection.
+ *
+ * \param dbus_path Object path of the device.
+ * \param connected true if the Connect call succeeded.
+ */
+void ble_scheduler_connect_finished(const char *dbus_path, bool connected);
+
+/**
+ * \brief Forgets a device that was removed. A queued request is dropped.
+ *
+ * \param dbus_path Object path of the device.
+ */
+void ble_scheduler_cancel(const char *dbus_path);
+
+/**
+ * \brief Records the first characteristic value of a device. The time from the first connection
+ *        request to the first value is logged per device, and a summary is logged when every
+ *        scheduled device has delivered its first value.
+ *
+ * \param dbus_path Object path of the device.
+ */
+void ble_scheduler_first_value(const char *dbus_path);
+
+/**
+ * \brief Stops waiting for the first value of a device that has no readable or notifying
+ *        characteristics, so the device does not hold back the fleet summary. The device is
+ *        left out of the time to first value statistics.
+ *
+ * \param dbus_path Object path of the device.
+ */
+void ble_scheduler_no_first_value(const char *dbus_path);
+
+/**
+ * \brief Returns the reconnection success rate and time to reconnect statistics.
+ */
+void ble_scheduler_get_reconnect_metrics(struct ble_scheduler_reconnect_metrics *metrics);
+
+#endif /* __PT_BLE_SCHEDULER_H__ */
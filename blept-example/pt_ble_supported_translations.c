@@ -42,6 +42,7 @@
 
 
 // Define supported characteristics table for each supported service
+// Environmental values change slowly, so sensors without notify support are read less often.
 static const ble_characteristic_t environment_sensing_characteristics[] =
 {
     // Temperature
@@ -52,7 +53,8 @@ static const ble_characteristic_t environment_sensing_characteristics[] =
      .value_format_descriptor = {
             .format = VALUE_FORMAT_INT16,
             .exponent = -2
-        }
+        },
+     .poll_interval_ms = 10000
     },
     // Humidity
     {.uuid = "00002A6F-0000-1000-8000-00805F9B34FB",
@@ -62,7 +64,8 @@ static const ble_characteristic_t environment_sensing_characteristics[] =
      .value_format_descriptor = {
             .format = VALUE_FORMAT_UINT16,
             .exponent = -2
-        }
+        },
+     .poll_interval_ms = 10000
     },
     // Barometer
     {.uuid = "00002A6D-0000-1000-8000-00805F9B34FB",
@@ -72,7 +75,8 @@ static const ble_characteristic_t environment_sensing_characteristics[] =
      .value_format_descriptor = {
             .format = VALUE_FORMAT_UINT32,
             .exponent = -1
-        }
+        },
+     .poll_interval_ms = 30000
     }
 };
 
@@ -398,11 +402,133 @@ bool ble_services_construct_dis_service(struct ble_device *device,
     return true;
 }
 
+// Returns the number of bits read from the characteristic for the integer and float formats, 0 if
+// the format is not supported.
+static int value_format_bits(const value_format_t format, bool *is_signed)
+{
+    *is_signed = false;
+    switch (format) {
+    case VALUE_FORMAT_INT8:
+        *is_signed = true;
+        /* fall through */
+    case VALUE_FORMAT_BOOLEAN:
+    case VALUE_FORMAT_UINT2:
+    case VALUE_FORMAT_UINT4:
+    case VALUE_FORMAT_UINT8:
+        return 8;
+    case VALUE_FORMAT_INT12:
+    case VALUE_FORMAT_INT16:
+        *is_signed = true;
+        /* fall through */
+    case VALUE_FORMAT_UINT12:
+    case VALUE_FORMAT_UINT16:
+        return 16;
+    case VALUE_FORMAT_INT24:
+        *is_signed = true;
+        /* fall through */
+    case VALUE_FORMAT_UINT24:
+        return 24;
+    case VALUE_FORMAT_INT32:
+        *is_signed = true;
+        /* fall through */
+    case VALUE_FORMAT_UINT32:
+    case VALUE_FORMAT_FLOAT32_IEEE754:
+        return 32;
+    default:
+        return 0;
+    }
+}
+
+static void write_big_endian(uint8_t *buf, const uint32_t value, const size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        buf[i] = (uint8_t)(value >> ((size - 1 - i) * 8));
+    }
+}
+
+bool ble_services_decode_formatted_value(const ble_services_characteristic_value_format_t *format_descriptor,
+                                         const double scale,
+                                         const uint8_t *value,
+                                         const size_t value_size,
+                                         uint8_t *value_out,
+                                         size_t *value_out_len,
+                                         float *float_value_out)
+{
+    assert(format_descriptor != NULL);
+    assert(value != NULL);
+    assert(value_out != NULL);
+    assert(value_out_len != NULL);
+
+    value_format_t format = format_descriptor->format;
+    bool is_signed;
+    int bits = value_format_bits(format, &is_signed);
+    if (bits == 0) {
+        return false;
+    }
+    if (*value_out_len < sizeof(uint32_t)) {
+        return false;
+    }
+
+    // Values are little endian in the characteristic
+    size_t num_bytes = (value_size > (size_t) bits / 8 ? (size_t) bits / 8 : value_size);
+    uint32_t raw_value = 0;
+    for (size_t i = 0; i < num_bytes; i++) {
+        raw_value |= ((uint32_t) value[i]) << (i * 8);
+    }
+    // 12 bit values are read from two octets, the upper four bits are not part of the value
+    int value_bits = bits;
+    if (format == VALUE_FORMAT_INT12 || format == VALUE_FORMAT_UINT12) {
+        value_bits = 12;
+        raw_value &= (1u << value_bits) - 1;
+    }
+    int64_t integer_value = raw_value;
+    if (is_signed && value_bits < 32 && (raw_value & (1u << (value_bits - 1)))) {
+        integer_value -= ((int64_t) 1 << value_bits);
+    } else if (is_signed && value_bits == 32) {
+        integer_value = (int32_t) raw_value;
+    }
+
+    if (format_descriptor->exponent < 0 || format == VALUE_FORMAT_FLOAT32_IEEE754) {
+        // Represent as float
+        float float_value;
+        if (format == VALUE_FORMAT_FLOAT32_IEEE754) {
+            memcpy(&float_value, &raw_value, sizeof(float_value));
+            float_value = (float)(float_value * scale);
+        } else {
+            float_value = (float)(integer_value * scale);
+        }
+        convert_float_value_to_network_byte_order(float_value, value_out);
+        *value_out_len = sizeof(float);
+        if (float_value_out != NULL) {
+            *float_value_out = float_value;
+        }
+        return true;
+    }
+
+    // Represent as int
+    integer_value = (int64_t)(integer_value * scale);
+    if (format == VALUE_FORMAT_BOOLEAN) {
+        value_out[0] = ((integer_value & 0xFF) > 0);
+        *value_out_len = sizeof(uint8_t);
+    } else if (bits == 8) {
+        value_out[0] = integer_value & 0xFF;
+        *value_out_len = sizeof(uint8_t);
+    } else if (bits == 16) {
+        write_big_endian(value_out, (uint32_t) integer_value, sizeof(uint16_t));
+        *value_out_len = sizeof(uint16_t);
+    } else {
+        write_big_endian(value_out, (uint32_t) integer_value, sizeof(uint32_t));
+        *value_out_len = sizeof(uint32_t);
+    }
+    return true;
+}
+
 bool ble_services_decode_value_with_format_descriptor(const struct ble_device *device,
                                                       const struct translation_context *ctx,
                                                       const uint8_t *value,
                                                       const size_t value_size,
-                                                      uint8_t **value_out,
+                                                      uint8_t *value_out,
                                                       size_t *value_out_len)
 {
     assert(ctx != NULL);
@@ -411,33 +537,25 @@ bool ble_services_decode_value_with_format_descriptor(const struct ble_device *d
 
     tr_debug("ble_services_decode_value_with_format_descriptor");
 
-    const struct ble_gatt_service *service = &device->attrs.services[ctx->sv_idx];
-    const struct ble_gatt_char *characteristic = &service->chars[ctx->ch_idx];
-
-    const ble_characteristic_t* char_descriptor = ble_services_get_characteristic_descriptor_by_uuids(service->uuid, characteristic->uuid);
-
-    value_format_t format = char_descriptor->value_format_descriptor.format;
-    int8_t exponent = char_descriptor->value_format_descriptor.exponent;
-    if (format == 0) {
+    const ble_characteristic_t* char_descriptor = ctx->characteristic_descriptor;
+    if (char_descriptor == NULL || char_descriptor->value_format_descriptor.format == 0) {
         return false;
     }
 
-    // Only supports upto 32bit size value presentations at the moment
-    int num_bytes = (value_size > 4 ? 4 : value_size);
-    uint32_t raw_value = 0;
-    for (int i = 0; i < num_bytes; i++) {
-        raw_value = raw_value + (((uint64_t)value[i]) << (i * 8));
+    float float_value = NAN;
+    if (!ble_services_decode_formatted_value(&char_descriptor->value_format_descriptor,
+                                             ctx->value_scale,
+                                             value,
+                                             value_size,
+                                             value_out,
+                                             value_out_len,
+                                             &float_value)) {
+        tr_warning("Unsupported value format presentation descriptor");
+        return false;
     }
+    tr_debug("Decoded value buffer %s", tr_array(value_out, *value_out_len));
 
-    uint8_t *temp_buf = NULL;
-    if (exponent < 0 || format == VALUE_FORMAT_FLOAT32_IEEE754) {
-        // Represent as float
-        float float_value = (float)raw_value * (pow(10, exponent));
-        temp_buf = malloc(sizeof(float));
-        convert_float_value_to_network_byte_order(float_value, temp_buf);
-        *value_out_len = sizeof(float);
-        tr_debug("Float value %f", float_value);
-        tr_debug("Float format buffer %s", tr_array(temp_buf, *value_out_len));
+    if (!isnan(float_value)) {
         // Update the min and max resources if they exist
         ipso_update_min_max_fields(edge_get_connection_id(),
                                    device->device_id,
@@ -445,55 +563,6 @@ bool ble_services_decode_value_with_format_descriptor(const struct ble_device *d
                                    ctx->object_instance_id,
                                    float_value);
     }
-    else {
-        // Represent as int
-        raw_value = raw_value * pow(10, exponent);
-        switch (format) {
-        case VALUE_FORMAT_BOOLEAN:
-            temp_buf = malloc(sizeof(uint8_t));
-            *temp_buf = ((raw_value & 0xFF) > 0);
-            *value_out_len = sizeof(uint8_t);
-            tr_debug("Integer value %d", ((raw_value & 0xFF) > 0));
-            tr_debug("Boolean format buffer %s", tr_array(temp_buf, *value_out_len));
-            break;
-        case VALUE_FORMAT_UINT2:
-        case VALUE_FORMAT_UINT4:
-        case VALUE_FORMAT_UINT8:
-        case VALUE_FORMAT_INT8:
-            temp_buf = malloc(sizeof(uint8_t));
-            *temp_buf = raw_value & 0xFF;
-            *value_out_len = sizeof(uint8_t);
-            tr_debug("Integer value %d", raw_value & 0xFF);
-            tr_debug("8-bit integer format buffer %s", tr_array(temp_buf, *value_out_len));
-            break;
-        case VALUE_FORMAT_UINT12:
-        case VALUE_FORMAT_UINT16:
-        case VALUE_FORMAT_INT12:
-        case VALUE_FORMAT_INT16:
-            temp_buf = malloc(sizeof(uint16_t));
-            *temp_buf = htonl((uint16_t)raw_value & 0xFFFF);
-            *value_out_len = sizeof(uint16_t);
-            tr_debug("Integer value %d", raw_value & 0xFFFF);
-            tr_debug("16-bit integer format buffer %s",
-                     tr_array(temp_buf, *value_out_len));
-            break;
-        case VALUE_FORMAT_UINT24:
-        case VALUE_FORMAT_UINT32:
-        case VALUE_FORMAT_INT24:
-        case VALUE_FORMAT_INT32:
-            temp_buf = malloc(sizeof(uint32_t));
-            *temp_buf = htonl((uint32_t)raw_value & 0xFFFFFFFF);
-            *value_out_len = sizeof(uint32_t);
-            tr_debug("Integer value %d", raw_value & 0xFFFFFFFF);
-            tr_debug("32-bit integer format buffer %s", tr_array(temp_buf, *value_out_len));
-            break;
-        default:
-            tr_warning("Unsupported value format presentation descriptor");
-            return false;
-        }
-    }
-
-    *value_out = temp_buf;
     return true;
 }
 
@@ -501,7 +570,7 @@ bool ble_services_decode_2bit_bitfield_value(const struct ble_device *device,
                                              const struct translation_context *ctx,
                                              const uint8_t *value,
                                              const size_t value_size,
-                                             uint8_t **value_out,
+                                             uint8_t *value_out,
                                              size_t *value_out_len)
 {
     assert(ctx != NULL);
@@ -518,14 +587,7 @@ bool ble_services_decode_2bit_bitfield_value(const struct ble_device *device,
     raw_value = raw_value >> (offset * 2);
     raw_value = raw_value & 0x03; // Clear all other bits than 2 lower most
 
-    uint8_t *value_buf = malloc(sizeof(uint8_t));
-    if (value_buf == NULL) {
-        return false;
-    }
-
-    *value_buf = raw_value;
-
-    *value_out = value_buf;
+    *value_out = raw_value;
     *value_out_len = sizeof(uint8_t);
 
     return true;
@@ -84,7 +84,7 @@ bool ble_services_decode_2bit_bitfield_value(const struct ble_device *device,
                                              const struct translation_context *ctx,
                                              const uint8_t *value,
                                              const size_t value_size,
-                                             uint8_t **value_out,
+                                             uint8_t *value_out,
                                              size_t *value_out_len);
 
 /**
@@ -97,7 +97,29 @@ bool ble_services_decode_value_with_format_descriptor(const struct ble_device *d
                                                       const struct translation_context *ctx,
                                                       const uint8_t *value,
                                                       const size_t value_size,
-                                                      uint8_t **value_out,
+                                                      uint8_t *value_out,
                                                       size_t *value_out_len);
 
+/**
+ * \brief Decodes a little endian characteristic value into the resource representation.
+ *        Integers are written in network byte order and values with a negative exponent or
+ *        an IEEE-754 format as a float. Nothing is allocated.
+ *
+ * \param format_descriptor Value format of the characteristic.
+ * \param scale 10 to the power of the format exponent, see ble_services_power_of_ten().
+ * \param value The characteristic value.
+ * \param value_size Size of the characteristic value.
+ * \param value_out Buffer for the decoded value.
+ * \param value_out_len On input the size of value_out, on success the size of the decoded value.
+ * \param float_value_out Set to the decoded value when it is represented as a float. Can be NULL.
+ * \return Returns true on success and false if the format is not supported.
+ */
+bool ble_services_decode_formatted_value(const ble_services_characteristic_value_format_t *format_descriptor,
+                                         const double scale,
+                                         const uint8_t *value,
+                                         const size_t value_size,
+                                         uint8_t *value_out,
+                                         size_t *value_out_len,
+                                         float *float_value_out);
+
 #endif /* _PT_BLE_SUPPORTED_TRANSLATIONS_H_ */
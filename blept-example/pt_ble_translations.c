@@ -27,18 +27,245 @@
 #include <math.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "pt-client-2/pt_api.h"
 #include "pt-client-2/pt_device_object.h"
 #include "devices.h"
 #include "pt_edge.h"
 #include "pt_ble_translations.h"
 #include "pt_ble_supported_translations.h"
+#include "pt_ble_advertisement.h"
 #include "examples-common-2/ipso_objects.h"
 #include "byte-order/byte_order.h"
 
 #define TRACE_GROUP "btsv"
 #include "mbed-trace/mbed_trace.h"
 
+// Bluetooth base UUID 00000000-0000-1000-8000-00805F9B34FB. SIG assigned 16 and 32-bit UUIDs replace
+// the first 32 bits.
+#define BLE_UUID_BASE_MSB 0x0000000000001000ULL
+#define BLE_UUID_BASE_LSB 0x800000805F9B34FBULL
+#define BLE_UUID_BASE_SUFFIX "-0000-1000-8000-00805F9B34FB"
+
+typedef struct ble_services_lookup_entry {
+    ble_uuid_t service_uuid;
+    ble_uuid_t characteristic_uuid;
+    const ble_service_t *service;
+    const ble_characteristic_t *characteristic;
+} ble_services_lookup_entry_t;
+
+// Descriptor tables sorted by UUID, built once from ble_services[].
+static ble_services_lookup_entry_t *service_lookup_table = NULL;
+static size_t service_lookup_count = 0;
+static ble_services_lookup_entry_t *characteristic_lookup_table = NULL;
+static size_t characteristic_lookup_count = 0;
+static pthread_once_t lookup_tables_once = PTHREAD_ONCE_INIT;
+
+static int hex_to_nibble(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool parse_hex(const char *str, int digits, uint64_t *value)
+{
+    int i;
+    *value = 0;
+    for (i = 0; i < digits; i++) {
+        int nibble = hex_to_nibble(str[i]);
+        if (nibble < 0) {
+            return false;
+        }
+        *value = (*value << 4) | nibble;
+    }
+    return true;
+}
+
+bool ble_uuid_parse(const char *uuid_str, ble_uuid_t *uuid)
+{
+    uint64_t value;
+    size_t len;
+    int i;
+
+    assert(uuid_str != NULL);
+    assert(uuid != NULL);
+
+    len = strnlen(uuid_str, FORMATTED_UUID_LEN + 1);
+
+    // Short forms and full UUIDs on the Bluetooth base only carry the 32-bit prefix
+    if (len == 4 || len == 8 ||
+        (len == FORMATTED_UUID_LEN && strncasecmp(uuid_str + 8, BLE_UUID_BASE_SUFFIX, FORMATTED_UUID_LEN - 8) == 0)) {
+        if (!parse_hex(uuid_str, len == 4 ? 4 : 8, &value)) {
+            return false;
+        }
+        uuid->msb = BLE_UUID_BASE_MSB | (value << 32);
+        uuid->lsb = BLE_UUID_BASE_LSB;
+        return true;
+    }
+
+    if (len != FORMATTED_UUID_LEN ||
+        uuid_str[8] != '-' || uuid_str[13] != '-' || uuid_str[18] != '-' || uuid_str[23] != '-') {
+        return false;
+    }
+    uuid->msb = 0;
+    uuid->lsb = 0;
+    for (i = 0; i < FORMATTED_UUID_LEN; i++) {
+        int nibble;
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            continue;
+        }
+        nibble = hex_to_nibble(uuid_str[i]);
+        if (nibble < 0) {
+            return false;
+        }
+        // The first 16 hex digits go to msb, shifting the top nibble of lsb into it
+        uuid->msb = (uuid->msb << 4) | (uuid->lsb >> 60);
+        uuid->lsb = (uuid->lsb << 4) | nibble;
+    }
+    return true;
+}
+
+#define POWER_OF_TEN_MIN_EXPONENT -18
+#define POWER_OF_TEN_MAX_EXPONENT 18
+
+static const double power_of_ten_table[POWER_OF_TEN_MAX_EXPONENT - POWER_OF_TEN_MIN_EXPONENT + 1] = {
+    1e-18, 1e-17, 1e-16, 1e-15, 1e-14, 1e-13, 1e-12, 1e-11, 1e-10, 1e-9, 1e-8, 1e-7, 1e-6,
+    1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+double ble_services_power_of_ten(const int exponent)
+{
+    if (exponent < POWER_OF_TEN_MIN_EXPONENT || exponent > POWER_OF_TEN_MAX_EXPONENT) {
+        return pow(10, exponent);
+    }
+    return power_of_ten_table[exponent - POWER_OF_TEN_MIN_EXPONENT];
+}
+
+size_t ble_services_value_format_size(const value_format_t format)
+{
+    switch (format) {
+    case VALUE_FORMAT_BOOLEAN:
+    case VALUE_FORMAT_UINT2:
+    case VALUE_FORMAT_UINT4:
+    case VALUE_FORMAT_UINT8:
+    case VALUE_FORMAT_INT8:
+        return 1;
+    case VALUE_FORMAT_UINT12:
+    case VALUE_FORMAT_UINT16:
+    case VALUE_FORMAT_INT12:
+    case VALUE_FORMAT_INT16:
+    case VALUE_FORMAT_SFLOAT16_IEEE11073:
+        return 2;
+    case VALUE_FORMAT_UINT24:
+    case VALUE_FORMAT_INT24:
+        return 3;
+    case VALUE_FORMAT_UINT32:
+    case VALUE_FORMAT_INT32:
+    case VALUE_FORMAT_FLOAT32_IEEE754:
+    case VALUE_FORMAT_FLOAT32_IEEE11073:
+    case VALUE_FORMAT_IEEE20601:
+        return 4;
+    case VALUE_FORMAT_UINT48:
+    case VALUE_FORMAT_INT48:
+        return 6;
+    case VALUE_FORMAT_UINT64:
+    case VALUE_FORMAT_INT64:
+    case VALUE_FORMAT_FLOAT64_IEEE754:
+        return 8;
+    case VALUE_FORMAT_UINT128:
+    case VALUE_FORMAT_INT128:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+static int compare_uuid(const ble_uuid_t *a, const ble_uuid_t *b)
+{
+    if (a->msb != b->msb) {
+        return a->msb < b->msb ? -1 : 1;
+    }
+    if (a->lsb != b->lsb) {
+        return a->lsb < b->lsb ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compare_lookup_entry(const void *a, const void *b)
+{
+    const ble_services_lookup_entry_t *entry_a = a;
+    const ble_services_lookup_entry_t *entry_b = b;
+    int ret = compare_uuid(&entry_a->service_uuid, &entry_b->service_uuid);
+    if (ret == 0) {
+        ret = compare_uuid(&entry_a->characteristic_uuid, &entry_b->characteristic_uuid);
+    }
+    return ret;
+}
+
+static void ble_services_build_lookup_tables()
+{
+    size_t characteristic_count = 0;
+    size_t i;
+    int j;
+
+    for (i = 0; i < ble_services_count; i++) {
+        characteristic_count += ble_services[i].characteristic_count;
+    }
+    service_lookup_table = calloc(ble_services_count, sizeof(ble_services_lookup_entry_t));
+    characteristic_lookup_table = calloc(characteristic_count, sizeof(ble_services_lookup_entry_t));
+    if ((ble_services_count > 0 && service_lookup_table == NULL) ||
+        (characteristic_count > 0 && characteristic_lookup_table == NULL)) {
+        tr_err("Could not allocate the service lookup tables");
+        return;
+    }
+
+    for (i = 0; i < ble_services_count; i++) {
+        const ble_service_t *service = &ble_services[i];
+        ble_uuid_t service_uuid;
+        if (!ble_uuid_parse(service->uuid, &service_uuid)) {
+            tr_err("Invalid service UUID %s in the translation table", service->uuid);
+            continue;
+        }
+        service_lookup_table[service_lookup_count].service_uuid = service_uuid;
+        service_lookup_table[service_lookup_count].service = service;
+        service_lookup_count++;
+
+        for (j = 0; j < service->characteristic_count; j++) {
+            ble_services_lookup_entry_t *entry = &characteristic_lookup_table[characteristic_lookup_count];
+            if (!ble_uuid_parse(service->characteristics[j].uuid, &entry->characteristic_uuid)) {
+                tr_err("Invalid characteristic UUID %s in the translation table", service->characteristics[j].uuid);
+                continue;
+            }
+            entry->service_uuid = service_uuid;
+            entry->service = service;
+            entry->characteristic = &service->characteristics[j];
+            characteristic_lookup_count++;
+        }
+    }
+
+    qsort(service_lookup_table, service_lookup_count, sizeof(ble_services_lookup_entry_t), compare_lookup_entry);
+    qsort(characteristic_lookup_table, characteristic_lookup_count, sizeof(ble_services_lookup_entry_t), compare_lookup_entry);
+}
+
+static const ble_services_lookup_entry_t *ble_services_lookup(const ble_services_lookup_entry_t *table,
+                                                              size_t count,
+                                                              const ble_services_lookup_entry_t *key)
+{
+    if (count == 0) {
+        return NULL;
+    }
+    return bsearch(key, table, count, sizeof(ble_services_lookup_entry_t), compare_lookup_entry);
+}
+
 /**
  * \brief Get handle to GATT service descriptor for given uuid if it exists.
  *
@@ -49,36 +276,91 @@ static const ble_service_t* ble_services_get_service_descriptor(const char *serv
 {
     assert(service_uuid != NULL);
 
-    int i = 0;
-    for (i = 0; i < ble_services_count; i++) {
-        if (strncasecmp(ble_services[i].uuid, service_uuid, FORMATTED_UUID_LEN) == 0) {
-            return &ble_services[i];
-        }
+    ble_services_lookup_entry_t key = {{0}};
+    const ble_services_lookup_entry_t *entry;
+
+    if (!ble_uuid_parse(service_uuid, &key.service_uuid)) {
+        return NULL;
     }
+    pthread_once(&lookup_tables_once, ble_services_build_lookup_tables);
+    entry = ble_services_lookup(service_lookup_table, service_lookup_count, &key);
+    return entry != NULL ? entry->service : NULL;
+}
 
-    return NULL;
+static uint64_t translation_key(const uint16_t object_id, const uint16_t instance_id, const uint16_t resource_id)
+{
+    return ((uint64_t) object_id << 32) | ((uint64_t) instance_id << 16) | resource_id;
 }
 
-/**
- * \brief Get handle to GATT characteristic with given uuid if it exists within given GATT service descriptor.
- *
- * \param service GATT service descriptor.
- * \param characteristic_uuid GATT characteristic uuid.
- * \return Returns pointer to the GATT characteristic descriptor if found, NULL otherwise.
- */
-static const ble_characteristic_t* ble_services_get_characteristic_descriptor(const ble_service_t *service, const char *characteristic_uuid)
+static int compare_translation_context(const void *a, const void *b)
 {
-    assert(service != NULL);
-    assert(characteristic_uuid != NULL);
+    const struct translation_context *ctx_a = *(struct translation_context * const *) a;
+    const struct translation_context *ctx_b = *(struct translation_context * const *) b;
+    uint64_t key_a = translation_key(ctx_a->object_id, ctx_a->object_instance_id, ctx_a->resource_id);
+    uint64_t key_b = translation_key(ctx_b->object_id, ctx_b->object_instance_id, ctx_b->resource_id);
+    if (key_a != key_b) {
+        return key_a < key_b ? -1 : 1;
+    }
+    return 0;
+}
 
-    int i = 0;
-    for (i = 0; i < service->characteristic_count; i++) {
-        if (strncasecmp(service->characteristics[i].uuid, characteristic_uuid, FORMATTED_UUID_LEN) == 0) {
-            return &service->characteristics[i];
+static void ble_services_clear_translation_index(struct ble_device *device)
+{
+    int sv_idx, ch_idx;
+
+    free(device->translation_index);
+    device->translation_index = NULL;
+    device->translation_index_count = 0;
+    for (sv_idx = 0; sv_idx < device->attrs.services_count; sv_idx++) {
+        struct ble_gatt_service *service = &device->attrs.services[sv_idx];
+        for (ch_idx = 0; ch_idx < service->chars_count; ch_idx++) {
+            free(service->chars[ch_idx].translations);
+            service->chars[ch_idx].translations = NULL;
+            service->chars[ch_idx].translations_count = 0;
         }
     }
+}
 
-    return NULL;
+void ble_services_build_translation_index(struct ble_device *device)
+{
+    int count;
+    int i = 0;
+
+    assert(device != NULL);
+    count = ns_list_count(&device->translations);
+    ble_services_clear_translation_index(device);
+    if (count == 0) {
+        return;
+    }
+
+    device->translation_index = calloc(count, sizeof(struct translation_context *));
+    if (device->translation_index == NULL) {
+        tr_err("Could not allocate the translation index for %s", device->device_id);
+        return;
+    }
+
+    // Count the translations of each characteristic first so that each gets a single allocation
+    ns_list_foreach(struct translation_context, ctx, &device->translations) {
+        device->translation_index[i++] = ctx;
+        device->attrs.services[ctx->sv_idx].chars[ctx->ch_idx].translations_count++;
+    }
+    device->translation_index_count = count;
+    qsort(device->translation_index, count, sizeof(struct translation_context *), compare_translation_context);
+
+    ns_list_foreach(struct translation_context, ctx, &device->translations) {
+        struct ble_gatt_char *characteristic = &device->attrs.services[ctx->sv_idx].chars[ctx->ch_idx];
+        if (characteristic->translations == NULL) {
+            characteristic->translations = calloc(characteristic->translations_count, sizeof(struct translation_context *));
+            if (characteristic->translations == NULL) {
+                tr_err("Could not allocate the translation index for %s", device->device_id);
+                ble_services_clear_translation_index(device);
+                return;
+            }
+            // Used as the fill position until all translations of the characteristic are added
+            characteristic->translations_count = 0;
+        }
+        characteristic->translations[characteristic->translations_count++] = ctx;
+    }
 }
 
 struct translation_context* ble_services_find_translation_context(const struct ble_device *device,
@@ -87,6 +369,21 @@ struct translation_context* ble_services_find_translation_context(const struct b
                                                                   const uint16_t resource_id)
 {
     assert(device != NULL);
+    if (device->translation_index != NULL) {
+        struct translation_context key = {
+            .object_id = object_id,
+            .object_instance_id = instance_id,
+            .resource_id = resource_id
+        };
+        struct translation_context *key_ptr = &key;
+        struct translation_context **found = bsearch(&key_ptr,
+                                                     device->translation_index,
+                                                     device->translation_index_count,
+                                                     sizeof(struct translation_context *),
+                                                     compare_translation_context);
+        return found != NULL ? *found : NULL;
+    }
+
     ns_list_foreach(struct translation_context, ctx, &device->translations) {
         if (ctx->object_id == object_id &&
             ctx->object_instance_id == instance_id &&
@@ -99,16 +396,18 @@ struct translation_context* ble_services_find_translation_context(const struct b
 
 const ble_characteristic_t* ble_services_get_characteristic_descriptor_by_uuids(const char *service_uuid, const char *characteristic_uuid)
 {
-    if (service_uuid == NULL || characteristic_uuid == NULL) {
-        return NULL;
-    }
+    ble_services_lookup_entry_t key = {{0}};
+    const ble_services_lookup_entry_t *entry;
 
-    const ble_service_t *service = ble_services_get_service_descriptor(service_uuid);
-    if (service == NULL) {
+    if (service_uuid == NULL || characteristic_uuid == NULL ||
+        !ble_uuid_parse(service_uuid, &key.service_uuid) ||
+        !ble_uuid_parse(characteristic_uuid, &key.characteristic_uuid)) {
         return NULL;
     }
 
-    return ble_services_get_characteristic_descriptor(service, characteristic_uuid);
+    pthread_once(&lookup_tables_once, ble_services_build_lookup_tables);
+    entry = ble_services_lookup(characteristic_lookup_table, characteristic_lookup_count, &key);
+    return entry != NULL ? entry->characteristic : NULL;
 }
 
 bool ble_services_is_supported_service(const char *service_uuid)
@@ -136,6 +435,8 @@ GVariant* ble_services_get_service_uuid_filter()
     for (i = 0; i < ble_services_count; i++) {
         g_variant_builder_add(&builder, "s", ble_services[i].uuid);
     }
+    // Devices that only advertise their values are found by the UUID of their service data.
+    ble_advertisement_add_service_uuids(&builder);
     ret_val = g_variant_builder_end(&builder);
     return ret_val;
 
@@ -144,6 +445,10 @@ GVariant* ble_services_get_service_uuid_filter()
 void ble_services_free_translation_contexts(struct ble_device *device)
 {
     assert(device != NULL);
+    // The per characteristic arrays are freed with the characteristics
+    free(device->translation_index);
+    device->translation_index = NULL;
+    device->translation_index_count = 0;
     ns_list_foreach_safe(struct translation_context, ctx, &device->translations) {
         ns_list_remove(&(device->translations), ctx);
         free(ctx);
@@ -180,6 +485,14 @@ void ble_services_configure_translation_context(struct ble_device *device,
     tc->characteristic_extra_flags = characteristic_extra_flags;
     tc->ch_idx = ch_idx;
     tc->sv_idx = sv_idx;
+    // A built index would miss this translation, fall back to searching the list until it is rebuilt
+    ble_services_clear_translation_index(device);
+    // Resolved once here so that decoding and encoding values never search the descriptor tables
+    tc->characteristic_descriptor = device->attrs.services[sv_idx].chars[ch_idx].descriptor;
+    tc->value_scale = 1.0;
+    if (tc->characteristic_descriptor != NULL) {
+        tc->value_scale = ble_services_power_of_ten(tc->characteristic_descriptor->value_format_descriptor.exponent);
+    }
     ns_list_add_to_end(&(device->translations), tc);
 }
 
@@ -206,16 +519,31 @@ void ble_services_construct_characteristic(struct ble_device *device,
     const struct ble_gatt_service *service = &device->attrs.services[sv_idx];
     const struct ble_gatt_char *characteristic = &service->chars[ch_idx];
 
-    const ble_service_t *service_descriptor = NULL;
-    const ble_characteristic_t *characteristic_descriptor = NULL;
+    const ble_characteristic_t *characteristic_descriptor = characteristic->descriptor;
 
     tr_info("    Constructing local characteristic translation for %s", characteristic->dbus_path);
-    service_descriptor = ble_services_get_service_descriptor(service->uuid);
-    if (NULL != service_descriptor) {
-        characteristic_descriptor = ble_services_get_characteristic_descriptor(service_descriptor, characteristic->uuid);
-        if (NULL != characteristic_descriptor && NULL != characteristic_descriptor->characteristic_construct) {
-            characteristic_descriptor->characteristic_construct(device, sv_idx, ch_idx, characteristic_descriptor);
-        }
+    if (NULL != characteristic_descriptor && NULL != characteristic_descriptor->characteristic_construct) {
+        characteristic_descriptor->characteristic_construct(device, sv_idx, ch_idx, characteristic_descriptor);
+    }
+}
+
+static void ble_services_decode_and_write_translation(const struct ble_device *ble_dev,
+                                                      const ble_characteristic_t *char_descriptor,
+                                                      const struct translation_context *ctx,
+                                                      const uint8_t *value,
+                                                      const size_t value_size)
+{
+    // Call the characteristic decoder to decode value
+    uint8_t decoded_value[BLE_DECODED_VALUE_MAX_SIZE];
+    size_t decoded_value_len = sizeof(decoded_value);
+    if (char_descriptor->characteristic_value_decode(ble_dev, ctx, value, value_size, decoded_value, &decoded_value_len)) {
+        // Write value to resource, the value buffer comes from the Edge value pool
+        edge_set_resource_value(ble_dev->device_id,
+                                ctx->object_id,
+                                ctx->object_instance_id,
+                                ctx->resource_id,
+                                decoded_value,
+                                decoded_value_len);
     }
 }
 
@@ -231,31 +559,24 @@ void ble_services_decode_and_write_characteristic_translation(const struct ble_d
     const struct ble_gatt_service *service = &ble_dev->attrs.services[sv_idx];
     const struct ble_gatt_char *characteristic = &service->chars[ch_idx];
 
-    // Get pointer to the characteristic descriptor where we can find the decode function
-    const ble_service_t *service_descriptor = ble_services_get_service_descriptor(service->uuid);
-    const ble_characteristic_t *char_descriptor = ble_services_get_characteristic_descriptor(service_descriptor, characteristic->uuid);
+    // The characteristic descriptor with the decode function was resolved when the characteristic was added
+    const ble_characteristic_t *char_descriptor = characteristic->descriptor;
     if (NULL == char_descriptor || NULL == char_descriptor->characteristic_value_decode) {
         tr_warning("No descriptor or decoder for characteristic at %s", characteristic->dbus_path);
         return;
     }
 
     // Find all translation contexts for this characteristic
+    if (ble_dev->translation_index != NULL) {
+        int i;
+        for (i = 0; i < characteristic->translations_count; i++) {
+            ble_services_decode_and_write_translation(ble_dev, char_descriptor, characteristic->translations[i], value, value_size);
+        }
+        return;
+    }
     ns_list_foreach(struct translation_context, ctx, &ble_dev->translations) {
         if (ctx->sv_idx == sv_idx && ctx->ch_idx == ch_idx) {
-            // Call the characteristic decoder to decode value
-            uint8_t *decoded_value = NULL;
-            size_t decoded_value_len = 0;
-            if (char_descriptor->characteristic_value_decode(ble_dev, ctx, value, value_size, &decoded_value, &decoded_value_len)) {
-                // Write value to resource
-                pt_device_set_resource_value(edge_get_connection_id(),
-                                             ble_dev->device_id,
-                                             ctx->object_id,
-                                             ctx->object_instance_id,
-                                             ctx->resource_id,
-                                             decoded_value,
-                                             decoded_value_len,
-                                             free);
-            }
+            ble_services_decode_and_write_translation(ble_dev, char_descriptor, ctx, value, value_size);
         }
     }
 }
@@ -283,7 +604,7 @@ void ble_services_encode_characteristic_value(const struct ble_device *device,
     tr_info("ble_services_encode_characteristic_value");
     tr_debug("write data %s", tr_array(new_value, new_size));
 
-    const ble_characteristic_t *characteristic_descriptor = ble_services_get_characteristic_descriptor_by_uuids(service->uuid, characteristic->uuid);
+    const ble_characteristic_t *characteristic_descriptor = ctx->characteristic_descriptor;
     if (characteristic_descriptor == NULL || characteristic_descriptor->characteristic_value_encode == NULL) {
         tr_warning("No characteristic descriptor or encoder for %s", characteristic->dbus_path);
         return;
@@ -74,6 +74,9 @@ typedef enum {
     VALUE_FORMAT_RESERVED2,
 } value_format_t;
 
+/* Size of the buffer passed to characteristic value decoders */
+#define BLE_DECODED_VALUE_MAX_SIZE 8
+
 typedef enum {
     VALUE_NAMESPACE_BLUETOOTH_SIG = 1,
     VALUE_NAMESPACE_RESERVED = 2
@@ -118,12 +121,10 @@ typedef bool (*ble_services_characteristic_construct_cb_t)(struct ble_device *de
  * \param value Pointer to GVariant containing a array of bytes with the bluetooth characteristic
  *              representation of the value. See GLib documentation for GVariant for reference
  *              how to access array members inside the GVariant.
- * \param data_buffer Pointer to a pointer to uint8_t or char. This is an output parameter and after
- *                    successfully decoding the value this should be set to point to a buffer containing
- *                    the decoded value. The buffer should be allocated using malloc as ownership is
- *                    transferred to the caller and the caller is responsible for freeing it.
- * \param data_size Pointer to a size_t. This is an output parameter and the data_buffer size should
- *                  be set to the location pointed to by this pointer.
+ * \param data_buffer Caller provided storage for the decoded value. The decoder writes the value here
+ *                    and must not allocate, so that decoding does not go through the heap.
+ * \param data_size On input the size of data_buffer, at least BLE_DECODED_VALUE_MAX_SIZE. On success
+ *                  it is set to the size of the decoded value.
  *
  * \return Returns true when characteristic successfully decoded and false on failure.
  */
@@ -131,7 +132,7 @@ typedef bool (*ble_services_characteristic_value_decode_cb_t)(const struct ble_d
                                                               const struct translation_context *ctx,
                                                               const uint8_t *value,
                                                               const size_t value_size,
-                                                              uint8_t **data_buffer,
+                                                              uint8_t *data_buffer,
                                                               size_t *data_size);
 
 /**
@@ -186,6 +187,8 @@ typedef bool (*ble_services_characteristic_value_encode_cb_t)(const struct ble_d
  *                                  into bluetooth characteristic value representation format.
  * \var value_format_descriptor Value format descriptor containing some additional information how the bluetooth
  *                              characteristic value is encoded.
+ * \var poll_interval_ms Interval for reading the characteristic when it cannot notify or indicate. Zero
+ *                       selects the default interval.
  */
 struct ble_characteristic {
     char                                          uuid[FORMATTED_UUID_LEN+1];
@@ -193,6 +196,7 @@ struct ble_characteristic {
     ble_services_characteristic_value_decode_cb_t characteristic_value_decode;
     ble_services_characteristic_value_encode_cb_t characteristic_value_encode;
     ble_services_characteristic_value_format_t    value_format_descriptor;
+    uint32_t                                      poll_interval_ms;
 };
 
 /**
@@ -213,6 +217,37 @@ struct ble_service {
     const ble_characteristic_t            *characteristics;
 };
 
+/**
+ * \struct ble_uuid
+ * \brief A 128-bit GATT UUID in numeric form, most significant half first.
+ */
+typedef struct ble_uuid {
+    uint64_t msb;
+    uint64_t lsb;
+} ble_uuid_t;
+
+/**
+ * \brief Parses a UUID string into its 128-bit form.
+ *
+ * \param uuid_str Formatted UUID, for example "0000181A-0000-1000-8000-00805F9B34FB", or a 16 or 32-bit
+ *                 SIG assigned UUID as 4 or 8 hex digits, which are expanded with the Bluetooth base UUID.
+ * \param uuid Output for the parsed UUID.
+ * \return Returns true on success and false if the string is not a valid UUID.
+ */
+bool ble_uuid_parse(const char *uuid_str, ble_uuid_t *uuid);
+
+/**
+ * \brief Returns 10 to the power of exponent. Exponents used by characteristic presentation formats
+ *        come from a table, others fall back to pow().
+ */
+double ble_services_power_of_ten(const int exponent);
+
+/**
+ * \brief Returns the size in bytes of a characteristic presentation format, 0 if the size of the
+ *        format is not fixed (strings, opaque and reserved formats).
+ */
+size_t ble_services_value_format_size(const value_format_t format);
+
 bool ble_services_is_supported_service(const char *service_uuid);
 bool ble_services_is_supported_characteristic(const char *service_uuid, const char *characteristic_uuid);
 
@@ -230,6 +265,10 @@ void ble_services_configure_translation_context(struct ble_device *device,
                                                 const uint16_t resource_id,
                                                 const uint32_t characteristic_extra_flags);
 void ble_services_free_translation_contexts(struct ble_device *device);
+/* Indexes the translations of the device by resource and by characteristic. Translations configured
+ * afterwards drop the index until it is built again.
+ */
+void ble_services_build_translation_index(struct ble_device *device);
 void ble_services_decode_and_write_characteristic_translation(const struct ble_device *ble_dev,
                                                               const int sv_idx,
                                                               const int ch_idx,
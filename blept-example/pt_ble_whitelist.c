@@ -0,0 +1,448 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file pt_ble_whitelist.c
+ * \brief Device name whitelist of the extended discovery mode.
+ *
+ * Exact names are kept in a hash set. Partial match names are compiled into an Aho-Corasick
+ * automaton: a trie of the names where every state also links to the longest suffix of its
+ * prefix that is a state too. A device name is then searched for all partial match names in one
+ * pass, so matching stays cheap with thousands of whitelist entries.
+ */
+
+#include "pt_ble_whitelist.h"
+
+#include <mbed-trace/mbed_trace.h>
+
+#include <errno.h>
+#include <glib.h>
+#include <glib-unix.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "common/read_file.h"
+#include "jansson.h"
+
+#define TRACE_GROUP "ble-wl"
+
+#define BLE_WHITELIST_NO_STATE (-1)
+#define BLE_WHITELIST_ROOT 0
+
+/* A state of the partial match automaton. The children of a state are a linked list. */
+struct ble_whitelist_state {
+    int first_child;
+    int next_sibling;
+    int fail;       /* state of the longest proper suffix of this prefix */
+    uint8_t byte;   /* byte of the transition from the parent */
+    bool match;     /* a partial match name ends here or at a state on the fail chain */
+};
+
+struct ble_whitelist {
+    GHashTable *exact_names;
+    GArray *states;                 /* struct ble_whitelist_state, the root is state 0 */
+    int root_next[UINT8_MAX + 1];   /* transitions of the root, visited for most bytes */
+    int partial_count;
+    struct ble_whitelist *advertisers; /* entries with the `advertisement` option, or NULL */
+};
+
+struct ble_whitelist_watch {
+    char *file_path;
+    char *file_name;    /* last component of file_path, the directory is watched */
+    int fd;
+    guint fd_source_id;
+    guint reload_source_id;
+    ble_whitelist_reloaded_cb callback;
+    void *userdata;
+};
+
+static inline struct ble_whitelist_state *ble_whitelist_state(const struct ble_whitelist *whitelist, int index)
+{
+    return &g_array_index(whitelist->states, struct ble_whitelist_state, index);
+}
+
+static int ble_whitelist_child(const struct ble_whitelist *whitelist, int state, uint8_t byte)
+{
+    int child;
+
+    if (state == BLE_WHITELIST_ROOT) {
+        return whitelist->root_next[byte];
+    }
+    for (child = ble_whitelist_state(whitelist, state)->first_child;
+         child != BLE_WHITELIST_NO_STATE;
+         child = ble_whitelist_state(whitelist, child)->next_sibling) {
+        if (ble_whitelist_state(whitelist, child)->byte == byte) {
+            return child;
+        }
+    }
+    return BLE_WHITELIST_NO_STATE;
+}
+
+static int ble_whitelist_add_state(struct ble_whitelist *whitelist, int parent, uint8_t byte)
+{
+    struct ble_whitelist_state state = {
+        .first_child = BLE_WHITELIST_NO_STATE,
+        .next_sibling = BLE_WHITELIST_NO_STATE,
+        .fail = BLE_WHITELIST_ROOT,
+        .byte = byte,
+        .match = false
+    };
+    int index = whitelist->states->len;
+
+    if (parent == BLE_WHITELIST_ROOT) {
+        whitelist->root_next[byte] = index;
+    }
+    state.next_sibling = ble_whitelist_state(whitelist, parent)->first_child;
+    g_array_append_val(whitelist->states, state);
+    ble_whitelist_state(whitelist, parent)->first_child = index;
+    return index;
+}
+
+struct ble_whitelist *ble_whitelist_new(void)
+{
+    struct ble_whitelist_state root = {
+        .first_child = BLE_WHITELIST_NO_STATE,
+        .next_sibling = BLE_WHITELIST_NO_STATE,
+        .fail = BLE_WHITELIST_ROOT,
+        .byte = 0,
+        .match = false
+    };
+    struct ble_whitelist *whitelist = calloc(1, sizeof(struct ble_whitelist));
+    int i;
+
+    if (whitelist == NULL) {
+        return NULL;
+    }
+    whitelist->exact_names = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    whitelist->states = g_array_new(FALSE, FALSE, sizeof(struct ble_whitelist_state));
+    g_array_append_val(whitelist->states, root);
+    for (i = 0; i <= UINT8_MAX; i++) {
+        whitelist->root_next[i] = BLE_WHITELIST_NO_STATE;
+    }
+    return whitelist;
+}
+
+bool ble_whitelist_add(struct ble_whitelist *whitelist, const char *name, bool partial_match)
+{
+    const uint8_t *p;
+    int state = BLE_WHITELIST_ROOT;
+
+    if (!partial_match) {
+        char *copy = strdup(name);
+        if (copy == NULL) {
+            return false;
+        }
+        g_hash_table_add(whitelist->exact_names, copy);
+        return true;
+    }
+
+    for (p = (const uint8_t *) name; *p != '\0'; p++) {
+        int next = ble_whitelist_child(whitelist, state, *p);
+        if (next == BLE_WHITELIST_NO_STATE) {
+            next = ble_whitelist_add_state(whitelist, state, *p);
+        }
+        state = next;
+    }
+    ble_whitelist_state(whitelist, state)->match = true;
+    whitelist->partial_count++;
+    return true;
+}
+
+void ble_whitelist_compile(struct ble_whitelist *whitelist)
+{
+    // Breadth first, so the fail state of a parent is complete before its children are linked.
+    int *queue = malloc(whitelist->states->len * sizeof(int));
+    int head = 0, tail = 0;
+    int child;
+
+    if (queue == NULL) {
+        tr_err("Could not allocate the whitelist compile queue");
+        return;
+    }
+    for (child = ble_whitelist_state(whitelist, BLE_WHITELIST_ROOT)->first_child;
+         child != BLE_WHITELIST_NO_STATE;
+         child = ble_whitelist_state(whitelist, child)->next_sibling) {
+        ble_whitelist_state(whitelist, child)->fail = BLE_WHITELIST_ROOT;
+        queue[tail++] = child;
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        for (child = ble_whitelist_state(whitelist, state)->first_child;
+             child != BLE_WHITELIST_NO_STATE;
+             child = ble_whitelist_state(whitelist, child)->next_sibling) {
+            uint8_t byte = ble_whitelist_state(whitelist, child)->byte;
+            int fail = ble_whitelist_state(whitelist, state)->fail;
+            int next = ble_whitelist_child(whitelist, fail, byte);
+            while (next == BLE_WHITELIST_NO_STATE && fail != BLE_WHITELIST_ROOT) {
+                fail = ble_whitelist_state(whitelist, fail)->fail;
+                next = ble_whitelist_child(whitelist, fail, byte);
+            }
+            next = (next == BLE_WHITELIST_NO_STATE) ? BLE_WHITELIST_ROOT : next;
+            ble_whitelist_state(whitelist, child)->fail = next;
+            if (ble_whitelist_state(whitelist, next)->match) {
+                ble_whitelist_state(whitelist, child)->match = true;
+            }
+            queue[tail++] = child;
+        }
+    }
+    free(queue);
+}
+
+bool ble_whitelist_match(const struct ble_whitelist *whitelist, const char *name)
+{
+    const uint8_t *p;
+    int state = BLE_WHITELIST_ROOT;
+
+    if (g_hash_table_contains(whitelist->exact_names, name)) {
+        return true;
+    }
+    if (whitelist->partial_count == 0) {
+        return false;
+    }
+    // An empty partial match name matches every device.
+    if (ble_whitelist_state(whitelist, BLE_WHITELIST_ROOT)->match) {
+        return true;
+    }
+    for (p = (const uint8_t *) name; *p != '\0'; p++) {
+        int next = ble_whitelist_child(whitelist, state, *p);
+        while (next == BLE_WHITELIST_NO_STATE && state != BLE_WHITELIST_ROOT) {
+            state = ble_whitelist_state(whitelist, state)->fail;
+            next = ble_whitelist_child(whitelist, state, *p);
+        }
+        state = (next == BLE_WHITELIST_NO_STATE) ? BLE_WHITELIST_ROOT : next;
+        if (ble_whitelist_state(whitelist, state)->match) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ble_whitelist_match_advertiser(const struct ble_whitelist *whitelist, const char *name)
+{
+    return whitelist->advertisers != NULL && ble_whitelist_match(whitelist->advertisers, name);
+}
+
+void ble_whitelist_free(struct ble_whitelist *whitelist)
+{
+    if (whitelist == NULL) {
+        return;
+    }
+    ble_whitelist_free(whitelist->advertisers);
+    g_hash_table_destroy(whitelist->exact_names);
+    g_array_free(whitelist->states, TRUE);
+    free(whitelist);
+}
+
+struct ble_whitelist *ble_whitelist_read(const char *file_path)
+{
+    struct ble_whitelist *whitelist = NULL;
+    json_t *json = NULL;
+    uint8_t *data = NULL;
+    size_t bytes_read = 0;
+    json_error_t error;
+    json_t *devices;
+    json_t *entry;
+    size_t index;
+
+    if (0 != edge_read_file(file_path, &data, &bytes_read)) {
+        tr_err("Cannot read the file '%s'", file_path);
+        goto exit_label;
+    }
+    json = json_loads((const char *) data, 0, &error);
+    if (json == NULL) {
+        tr_err("Jansson cannot parse '%s' error: '%s' on line: %d", file_path, error.text, error.line);
+        goto exit_label;
+    }
+    devices = json_object_get(json, "whitelisted-devices");
+    if (NULL == devices) {
+        tr_err("Cannot find 'whitelisted-devices' in '%s'", file_path);
+        goto exit_label;
+    }
+
+    whitelist = ble_whitelist_new();
+    if (whitelist == NULL) {
+        tr_err("Could not allocate the whitelist");
+        goto exit_label;
+    }
+    json_array_foreach(devices, index, entry)
+    {
+        json_t *json_name = json_object_get(entry, "name");
+        if (!json_name) {
+            tr_err("Cannot find name-value pair for 'name' in device entry");
+            goto error_exit;
+        }
+        if (!json_is_string(json_name)) {
+            tr_err("Value for key 'name' is not a string");
+            goto error_exit;
+        }
+        bool partial = true;
+        json_t *partial_json = json_object_get(entry, "partial-match");
+        if (partial_json) {
+            if (json_is_integer(partial_json)) {
+                partial = (bool) json_integer_value(partial_json);
+            } else {
+                tr_err("Value for 'partial-match' is not integer");
+                goto error_exit;
+            }
+        }
+        bool advertisement = false;
+        json_t *advertisement_json = json_object_get(entry, "advertisement");
+        if (advertisement_json) {
+            if (json_is_integer(advertisement_json)) {
+                advertisement = (bool) json_integer_value(advertisement_json);
+            } else {
+                tr_err("Value for 'advertisement' is not integer");
+                goto error_exit;
+            }
+        }
+        if (!ble_whitelist_add(whitelist, json_string_value(json_name), partial)) {
+            tr_err("Could not add '%s' to the whitelist", json_string_value(json_name));
+            goto error_exit;
+        }
+        if (advertisement) {
+            if (whitelist->advertisers == NULL) {
+                whitelist->advertisers = ble_whitelist_new();
+            }
+            if (whitelist->advertisers == NULL ||
+                !ble_whitelist_add(whitelist->advertisers, json_string_value(json_name), partial)) {
+                tr_err("Could not add '%s' to the whitelist", json_string_value(json_name));
+                goto error_exit;
+            }
+        }
+    }
+    ble_whitelist_compile(whitelist);
+    if (whitelist->advertisers != NULL) {
+        ble_whitelist_compile(whitelist->advertisers);
+    }
+    tr_info("Whitelist '%s' has %u exact and %d partial match names (%u automaton states)",
+            file_path,
+            g_hash_table_size(whitelist->exact_names),
+            whitelist->partial_count,
+            whitelist->states->len);
+    goto exit_label;
+
+error_exit:
+    ble_whitelist_free(whitelist);
+    whitelist = NULL;
+
+exit_label:
+    json_decref(json);
+    free(data);
+    return whitelist;
+}
+
+static gboolean ble_whitelist_reload(gpointer data)
+{
+    struct ble_whitelist_watch *watch = data;
+    struct ble_whitelist *whitelist;
+
+    watch->reload_source_id = 0;
+    tr_info("Whitelist file '%s' changed, reloading", watch->file_path);
+    whitelist = ble_whitelist_read(watch->file_path);
+    if (whitelist == NULL) {
+        tr_warn("Keeping the previous whitelist");
+    } else {
+        watch->callback(whitelist, watch->userdata);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean ble_whitelist_file_event(gint fd, GIOCondition condition, gpointer data)
+{
+    struct ble_whitelist_watch *watch = data;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+    (void) condition;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        char *p;
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+            const struct inotify_event *event = (const struct inotify_event *) p;
+            if (event->len > 0 && strcmp(event->name, watch->file_name) == 0) {
+                changed = true;
+            }
+        }
+    }
+    if (changed && watch->reload_source_id == 0) {
+        watch->reload_source_id = g_timeout_add(BLE_WHITELIST_RELOAD_DELAY_MS, ble_whitelist_reload, watch);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+struct ble_whitelist_watch *ble_whitelist_watch_start(const char *file_path,
+                                                      ble_whitelist_reloaded_cb callback,
+                                                      void *userdata)
+{
+    struct ble_whitelist_watch *watch = calloc(1, sizeof(struct ble_whitelist_watch));
+    char *directory;
+
+    if (watch == NULL) {
+        return NULL;
+    }
+    watch->fd = -1;
+    watch->file_path = strdup(file_path);
+    watch->file_name = g_path_get_basename(file_path);
+    watch->callback = callback;
+    watch->userdata = userdata;
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd < 0) {
+        tr_err("Cannot watch the whitelist file: %s", strerror(errno));
+        goto error;
+    }
+    // Editors often replace the file by renaming a new one over it, so the directory is watched.
+    directory = g_path_get_dirname(file_path);
+    if (inotify_add_watch(watch->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        tr_err("Cannot watch the directory '%s' of the whitelist file: %s", directory, strerror(errno));
+        g_free(directory);
+        goto error;
+    }
+    g_free(directory);
+    watch->fd_source_id = g_unix_fd_add(watch->fd, G_IO_IN, ble_whitelist_file_event, watch);
+    tr_info("Watching whitelist file '%s' for changes", file_path);
+    return watch;
+
+error:
+    ble_whitelist_watch_stop(watch);
+    return NULL;
+}
+
+void ble_whitelist_watch_stop(struct ble_whitelist_watch *watch)
+{
+    if (watch == NULL) {
+        return;
+    }
+    if (watch->reload_source_id != 0) {
+        g_source_remove(watch->reload_source_id);
+    }
+    if (watch->fd_source_id != 0) {
+        g_source_remove(watch->fd_source_id);
+    }
+    if (watch->fd >= 0) {
+        close(watch->fd);
+    }
+    free(watch->file_path);
+    g_free(watch->file_name);
+    free(watch);
+}
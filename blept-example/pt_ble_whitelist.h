@@ -0,0 +1,104 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef __PT_BLE_WHITELIST_H__
+#define __PT_BLE_WHITELIST_H__
+
+#include "stdbool.h"
+
+/* Delay from the last change of the whitelist file to its reload, editors write in several steps */
+#define BLE_WHITELIST_RELOAD_DELAY_MS 200
+
+struct ble_whitelist;
+struct ble_whitelist_watch;
+
+/**
+ * \brief Called with the reloaded whitelist after the whitelist file changed.
+ *
+ * \param whitelist The new whitelist, owned by the callee.
+ * \param userdata The user data given to ble_whitelist_watch_start().
+ */
+typedef void (*ble_whitelist_reloaded_cb)(struct ble_whitelist *whitelist, void *userdata);
+
+/**
+ * \brief Creates an empty whitelist. Names are added with ble_whitelist_add() and the whitelist
+ *        is compiled with ble_whitelist_compile() before it is matched.
+ */
+struct ble_whitelist *ble_whitelist_new(void);
+
+/**
+ * \brief Adds a device name pattern.
+ *
+ * \param name The device name.
+ * \param partial_match If true, the pattern matches devices with a name that contains it.
+ *                      Otherwise the whole name must be equal.
+ * \return true on success, false if out of memory.
+ */
+bool ble_whitelist_add(struct ble_whitelist *whitelist, const char *name, bool partial_match);
+
+/**
+ * \brief Builds the matching automaton of the partial match patterns.
+ */
+void ble_whitelist_compile(struct ble_whitelist *whitelist);
+
+/**
+ * \brief Reads the `whitelisted-devices` of an extended discovery configuration file
+ *        and compiles them. An entry may set the `partial-match` and `advertisement` options.
+ *
+ * \param file_path Path of the JSON configuration file.
+ * \return The whitelist, or NULL if the file could not be read or is invalid.
+ */
+struct ble_whitelist *ble_whitelist_read(const char *file_path);
+
+void ble_whitelist_free(struct ble_whitelist *whitelist);
+
+/**
+ * \brief Checks a device name against the whitelist. The time does not depend on the number
+ *        of patterns: exact names are looked up in a hash set and all partial match patterns
+ *        are searched in one pass over the name.
+ *
+ * \return true if the name matches at least one pattern.
+ */
+bool ble_whitelist_match(const struct ble_whitelist *whitelist, const char *name);
+
+/**
+ * \brief Checks a device name against the entries that have the `advertisement` option. Such
+ *        devices are read from their advertisements instead of being connected to.
+ *
+ * \return true if the name matches at least one of these entries.
+ */
+bool ble_whitelist_match_advertiser(const struct ble_whitelist *whitelist, const char *name);
+
+/**
+ * \brief Watches the whitelist file and reloads it when it is written or replaced.
+ *        The callback is called in the default GLib main context. If the changed file is not a
+ *        valid whitelist, the error is logged and the callback is not called.
+ *
+ * \param file_path Path of the JSON configuration file.
+ * \param callback Called with the reloaded whitelist.
+ * \param userdata Passed to the callback.
+ * \return The watch, or NULL if the file cannot be watched.
+ */
+struct ble_whitelist_watch *ble_whitelist_watch_start(const char *file_path,
+                                                      ble_whitelist_reloaded_cb callback,
+                                                      void *userdata);
+
+void ble_whitelist_watch_stop(struct ble_whitelist_watch *watch);
+
+#endif /* __PT_BLE_WHITELIST_H__ */
@@ -52,6 +52,69 @@ static pt_status_t resource_callback_handler(const connection_id_t connection_id
 
 #define TRACE_GROUP "pt-edge"
 
+// Resource values set from BLE are mostly numbers and flags that are replaced on every update.
+// Their buffers are recycled through a free list instead of going back to malloc each time.
+#define EDGE_VALUE_POOL_BLOCK_SIZE 16
+#define EDGE_VALUE_POOL_MAX_FREE_BLOCKS 256
+
+typedef union edge_value_block {
+    union edge_value_block *next;
+    uint8_t data[EDGE_VALUE_POOL_BLOCK_SIZE];
+} edge_value_block_t;
+
+static edge_value_block_t *value_pool_free_list = NULL;
+static int value_pool_free_count = 0;
+static pthread_mutex_t value_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t *edge_value_pool_alloc()
+{
+    edge_value_block_t *block;
+
+    pthread_mutex_lock(&value_pool_mutex);
+    block = value_pool_free_list;
+    if (block != NULL) {
+        value_pool_free_list = block->next;
+        value_pool_free_count--;
+    }
+    pthread_mutex_unlock(&value_pool_mutex);
+
+    if (block == NULL) {
+        block = malloc(sizeof(edge_value_block_t));
+    }
+    return (uint8_t *) block;
+}
+
+// Free callback for the PT API, may be called from any thread.
+static void edge_value_pool_free(void *data)
+{
+    edge_value_block_t *block = data;
+
+    if (block == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&value_pool_mutex);
+    if (value_pool_free_count < EDGE_VALUE_POOL_MAX_FREE_BLOCKS) {
+        block->next = value_pool_free_list;
+        value_pool_free_list = block;
+        value_pool_free_count++;
+        block = NULL;
+    }
+    pthread_mutex_unlock(&value_pool_mutex);
+    free(block);
+}
+
+static void edge_value_pool_clear()
+{
+    pthread_mutex_lock(&value_pool_mutex);
+    while (value_pool_free_list != NULL) {
+        edge_value_block_t *block = value_pool_free_list;
+        value_pool_free_list = block->next;
+        free(block);
+    }
+    value_pool_free_count = 0;
+    pthread_mutex_unlock(&value_pool_mutex);
+}
+
 /*
  * Lwm2mResourceType:
  *  LWM2M_STRING,
@@ -116,7 +179,15 @@ edge_set_resource_value(const char *device_id,
                         const uint32_t value_size)
 {
     // pt_resource_set_value frees the value buffer, so copy the value to new buffer.
-    uint8_t *buf = malloc(value_size);
+    uint8_t *buf;
+    pt_resource_value_free_callback value_free;
+    if (value_size <= EDGE_VALUE_POOL_BLOCK_SIZE) {
+        buf = edge_value_pool_alloc();
+        value_free = edge_value_pool_free;
+    } else {
+        buf = malloc(value_size);
+        value_free = free;
+    }
     if (buf) {
         memcpy(buf, value, value_size);
         pt_device_set_resource_value(g_connection_id,
@@ -126,7 +197,7 @@ edge_set_resource_value(const char *device_id,
                                      resource_id,
                                      buf,
                                      value_size,
-                                     free);
+                                     value_free);
     }
 }
 
@@ -149,20 +220,21 @@ static pt_status_t resource_callback_handler(const connection_id_t connection_id
     }
 
     pt_status_t status = PT_STATUS_ERROR;
-    devices_mutex_lock();
 
     tr_info("Edge resource callback.");
 
-    ble = devices_find_device_by_device_id(device_id);
+    // Only the device is locked, so writes to other devices and the BLE event loop are not blocked.
+    ble = devices_acquire_device_by_device_id(device_id);
     if (NULL == ble) {
         tr_warn("No match for device \"%s/%d/%d/%d\".",
                 device_id, object_id, instance_id, resource_id);
-        status = PT_STATUS_ERROR;
-        goto out;
+        return PT_STATUS_ERROR;
     }
+    device_mutex_lock(ble);
 
     if (operation & OPERATION_WRITE) {
-        tr_info("Attempting write to ble characteristic associated with %s/%d/%d/%d",
+        // The write is only queued here, so no mutex is held while the device responds.
+        tr_info("Queueing write to ble characteristic associated with %s/%d/%d/%d",
                 device_id, object_id, instance_id, resource_id);
         if (device_write_characteristic(ble, object_id, instance_id, resource_id,
                                         value, value_size) == 0) {
@@ -178,7 +250,8 @@ static pt_status_t resource_callback_handler(const connection_id_t connection_id
     }
 
 out:
-    devices_mutex_unlock();
+    device_mutex_unlock(ble);
+    devices_release_device(ble);
     return status;
 }
 
@@ -647,6 +720,7 @@ void stop_protocol_translator_api_thread()
 
     tr_debug("Waiting for protocol translator api thread to stop.");
     pthread_join(protocol_translator_api_thread, &result);
+    edge_value_pool_clear();
 }
 
 void edge_write_values(const char *device_id)
@@ -0,0 +1,959 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file bluez_simulator.c
+ * \brief Exports the subset of the BlueZ D-Bus API used by blept with synthetic devices.
+ *
+ * All objects live in the thread of the simulator, which runs its own GMainContext. Method calls
+ * with a configured latency are answered from a timer so that the simulator keeps serving other
+ * calls and notifications in the meantime.
+ */
+
+#include "bluez_simulator.h"
+
+#include <gio/gio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_GROUP "bsim"
+#include "mbed-trace/mbed_trace.h"
+
+#define BLUEZ_NAME "org.bluez"
+#define OBJECT_MANAGER_IFACE "org.freedesktop.DBus.ObjectManager"
+#define PROPERTIES_IFACE "org.freedesktop.DBus.Properties"
+#define ADAPTER_IFACE "org.bluez.Adapter1"
+#define DEVICE_IFACE "org.bluez.Device1"
+#define GATT_SERVICE_IFACE "org.bluez.GattService1"
+#define GATT_CHARACTERISTIC_IFACE "org.bluez.GattCharacteristic1"
+
+/* DBUS_NAME_FLAG_DO_NOT_QUEUE of RequestName */
+#define SIM_NAME_FLAG_DO_NOT_QUEUE 4
+#define SIM_NAME_REPLY_PRIMARY_OWNER 1
+
+#define SIM_PATH_MAX 96
+
+static const gchar sim_introspection_xml[] =
+    "<node>"
+    "  <interface name='" OBJECT_MANAGER_IFACE "'>"
+    "    <method name='GetManagedObjects'>"
+    "      <arg name='objects' type='a{oa{sa{sv}}}' direction='out'/>"
+    "    </method>"
+    "    <signal name='InterfacesAdded'>"
+    "      <arg name='object' type='o'/>"
+    "      <arg name='interfaces' type='a{sa{sv}}'/>"
+    "    </signal>"
+    "    <signal name='InterfacesRemoved'>"
+    "      <arg name='object' type='o'/>"
+    "      <arg name='interfaces' type='as'/>"
+    "    </signal>"
+    "  </interface>"
+    "  <interface name='" ADAPTER_IFACE "'>"
+    "    <method name='SetDiscoveryFilter'>"
+    "      <arg name='filter' type='a{sv}' direction='in'/>"
+    "    </method>"
+    "    <method name='StartDiscovery'/>"
+    "    <method name='StopDiscovery'/>"
+    "    <method name='RemoveDevice'>"
+    "      <arg name='device' type='o' direction='in'/>"
+    "    </method>"
+    "    <property name='Address' type='s' access='read'/>"
+    "    <property name='Name' type='s' access='read'/>"
+    "    <property name='Powered' type='b' access='readwrite'/>"
+    "    <property name='Discovering' type='b' access='read'/>"
+    "  </interface>"
+    "  <interface name='" DEVICE_IFACE "'>"
+    "    <method name='Connect'/>"
+    "    <method name='Disconnect'/>"
+    "    <property name='Address' type='s' access='read'/>"
+    "    <property name='Name' type='s' access='read'/>"
+    "    <property name='Alias' type='s' access='read'/>"
+    "    <property name='Adapter' type='o' access='read'/>"
+    "    <property name='UUIDs' type='as' access='read'/>"
+    "    <property name='RSSI' type='n' access='read'/>"
+    "    <property name='Paired' type='b' access='read'/>"
+    "    <property name='Connected' type='b' access='read'/>"
+    "    <property name='ServicesResolved' type='b' access='read'/>"
+    "  </interface>"
+    "  <interface name='" GATT_SERVICE_IFACE "'>"
+    "    <property name='UUID' type='s' access='read'/>"
+    "    <property name='Device' type='o' access='read'/>"
+    "    <property name='Primary' type='b' access='read'/>"
+    "  </interface>"
+    "  <interface name='" GATT_CHARACTERISTIC_IFACE "'>"
+    "    <method name='ReadValue'>"
+    "      <arg name='options' type='a{sv}' direction='in'/>"
+    "      <arg name='value' type='ay' direction='out'/>"
+    "    </method>"
+    "    <method name='WriteValue'>"
+    "      <arg name='value' type='ay' direction='in'/>"
+    "      <arg name='options' type='a{sv}' direction='in'/>"
+    "    </method>"
+    "    <method name='StartNotify'/>"
+    "    <method name='StopNotify'/>"
+    "    <property name='UUID' type='s' access='read'/>"
+    "    <property name='Service' type='o' access='read'/>"
+    "    <property name='Value' type='ay' access='read'/>"
+    "    <property name='Notifying' type='b' access='read'/>"
+    "    <property name='Flags' type='as' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+struct sim_device;
+
+struct sim_characteristic {
+    struct sim_device *device;
+    char path[SIM_PATH_MAX];
+    guint registration_id;
+    guint notify_source_id;
+    bool notifying;
+    uint32_t sequence;
+    uint8_t value[BLUEZ_SIMULATOR_VALUE_SIZE];
+};
+
+struct sim_device {
+    struct bluez_simulator *sim;
+    int index;
+    char path[SIM_PATH_MAX];
+    char service_path[SIM_PATH_MAX];
+    char address[18];
+    char name[32];
+    guint registration_id;
+    guint service_registration_id;
+    guint pending_source_id;
+    bool connected;
+    bool services_resolved;
+    struct sim_characteristic *chars;
+};
+
+/* A method call answered after a simulated latency */
+struct sim_pending_call {
+    struct sim_device *device;
+    struct sim_characteristic *characteristic;
+    GDBusMethodInvocation *invocation;
+};
+
+struct bluez_simulator {
+    struct bluez_simulator_config config;
+    char adapter_path[SIM_PATH_MAX];
+    GThread *thread;
+    GMainContext *context;
+    GMainLoop *loop;
+    GDBusConnection *connection;
+    GDBusNodeInfo *introspection;
+    guint manager_registration_id;
+    guint adapter_registration_id;
+    bool powered;
+    bool discovering;
+    struct sim_device *devices;
+    volatile gsize notifications_sent;
+
+    GMutex ready_mutex;
+    GCond ready_cond;
+    bool ready;
+    bool setup_ok;
+};
+
+static void sim_method_call(GDBusConnection *connection,
+                            const gchar *sender,
+                            const gchar *object_path,
+                            const gchar *interface_name,
+                            const gchar *method_name,
+                            GVariant *parameters,
+                            GDBusMethodInvocation *invocation,
+                            gpointer user_data);
+static GVariant *sim_get_property(GDBusConnection *connection,
+                                  const gchar *sender,
+                                  const gchar *object_path,
+                                  const gchar *interface_name,
+                                  const gchar *property_name,
+                                  GError **error,
+                                  gpointer user_data);
+static gboolean sim_set_property(GDBusConnection *connection,
+                                 const gchar *sender,
+                                 const gchar *object_path,
+                                 const gchar *interface_name,
+                                 const gchar *property_name,
+                                 GVariant *value,
+                                 GError **error,
+                                 gpointer user_data);
+
+static const GDBusInterfaceVTable sim_vtable = {
+    sim_method_call,
+    sim_get_property,
+    sim_set_property
+};
+
+// Timers of the simulator run in its own main context, g_timeout_add would use the default one.
+static guint sim_timeout_add(struct bluez_simulator *sim, guint interval_ms, GSourceFunc func, gpointer data)
+{
+    GSource *source = g_timeout_source_new(interval_ms);
+    guint id;
+    g_source_set_callback(source, func, data, NULL);
+    id = g_source_attach(source, sim->context);
+    g_source_unref(source);
+    return id;
+}
+
+static void sim_source_remove(struct bluez_simulator *sim, guint *id)
+{
+    if (*id != 0) {
+        GSource *source = g_main_context_find_source_by_id(sim->context, *id);
+        if (source != NULL) {
+            g_source_destroy(source);
+        }
+        *id = 0;
+    }
+}
+
+static GDBusInterfaceInfo *sim_interface_info(struct bluez_simulator *sim, const char *interface_name)
+{
+    return g_dbus_node_info_lookup_interface(sim->introspection, interface_name);
+}
+
+static void sim_characteristic_refresh_value(struct sim_characteristic *ch)
+{
+    gint64 stamp = g_get_monotonic_time();
+    ch->sequence++;
+    memcpy(ch->value, &stamp, sizeof(stamp));
+    memcpy(ch->value + sizeof(stamp), &ch->sequence, sizeof(ch->sequence));
+}
+
+static GVariant *sim_characteristic_value(struct sim_characteristic *ch)
+{
+    return g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, ch->value, sizeof(ch->value), 1);
+}
+
+static GVariant *sim_adapter_properties(struct bluez_simulator *sim)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&builder, "{sv}", "Address", g_variant_new_string("10:00:00:00:00:00"));
+    g_variant_builder_add(&builder, "{sv}", "Name", g_variant_new_string("blept-simulator"));
+    g_variant_builder_add(&builder, "{sv}", "Powered", g_variant_new_boolean(sim->powered));
+    g_variant_builder_add(&builder, "{sv}", "Discovering", g_variant_new_boolean(sim->discovering));
+    return g_variant_builder_end(&builder);
+}
+
+static GVariant *sim_device_properties(struct sim_device *dev)
+{
+    const gchar *uuids[] = {BLUEZ_SIMULATOR_SERVICE_UUID, NULL};
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&builder, "{sv}", "Address", g_variant_new_string(dev->address));
+    g_variant_builder_add(&builder, "{sv}", "Name", g_variant_new_string(dev->name));
+    g_variant_builder_add(&builder, "{sv}", "Alias", g_variant_new_string(dev->name));
+    g_variant_builder_add(&builder, "{sv}", "Adapter", g_variant_new_object_path(dev->sim->adapter_path));
+    g_variant_builder_add(&builder, "{sv}", "UUIDs", g_variant_new_strv(uuids, -1));
+    g_variant_builder_add(&builder, "{sv}", "RSSI", g_variant_new_int16(-40 - dev->index % 50));
+    g_variant_builder_add(&builder, "{sv}", "Paired", g_variant_new_boolean(FALSE));
+    g_variant_builder_add(&builder, "{sv}", "Connected", g_variant_new_boolean(dev->connected));
+    g_variant_builder_add(&builder, "{sv}", "ServicesResolved", g_variant_new_boolean(dev->services_resolved));
+    return g_variant_builder_end(&builder);
+}
+
+static GVariant *sim_service_properties(struct sim_device *dev)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&builder, "{sv}", "UUID", g_variant_new_string(BLUEZ_SIMULATOR_SERVICE_UUID));
+    g_variant_builder_add(&builder, "{sv}", "Device", g_variant_new_object_path(dev->path));
+    g_variant_builder_add(&builder, "{sv}", "Primary", g_variant_new_boolean(TRUE));
+    return g_variant_builder_end(&builder);
+}
+
+static GVariant *sim_characteristic_properties(struct sim_characteristic *ch)
+{
+    const gchar *flags[] = {"read", "write", "notify", NULL};
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&builder, "{sv}", "UUID", g_variant_new_string(BLUEZ_SIMULATOR_CHARACTERISTIC_UUID));
+    g_variant_builder_add(&builder, "{sv}", "Service", g_variant_new_object_path(ch->device->service_path));
+    g_variant_builder_add(&builder, "{sv}", "Value", sim_characteristic_value(ch));
+    g_variant_builder_add(&builder, "{sv}", "Notifying", g_variant_new_boolean(ch->notifying));
+    g_variant_builder_add(&builder, "{sv}", "Flags", g_variant_new_strv(flags, -1));
+    return g_variant_builder_end(&builder);
+}
+
+static void sim_emit_property_changed(struct bluez_simulator *sim,
+                                      const char *path,
+                                      const char *interface_name,
+                                      const char *property_name,
+                                      GVariant *value)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&builder, "{sv}", property_name, value);
+    g_dbus_connection_emit_signal(sim->connection,
+                                  NULL,
+                                  path,
+                                  PROPERTIES_IFACE,
+                                  "PropertiesChanged",
+                                  g_variant_new("(s@a{sv}@as)",
+                                                interface_name,
+                                                g_variant_builder_end(&builder),
+                                                g_variant_new_strv(NULL, 0)),
+                                  NULL);
+}
+
+static void sim_emit_interfaces_added(struct bluez_simulator *sim,
+                                      const char *path,
+                                      const char *interface_name,
+                                      GVariant *properties)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sa{sv}}"));
+    g_variant_builder_add(&builder, "{s@a{sv}}", interface_name, properties);
+    g_dbus_connection_emit_signal(sim->connection,
+                                  NULL,
+                                  "/",
+                                  OBJECT_MANAGER_IFACE,
+                                  "InterfacesAdded",
+                                  g_variant_new("(o@a{sa{sv}})", path, g_variant_builder_end(&builder)),
+                                  NULL);
+}
+
+static void sim_emit_interfaces_removed(struct bluez_simulator *sim, const char *path, const char *interface_name)
+{
+    const gchar *interfaces[] = {interface_name, NULL};
+    g_dbus_connection_emit_signal(sim->connection,
+                                  NULL,
+                                  "/",
+                                  OBJECT_MANAGER_IFACE,
+                                  "InterfacesRemoved",
+                                  g_variant_new("(o^as)", path, interfaces),
+                                  NULL);
+}
+
+static guint sim_register_object(struct bluez_simulator *sim, const char *path, const char *interface_name, gpointer data)
+{
+    GError *err = NULL;
+    guint id = g_dbus_connection_register_object(sim->connection,
+                                                 path,
+                                                 sim_interface_info(sim, interface_name),
+                                                 &sim_vtable,
+                                                 data,
+                                                 NULL,
+                                                 &err);
+    if (id == 0) {
+        tr_err("Could not export %s on %s: %s", interface_name, path, err->message);
+        g_clear_error(&err);
+    }
+    return id;
+}
+
+static void sim_unregister_object(struct bluez_simulator *sim, guint *id)
+{
+    if (*id != 0) {
+        g_dbus_connection_unregister_object(sim->connection, *id);
+        *id = 0;
+    }
+}
+
+static gboolean sim_characteristic_notify(gpointer data)
+{
+    struct sim_characteristic *ch = data;
+    struct bluez_simulator *sim = ch->device->sim;
+
+    sim_characteristic_refresh_value(ch);
+    sim_emit_property_changed(sim, ch->path, GATT_CHARACTERISTIC_IFACE, "Value", sim_characteristic_value(ch));
+    g_atomic_pointer_add(&sim->notifications_sent, 1);
+    return G_SOURCE_CONTINUE;
+}
+
+static void sim_characteristic_set_notifying(struct sim_characteristic *ch, bool notifying)
+{
+    struct bluez_simulator *sim = ch->device->sim;
+
+    if (ch->notifying == notifying) {
+        return;
+    }
+    ch->notifying = notifying;
+    if (notifying) {
+        ch->notify_source_id = sim_timeout_add(sim, sim->config.notify_interval_ms, sim_characteristic_notify, ch);
+    } else {
+        sim_source_remove(sim, &ch->notify_source_id);
+    }
+    if (ch->registration_id != 0) {
+        sim_emit_property_changed(sim, ch->path, GATT_CHARACTERISTIC_IFACE, "Notifying", g_variant_new_boolean(notifying));
+    }
+}
+
+static void sim_device_export_gatt(struct sim_device *dev)
+{
+    struct bluez_simulator *sim = dev->sim;
+    int i;
+
+    if (dev->service_registration_id != 0) {
+        return;
+    }
+    dev->service_registration_id = sim_register_object(sim, dev->service_path, GATT_SERVICE_IFACE, dev);
+    sim_emit_interfaces_added(sim, dev->service_path, GATT_SERVICE_IFACE, sim_service_properties(dev));
+    for (i = 0; i < sim->config.characteristic_count; i++) {
+        struct sim_characteristic *ch = &dev->chars[i];
+        ch->registration_id = sim_register_object(sim, ch->path, GATT_CHARACTERISTIC_IFACE, ch);
+        sim_emit_interfaces_added(sim, ch->path, GATT_CHARACTERISTIC_IFACE, sim_characteristic_properties(ch));
+    }
+}
+
+static void sim_device_unexport_gatt(struct sim_device *dev)
+{
+    struct bluez_simulator *sim = dev->sim;
+    int i;
+
+    if (dev->service_registration_id == 0) {
+        return;
+    }
+    for (i = 0; i < sim->config.characteristic_count; i++) {
+        struct sim_characteristic *ch = &dev->chars[i];
+        sim_characteristic_set_notifying(ch, false);
+        sim_unregister_object(sim, &ch->registration_id);
+        sim_emit_interfaces_removed(sim, ch->path, GATT_CHARACTERISTIC_IFACE);
+    }
+    sim_unregister_object(sim, &dev->service_registration_id);
+    sim_emit_interfaces_removed(sim, dev->service_path, GATT_SERVICE_IFACE);
+}
+
+static void sim_device_disconnect(struct sim_device *dev)
+{
+    struct bluez_simulator *sim = dev->sim;
+
+    sim_source_remove(sim, &dev->pending_source_id);
+    sim_device_unexport_gatt(dev);
+    if (dev->services_resolved) {
+        dev->services_resolved = false;
+        sim_emit_property_changed(sim, dev->path, DEVICE_IFACE, "ServicesResolved", g_variant_new_boolean(FALSE));
+    }
+    if (dev->connected) {
+        dev->connected = false;
+        sim_emit_property_changed(sim, dev->path, DEVICE_IFACE, "Connected", g_variant_new_boolean(FALSE));
+    }
+}
+
+static void sim_device_export(struct sim_device *dev)
+{
+    if (dev->registration_id != 0) {
+        return;
+    }
+    dev->registration_id = sim_register_object(dev->sim, dev->path, DEVICE_IFACE, dev);
+    sim_emit_interfaces_added(dev->sim, dev->path, DEVICE_IFACE, sim_device_properties(dev));
+}
+
+static void sim_device_unexport(struct sim_device *dev)
+{
+    if (dev->registration_id == 0) {
+        return;
+    }
+    sim_device_disconnect(dev);
+    sim_unregister_object(dev->sim, &dev->registration_id);
+    sim_emit_interfaces_removed(dev->sim, dev->path, DEVICE_IFACE);
+}
+
+static gboolean sim_device_services_resolved(gpointer data)
+{
+    struct sim_device *dev = data;
+
+    dev->pending_source_id = 0;
+    sim_device_export_gatt(dev);
+    dev->services_resolved = true;
+    sim_emit_property_changed(dev->sim, dev->path, DEVICE_IFACE, "ServicesResolved", g_variant_new_boolean(TRUE));
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean sim_device_connected(gpointer data)
+{
+    struct sim_pending_call *call = data;
+    struct sim_device *dev = call->device;
+
+    dev->pending_source_id = 0;
+    dev->connected = true;
+    sim_emit_property_changed(dev->sim, dev->path, DEVICE_IFACE, "Connected", g_variant_new_boolean(TRUE));
+    g_dbus_method_invocation_return_value(call->invocation, NULL);
+    free(call);
+
+    // BlueZ resolves the services after the link is up.
+    dev->pending_source_id = sim_timeout_add(dev->sim,
+                                             dev->sim->config.connect_latency_ms,
+                                             sim_device_services_resolved,
+                                             dev);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean sim_characteristic_read_done(gpointer data)
+{
+    struct sim_pending_call *call = data;
+    struct sim_characteristic *ch = call->characteristic;
+
+    sim_characteristic_refresh_value(ch);
+    g_dbus_method_invocation_return_value(call->invocation, g_variant_new("(@ay)", sim_characteristic_value(ch)));
+    free(call);
+    return G_SOURCE_REMOVE;
+}
+
+static struct sim_pending_call *sim_pending_call_new(struct sim_device *dev,
+                                                     struct sim_characteristic *ch,
+                                                     GDBusMethodInvocation *invocation)
+{
+    struct sim_pending_call *call = calloc(1, sizeof(struct sim_pending_call));
+    if (call == NULL) {
+        g_dbus_method_invocation_return_dbus_error(invocation, "org.bluez.Error.Failed", "Out of memory");
+        return NULL;
+    }
+    call->device = dev;
+    call->characteristic = ch;
+    call->invocation = invocation;
+    return call;
+}
+
+static struct sim_device *sim_find_device(struct bluez_simulator *sim, const char *path)
+{
+    int i;
+    for (i = 0; i < sim->config.device_count; i++) {
+        if (strcmp(sim->devices[i].path, path) == 0) {
+            return &sim->devices[i];
+        }
+    }
+    return NULL;
+}
+
+static void sim_adapter_method_call(struct bluez_simulator *sim,
+                                    const gchar *method_name,
+                                    GVariant *parameters,
+                                    GDBusMethodInvocation *invocation)
+{
+    int i;
+
+    if (strcmp(method_name, "StartDiscovery") == 0) {
+        if (!sim->discovering) {
+            sim->discovering = true;
+            sim_emit_property_changed(sim, sim->adapter_path, ADAPTER_IFACE, "Discovering", g_variant_new_boolean(TRUE));
+        }
+        for (i = 0; i < sim->config.device_count; i++) {
+            sim_device_export(&sim->devices[i]);
+        }
+    } else if (strcmp(method_name, "StopDiscovery") == 0) {
+        if (sim->discovering) {
+            sim->discovering = false;
+            sim_emit_property_changed(sim, sim->adapter_path, ADAPTER_IFACE, "Discovering", g_variant_new_boolean(FALSE));
+        }
+    } else if (strcmp(method_name, "RemoveDevice") == 0) {
+        const gchar *path;
+        struct sim_device *dev;
+        g_variant_get(parameters, "(&o)", &path);
+        dev = sim_find_device(sim, path);
+        if (dev == NULL || dev->registration_id == 0) {
+            g_dbus_method_invocation_return_dbus_error(invocation, "org.bluez.Error.DoesNotExist", "Does Not Exist");
+            return;
+        }
+        sim_device_unexport(dev);
+    }
+    // SetDiscoveryFilter is accepted as is, all simulated devices match.
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static void sim_device_method_call(struct sim_device *dev,
+                                   const gchar *method_name,
+                                   GDBusMethodInvocation *invocation)
+{
+    struct bluez_simulator *sim = dev->sim;
+
+    if (strcmp(method_name, "Connect") == 0) {
+        struct sim_pending_call *call;
+        if (dev->connected || dev->pending_source_id != 0) {
+            g_dbus_method_invocation_return_dbus_error(invocation,
+                                                       dev->connected ? "org.bluez.Error.AlreadyConnected" :
+                                                                        "org.bluez.Error.InProgress",
+                                                       "Connect");
+            return;
+        }
+        call = sim_pending_call_new(dev, NULL, invocation);
+        if (call != NULL) {
+            dev->pending_source_id = sim_timeout_add(sim, sim->config.connect_latency_ms, sim_device_connected, call);
+        }
+        return;
+    }
+    // Disconnect
+    sim_device_disconnect(dev);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static void sim_characteristic_method_call(struct sim_characteristic *ch,
+                                           const gchar *method_name,
+                                           GVariant *parameters,
+                                           GDBusMethodInvocation *invocation)
+{
+    struct bluez_simulator *sim = ch->device->sim;
+
+    if (strcmp(method_name, "ReadValue") == 0) {
+        struct sim_pending_call *call = sim_pending_call_new(ch->device, ch, invocation);
+        if (call == NULL) {
+            return;
+        }
+        if (sim->config.read_latency_ms > 0) {
+            sim_timeout_add(sim, sim->config.read_latency_ms, sim_characteristic_read_done, call);
+        } else {
+            sim_characteristic_read_done(call);
+        }
+        return;
+    }
+    if (strcmp(method_name, "WriteValue") == 0) {
+        GVariant *value = g_variant_get_child_value(parameters, 0);
+        gsize size;
+        const guint8 *data = g_variant_get_fixed_array(value, &size, 1);
+        memcpy(ch->value, data, MIN(size, sizeof(ch->value)));
+        g_variant_unref(value);
+    } else if (strcmp(method_name, "StartNotify") == 0) {
+        sim_characteristic_set_notifying(ch, true);
+    } else if (strcmp(method_name, "StopNotify") == 0) {
+        sim_characteristic_set_notifying(ch, false);
+    }
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static void sim_add_managed_object(GVariantBuilder *objects, const char *path, const char *interface_name, GVariant *properties)
+{
+    GVariantBuilder interfaces;
+    g_variant_builder_init(&interfaces, G_VARIANT_TYPE("a{sa{sv}}"));
+    g_variant_builder_add(&interfaces, "{s@a{sv}}", interface_name, properties);
+    g_variant_builder_add(objects, "{o@a{sa{sv}}}", path, g_variant_builder_end(&interfaces));
+}
+
+static GVariant *sim_get_managed_objects(struct bluez_simulator *sim)
+{
+    GVariantBuilder objects;
+    int i, c;
+
+    g_variant_builder_init(&objects, G_VARIANT_TYPE("a{oa{sa{sv}}}"));
+    sim_add_managed_object(&objects, sim->adapter_path, ADAPTER_IFACE, sim_adapter_properties(sim));
+    for (i = 0; i < sim->config.device_count; i++) {
+        struct sim_device *dev = &sim->devices[i];
+        if (dev->registration_id == 0) {
+            continue;
+        }
+        sim_add_managed_object(&objects, dev->path, DEVICE_IFACE, sim_device_properties(dev));
+        if (dev->service_registration_id == 0) {
+            continue;
+        }
+        sim_add_managed_object(&objects, dev->service_path, GATT_SERVICE_IFACE, sim_service_properties(dev));
+        for (c = 0; c < sim->config.characteristic_count; c++) {
+            struct sim_characteristic *ch = &dev->chars[c];
+            sim_add_managed_object(&objects, ch->path, GATT_CHARACTERISTIC_IFACE, sim_characteristic_properties(ch));
+        }
+    }
+    return g_variant_new("(@a{oa{sa{sv}}})", g_variant_builder_end(&objects));
+}
+
+static void sim_method_call(GDBusConnection *connection,
+                            const gchar *sender,
+                            const gchar *object_path,
+                            const gchar *interface_name,
+                            const gchar *method_name,
+                            GVariant *parameters,
+                            GDBusMethodInvocation *invocation,
+                            gpointer user_data)
+{
+    (void) connection;
+    (void) sender;
+    (void) object_path;
+
+    if (strcmp(interface_name, OBJECT_MANAGER_IFACE) == 0) {
+        g_dbus_method_invocation_return_value(invocation, sim_get_managed_objects(user_data));
+    } else if (strcmp(interface_name, ADAPTER_IFACE) == 0) {
+        sim_adapter_method_call(user_data, method_name, parameters, invocation);
+    } else if (strcmp(interface_name, DEVICE_IFACE) == 0) {
+        sim_device_method_call(user_data, method_name, invocation);
+    } else if (strcmp(interface_name, GATT_CHARACTERISTIC_IFACE) == 0) {
+        sim_characteristic_method_call(user_data, method_name, parameters, invocation);
+    } else {
+        g_dbus_method_invocation_return_dbus_error(invocation, "org.bluez.Error.NotSupported", method_name);
+    }
+}
+
+static GVariant *sim_get_property(GDBusConnection *connection,
+                                  const gchar *sender,
+                                  const gchar *object_path,
+                                  const gchar *interface_name,
+                                  const gchar *property_name,
+                                  GError **error,
+                                  gpointer user_data)
+{
+    GVariant *properties;
+    GVariant *value;
+    (void) connection;
+    (void) sender;
+    (void) object_path;
+
+    if (strcmp(interface_name, ADAPTER_IFACE) == 0) {
+        properties = sim_adapter_properties(user_data);
+    } else if (strcmp(interface_name, DEVICE_IFACE) == 0) {
+        properties = sim_device_properties(user_data);
+    } else if (strcmp(interface_name, GATT_SERVICE_IFACE) == 0) {
+        properties = sim_service_properties(user_data);
+    } else {
+        properties = sim_characteristic_properties(user_data);
+    }
+    g_variant_ref_sink(properties);
+    value = g_variant_lookup_value(properties, property_name, NULL);
+    g_variant_unref(properties);
+    if (value == NULL) {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "No property %s", property_name);
+    }
+    return value;
+}
+
+static gboolean sim_set_property(GDBusConnection *connection,
+                                 const gchar *sender,
+                                 const gchar *object_path,
+                                 const gchar *interface_name,
+                                 const gchar *property_name,
+                                 GVariant *value,
+                                 GError **error,
+                                 gpointer user_data)
+{
+    struct bluez_simulator *sim = user_data;
+    (void) connection;
+    (void) sender;
+    (void) object_path;
+
+    if (strcmp(interface_name, ADAPTER_IFACE) != 0 || strcmp(property_name, "Powered") != 0) {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_PROPERTY_READ_ONLY, "Property %s is read-only", property_name);
+        return FALSE;
+    }
+    sim->powered = g_variant_get_boolean(value);
+    sim_emit_property_changed(sim, sim->adapter_path, ADAPTER_IFACE, "Powered", g_variant_new_boolean(sim->powered));
+    return TRUE;
+}
+
+static bool sim_devices_create(struct bluez_simulator *sim)
+{
+    int i, c;
+
+    sim->devices = calloc(sim->config.device_count, sizeof(struct sim_device));
+    if (sim->devices == NULL) {
+        return false;
+    }
+    for (i = 0; i < sim->config.device_count; i++) {
+        struct sim_device *dev = &sim->devices[i];
+        dev->sim = sim;
+        dev->index = i;
+        snprintf(dev->address, sizeof(dev->address), "10:00:00:00:%02X:%02X", (i >> 8) & 0xff, i & 0xff);
+        snprintf(dev->name, sizeof(dev->name), "blept-sim-%d", i);
+        snprintf(dev->path, sizeof(dev->path), "%s/dev_10_00_00_00_%02X_%02X",
+                 sim->adapter_path, (i >> 8) & 0xff, i & 0xff);
+        snprintf(dev->service_path, sizeof(dev->service_path), "%s/service0001", dev->path);
+        dev->chars = calloc(sim->config.characteristic_count, sizeof(struct sim_characteristic));
+        if (dev->chars == NULL) {
+            return false;
+        }
+        for (c = 0; c < sim->config.characteristic_count; c++) {
+            dev->chars[c].device = dev;
+            snprintf(dev->chars[c].path, sizeof(dev->chars[c].path), "%s/char%04x", dev->service_path, c + 2);
+            sim_characteristic_refresh_value(&dev->chars[c]);
+        }
+    }
+    return true;
+}
+
+static void sim_devices_free(struct bluez_simulator *sim)
+{
+    int i;
+
+    if (sim->devices == NULL) {
+        return;
+    }
+    for (i = 0; i < sim->config.device_count; i++) {
+        free(sim->devices[i].chars);
+    }
+    free(sim->devices);
+    sim->devices = NULL;
+}
+
+static bool sim_setup(struct bluez_simulator *sim)
+{
+    GError *err = NULL;
+    GVariant *ret;
+    guint32 reply = 0;
+
+    sim->introspection = g_dbus_node_info_new_for_xml(sim_introspection_xml, &err);
+    if (sim->introspection == NULL) {
+        tr_err("Invalid introspection data: %s", err->message);
+        g_clear_error(&err);
+        return false;
+    }
+    if (sim->config.bus_address != NULL) {
+        sim->connection = g_dbus_connection_new_for_address_sync(sim->config.bus_address,
+                                                                 G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION |
+                                                                 G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                                                 NULL,
+                                                                 NULL,
+                                                                 &err);
+    } else {
+        sim->connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &err);
+    }
+    if (sim->connection == NULL) {
+        tr_err("Could not connect to the bus: %s", err->message);
+        g_clear_error(&err);
+        return false;
+    }
+
+    sim->manager_registration_id = sim_register_object(sim, "/", OBJECT_MANAGER_IFACE, sim);
+    sim->adapter_registration_id = sim_register_object(sim, sim->adapter_path, ADAPTER_IFACE, sim);
+    if (sim->manager_registration_id == 0 || sim->adapter_registration_id == 0) {
+        return false;
+    }
+
+    ret = g_dbus_connection_call_sync(sim->connection,
+                                      "org.freedesktop.DBus",
+                                      "/org/freedesktop/DBus",
+                                      "org.freedesktop.DBus",
+                                      "RequestName",
+                                      g_variant_new("(su)", BLUEZ_NAME, SIM_NAME_FLAG_DO_NOT_QUEUE),
+                                      G_VARIANT_TYPE("(u)"),
+                                      G_DBUS_CALL_FLAGS_NONE,
+                                      -1,
+                                      NULL,
+                                      &err);
+    if (ret == NULL) {
+        tr_err("Could not request the name %s: %s", BLUEZ_NAME, err->message);
+        g_clear_error(&err);
+        return false;
+    }
+    g_variant_get(ret, "(u)", &reply);
+    g_variant_unref(ret);
+    if (reply != SIM_NAME_REPLY_PRIMARY_OWNER) {
+        tr_err("The name %s is already owned on the bus", BLUEZ_NAME);
+        return false;
+    }
+    tr_info("Simulating %d devices with %d characteristics on %s",
+            sim->config.device_count, sim->config.characteristic_count, sim->adapter_path);
+    return true;
+}
+
+static void sim_teardown(struct bluez_simulator *sim)
+{
+    int i;
+
+    if (sim->connection != NULL) {
+        for (i = 0; sim->devices != NULL && i < sim->config.device_count; i++) {
+            sim_device_unexport(&sim->devices[i]);
+        }
+        sim_unregister_object(sim, &sim->adapter_registration_id);
+        sim_unregister_object(sim, &sim->manager_registration_id);
+        g_dbus_connection_flush_sync(sim->connection, NULL, NULL);
+        g_object_unref(sim->connection);
+        sim->connection = NULL;
+    }
+    if (sim->introspection != NULL) {
+        g_dbus_node_info_unref(sim->introspection);
+        sim->introspection = NULL;
+    }
+}
+
+static gpointer sim_thread(gpointer data)
+{
+    struct bluez_simulator *sim = data;
+    bool ok;
+
+    g_main_context_push_thread_default(sim->context);
+    ok = sim_setup(sim);
+
+    g_mutex_lock(&sim->ready_mutex);
+    sim->setup_ok = ok;
+    sim->ready = true;
+    g_cond_signal(&sim->ready_cond);
+    g_mutex_unlock(&sim->ready_mutex);
+
+    if (ok) {
+        g_main_loop_run(sim->loop);
+    }
+    sim_teardown(sim);
+    g_main_context_pop_thread_default(sim->context);
+    return NULL;
+}
+
+static void sim_free(struct bluez_simulator *sim)
+{
+    sim_devices_free(sim);
+    if (sim->loop != NULL) {
+        g_main_loop_unref(sim->loop);
+    }
+    if (sim->context != NULL) {
+        g_main_context_unref(sim->context);
+    }
+    g_mutex_clear(&sim->ready_mutex);
+    g_cond_clear(&sim->ready_cond);
+    free(sim);
+}
+
+struct bluez_simulator *bluez_simulator_start(const struct bluez_simulator_config *config)
+{
+    struct bluez_simulator *sim;
+
+    if (config->device_count <= 0 || config->characteristic_count <= 0 || config->notify_interval_ms <= 0) {
+        tr_err("Invalid simulator configuration");
+        return NULL;
+    }
+    sim = calloc(1, sizeof(struct bluez_simulator));
+    if (sim == NULL) {
+        return NULL;
+    }
+    sim->config = *config;
+    sim->powered = true;
+    snprintf(sim->adapter_path, sizeof(sim->adapter_path), "/org/bluez/%s", config->adapter);
+    g_mutex_init(&sim->ready_mutex);
+    g_cond_init(&sim->ready_cond);
+    sim->context = g_main_context_new();
+    sim->loop = g_main_loop_new(sim->context, FALSE);
+    if (!sim_devices_create(sim)) {
+        tr_err("Could not allocate the simulated devices");
+        sim_free(sim);
+        return NULL;
+    }
+
+    sim->thread = g_thread_new("bluez-simulator", sim_thread, sim);
+    g_mutex_lock(&sim->ready_mutex);
+    while (!sim->ready) {
+        g_cond_wait(&sim->ready_cond, &sim->ready_mutex);
+    }
+    g_mutex_unlock(&sim->ready_mutex);
+
+    if (!sim->setup_ok) {
+        g_thread_join(sim->thread);
+        sim_free(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+void bluez_simulator_stop(struct bluez_simulator *sim)
+{
+    if (sim == NULL) {
+        return;
+    }
+    g_main_loop_quit(sim->loop);
+    g_thread_join(sim->thread);
+    sim_free(sim);
+}
+
+uint64_t bluez_simulator_notifications_sent(struct bluez_simulator *sim)
+{
+    return (uint64_t) g_atomic_pointer_get(&sim->notifications_sent);
+}
@@ -0,0 +1,71 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef __BLUEZ_SIMULATOR_H__
+#define __BLUEZ_SIMULATOR_H__
+
+#include "stdbool.h"
+#include "stdint.h"
+#include "glib.h"
+
+/* The simulated devices advertise this service, which blept discovers without a whitelist */
+#define BLUEZ_SIMULATOR_SERVICE_UUID "0000a000-0000-1000-8000-00805f9b34fb"
+#define BLUEZ_SIMULATOR_CHARACTERISTIC_UUID "0000a001-0000-1000-8000-00805f9b34fb"
+
+/* Characteristic value: the monotonic time in microseconds when the value was generated
+ * (gint64) followed by a sequence number (uint32_t), both in host byte order.
+ */
+#define BLUEZ_SIMULATOR_VALUE_SIZE 12
+
+struct bluez_simulator_config {
+    const char *bus_address;   /* D-Bus address to export the objects on, NULL for the session bus */
+    const char *adapter;       /* adapter name, for example "hci0" */
+    int device_count;
+    int characteristic_count;  /* characteristics per device */
+    int notify_interval_ms;    /* interval of value changes of a notifying characteristic */
+    int connect_latency_ms;    /* delay of Connect and of the service resolution after it */
+    int read_latency_ms;       /* delay of ReadValue */
+};
+
+struct bluez_simulator;
+
+/**
+ * \brief Starts a stand-in for the BlueZ daemon in its own thread.
+ *
+ *        The simulator owns the org.bluez name on the bus and exports an adapter. The devices are
+ *        exported when discovery is started. A device exports its GATT service and characteristics
+ *        when it is connected. Notifying characteristics change their value at the configured
+ *        interval.
+ *
+ * \param config The configuration, copied by the simulator.
+ * \return The simulator, or NULL if the bus could not be set up.
+ */
+struct bluez_simulator *bluez_simulator_start(const struct bluez_simulator_config *config);
+
+/**
+ * \brief Stops the simulator thread and removes the exported objects from the bus.
+ */
+void bluez_simulator_stop(struct bluez_simulator *sim);
+
+/**
+ * \brief Returns the number of value notifications sent so far.
+ */
+uint64_t bluez_simulator_notifications_sent(struct bluez_simulator *sim);
+
+#endif /* __BLUEZ_SIMULATOR_H__ */
@@ -0,0 +1,95 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \file bluez_simulator_main.c
+ * \brief Runs the BlueZ simulator on a bus until interrupted, to test blept without radios.
+ *
+ * Usage: blept-bluez-simulator <bus address|session> [devices] [characteristics per device]
+ *                              [notify interval ms] [connect latency ms] [read latency ms]
+ *
+ * Start blept with --address set to the same bus address.
+ */
+
+#include "bluez_simulator.h"
+
+#include <mbed-trace/mbed_trace.h>
+#include "common/edge_trace.h"
+
+#include <glib-unix.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_GROUP "bsim"
+
+#define SIMULATOR_DEFAULT_DEVICES 100
+#define SIMULATOR_DEFAULT_CHARACTERISTICS 4
+#define SIMULATOR_DEFAULT_NOTIFY_INTERVAL_MS 1000
+#define SIMULATOR_DEFAULT_CONNECT_LATENCY_MS 50
+#define SIMULATOR_DEFAULT_READ_LATENCY_MS 10
+
+static gboolean simulator_quit(gpointer data)
+{
+    g_main_loop_quit(data);
+    return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char **argv)
+{
+    struct bluez_simulator_config config;
+    struct bluez_simulator *sim;
+    GMainLoop *loop;
+
+    if (argc < 2) {
+        fprintf(stderr,
+                "Usage: %s <bus address|session> [devices] [characteristics per device] [notify interval ms] "
+                "[connect latency ms] [read latency ms]\n",
+                argv[0]);
+        return 1;
+    }
+    config.bus_address = strcmp(argv[1], "session") == 0 ? NULL : argv[1];
+    config.adapter = "hci0";
+    config.device_count = argc > 2 ? atoi(argv[2]) : SIMULATOR_DEFAULT_DEVICES;
+    config.characteristic_count = argc > 3 ? atoi(argv[3]) : SIMULATOR_DEFAULT_CHARACTERISTICS;
+    config.notify_interval_ms = argc > 4 ? atoi(argv[4]) : SIMULATOR_DEFAULT_NOTIFY_INTERVAL_MS;
+    config.connect_latency_ms = argc > 5 ? atoi(argv[5]) : SIMULATOR_DEFAULT_CONNECT_LATENCY_MS;
+    config.read_latency_ms = argc > 6 ? atoi(argv[6]) : SIMULATOR_DEFAULT_READ_LATENCY_MS;
+
+    edge_trace_init(0);
+
+    sim = bluez_simulator_start(&config);
+    if (sim == NULL) {
+        tr_err("Could not start the simulator");
+        return 1;
+    }
+
+    loop = g_main_loop_new(NULL, FALSE);
+    g_unix_signal_add(SIGINT, simulator_quit, loop);
+    g_unix_signal_add(SIGTERM, simulator_quit, loop);
+    g_main_loop_run(loop);
+    g_main_loop_unref(loop);
+
+    printf("notifications sent: %" PRIu64 "\n", bluez_simulator_notifications_sent(sim));
+    bluez_simulator_stop(sim);
+    return 0;
+}
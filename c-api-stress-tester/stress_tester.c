@@ -14,6 +14,7 @@
 #include "pt-client/client.h"
 #include "mbed-trace/mbed_trace.h"
 #include "examples-common/client_config.h"
+#include "examples-common/device_batch.h"
 #include "stress-tester/stress_tester.h"
 #include "examples-common/ipso_objects.h"
 #include "device-interface/thermal_zone.h"
@@ -27,6 +28,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include "ns_list.h"
 #include "unistd.h"
 #include "time.h"
@@ -43,6 +45,7 @@
  */
 
 #define RANDOM_DEVICE_PREFIX "rand"
+#define COLD_START_DEVICE_PREFIX "cold"
 #define LIFETIME 86400
 #define MAX_DEVICE_ID_LEN 50
 struct stress_tester_s;
@@ -58,6 +61,8 @@ typedef struct {
     pt_device_list_t *_devices;
     struct pt_api_thread_s *api_data;
     pthread_mutex_t device_list_mutex;
+    struct timespec cold_start_time;
+    bool cold_start_done;
 } test_thread_t;
 
 typedef struct {
@@ -107,6 +112,8 @@ typedef struct stress_tester_s {
     int32_t min_number_of_devices;
     int32_t test_duration_seconds;
     int32_t sleep_time_ms;
+    int32_t cold_start_devices;
+    int32_t batch_window;
     test_thread_t *test_threads;
     pt_api_thread_t *api_threads; // Each protocol translator needs its own API thread.
     pthread_t *shutdown_thread;
@@ -943,6 +950,125 @@ static void set_random_value(test_thread_t *test_data)
     }
 }
 
+static int64_t elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void cold_start_device_registered(pt_device_t *device, bool success, void *userdata)
+{
+    test_thread_t *test_data = (test_thread_t *) userdata;
+    if (success) {
+        test_data_conditionally_lock_device_list(test_data);
+        pt_device_userdata_t *device_userdata = device->userdata;
+        device_userdata_t *data = device_userdata->data;
+        data->registered = true;
+        test_data_conditionally_unlock_device_list(test_data);
+    }
+}
+
+static void cold_start_lock_connection(void *userdata)
+{
+    api_data_conditionally_lock_connection(((test_thread_t *) userdata)->api_data);
+}
+
+static void cold_start_unlock_connection(void *userdata)
+{
+    api_data_conditionally_unlock_connection(((test_thread_t *) userdata)->api_data);
+}
+
+static void cold_start_done(uint32_t registered, uint32_t failed, void *userdata)
+{
+    test_thread_t *test_data = (test_thread_t *) userdata;
+    int64_t duration = elapsed_ms(&test_data->cold_start_time);
+    tr_info("Cold start in test thread #%d: %u devices registered, %u failed in %" PRId64 " ms (%.1f devices/s)",
+            test_data->test_thread_index,
+            registered,
+            failed,
+            duration,
+            duration > 0 ? registered * 1000.0 / duration : 0.0);
+    test_data_conditionally_lock_device_list(test_data);
+    test_data->cold_start_done = true;
+    test_data_conditionally_unlock_device_list(test_data);
+}
+
+/**
+ * \brief Cold start action. Registers `--cold-start-devices` devices in one batch the way a
+ *        gateway does after restart and reports the time it took until all were registered.
+ */
+static void run_cold_start_action(test_thread_t *test_data)
+{
+    pt_api_thread_t *api_data = test_data->api_data;
+    stress_tester_t *tester = api_data->tester;
+    int32_t count = tester->cold_start_devices;
+    int32_t index;
+    bool done = false;
+
+    while (!(api_data->connected && api_data->protocol_translator_api_running)) {
+        if (!api_data->keep_running || shutdown_initiated) {
+            return;
+        }
+        sleep_ms(10);
+    }
+
+    pt_device_t **devices = calloc(count, sizeof(pt_device_t *));
+    if (!devices) {
+        tr_err("Could not allocate cold start device array.");
+        return;
+    }
+    test_data_conditionally_lock_device_list(test_data);
+    for (index = 0; index < count; index++) {
+        char *device_id = calloc(1,
+                                 strlen(COLD_START_DEVICE_PREFIX) + 1 /* '-' */ +
+                                         edge_int_length(test_data->test_thread_index) + 1 /* '-' */ +
+                                         edge_int_length(index) + 1 /* NUL terminator */);
+        sprintf(device_id, "%s-%d-%d", COLD_START_DEVICE_PREFIX, test_data->test_thread_index, index);
+        device_userdata_t *data = (device_userdata_t *) calloc(1, sizeof(device_userdata_t));
+        pt_device_userdata_t *userdata = pt_api_create_device_userdata(data, free);
+        pt_device_t *device = client_config_create_device_with_userdata(device_id, "", userdata);
+        free(device_id);
+        ipso_create_thermometer(device, 0, 24, false, NULL);
+        pt_device_entry_t *device_entry = malloc(sizeof(pt_device_entry_t));
+        device_entry->device = device;
+        ns_list_add_to_end(test_data->_devices, device_entry);
+        devices[index] = device;
+    }
+    test_data->cold_start_done = false;
+    test_data_conditionally_unlock_device_list(test_data);
+
+    tr_info("Cold start in test thread #%d: registering %d devices with window %d",
+            test_data->test_thread_index,
+            count,
+            tester->batch_window);
+    clock_gettime(CLOCK_MONOTONIC, &test_data->cold_start_time);
+    // The batch takes the connection lock itself for each registration it sends.
+    pt_status_t status = device_batch_register(api_data->connection,
+                                               devices,
+                                               count,
+                                               tester->batch_window,
+                                               cold_start_device_registered,
+                                               cold_start_done,
+                                               cold_start_lock_connection,
+                                               cold_start_unlock_connection,
+                                               test_data);
+    free(devices);
+    if (status != PT_STATUS_SUCCESS) {
+        tr_err("Could not start the cold start registration, status: %d", status);
+        return;
+    }
+
+    while (!done && api_data->keep_running && !shutdown_initiated) {
+        test_data_conditionally_lock_device_list(test_data);
+        done = test_data->cold_start_done;
+        test_data_conditionally_unlock_device_list(test_data);
+        if (!done) {
+            sleep_ms(10);
+        }
+    }
+}
+
 static void run_test_action(test_thread_t *test_data)
 {
     test_action_e action = rand() / (RAND_MAX / ACTION_LAST + 1);
@@ -978,6 +1104,10 @@ static void *test_thread_func(void *arg) {
     pt_api_thread_t *api_data = test_data->api_data;
     bool done = false;
 
+    if (api_data->tester->cold_start_devices > 0) {
+        run_cold_start_action(test_data);
+    }
+
     while (!done) {
 
         if (api_data->keep_running && !shutdown_initiated) {
@@ -1057,6 +1187,8 @@ static bool create_tester(stress_tester_t *tester, DocoptArgs *args)
     tester->args = args;
     tester->parallel_connection_lock = atoi(args->parallel_connection_lock);
     tester->test_duration_seconds = atoi(args->test_duration_seconds);
+    tester->cold_start_devices = atoi(args->cold_start_devices);
+    tester->batch_window = atoi(args->batch_window);
     create_pt_api_threads(tester);
     create_test_threads(tester);
     return true;
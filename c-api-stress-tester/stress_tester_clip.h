@@ -35,6 +35,8 @@ typedef struct {
     int color_log;
     int help;
     /* options with arguments */
+    char *batch_window;
+    char *cold_start_devices;
     char *edge_domain_socket;
     char *max_devices;
     char *min_devices;
@@ -53,7 +55,7 @@ const char help_message[] =
 "C-API Stress tester.\n"
 "\n"
 "Usage:\n"
-"  c-api-stress-tester --protocol-translator-name <name> [--edge-domain-socket <domain-socket>] [--number-of-protocol-translators <count>] [--number-of-threads <thread-num>] [--max-devices <max-devices>] [--min-devices <min-devices>] [--test-duration-seconds <duration-seconds>] [--sleep-time-ms <milliseconds>] [--parallel-connection-lock <int>] [--color-log]\n"
+"  c-api-stress-tester --protocol-translator-name <name> [--edge-domain-socket <domain-socket>] [--number-of-protocol-translators <count>] [--number-of-threads <thread-num>] [--max-devices <max-devices>] [--min-devices <min-devices>] [--test-duration-seconds <duration-seconds>] [--sleep-time-ms <milliseconds>] [--parallel-connection-lock <int>] [--cold-start-devices <count>] [--batch-window <size>] [--color-log]\n"
 "  c-api-stress-tester --help\n"
 "\n"
 "Options:\n"
@@ -67,13 +69,15 @@ const char help_message[] =
 "  -r --test-duration-seconds <duration-seconds>  Test duration in seconds. If duration is set to 0, runs for infinitely. [default: 0].\n"
 "  -l --parallel-connection-lock <int>            Parallel connection lock from application side. 1 enables. 0 disables. [default: 1]\n"
 "  -s --sleep-time-ms <milliseconds>              Thread sleep time in ms. Affects to how long tester thread waits until next operation. [default: 1000]\n"
+"  -c --cold-start-devices <count>                Register this many devices per test thread in one batch before the random tests start and report the time taken. [default: 0]\n"
+"  -w --batch-window <size>                       Maximum number of outstanding registrations in a batch. 0 means unlimited. [default: 100]\n"
 "  --color-log                                    Use ANSI colors in log.\n"
 "\n"
 "";
 
 const char usage_pattern[] =
 "Usage:\n"
-"  c-api-stress-tester --protocol-translator-name <name> [--edge-domain-socket <domain-socket>] [--number-of-protocol-translators <count>] [--number-of-threads <thread-num>] [--max-devices <max-devices>] [--min-devices <min-devices>] [--test-duration-seconds <duration-seconds>] [--sleep-time-ms <milliseconds>] [--parallel-connection-lock <int>] [--color-log]\n"
+"  c-api-stress-tester --protocol-translator-name <name> [--edge-domain-socket <domain-socket>] [--number-of-protocol-translators <count>] [--number-of-threads <thread-num>] [--max-devices <max-devices>] [--min-devices <min-devices>] [--test-duration-seconds <duration-seconds>] [--sleep-time-ms <milliseconds>] [--parallel-connection-lock <int>] [--cold-start-devices <count>] [--batch-window <size>] [--color-log]\n"
 "  c-api-stress-tester --help";
 
 typedef struct {
@@ -297,6 +301,12 @@ int elems_to_args(Elements *elements, DocoptArgs *args, bool help,
             args->color_log = option->value;
         } else if (!strcmp(option->olong, "--help")) {
             args->help = option->value;
+        } else if (!strcmp(option->olong, "--batch-window")) {
+            if (option->argument)
+                args->batch_window = option->argument;
+        } else if (!strcmp(option->olong, "--cold-start-devices")) {
+            if (option->argument)
+                args->cold_start_devices = option->argument;
         } else if (!strcmp(option->olong, "--edge-domain-socket")) {
             if (option->argument)
                 args->edge_domain_socket = option->argument;
@@ -344,8 +354,9 @@ int elems_to_args(Elements *elements, DocoptArgs *args, bool help,
 
 DocoptArgs docopt(int argc, char *argv[], bool help, const char *version) {
     DocoptArgs args = {
-        0, 0, (char*) "/tmp/edge.sock", (char*) "100", (char*) "10", (char*)
-        "1", (char*) "1", (char*) "1", NULL, (char*) "1000", (char*) "0",
+        0, 0, (char*) "100", (char*) "0", (char*) "/tmp/edge.sock", (char*)
+        "100", (char*) "10", (char*) "1", (char*) "1", (char*) "1", NULL,
+        (char*) "1000", (char*) "0",
         usage_pattern, help_message
     };
     Tokens ts;
@@ -356,6 +367,8 @@ DocoptArgs docopt(int argc, char *argv[], bool help, const char *version) {
     Option options[] = {
         {NULL, "--color-log", 0, 0, NULL},
         {"-h", "--help", 0, 0, NULL},
+        {"-w", "--batch-window", 1, 0, NULL},
+        {"-c", "--cold-start-devices", 1, 0, NULL},
         {NULL, "--edge-domain-socket", 1, 0, NULL},
         {"-a", "--max-devices", 1, 0, NULL},
         {"-i", "--min-devices", 1, 0, NULL},
@@ -366,7 +379,7 @@ DocoptArgs docopt(int argc, char *argv[], bool help, const char *version) {
         {"-s", "--sleep-time-ms", 1, 0, NULL},
         {"-r", "--test-duration-seconds", 1, 0, NULL}
     };
-    Elements elements = {0, 0, 11, commands, arguments, options};
+    Elements elements = {0, 0, 13, commands, arguments, options};
 
     ts = tokens_new(argc, argv);
     if (parse_args(&ts, &elements))
@@ -0,0 +1,374 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "device-interface/host_sensors.h"
+#include "common/read_file.h"
+#include "mbed-trace/mbed_trace.h"
+
+#define TRACE_GROUP            "hsens"
+#define THERMAL_ZONE_CLASS_DIR "/sys/class/thermal"
+#define THERMAL_ZONE_PREFIX    "thermal_zone"
+#define HWMON_CLASS_DIR        "/sys/class/hwmon"
+#define PROC_STAT_FILE         "/proc/stat"
+#define PROC_STAT_BUFFER_SIZE  4096
+
+/* Reads a short sysfs attribute like "type", "name" or "temp1_label" and strips the newline. */
+static bool read_attribute(const char *path, char *out, size_t out_size)
+{
+    uint8_t *buffer = NULL;
+    size_t read;
+    if (edge_read_file(path, &buffer, &read) != 0 || read == 0) {
+        free(buffer);
+        return false;
+    }
+    snprintf(out, out_size, "%.*s", (int) read, (char *) buffer);
+    out[strcspn(out, "\n")] = '\0';
+    free(buffer);
+    return true;
+}
+
+static host_sensor_t *add_sensor(host_sensors_t *sensors, int *capacity, host_sensor_kind_e kind, float scale)
+{
+    if (sensors->count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 16;
+        host_sensor_t *grown = realloc(sensors->sensors, new_capacity * sizeof(host_sensor_t));
+        if (!grown) {
+            tr_err("Could not allocate memory for host sensors.");
+            return NULL;
+        }
+        sensors->sensors = grown;
+        *capacity = new_capacity;
+    }
+    host_sensor_t *sensor = &sensors->sensors[sensors->count++];
+    memset(sensor, 0, sizeof(host_sensor_t));
+    sensor->kind = kind;
+    sensor->scale = scale;
+    sensor->fd = -1;
+    sensor->cpu_index = -1;
+    return sensor;
+}
+
+static void add_file_sensor(host_sensors_t *sensors,
+                            int *capacity,
+                            host_sensor_kind_e kind,
+                            float scale,
+                            const char *path,
+                            const char *name)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        tr_debug("Could not open '%s'.", path);
+        return;
+    }
+    host_sensor_t *sensor = add_sensor(sensors, capacity, kind, scale);
+    if (!sensor) {
+        close(fd);
+        return;
+    }
+    sensor->fd = fd;
+    snprintf(sensor->name, sizeof(sensor->name), "%s", name);
+}
+
+static void discover_thermal_zones(host_sensors_t *sensors, int *capacity)
+{
+    struct dirent *entry;
+    char path[PATH_MAX];
+    char name[64];
+    DIR *dir = opendir(THERMAL_ZONE_CLASS_DIR);
+    if (!dir) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(THERMAL_ZONE_PREFIX, entry->d_name, strlen(THERMAL_ZONE_PREFIX)) != 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s/type", THERMAL_ZONE_CLASS_DIR, entry->d_name);
+        if (!read_attribute(path, name, sizeof(name))) {
+            snprintf(name, sizeof(name), "%.63s", entry->d_name);
+        }
+        snprintf(path, sizeof(path), "%s/%s/temp", THERMAL_ZONE_CLASS_DIR, entry->d_name);
+        add_file_sensor(sensors, capacity, HOST_SENSOR_THERMAL_ZONE, 0.001f, path, name);
+    }
+    closedir(dir);
+}
+
+static void discover_hwmon_device(host_sensors_t *sensors, int *capacity, const char *hwmon_dir)
+{
+    struct dirent *entry;
+    char path[PATH_MAX];
+    char chip[32];
+    char label[32];
+    char name[64];
+    DIR *dir = opendir(hwmon_dir);
+    if (!dir) {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/name", hwmon_dir);
+    if (!read_attribute(path, chip, sizeof(chip))) {
+        snprintf(chip, sizeof(chip), "hwmon");
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        host_sensor_kind_e kind;
+        float scale;
+        size_t prefix_len = strcspn(entry->d_name, "_");
+        const char *suffix = entry->d_name + prefix_len;
+        if (strcmp(suffix, "_input") != 0) {
+            continue;
+        }
+        if (strncmp(entry->d_name, "temp", 4) == 0) {
+            kind = HOST_SENSOR_HWMON_TEMPERATURE;
+            scale = 0.001f; // millidegree Celsius
+        } else if (strncmp(entry->d_name, "in", 2) == 0) {
+            kind = HOST_SENSOR_HWMON_VOLTAGE;
+            scale = 0.001f; // millivolts
+        } else if (strncmp(entry->d_name, "fan", 3) == 0) {
+            kind = HOST_SENSOR_HWMON_FAN;
+            scale = 1.0f; // rpm
+        } else {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%.*s_label", hwmon_dir, (int) prefix_len, entry->d_name);
+        if (!read_attribute(path, label, sizeof(label))) {
+            snprintf(label, sizeof(label), "%.*s", (int) (prefix_len < 31 ? prefix_len : 31), entry->d_name);
+        }
+        snprintf(name, sizeof(name), "%s-%s", chip, label);
+        snprintf(path, sizeof(path), "%s/%s", hwmon_dir, entry->d_name);
+        add_file_sensor(sensors, capacity, kind, scale, path, name);
+    }
+    closedir(dir);
+}
+
+static void discover_hwmon(host_sensors_t *sensors, int *capacity)
+{
+    struct dirent *entry;
+    char path[PATH_MAX];
+    DIR *dir = opendir(HWMON_CLASS_DIR);
+    if (!dir) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", HWMON_CLASS_DIR, entry->d_name);
+        discover_hwmon_device(sensors, capacity, path);
+    }
+    closedir(dir);
+}
+
+static char *next_line(char *line)
+{
+    char *end = strchr(line, '\n');
+    return end ? end + 1 : NULL;
+}
+
+/* Reads the whole /proc/stat with pread, growing the cached buffer if needed. */
+static ssize_t read_proc_stat(host_sensors_t *sensors)
+{
+    while (true) {
+        ssize_t read = pread(sensors->proc_stat_fd, sensors->proc_stat_buffer, sensors->proc_stat_buffer_size - 1, 0);
+        if (read < 0) {
+            return -1;
+        }
+        if ((size_t) read < sensors->proc_stat_buffer_size - 1) {
+            sensors->proc_stat_buffer[read] = '\0';
+            return read;
+        }
+        char *grown = realloc(sensors->proc_stat_buffer, sensors->proc_stat_buffer_size * 2);
+        if (!grown) {
+            return -1;
+        }
+        sensors->proc_stat_buffer = grown;
+        sensors->proc_stat_buffer_size *= 2;
+    }
+}
+
+static void discover_cpu_load(host_sensors_t *sensors, int *capacity)
+{
+    sensors->proc_stat_fd = open(PROC_STAT_FILE, O_RDONLY | O_CLOEXEC);
+    if (sensors->proc_stat_fd < 0) {
+        return;
+    }
+    sensors->proc_stat_buffer_size = PROC_STAT_BUFFER_SIZE;
+    sensors->proc_stat_buffer = malloc(sensors->proc_stat_buffer_size);
+    if (!sensors->proc_stat_buffer || read_proc_stat(sensors) < 0) {
+        return;
+    }
+    sensors->cpu_first = sensors->count;
+    for (char *line = sensors->proc_stat_buffer; line && *line; line = next_line(line)) {
+        int cpu;
+        /* Skip the aggregate "cpu " line, only the per-CPU lines are exposed */
+        if (strncmp(line, "cpu", 3) != 0 || !isdigit((unsigned char) line[3]) || sscanf(line, "cpu%d", &cpu) != 1) {
+            continue;
+        }
+        host_sensor_t *sensor = add_sensor(sensors, capacity, HOST_SENSOR_CPU_LOAD, 1.0f);
+        if (!sensor) {
+            break;
+        }
+        sensor->cpu_index = cpu;
+        snprintf(sensor->name, sizeof(sensor->name), "cpu%d-load", cpu);
+        sensors->cpu_count++;
+    }
+}
+
+host_sensors_t *host_sensors_discover()
+{
+    int capacity = 0;
+    host_sensors_t *sensors = calloc(1, sizeof(host_sensors_t));
+    if (!sensors) {
+        tr_err("Could not allocate host sensors.");
+        return NULL;
+    }
+    sensors->proc_stat_fd = -1;
+    discover_thermal_zones(sensors, &capacity);
+    discover_hwmon(sensors, &capacity);
+    discover_cpu_load(sensors, &capacity);
+    if (sensors->count == 0) {
+        tr_warn("No host sensors found.");
+        host_sensors_free(sensors);
+        return NULL;
+    }
+    tr_info("Discovered %d host sensors, %d of them CPU load counters.", sensors->count, sensors->cpu_count);
+    /* Establish the initial values and the CPU load baseline */
+    host_sensors_sample(sensors);
+    return sensors;
+}
+
+static void set_value(host_sensor_t *sensor, float value)
+{
+    sensor->changed = sensor->value != value;
+    sensor->value = value;
+}
+
+static int sample_cpu_load(host_sensors_t *sensors)
+{
+    int changed = 0;
+    int index = 0;
+    if (sensors->cpu_count == 0 || read_proc_stat(sensors) < 0) {
+        return 0;
+    }
+    for (char *line = sensors->proc_stat_buffer; line && *line && index < sensors->cpu_count; line = next_line(line)) {
+        int cpu;
+        unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
+        if (strncmp(line, "cpu", 3) != 0 || !isdigit((unsigned char) line[3]) ||
+            sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &cpu, &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) != 9) {
+            continue;
+        }
+        /* The lines and the sensors are both in CPU order. An offline CPU has no line, so skip
+         * its sensor instead of matching the following lines to the wrong sensors. */
+        while (index < sensors->cpu_count && sensors->sensors[sensors->cpu_first + index].cpu_index < cpu) {
+            sensors->sensors[sensors->cpu_first + index++].changed = false;
+        }
+        if (index == sensors->cpu_count || sensors->sensors[sensors->cpu_first + index].cpu_index != cpu) {
+            // A CPU that was offline at discovery has no sensor
+            continue;
+        }
+        host_sensor_t *sensor = &sensors->sensors[sensors->cpu_first + index++];
+        uint64_t total = user + nice + system + idle + iowait + irq + softirq + steal;
+        uint64_t busy = total - idle - iowait;
+        if (sensor->cpu_total && total > sensor->cpu_total) {
+            set_value(sensor, 100.0f * (busy - sensor->cpu_busy) / (total - sensor->cpu_total));
+            if (sensor->changed) {
+                changed++;
+            }
+        } else {
+            sensor->changed = false;
+        }
+        sensor->cpu_busy = busy;
+        sensor->cpu_total = total;
+    }
+    while (index < sensors->cpu_count) {
+        sensors->sensors[sensors->cpu_first + index++].changed = false;
+    }
+    return changed;
+}
+
+int host_sensors_sample(host_sensors_t *sensors)
+{
+    char buffer[32];
+    int changed = 0;
+    if (!sensors) {
+        return 0;
+    }
+    for (int i = 0; i < sensors->count; i++) {
+        host_sensor_t *sensor = &sensors->sensors[i];
+        if (sensor->fd < 0) {
+            continue;
+        }
+        ssize_t read = pread(sensor->fd, buffer, sizeof(buffer) - 1, 0);
+        if (read <= 0) {
+            sensor->changed = false;
+            continue;
+        }
+        buffer[read] = '\0';
+        set_value(sensor, strtol(buffer, NULL, 10) * sensor->scale);
+        if (sensor->changed) {
+            changed++;
+        }
+    }
+    changed += sample_cpu_load(sensors);
+    return changed;
+}
+
+const char *host_sensors_units(const host_sensor_t *sensor)
+{
+    switch (sensor->kind) {
+        case HOST_SENSOR_THERMAL_ZONE:
+        case HOST_SENSOR_HWMON_TEMPERATURE:
+            return "CEL";
+        case HOST_SENSOR_HWMON_VOLTAGE:
+            return "V";
+        case HOST_SENSOR_HWMON_FAN:
+            return "rpm";
+        case HOST_SENSOR_CPU_LOAD:
+            return "%";
+    }
+    return NULL;
+}
+
+void host_sensors_free(host_sensors_t *sensors)
+{
+    if (!sensors) {
+        return;
+    }
+    for (int i = 0; i < sensors->count; i++) {
+        if (sensors->sensors[i].fd >= 0) {
+            close(sensors->sensors[i].fd);
+        }
+    }
+    if (sensors->proc_stat_fd >= 0) {
+        close(sensors->proc_stat_fd);
+    }
+    free(sensors->proc_stat_buffer);
+    free(sensors->sensors);
+    free(sensors);
+}
@@ -116,6 +116,65 @@ void client_config_create_cpu_temperature_device(connection_id_t connection_id,
     }
 }
 
+static uint16_t host_sensor_object_id(const host_sensor_t *sensor)
+{
+    switch (sensor->kind) {
+        case HOST_SENSOR_THERMAL_ZONE:
+        case HOST_SENSOR_HWMON_TEMPERATURE:
+            return TEMPERATURE_SENSOR;
+        case HOST_SENSOR_HWMON_VOLTAGE:
+            return VOLTAGE_SENSOR;
+        case HOST_SENSOR_CPU_LOAD:
+            return PERCENTAGE_SENSOR;
+        case HOST_SENSOR_HWMON_FAN:
+        default:
+            return GENERIC_SENSOR;
+    }
+}
+
+bool client_config_create_host_sensors_device(connection_id_t connection_id,
+                                              const char *device_id,
+                                              const host_sensors_t *sensors,
+                                              uint16_t *object_ids,
+                                              uint16_t *instance_ids)
+{
+    /* Next free instance id for TEMPERATURE, VOLTAGE, PERCENTAGE and GENERIC sensor objects */
+    const uint16_t objects[] = {TEMPERATURE_SENSOR, VOLTAGE_SENSOR, PERCENTAGE_SENSOR, GENERIC_SENSOR};
+    uint16_t next_instance[sizeof(objects) / sizeof(objects[0])] = {0};
+
+    if (!sensors || sensors->count == 0) {
+        return false;
+    }
+    client_config_create_device_with_parameters(connection_id,
+                                                device_id,
+                                                NULL,           // userdata
+                                                "ARM",          // manufacturer
+                                                "host-sensors", // model_number
+                                                "001",          // serial_number
+                                                "example"       // device_type
+    );
+
+    for (int i = 0; i < sensors->count; i++) {
+        const host_sensor_t *sensor = &sensors->sensors[i];
+        uint16_t object_id = host_sensor_object_id(sensor);
+        size_t slot = 0;
+        while (objects[slot] != object_id) {
+            slot++;
+        }
+        object_ids[i] = object_id;
+        instance_ids[i] = next_instance[slot]++;
+        ipso_create_sensor_object(connection_id,
+                                  device_id,
+                                  object_id,
+                                  instance_ids[i],
+                                  host_sensors_units(sensor),
+                                  sensor->name);
+        ipso_add_min_max_fields(connection_id, device_id, object_id, instance_ids[i], ipso_reset_min_max_object);
+    }
+    tr_info("Created '%s' with %d sensor object instances.", device_id, sensors->count);
+    return true;
+}
+
 void client_config_create_device_with_parameters(connection_id_t connection_id,
                                                  const char *device_id,
                                                  pt_userdata_t *userdata,
@@ -19,6 +19,8 @@
  */
 
 #include <float.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <string.h>
 
 #include <stdlib.h>
@@ -28,9 +30,45 @@
 #include "pt-client-2/pt_api.h"
 #include "byte-order/byte_order.h"
 #include "mbed-trace/mbed_trace.h"
+#include "ns_list.h"
 
 #define TRACE_GROUP "ipso-objects"
 
+typedef NS_LIST_HEAD(ipso_sensor_handle_t, link) ipso_sensor_handle_list_t;
+
+/* Registry of live sensor handles. Guards the list and the request flags of the handles,
+ * because the min/max reset requests arrive on the protocol translator event loop thread.
+ * The pt-client API is never called while holding this mutex. */
+static ipso_sensor_handle_list_t sensor_handles = NS_LIST_INIT(sensor_handles);
+static pthread_mutex_t sensor_handles_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* The value, min and max written by one ipso_sensor_set_value() call share one block. The
+ * pt-client frees each value on its own, the block is recycled when all of its slots are freed. */
+#define IPSO_VALUE_BLOCK_SLOTS 3
+#define IPSO_VALUE_BLOCK_MAX_FREE_BLOCKS 64
+
+typedef struct ipso_value_block ipso_value_block_t;
+
+typedef struct ipso_value_slot {
+    ipso_value_block_t *block;
+    uint8_t data[sizeof(float)];
+} ipso_value_slot_t;
+
+struct ipso_value_block {
+    ipso_value_block_t *next; /* free list link */
+    int references;
+    int used;
+    ipso_value_slot_t slots[IPSO_VALUE_BLOCK_SLOTS];
+};
+
+static ipso_value_block_t *value_block_free_list = NULL;
+static int value_block_free_count = 0;
+static pthread_mutex_t value_block_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ipso_sensor_handle_t *ipso_find_sensor_handle(const char *device_id,
+                                                     const uint16_t object_id,
+                                                     const uint16_t object_instance_id);
+
 void ipso_add_min_max_fields(connection_id_t connection_id,
                              const char *device_id,
                              const uint16_t object_id,
@@ -289,6 +327,14 @@ pt_status_t ipso_reset_min_max_object(const connection_id_t connection_id,
 {
     tr_info("Resetting min and max to default values on '%s'.", device_id);
 
+    /* A cached sensor handle starts min and max over from the defaults on its next sample */
+    pthread_mutex_lock(&sensor_handles_mutex);
+    ipso_sensor_handle_t *handle = ipso_find_sensor_handle(device_id, object_id, object_instance_id);
+    if (handle) {
+        handle->reset_requested = true;
+    }
+    pthread_mutex_unlock(&sensor_handles_mutex);
+
     float min_default = FLT_MAX; // Set minimum measured on reset to max float
     uint8_t *min_default_data = malloc(sizeof(float));
     if (min_default_data == NULL) {
@@ -407,6 +453,247 @@ pt_status_t ipso_update_min_max_fields(const connection_id_t connection_id,
     return PT_STATUS_SUCCESS;
 }
 
+static ipso_sensor_handle_t *ipso_find_sensor_handle(const char *device_id,
+                                                     const uint16_t object_id,
+                                                     const uint16_t object_instance_id)
+{
+    ns_list_foreach(ipso_sensor_handle_t, handle, &sensor_handles) {
+        if (handle->object_id == object_id && handle->object_instance_id == object_instance_id &&
+            strcmp(handle->device_id, device_id) == 0) {
+            return handle;
+        }
+    }
+    return NULL;
+}
+
+static ipso_value_block_t *ipso_value_block_alloc(void)
+{
+    ipso_value_block_t *block;
+
+    pthread_mutex_lock(&value_block_mutex);
+    block = value_block_free_list;
+    if (block != NULL) {
+        value_block_free_list = block->next;
+        value_block_free_count--;
+    }
+    pthread_mutex_unlock(&value_block_mutex);
+
+    if (block == NULL) {
+        block = malloc(sizeof(ipso_value_block_t));
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+    block->references = IPSO_VALUE_BLOCK_SLOTS;
+    block->used = 0;
+    for (int i = 0; i < IPSO_VALUE_BLOCK_SLOTS; i++) {
+        block->slots[i].block = block;
+    }
+    return block;
+}
+
+static void ipso_value_block_release(ipso_value_block_t *block, const int count)
+{
+    pthread_mutex_lock(&value_block_mutex);
+    block->references -= count;
+    if (block->references == 0) {
+        if (value_block_free_count < IPSO_VALUE_BLOCK_MAX_FREE_BLOCKS) {
+            block->next = value_block_free_list;
+            value_block_free_list = block;
+            value_block_free_count++;
+            block = NULL;
+        }
+    } else {
+        block = NULL;
+    }
+    pthread_mutex_unlock(&value_block_mutex);
+    free(block);
+}
+
+static void ipso_value_block_clear(void)
+{
+    pthread_mutex_lock(&value_block_mutex);
+    while (value_block_free_list != NULL) {
+        ipso_value_block_t *block = value_block_free_list;
+        value_block_free_list = block->next;
+        free(block);
+    }
+    value_block_free_count = 0;
+    pthread_mutex_unlock(&value_block_mutex);
+}
+
+/* Free callback for the pt-client, may be called from any thread. */
+static void ipso_value_slot_free(void *data)
+{
+    ipso_value_slot_t *slot = (ipso_value_slot_t *) ((uint8_t *) data - offsetof(ipso_value_slot_t, data));
+    ipso_value_block_release(slot->block, 1);
+}
+
+/* Writes a new value to a resource. The pt-client may still refer to the previous buffer
+ * while it sends it to Edge Core, so every value gets a slot of its own. The block is taken
+ * on the first write. */
+static void ipso_sensor_handle_set(ipso_sensor_handle_t *handle,
+                                   ipso_value_block_t **block,
+                                   const uint16_t resource_id,
+                                   const float value)
+{
+    if (*block == NULL) {
+        *block = ipso_value_block_alloc();
+        if (*block == NULL) {
+            tr_err("Could not allocate resource value buffer");
+            return;
+        }
+    }
+    ipso_value_slot_t *slot = &(*block)->slots[(*block)->used++];
+    convert_float_value_to_network_byte_order(value, slot->data);
+    (void) pt_device_set_resource_value(handle->connection_id,
+                                        handle->device_id,
+                                        handle->object_id,
+                                        handle->object_instance_id,
+                                        resource_id,
+                                        slot->data,
+                                        sizeof(float),
+                                        ipso_value_slot_free);
+}
+
+static bool ipso_sensor_handle_read(ipso_sensor_handle_t *handle, const uint16_t resource_id, float *value)
+{
+    uint8_t *buffer = NULL;
+    uint32_t size = 0;
+    if (pt_device_get_resource_value(handle->connection_id,
+                                     handle->device_id,
+                                     handle->object_id,
+                                     handle->object_instance_id,
+                                     resource_id,
+                                     &buffer,
+                                     &size) != PT_STATUS_SUCCESS ||
+        buffer == NULL || size != sizeof(float)) {
+        return false;
+    }
+    convert_value_to_host_order_float(buffer, value);
+    return true;
+}
+
+/* Checks that the resources exist and caches their current values. */
+static bool ipso_sensor_handle_resolve(ipso_sensor_handle_t *handle)
+{
+    if (!ipso_sensor_handle_read(handle, SENSOR_VALUE, &handle->value)) {
+        tr_err("Sensor value resource missing on '%s/%d/%d'.",
+               handle->device_id,
+               handle->object_id,
+               handle->object_instance_id);
+        return false;
+    }
+    handle->has_min_max = ipso_sensor_handle_read(handle, MIN_MEASURED_VALUE, &handle->min_value) &&
+                          ipso_sensor_handle_read(handle, MAX_MEASURED_VALUE, &handle->max_value);
+    return true;
+}
+
+ipso_sensor_handle_t *ipso_sensor_handle_create(const connection_id_t connection_id,
+                                                const char *device_id,
+                                                const uint16_t object_id,
+                                                const uint16_t object_instance_id)
+{
+    ipso_sensor_handle_t *handle = calloc(1, sizeof(ipso_sensor_handle_t));
+    if (handle == NULL) {
+        tr_err("Could not allocate sensor handle");
+        return NULL;
+    }
+    handle->device_id = strdup(device_id);
+    if (handle->device_id == NULL) {
+        tr_err("Could not allocate sensor handle device id");
+        free(handle);
+        return NULL;
+    }
+    handle->connection_id = connection_id;
+    handle->object_id = object_id;
+    handle->object_instance_id = object_instance_id;
+
+    if (!ipso_sensor_handle_resolve(handle)) {
+        free(handle->device_id);
+        free(handle);
+        return NULL;
+    }
+    pthread_mutex_lock(&sensor_handles_mutex);
+    ns_list_add_to_end(&sensor_handles, handle);
+    pthread_mutex_unlock(&sensor_handles_mutex);
+    return handle;
+}
+
+void ipso_sensor_handle_rebind(ipso_sensor_handle_t *handle)
+{
+    pthread_mutex_lock(&sensor_handles_mutex);
+    handle->rebind_requested = true;
+    pthread_mutex_unlock(&sensor_handles_mutex);
+}
+
+bool ipso_sensor_set_value(ipso_sensor_handle_t *handle, const float new_value)
+{
+    ipso_value_block_t *block = NULL;
+    bool changed;
+    bool rebind;
+    bool reset;
+
+    pthread_mutex_lock(&sensor_handles_mutex);
+    rebind = handle->rebind_requested;
+    reset = handle->reset_requested;
+    handle->rebind_requested = false;
+    handle->reset_requested = false;
+    pthread_mutex_unlock(&sensor_handles_mutex);
+
+    if (rebind && !ipso_sensor_handle_resolve(handle)) {
+        return false;
+    }
+    if (reset) {
+        /* The reset callback already wrote the defaults to the resources */
+        handle->min_value = FLT_MAX;
+        handle->max_value = -FLT_MAX;
+    }
+
+    changed = handle->value != new_value;
+    if (changed) {
+        handle->value = new_value;
+        ipso_sensor_handle_set(handle, &block, SENSOR_VALUE, new_value);
+    }
+    /* Checked also when the value did not change, min and max may have been reset */
+    if (handle->has_min_max) {
+        if (new_value < handle->min_value) {
+            handle->min_value = new_value;
+            ipso_sensor_handle_set(handle, &block, MIN_MEASURED_VALUE, new_value);
+            changed = true;
+        }
+        if (new_value > handle->max_value) {
+            handle->max_value = new_value;
+            ipso_sensor_handle_set(handle, &block, MAX_MEASURED_VALUE, new_value);
+            changed = true;
+        }
+    }
+    if (block != NULL) {
+        /* Drop the references of the slots that were not written */
+        ipso_value_block_release(block, IPSO_VALUE_BLOCK_SLOTS - block->used);
+    }
+    return changed;
+}
+
+void ipso_sensor_handle_free(ipso_sensor_handle_t *handle)
+{
+    bool last;
+
+    if (handle == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&sensor_handles_mutex);
+    ns_list_remove(&sensor_handles, handle);
+    last = ns_list_is_empty(&sensor_handles);
+    pthread_mutex_unlock(&sensor_handles_mutex);
+    if (last) {
+        /* Blocks that the pt-client still holds go back to the free list when it releases them */
+        ipso_value_block_clear();
+    }
+    free(handle->device_id);
+    free(handle);
+}
+
 pt_status_t ipso_write_set_point_value(const connection_id_t connection_id,
                                 const char *device_id,
                                 const uint16_t object_id,
@@ -0,0 +1,190 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "examples-common/device_batch.h"
+#include "mbed-trace/mbed_trace.h"
+#define TRACE_GROUP "dev-batch"
+
+struct device_batch;
+
+typedef struct device_batch_entry {
+    struct device_batch *batch;
+    pt_device_t *device;
+} device_batch_entry_t;
+
+typedef struct device_batch {
+    pthread_mutex_t mutex;
+    connection_t *connection;
+    device_batch_entry_t *entries;
+    uint32_t count;
+    uint32_t window;
+    uint32_t next;
+    uint32_t in_flight;
+    uint32_t registered;
+    uint32_t failed;
+    /* Number of threads currently inside device_batch_submit(). The batch is
+     * released only when this is zero and all devices have completed. */
+    uint32_t submitters;
+    device_batch_device_cb device_cb;
+    device_batch_done_cb done_cb;
+    device_batch_lock_cb lock_cb;
+    device_batch_lock_cb unlock_cb;
+    void *userdata;
+} device_batch_t;
+
+static void device_batch_success(const char *device_id, void *userdata);
+static void device_batch_failure(const char *device_id, void *userdata);
+
+static void device_batch_free(device_batch_t *batch)
+{
+    pthread_mutex_destroy(&batch->mutex);
+    free(batch->entries);
+    free(batch);
+}
+
+/**
+ * \brief Submits devices until the window is full or all devices have been sent.
+ *        The thread which leaves the function last after the final completion
+ *        calls the done callback and releases the batch.
+ */
+static void device_batch_submit(device_batch_t *batch)
+{
+    bool finished;
+    pthread_mutex_lock(&batch->mutex);
+    batch->submitters++;
+    while (batch->next < batch->count && (batch->window == 0 || batch->in_flight < batch->window)) {
+        device_batch_entry_t *entry = &batch->entries[batch->next++];
+        batch->in_flight++;
+        pthread_mutex_unlock(&batch->mutex);
+
+        if (batch->lock_cb) {
+            batch->lock_cb(batch->userdata);
+        }
+        pt_status_t status = pt_register_device(batch->connection,
+                                                entry->device,
+                                                device_batch_success,
+                                                device_batch_failure,
+                                                entry);
+        if (batch->unlock_cb) {
+            batch->unlock_cb(batch->userdata);
+        }
+        if (status != PT_STATUS_SUCCESS) {
+            tr_err("Could not send registration for '%s', status: %d", entry->device->device_id, status);
+            if (batch->device_cb) {
+                batch->device_cb(entry->device, false, batch->userdata);
+            }
+        }
+
+        pthread_mutex_lock(&batch->mutex);
+        if (status != PT_STATUS_SUCCESS) {
+            batch->in_flight--;
+            batch->failed++;
+        }
+    }
+    batch->submitters--;
+    finished = batch->submitters == 0 && batch->registered + batch->failed == batch->count;
+    pthread_mutex_unlock(&batch->mutex);
+
+    if (finished) {
+        tr_info("Device batch done, registered: %u failed: %u", batch->registered, batch->failed);
+        if (batch->done_cb) {
+            batch->done_cb(batch->registered, batch->failed, batch->userdata);
+        }
+        device_batch_free(batch);
+    }
+}
+
+static void device_batch_complete(device_batch_entry_t *entry, bool success)
+{
+    device_batch_t *batch = entry->batch;
+    if (batch->device_cb) {
+        batch->device_cb(entry->device, success, batch->userdata);
+    }
+
+    pthread_mutex_lock(&batch->mutex);
+    batch->in_flight--;
+    if (success) {
+        batch->registered++;
+    } else {
+        batch->failed++;
+    }
+    pthread_mutex_unlock(&batch->mutex);
+
+    /* Refill the window, this also finalizes the batch after the last device */
+    device_batch_submit(batch);
+}
+
+static void device_batch_success(const char *device_id, void *userdata)
+{
+    (void) device_id;
+    device_batch_complete((device_batch_entry_t *) userdata, true);
+}
+
+static void device_batch_failure(const char *device_id, void *userdata)
+{
+    tr_warn("Batch registration failed for '%s'", device_id);
+    device_batch_complete((device_batch_entry_t *) userdata, false);
+}
+
+pt_status_t device_batch_register(connection_t *connection,
+                                  pt_device_t **devices,
+                                  uint32_t count,
+                                  uint32_t window,
+                                  device_batch_device_cb device_cb,
+                                  device_batch_done_cb done_cb,
+                                  device_batch_lock_cb lock_cb,
+                                  device_batch_lock_cb unlock_cb,
+                                  void *userdata)
+{
+    uint32_t index;
+    if (!connection || !devices || count == 0) {
+        return PT_STATUS_INVALID_PARAMETERS;
+    }
+
+    device_batch_t *batch = calloc(1, sizeof(device_batch_t));
+    if (!batch) {
+        return PT_STATUS_ALLOCATION_FAIL;
+    }
+    batch->entries = calloc(count, sizeof(device_batch_entry_t));
+    if (!batch->entries) {
+        free(batch);
+        return PT_STATUS_ALLOCATION_FAIL;
+    }
+    for (index = 0; index < count; index++) {
+        batch->entries[index].batch = batch;
+        batch->entries[index].device = devices[index];
+    }
+    pthread_mutex_init(&batch->mutex, NULL);
+    batch->connection = connection;
+    batch->count = count;
+    batch->window = window;
+    batch->device_cb = device_cb;
+    batch->done_cb = done_cb;
+    batch->lock_cb = lock_cb;
+    batch->unlock_cb = unlock_cb;
+    batch->userdata = userdata;
+
+    tr_info("Registering batch of %u devices, window %u", count, window);
+    device_batch_submit(batch);
+    return PT_STATUS_SUCCESS;
+}
@@ -0,0 +1,83 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef EDGE_HOST_SENSORS_H
+#define EDGE_HOST_SENSORS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    HOST_SENSOR_THERMAL_ZONE,
+    HOST_SENSOR_HWMON_TEMPERATURE,
+    HOST_SENSOR_HWMON_VOLTAGE,
+    HOST_SENSOR_HWMON_FAN,
+    HOST_SENSOR_CPU_LOAD
+} host_sensor_kind_e;
+
+/**
+ * \brief One host metric. The sysfs attribute of file based sensors is kept open
+ *        and re-read with pread() on every sample.
+ */
+typedef struct host_sensor {
+    host_sensor_kind_e kind;
+    char name[64];
+    int fd;
+    int cpu_index;
+    float scale;
+    float value;
+    bool changed;
+    uint64_t cpu_busy;
+    uint64_t cpu_total;
+} host_sensor_t;
+
+typedef struct host_sensors {
+    int count;
+    host_sensor_t *sensors;
+    int cpu_first;
+    int cpu_count;
+    int proc_stat_fd;
+    char *proc_stat_buffer;
+    size_t proc_stat_buffer_size;
+} host_sensors_t;
+
+/**
+ * \brief Discovers all thermal zones, hwmon temperature, voltage and fan inputs and
+ *        the per-CPU load counters of the host.
+ * \return The discovered sensors or NULL if nothing was found. Free with `host_sensors_free()`.
+ */
+host_sensors_t *host_sensors_discover();
+
+/**
+ * \brief Reads all sensors in one pass.
+ *        The `changed` flag of each sensor tells whether its value differs from the previous sample.
+ * \return Number of sensors which changed.
+ */
+int host_sensors_sample(host_sensors_t *sensors);
+
+/**
+ * \return The unit of the sensor in the IPSO `Sensor Units` representation.
+ */
+const char *host_sensors_units(const host_sensor_t *sensor);
+
+void host_sensors_free(host_sensors_t *sensors);
+
+#endif /* EDGE_HOST_SENSORS_H */
@@ -23,12 +23,22 @@
 
 #include <stdbool.h>
 #include "pt-client-2/pt_api.h"
+#include "device-interface/host_sensors.h"
 
 const char *client_config_get_cpu_thermal_zone_file_path();
 const char *client_config_get_protocol_translator_name();
 bool client_config_create_devices(connection_id_t connection_id, const char *endpoint_postfix);
 void client_config_create_cpu_temperature_device(connection_id_t connection_id,
                                                  const char *device_id);
+/**
+ * \brief Creates a device exposing every discovered host sensor as an IPSO sensor object instance.
+ *        The object and instance id chosen for sensor `i` are written to `object_ids[i]` and `instance_ids[i]`.
+ */
+bool client_config_create_host_sensors_device(connection_id_t connection_id,
+                                              const char *device_id,
+                                              const host_sensors_t *sensors,
+                                              uint16_t *object_ids,
+                                              uint16_t *instance_ids);
 void client_config_create_device_with_userdata(connection_id_t connection_id,
                                                const char *device_id,
                                                pt_userdata_t *userdata);
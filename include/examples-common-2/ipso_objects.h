@@ -22,14 +22,18 @@
 #define EDGE_IPSO_OBJECTS_H
 
 #include "pt-client-2/pt_api.h"
+#include "ns_list.h"
 
 enum IPSO_OBJECTS {
     DIGITAL_OUTPUT          = 3201,
+    GENERIC_SENSOR          = 3300,
     TEMPERATURE_SENSOR      = 3303,
     HUMIDITY_SENSOR         = 3304,
     SET_POINT               = 3308,
     LIGHT_CONTROL           = 3311,
     BAROMETER_SENSOR        = 3315,
+    VOLTAGE_SENSOR          = 3316,
+    PERCENTAGE_SENSOR       = 3320,
     CONCENTRATION_SENSOR    = 3325,
     PUSH_BUTTON             = 3347,
     FIRMWARE_UPDATE         = 5
@@ -98,4 +102,47 @@ pt_status_t ipso_update_min_max_fields(const connection_id_t connection_id,
                                        const uint16_t object_instance_id,
                                        const float new_value);
 
+/**
+ * \brief Cached handle to the value, min and max resources of a sensor object instance.
+ *
+ * The handle caches the current values of the resources, so a sample is compared without
+ * reading the resources back and only the resources that changed are written, each once.
+ * The pt-client API addresses resources by id, so every write still looks its resource up.
+ * A handle is used from one thread, only the rebind and min/max reset requests may come
+ * from other threads.
+ */
+typedef struct ipso_sensor_handle {
+    ns_list_link_t link;
+    connection_id_t connection_id;
+    char *device_id;
+    uint16_t object_id;
+    uint16_t object_instance_id;
+    bool has_min_max;
+    bool rebind_requested;
+    bool reset_requested;
+    float value;
+    float min_value;
+    float max_value;
+} ipso_sensor_handle_t;
+
+ipso_sensor_handle_t *ipso_sensor_handle_create(const connection_id_t connection_id,
+                                                const char *device_id,
+                                                const uint16_t object_id,
+                                                const uint16_t object_instance_id);
+
+/**
+ * \brief Requests the resource values to be read again on the next `ipso_sensor_set_value()`.
+ *        Used when the device was re-created, for example after a firmware update.
+ */
+void ipso_sensor_handle_rebind(ipso_sensor_handle_t *handle);
+
+/**
+ * \brief Sets the sensor value and updates the min and max values in one pass.
+ *        The written values share one pooled block, so a call allocates at most once.
+ * \return true if any of the resources changed.
+ */
+bool ipso_sensor_set_value(ipso_sensor_handle_t *handle, const float new_value);
+
+void ipso_sensor_handle_free(ipso_sensor_handle_t *handle);
+
 #endif /* EDGE_IPSO_OBJECTS_H */
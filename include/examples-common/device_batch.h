@@ -0,0 +1,91 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef EDGE_DEVICE_BATCH_H
+#define EDGE_DEVICE_BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pt-client/pt_api.h"
+
+/**
+ * \brief Called once for each device in the batch when its registration completes.
+ *
+ * \param device The device given in the batch.
+ * \param success true if Edge Core accepted the registration, false otherwise.
+ * \param userdata The user-supplied context from the `device_batch_register()` call.
+ */
+typedef void (*device_batch_device_cb)(pt_device_t *device, bool success, void *userdata);
+
+/**
+ * \brief Called once when every device in the batch has completed.
+ *
+ * \param registered Number of devices registered successfully.
+ * \param failed Number of devices which failed to register.
+ * \param userdata The user-supplied context from the `device_batch_register()` call.
+ */
+typedef void (*device_batch_done_cb)(uint32_t registered, uint32_t failed, void *userdata);
+
+/**
+ * \brief Called around each `pt_register_device()` call of the batch, so the caller can serialize
+ *        the batch with its own use of the connection.
+ *
+ * \param userdata The user-supplied context from the `device_batch_register()` call.
+ */
+typedef void (*device_batch_lock_cb)(void *userdata);
+
+/**
+ * \brief Registers a set of devices keeping up to `window` registrations in flight.
+ *
+ * Edge Core registers one device per `device_register` request, so the batch
+ * is sent as a pipeline: the next device is submitted as soon as an earlier one
+ * completes instead of waiting for each round trip in turn. The callbacks run on
+ * the protocol translator event loop thread. The device pointers must remain
+ * valid until `done_cb` has been called.
+ *
+ * The window is refilled from the completion callbacks, so registrations are also sent
+ * from the event loop thread. A caller sharing the connection between threads passes
+ * `lock_cb` and `unlock_cb`, and then must not hold that lock when calling this function.
+ *
+ * \param connection The connection to register the devices to.
+ * \param devices Array of devices to register. The array is copied.
+ * \param count Number of devices in the array.
+ * \param window Maximum number of outstanding registrations. 0 means unlimited.
+ * \param device_cb Per-device result callback. May be NULL.
+ * \param done_cb Batch completion callback. May be NULL.
+ * \param lock_cb Called before each registration is sent. May be NULL.
+ * \param unlock_cb Called after each registration is sent. May be NULL.
+ * \param userdata Context passed to the callbacks.
+ *
+ * \return PT_STATUS_SUCCESS if the batch was started. The per-device failures are reported
+ *         through the callbacks. Other codes if the batch could not be started, in which case
+ *         no callbacks are called.
+ */
+pt_status_t device_batch_register(connection_t *connection,
+                                  pt_device_t **devices,
+                                  uint32_t count,
+                                  uint32_t window,
+                                  device_batch_device_cb device_cb,
+                                  device_batch_done_cb done_cb,
+                                  device_batch_lock_cb lock_cb,
+                                  device_batch_lock_cb unlock_cb,
+                                  void *userdata);
+
+#endif /* EDGE_DEVICE_BATCH_H */
@@ -0,0 +1,289 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pt-example/asset_stream.h"
+#include "mbed-trace/mbed_trace.h"
+
+#define TRACE_GROUP "asset"
+
+#define ASSET_STREAM_CHECKPOINT_MAGIC 0x41534b50
+#define ASSET_STREAM_CHECKPOINT_VERSION 1
+
+typedef struct asset_stream_checkpoint {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t offset;
+    sha256_ctx_t sha;
+} asset_stream_checkpoint_t;
+
+static double monotonic_seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double mib_per_second(uint64_t bytes, double seconds)
+{
+    if (seconds <= 0) {
+        return 0;
+    }
+    return bytes / (1024.0 * 1024.0) / seconds;
+}
+
+static bool write_fully(int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool load_checkpoint(const char *path, const struct stat *source_stat, asset_stream_checkpoint_t *checkpoint)
+{
+    bool valid = false;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (read(fd, checkpoint, sizeof(*checkpoint)) == sizeof(*checkpoint) &&
+        checkpoint->magic == ASSET_STREAM_CHECKPOINT_MAGIC &&
+        checkpoint->version == ASSET_STREAM_CHECKPOINT_VERSION &&
+        checkpoint->source_size == (uint64_t) source_stat->st_size &&
+        checkpoint->source_mtime == (int64_t) source_stat->st_mtime &&
+        checkpoint->offset == checkpoint->sha.length &&
+        checkpoint->offset <= checkpoint->source_size) {
+        valid = true;
+    }
+    close(fd);
+    return valid;
+}
+
+/* The checkpoint is replaced atomically so a crash never leaves a torn record */
+static bool store_checkpoint(const char *path, int destination_fd, const asset_stream_checkpoint_t *checkpoint)
+{
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int) sizeof(tmp_path)) {
+        return false;
+    }
+    /* Data must be on disk before the offset claiming it */
+    if (fdatasync(destination_fd) != 0) {
+        tr_warn("fdatasync failed: %s", strerror(errno));
+        return false;
+    }
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        tr_warn("Could not create checkpoint %s: %s", tmp_path, strerror(errno));
+        return false;
+    }
+    bool ok = write_fully(fd, (const uint8_t *) checkpoint, sizeof(*checkpoint)) && fdatasync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp_path, path) != 0) {
+        tr_warn("Could not store checkpoint %s: %s", path, strerror(errno));
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+void asset_stream_digest_to_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char *out)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        out[i * 2] = hex[digest[i] >> 4];
+        out[i * 2 + 1] = hex[digest[i] & 0x0f];
+    }
+    out[SHA256_DIGEST_SIZE * 2] = '\0';
+}
+
+bool asset_stream_copy(const char *source,
+                       const char *destination,
+                       uint64_t expected_size,
+                       const volatile bool *keep_running,
+                       asset_stream_result_t *result)
+{
+    char checkpoint_path[PATH_MAX];
+    asset_stream_checkpoint_t checkpoint;
+    struct stat source_stat;
+    uint8_t *buffer = NULL;
+    int source_fd = -1;
+    int destination_fd = -1;
+    bool success = false;
+
+    if (!source || !destination || !result) {
+        return false;
+    }
+    memset(result, 0, sizeof(*result));
+    if (snprintf(checkpoint_path, sizeof(checkpoint_path), "%s.ckpt", destination) >= (int) sizeof(checkpoint_path)) {
+        tr_err("Destination path too long: %s", destination);
+        return false;
+    }
+
+    source_fd = open(source, O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0 || fstat(source_fd, &source_stat) != 0) {
+        tr_err("Could not open asset %s: %s", source, strerror(errno));
+        goto cleanup;
+    }
+    if (expected_size && (uint64_t) source_stat.st_size != expected_size) {
+        tr_err("Asset %s size %" PRIu64 " does not match the manifest size %" PRIu64,
+               source, (uint64_t) source_stat.st_size, expected_size);
+        goto cleanup;
+    }
+
+    /* Without an interrupted copy to resume, a hard link stores the asset without a second copy */
+    if (access(checkpoint_path, F_OK) != 0) {
+        unlink(destination);
+        if (link(source, destination) == 0) {
+            result->bytes = source_stat.st_size;
+            result->linked = true;
+            tr_info("Linked %s to %s", source, destination);
+            success = true;
+            goto cleanup;
+        }
+        if (errno != EXDEV) {
+            tr_debug("Could not link %s to %s, copying it: %s", source, destination, strerror(errno));
+        }
+    }
+    posix_fadvise(source_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    destination_fd = open(destination, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (destination_fd < 0) {
+        tr_err("Could not open %s: %s", destination, strerror(errno));
+        goto cleanup;
+    }
+
+    if (load_checkpoint(checkpoint_path, &source_stat, &checkpoint)) {
+        struct stat destination_stat;
+        if (fstat(destination_fd, &destination_stat) != 0 ||
+            (uint64_t) destination_stat.st_size < checkpoint.offset) {
+            tr_warn("Checkpoint of %s does not match the stored data, starting over.", destination);
+            memset(&checkpoint, 0, sizeof(checkpoint));
+        }
+    } else {
+        memset(&checkpoint, 0, sizeof(checkpoint));
+    }
+    if (checkpoint.magic != ASSET_STREAM_CHECKPOINT_MAGIC) {
+        checkpoint.magic = ASSET_STREAM_CHECKPOINT_MAGIC;
+        checkpoint.version = ASSET_STREAM_CHECKPOINT_VERSION;
+        checkpoint.source_size = source_stat.st_size;
+        checkpoint.source_mtime = source_stat.st_mtime;
+        checkpoint.offset = 0;
+        sha256_init(&checkpoint.sha);
+    } else {
+        tr_info("Resuming %s from offset %" PRIu64, destination, checkpoint.offset);
+    }
+    result->resumed_from = checkpoint.offset;
+
+    /* Anything written after the last checkpoint is not covered by the hash state */
+    if (ftruncate(destination_fd, checkpoint.offset) != 0 ||
+        lseek(source_fd, checkpoint.offset, SEEK_SET) < 0 ||
+        lseek(destination_fd, checkpoint.offset, SEEK_SET) < 0) {
+        tr_err("Could not seek to offset %" PRIu64 ": %s", checkpoint.offset, strerror(errno));
+        goto cleanup;
+    }
+
+    buffer = malloc(ASSET_STREAM_CHUNK_SIZE);
+    if (!buffer) {
+        tr_err("Could not allocate the asset buffer.");
+        goto cleanup;
+    }
+
+    double start = monotonic_seconds();
+    uint64_t next_checkpoint = checkpoint.offset + ASSET_STREAM_CHECKPOINT_INTERVAL;
+    while (checkpoint.offset < checkpoint.source_size) {
+        if (keep_running && !*keep_running) {
+            store_checkpoint(checkpoint_path, destination_fd, &checkpoint);
+            tr_info("Stopped storing %s at offset %" PRIu64, destination, checkpoint.offset);
+            goto cleanup;
+        }
+        ssize_t count = read(source_fd, buffer, ASSET_STREAM_CHUNK_SIZE);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tr_err("Reading %s failed: %s", source, strerror(errno));
+            goto cleanup;
+        }
+        if (count == 0) {
+            tr_err("Asset %s truncated at %" PRIu64, source, checkpoint.offset);
+            goto cleanup;
+        }
+        sha256_update(&checkpoint.sha, buffer, count);
+        if (!write_fully(destination_fd, buffer, count)) {
+            tr_err("Writing %s failed: %s", destination, strerror(errno));
+            goto cleanup;
+        }
+        checkpoint.offset += count;
+
+        if (checkpoint.offset >= next_checkpoint && checkpoint.offset < checkpoint.source_size) {
+            store_checkpoint(checkpoint_path, destination_fd, &checkpoint);
+            next_checkpoint = checkpoint.offset + ASSET_STREAM_CHECKPOINT_INTERVAL;
+            double elapsed = monotonic_seconds() - start;
+            tr_info("%s: %" PRIu64 "/%" PRIu64 " bytes, %.1f MiB/s",
+                    destination, checkpoint.offset, checkpoint.source_size,
+                    mib_per_second(checkpoint.offset - result->resumed_from, elapsed));
+        }
+    }
+    if (fdatasync(destination_fd) != 0) {
+        tr_err("fdatasync of %s failed: %s", destination, strerror(errno));
+        goto cleanup;
+    }
+
+    result->bytes = checkpoint.offset;
+    result->seconds = monotonic_seconds() - start;
+    sha256_final(&checkpoint.sha, result->digest);
+    unlink(checkpoint_path);
+    tr_info("%s: %" PRIu64 " bytes in %.2f s, %.1f MiB/s",
+            destination, result->bytes, result->seconds,
+            mib_per_second(result->bytes - result->resumed_from, result->seconds));
+    success = true;
+
+cleanup:
+    free(buffer);
+    if (destination_fd >= 0) {
+        close(destination_fd);
+    }
+    if (source_fd >= 0) {
+        close(source_fd);
+    }
+    return success;
+}
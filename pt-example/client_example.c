@@ -20,31 +20,46 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "byte-order/byte_order.h"
 #include "client_example_clip.h"
 #include "common/constants.h"
 #include "common/integer_length.h"
+#include "device-interface/host_sensors.h"
 #include "device-interface/thermal_zone.h"
 #include "examples-common-2/client_config.h"
 #include "examples-common-2/ipso_objects.h"
+#include "pt-example/asset_stream.h"
 #include "pt-example/client_example.h"
+#include "pt-example/sampler.h"
 
 #include "mbed-trace/mbed_trace.h"
 #include "common/edge_trace.h"
+#include "ns_list.h"
 /* The protocol translator API include */
 #include "pt-client-2/pt_api.h"
 
 #define TRACE_GROUP "clnt-example"
 #define CPU_TEMPERATURE_DEVICE "cpu-temperature"
+#define HOST_SENSORS_DEVICE "host-sensors"
 
 connection_id_t g_connection_id = PT_API_CONNECTION_ID_INVALID;
 sem_t g_shutdown_handler_called;
 pt_client_t *g_client = NULL;
+sampler_t *g_sampler = NULL;
+ipso_sensor_handle_t *g_cpu_temperature_handle = NULL;
+const char *g_firmware_dir = ".";
+uint32_t g_sample_period_ms = 0;
+uint32_t g_sample_jitter_ms = 0;
 #define MANIFEST_VENDOR_CLASS_SIZE 16
 
 /**
@@ -158,6 +173,9 @@ static void set_keep_running(bool keep_running)
     pthread_mutex_lock(&state_data_mutex);
     g_keep_running = keep_running;
     pthread_mutex_unlock(&state_data_mutex);
+    if (!keep_running) {
+        sampler_stop(g_sampler);
+    }
 }
 
 static bool get_protocol_translator_api_running()
@@ -238,6 +256,7 @@ static void shutdown_and_cleanup()
 static void shutdown_handler(int signum)
 {
     sem_post(&g_shutdown_handler_called);
+    sampler_stop(g_sampler);
 }
 
 static bool is_shutdown_handler_called()
@@ -484,127 +503,21 @@ void start_protocol_translator_api(protocol_translator_api_start_ctx_t *ctx)
                    &protocol_translator_api_start_func, ctx);
 }
 
-static void *malloc_and_memcpy(void *src, size_t size)
-{
-    void *ret = malloc(size);
-    if (ret != NULL) {
-        memcpy(ret, src, size);
-    }
-    return ret;
-}
-
 /**
  * \brief Update the given temperature to device object
  *
  * This function updates the given temperature to the device object.
- * Internally, this function changes the given float
- * byte-order to network byte-order. On little endian architecture, the
- * byte-order is changed, and on big endian architecture, the order is unchanged.
+ * The value, min and max resources are resolved once into the sensor handle,
+ * so a sample writes each of them at most once and does not allocate.
  *
- * \param *device The pointer to device object to update.
+ * \param handle The sensor handle of the temperature object instance.
  * \param temperature The temperature in host network byte order.
+ * \return true if the temperature, min or max changed.
  */
-void update_temperature_to_device(const char *device_id, float temperature)
+bool update_temperature_to_device(ipso_sensor_handle_t *handle, float temperature)
 {
     tr_info("Updating temperature to device: %f", temperature);
-
-    float current;
-    uint8_t *value_buffer;
-    uint32_t value_len;
-    pt_status_t status = pt_device_get_resource_value(g_connection_id, device_id, TEMPERATURE_SENSOR, 0, SENSOR_VALUE,
-                                                      &value_buffer, &value_len);
-    if (status != PT_STATUS_SUCCESS) {
-        tr_err("Current temperature sensor resource value get failed.");
-        return;
-    }
-
-    convert_value_to_host_order_float(value_buffer, &current);
-
-    /* If value changed update it */
-    if (current != temperature) {
-        float *nw_temperature = malloc(sizeof(float));
-        convert_float_value_to_network_byte_order(temperature, (uint8_t *) nw_temperature);
-        /* The value is a float. Do not change the value_size: original size applies. */
-        pt_device_set_resource_value(g_connection_id,
-                                     device_id,
-                                     TEMPERATURE_SENSOR,
-                                     0,
-                                     SENSOR_VALUE,
-                                     (uint8_t *) nw_temperature,
-                                     sizeof(float),
-                                     free);
-
-        /* Find the min and max resources and update them accordingly.
-         * Brute force checks: if values are reset, the `value changed` check
-         * for the current value may skip setting the min and max.
-         */
-        bool min_exists = pt_device_resource_exists(g_connection_id,
-                                                    device_id,
-                                                    TEMPERATURE_SENSOR,
-                                                    0,
-                                                    MIN_MEASURED_VALUE);
-
-        if (min_exists) {
-            float min_value;
-            status = pt_device_get_resource_value(g_connection_id, device_id, TEMPERATURE_SENSOR, 0, MIN_MEASURED_VALUE,
-                                                  &value_buffer, &value_len);
-
-            if (status != PT_STATUS_SUCCESS) {
-                tr_err("Temperature sensor min resource value get failed.");
-                return;
-            }
-
-            convert_value_to_host_order_float(value_buffer, &min_value);
-            if (temperature < min_value) {
-                uint8_t *new_min_value = malloc_and_memcpy(nw_temperature, sizeof(float));
-                if (new_min_value) {
-                    pt_device_set_resource_value(g_connection_id,
-                                                 device_id,
-                                                 TEMPERATURE_SENSOR,
-                                                 0,
-                                                 MIN_MEASURED_VALUE,
-                                                 new_min_value,
-                                                 sizeof(float),
-                                                 free);
-                } else {
-                    tr_err("Memory allocation failed when allocating new min value");
-                }
-            }
-        }
-
-        bool max_exists = pt_device_resource_exists(g_connection_id,
-                                                    device_id,
-                                                    TEMPERATURE_SENSOR,
-                                                    0,
-                                                    MAX_MEASURED_VALUE);
-        if (max_exists) {
-            float max_value;
-            status = pt_device_get_resource_value(g_connection_id, device_id, TEMPERATURE_SENSOR, 0, MAX_MEASURED_VALUE,
-                                                  &value_buffer, &value_len);
-
-            if (status != PT_STATUS_SUCCESS) {
-                tr_err("Temperature sensor max resource value get failed.");
-                return;
-            }
-
-            convert_value_to_host_order_float(value_buffer, &max_value);
-            if (temperature > max_value) {
-                uint8_t *new_max_value = malloc_and_memcpy(nw_temperature, sizeof(float));
-                if (new_max_value) {
-                    pt_device_set_resource_value(g_connection_id,
-                                                 device_id,
-                                                 TEMPERATURE_SENSOR,
-                                                 0,
-                                                 MAX_MEASURED_VALUE,
-                                                 new_max_value,
-                                                 sizeof(float),
-                                                 free);
-                } else {
-                    tr_err("Memory allocation failed when allocating new max value");
-                }
-            }
-        }
-    }
+    return ipso_sensor_set_value(handle, temperature);
 }
 
 void update_object_structure_success_handler(connection_id_t connection_id, void *ctx)
@@ -663,6 +576,9 @@ void unregister_success_handler(connection_id_t connection_id, const char *devic
                             ipso_reset_min_max_object);
     tr_info( "Asset Version %s",  asset->version);
     pt_device_update_firmware_update_resources(connection_id, device_id, asset->version);
+    if (g_cpu_temperature_handle && strcmp(g_cpu_temperature_handle->device_id, device_id) == 0) {
+        ipso_sensor_handle_rebind(g_cpu_temperature_handle);
+    }
     pt_manifest_context_free(asset);
     pt_device_register(connection_id, device_id, device_register_success_handler, device_register_failure_handler, NULL);
 }
@@ -686,24 +602,172 @@ void asset_manifest_failure_handler(connection_id_t connection_id, const char *f
     tr_info("Manifest Failure Not Reported to Edge-Core");
 }
 
+typedef struct asset_stream_job {
+    ns_list_link_t link;
+    pthread_t thread;
+    bool finished;
+    connection_id_t connection_id;
+    char *filename;
+    pt_manifest_context_t *asset;
+} asset_stream_job_t;
+
+typedef NS_LIST_HEAD(asset_stream_job_t, link) asset_stream_job_list_t;
+
+/* Stream threads that have not been joined yet. Once closed at shutdown no new streams start. */
+static asset_stream_job_list_t g_asset_stream_jobs = NS_LIST_INIT(g_asset_stream_jobs);
+static pthread_mutex_t g_asset_stream_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool g_asset_stream_jobs_closed = false;
+
+static void asset_stream_job_free(asset_stream_job_t *job)
+{
+    free(job->filename);
+    free(job);
+}
+
+/* Joins the stream threads that have finished. Called with g_asset_stream_jobs_mutex held. */
+static void asset_stream_jobs_reap()
+{
+    ns_list_foreach_safe(asset_stream_job_t, job, &g_asset_stream_jobs) {
+        if (job->finished) {
+            ns_list_remove(&g_asset_stream_jobs, job);
+            pthread_join(job->thread, NULL);
+            asset_stream_job_free(job);
+        }
+    }
+}
+
+/*
+ * Stops the running asset streams and waits for them. An interrupted stream
+ * keeps its checkpoint and resumes when the asset is delivered again.
+ */
+static void asset_stream_jobs_join()
+{
+    pthread_mutex_lock(&g_asset_stream_jobs_mutex);
+    g_asset_stream_jobs_closed = true;
+    pthread_mutex_unlock(&g_asset_stream_jobs_mutex);
+
+    /* No jobs are added after closing, so the list is only changed here */
+    ns_list_foreach_safe(asset_stream_job_t, job, &g_asset_stream_jobs) {
+        pthread_join(job->thread, NULL);
+        ns_list_remove(&g_asset_stream_jobs, job);
+        asset_stream_job_free(job);
+    }
+}
+
+/* Unregisters the device so it can be registered again with the new asset hash and version.
+ * The download campaign completes after the re-registration. Takes the ownership of `asset`. */
+static pt_status_t asset_continue_update(const connection_id_t connection_id, pt_manifest_context_t *asset)
+{
+    pt_status_t status = pt_device_unregister(connection_id,
+                                              asset->device_id,
+                                              unregister_success_handler,
+                                              unregister_failure_handler,
+                                              asset);
+    if (status != PT_STATUS_SUCCESS) {
+        tr_err("Could not unregister device %s to complete the update.", asset->device_id);
+        pt_manifest_context_free(asset);
+    }
+    return status;
+}
+
+/* The device id and the version come from the manifest and become a file name. Anything that
+ * could name a file outside the firmware directory is rejected. */
+static bool asset_path_component_valid(const char *component)
+{
+    return component[0] != '\0' && strcmp(component, ".") != 0 && strcmp(component, "..") != 0 &&
+           strchr(component, '/') == NULL;
+}
+
+static bool asset_destination_path(const pt_manifest_context_t *asset, char *path, size_t size)
+{
+    if (!asset_path_component_valid(asset->device_id) || !asset_path_component_valid(asset->version)) {
+        tr_warn("Device id or version of device %s is not a valid file name.", asset->device_id);
+        return false;
+    }
+    if (snprintf(path, size, "%s/%s-%s.bin", g_firmware_dir, asset->device_id, asset->version) >= (int) size) {
+        tr_warn("Firmware path for device %s too long.", asset->device_id);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Streams the downloaded asset to the firmware directory. Large images take a
+ * while to copy and hash, so this runs in its own thread instead of blocking
+ * the protocol translator event loop.
+ */
+static void *asset_stream_thread(void *arg)
+{
+    asset_stream_job_t *job = (asset_stream_job_t *) arg;
+    pt_manifest_context_t *asset = job->asset;
+    asset_stream_result_t result;
+    char destination[PATH_MAX];
+    char digest[SHA256_DIGEST_SIZE * 2 + 1];
+
+    if (!asset_destination_path(asset, destination, sizeof(destination))) {
+        tr_warn("The asset of device %s is not stored.", asset->device_id);
+    } else if (asset_stream_copy(job->filename, destination, asset->size, &g_keep_running, &result)) {
+        if (result.linked) {
+            tr_info("Asset for %s stored to %s: %" PRIu64 " bytes, linked", asset->device_id, destination, result.bytes);
+        } else {
+            asset_stream_digest_to_hex(result.digest, digest);
+            tr_info("Asset for %s stored to %s: %" PRIu64 " bytes, sha256 %s",
+                    asset->device_id, destination, result.bytes, digest);
+        }
+    } else if (get_keep_running()) {
+        tr_warn("Storing the asset of device %s to %s failed, continuing the update without the stored copy.",
+                asset->device_id, destination);
+    }
+
+    if (get_keep_running()) {
+        asset_continue_update(job->connection_id, asset);
+    } else {
+        pt_manifest_context_free(asset);
+    }
+
+    pthread_mutex_lock(&g_asset_stream_jobs_mutex);
+    job->finished = true;
+    pthread_mutex_unlock(&g_asset_stream_jobs_mutex);
+    return NULL;
+}
+
 void asset_download_success_handler(connection_id_t connection_id, const char *filename, int error_code, void *ctx)
 {
     pt_manifest_context_t *asset = (pt_manifest_context_t*) ctx;
     tr_info("Download request complete! Awaiting for async response to come back");
     tr_cmdline("Download complete! File location for %s:\r\n", filename);
-    int c,count=0;
-    FILE *file;
-    file = fopen(filename, "r");
-    if (file) {
-        while ((c = getc(file)) != EOF)
-            count++;
-        fclose(file);
-    }
-    tr_info("count=%d\n",count);
 
-    // Unregister device so we can re-register with new asset hash and version
-    // Download campaign will complete after a re-register
-    pt_device_unregister(connection_id, asset->device_id, unregister_success_handler, unregister_failure_handler, asset);
+    asset_stream_job_t *job = calloc(1, sizeof(asset_stream_job_t));
+    if (job) {
+        job->filename = strdup(filename);
+    }
+    if (!job || !job->filename) {
+        tr_err("Could not allocate the asset stream job.");
+        free(job);
+        pt_manifest_context_free(asset);
+        return;
+    }
+    job->connection_id = connection_id;
+    job->asset = asset;
+
+    pthread_mutex_lock(&g_asset_stream_jobs_mutex);
+    if (g_asset_stream_jobs_closed) {
+        pthread_mutex_unlock(&g_asset_stream_jobs_mutex);
+        tr_info("Shutting down, the asset of device %s is not stored.", asset->device_id);
+        asset_stream_job_free(job);
+        pt_manifest_context_free(asset);
+        return;
+    }
+    asset_stream_jobs_reap();
+    if (pthread_create(&job->thread, NULL, asset_stream_thread, job) != 0) {
+        pthread_mutex_unlock(&g_asset_stream_jobs_mutex);
+        tr_err("Could not start the asset stream thread.");
+        asset_stream_job_free(job);
+        pt_manifest_context_free(asset);
+        return;
+    }
+    ns_list_add_to_end(&g_asset_stream_jobs, job);
+    pthread_mutex_unlock(&g_asset_stream_jobs_mutex);
 }
 
 void asset_download_failure_handler(connection_id_t connection_id, const char *filename, int error_code, void *ctx)
@@ -751,6 +815,20 @@ pt_status_t manifest_meta_data_handle(const connection_id_t connection_id,
         return PT_STATUS_ERROR;
     }
 
+    /* A complete stored copy remains from an earlier delivery of the same version, for example
+     * before a reconnection, so the asset is not downloaded again. */
+    char destination[PATH_MAX];
+    char checkpoint[PATH_MAX];
+    struct stat stored;
+    if (asset_destination_path(ctx, destination, sizeof(destination)) &&
+        snprintf(checkpoint, sizeof(checkpoint), "%s.ckpt", destination) < (int) sizeof(checkpoint) &&
+        stat(destination, &stored) == 0 && S_ISREG(stored.st_mode) && (uint64_t) stored.st_size == size &&
+        access(checkpoint, F_OK) != 0) {
+        tr_info("Asset %s of device %s is already stored in %s, skipping the download.",
+                ctx->version, device_id, destination);
+        return asset_continue_update(connection_id, ctx);
+    }
+
     return pt_download_asset(connection_id,
                              device_id,
                              ctx->size,
@@ -759,8 +837,130 @@ pt_status_t manifest_meta_data_handle(const connection_id_t connection_id,
                              ctx);
 }
 
+static bool sample_cpu_temperature(void *userdata)
+{
+    const char *device_id = (const char *) userdata;
+    if (!is_connected()) {
+        tr_debug("main_loop: currently in disconnected state. Not writing any values!");
+        return false;
+    }
+    if (!pt_device_exists(g_connection_id, device_id) || !get_protocol_translator_api_running()) {
+        return false;
+    }
+    if (!g_cpu_temperature_handle) {
+        return false;
+    }
+    float temperature = tzone_read_cpu_temperature();
+    return update_temperature_to_device(g_cpu_temperature_handle, temperature);
+}
+
+/**
+ * \brief Host sensors exposed by the multi-sensor mode and the IPSO object instances they map to.
+ */
+typedef struct host_sensors_device {
+    char *device_id;
+    host_sensors_t *sensors;
+    ipso_sensor_handle_t **handles;
+} host_sensors_device_t;
+
+static void host_sensors_device_free(host_sensors_device_t *device)
+{
+    if (device) {
+        if (device->handles) {
+            for (int i = 0; i < device->sensors->count; i++) {
+                ipso_sensor_handle_free(device->handles[i]);
+            }
+        }
+        free(device->handles);
+        host_sensors_free(device->sensors);
+        free(device->device_id);
+        free(device);
+    }
+}
+
+static host_sensors_device_t *host_sensors_device_create(const char *endpoint_postfix)
+{
+    host_sensors_device_t *device = calloc(1, sizeof(host_sensors_device_t));
+    if (!device) {
+        return NULL;
+    }
+    device->sensors = host_sensors_discover();
+    device->device_id = malloc(strlen(HOST_SENSORS_DEVICE) + strlen(endpoint_postfix) + 1);
+    if (!device->sensors || !device->device_id) {
+        host_sensors_device_free(device);
+        return NULL;
+    }
+    sprintf(device->device_id, "%s%s", HOST_SENSORS_DEVICE, endpoint_postfix);
+    uint16_t *object_ids = calloc(device->sensors->count, sizeof(uint16_t));
+    uint16_t *instance_ids = calloc(device->sensors->count, sizeof(uint16_t));
+    device->handles = calloc(device->sensors->count, sizeof(ipso_sensor_handle_t *));
+    bool created = object_ids && instance_ids && device->handles &&
+                   client_config_create_host_sensors_device(g_connection_id,
+                                                            device->device_id,
+                                                            device->sensors,
+                                                            object_ids,
+                                                            instance_ids);
+    for (int i = 0; created && i < device->sensors->count; i++) {
+        const host_sensor_t *sensor = &device->sensors->sensors[i];
+        device->handles[i] = ipso_sensor_handle_create(g_connection_id,
+                                                       device->device_id,
+                                                       object_ids[i],
+                                                       instance_ids[i]);
+        /* Later samples are written only when they change, so write the value of the discovery
+         * sample now. The CPU load has only its baseline until the next sample. */
+        if (device->handles[i] && sensor->kind != HOST_SENSOR_CPU_LOAD) {
+            ipso_sensor_set_value(device->handles[i], sensor->value);
+        }
+    }
+    free(object_ids);
+    free(instance_ids);
+    if (!created) {
+        host_sensors_device_free(device);
+        return NULL;
+    }
+    return device;
+}
+
+static bool sample_host_sensors(void *userdata)
+{
+    host_sensors_device_t *device = (host_sensors_device_t *) userdata;
+    struct timespec start, end;
+    if (!is_connected() || !get_protocol_translator_api_running() ||
+        !pt_device_exists(g_connection_id, device->device_id)) {
+        return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int changed = host_sensors_sample(device->sensors);
+    for (int i = 0; i < device->sensors->count && changed > 0; i++) {
+        const host_sensor_t *sensor = &device->sensors->sensors[i];
+        if (sensor->changed && device->handles[i]) {
+            ipso_sensor_set_value(device->handles[i], sensor->value);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    int64_t elapsed_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    tr_debug("Host sensors: %d of %d changed, sampled and updated in %" PRId64 " us (%.2f us per sensor).",
+             changed,
+             device->sensors->count,
+             elapsed_us,
+             (double) elapsed_us / device->sensors->count);
+    return changed > 0;
+}
+
+static void send_device_updates(void *userdata)
+{
+    (void) userdata;
+    pt_devices_update(g_connection_id,
+                      update_object_structure_success_handler,
+                      update_object_structure_failure_handler,
+                      NULL);
+}
+
 void main_loop(DocoptArgs *args)
 {
+    host_sensors_device_t *host_sensors_device = NULL;
     wait_until_connected();
 
     char *cpu_temperature_device_id = malloc(strlen(CPU_TEMPERATURE_DEVICE) + strlen(args->endpoint_postfix) + 1);
@@ -769,33 +969,53 @@ void main_loop(DocoptArgs *args)
         sprintf(cpu_temperature_device_id, "%s%s", CPU_TEMPERATURE_DEVICE, args->endpoint_postfix);
         pt_device_add_manifest_callback(g_connection_id, manifest_meta_data_handle);
         client_config_create_cpu_temperature_device(g_connection_id, cpu_temperature_device_id);
+        g_cpu_temperature_handle = ipso_sensor_handle_create(g_connection_id,
+                                                             cpu_temperature_device_id,
+                                                             TEMPERATURE_SENSOR,
+                                                             0);
         pt_device_register(g_connection_id,
                            cpu_temperature_device_id,
                            device_register_success_handler,
                            device_register_failure_handler, NULL);
 
-        while (get_keep_running()) {
-            if (is_shutdown_handler_called()) {
-                tr_info("Interrupt was received! Shutting down.");
-                break;
+        if (args->host_sensors) {
+            host_sensors_device = host_sensors_device_create(args->endpoint_postfix);
+            if (host_sensors_device) {
+                pt_device_register(g_connection_id,
+                                   host_sensors_device->device_id,
+                                   device_register_success_handler,
+                                   device_register_failure_handler, NULL);
+            } else {
+                tr_err("Could not create the host sensors device.");
             }
+        }
 
-            if (is_connected()) {
-                if (pt_device_exists(g_connection_id, cpu_temperature_device_id) &&
-                    get_protocol_translator_api_running()) {
-                    float temperature = tzone_read_cpu_temperature();
-                    update_temperature_to_device(cpu_temperature_device_id, temperature);
-                    pt_devices_update(g_connection_id,
-                                      update_object_structure_success_handler,
-                                      update_object_structure_failure_handler,
-                                      NULL);
-                }
-
-            } else {
-                tr_debug("main_loop: currently in disconnected state. Not writing any values!");
+        /* The sampler sleeps in epoll until a sampling timer expires or a shutdown is requested.
+         * Values are sent to Edge Core only when a sample changed. */
+        if (sampler_add_source(g_sampler,
+                               g_sample_period_ms,
+                               g_sample_jitter_ms,
+                               sample_cpu_temperature,
+                               cpu_temperature_device_id) &&
+            (!host_sensors_device ||
+             sampler_add_source(g_sampler,
+                                g_sample_period_ms,
+                                g_sample_jitter_ms,
+                                sample_host_sensors,
+                                host_sensors_device))) {
+            if (get_keep_running() && !is_shutdown_handler_called()) {
+                sampler_run(g_sampler, send_device_updates, NULL);
             }
-            sleep(5);
+        } else {
+            tr_err("Could not start the sensor sampling.");
+        }
+        if (is_shutdown_handler_called()) {
+            tr_info("Interrupt was received! Shutting down.");
         }
+        asset_stream_jobs_join();
+        host_sensors_device_free(host_sensors_device);
+        ipso_sensor_handle_free(g_cpu_temperature_handle);
+        g_cpu_temperature_handle = NULL;
     }
 
     if(cpu_temperature_device_id)
@@ -822,6 +1042,7 @@ int main(int argc, char **argv)
 {
     DocoptArgs args = docopt(argc, argv, /* help */ 1, /* version */ "0.1");
     edge_trace_init(args.color_log);
+    g_firmware_dir = args.firmware_dir;
     int32_t result = pthread_mutex_init(&shutdown_wait_mutex, NULL);
     assert(0 == result);
     result = pthread_mutex_init(&state_data_mutex, NULL);
@@ -833,6 +1054,27 @@ int main(int argc, char **argv)
         fprintf(stderr, "The --protocol-translator-name parameter is mandatory. Please see --help\n");
         return 1;
     }
+
+    int sample_period_ms = atoi(args.sample_period_ms);
+    if (sample_period_ms <= 0) {
+        fprintf(stderr, "The --sample-period-ms parameter must be a positive number of milliseconds.\n");
+        return 1;
+    }
+    int sample_jitter_ms = atoi(args.sample_jitter_ms);
+    if (sample_jitter_ms < 0) {
+        fprintf(stderr, "The --sample-jitter-ms parameter must not be negative.\n");
+        return 1;
+    }
+    g_sample_period_ms = sample_period_ms;
+    g_sample_jitter_ms = sample_jitter_ms;
+
+    /* The sampler lives until all threads are joined, so the signal handler and the
+     * protocol translator callbacks can always stop it. */
+    g_sampler = sampler_create();
+    if (g_sampler == NULL) {
+        tr_err("Failed to create the sampler.");
+        return 1;
+    }
     pt_api_init();
     protocol_translator_callbacks_t pt_cbs = {0};
     pt_cbs.connection_ready_cb = connection_ready_handler;
@@ -871,6 +1113,15 @@ int main(int argc, char **argv)
     wait_for_protocol_translator_api_thread();
     free(ctx);
     pt_client_free(g_client);
+    // The shutdown handler must not stop the sampler once it is freed.
+    sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGTERM);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, NULL);
+    sampler_free(g_sampler);
+    g_sampler = NULL;
     pthread_mutex_destroy(&shutdown_wait_mutex);
     pthread_mutex_destroy(&state_data_mutex);
     edge_trace_destroy();
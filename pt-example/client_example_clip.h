@@ -34,10 +34,14 @@ typedef struct {
     /* options without arguments */
     int color_log;
     int help;
+    int host_sensors;
     /* options with arguments */
     char *edge_domain_socket;
     char *endpoint_postfix;
+    char *firmware_dir;
     char *protocol_translator_name;
+    char *sample_jitter_ms;
+    char *sample_period_ms;
     /* special */
     const char *usage_pattern;
     const char *help_message;
@@ -47,7 +51,7 @@ const char help_message[] =
 "Protocol Translator Example.\n"
 "\n"
 "Usage:\n"
-"  pt-example --protocol-translator-name <name> [--endpoint-postfix <name>] [--edge-domain-socket <domain-socket>] [--color-log]\n"
+"  pt-example --protocol-translator-name <name> [--endpoint-postfix <name>] [--edge-domain-socket <domain-socket>] [--sample-period-ms <milliseconds>] [--sample-jitter-ms <milliseconds>] [--host-sensors] [--firmware-dir <directory>] [--color-log]\n"
 "  pt-example --help\n"
 "\n"
 "Options:\n"
@@ -55,12 +59,16 @@ const char help_message[] =
 "  -n --protocol-translator-name <name>      Name of the Protocol Translator.\n"
 "  -e --endpoint-postfix <postfix>           Name for the endpoint postfix [default: -0]\n"
 "  --edge-domain-socket <string>             Edge Core domain socket path [default: /tmp/edge.sock].\n"
+"  -p --sample-period-ms <milliseconds>      Sensor sampling period in milliseconds [default: 5000].\n"
+"  -j --sample-jitter-ms <milliseconds>      Random variation added to each sampling period in milliseconds [default: 0].\n"
+"  --host-sensors                            Also expose every thermal zone, hwmon sensor and per-CPU load as a sensor object of a host-sensors device.\n"
+"  -f --firmware-dir <directory>             Directory where downloaded firmware assets are stored [default: .].\n"
 "  --color-log                               Use ANSI colors in log.\n"
 "";
 
 const char usage_pattern[] =
 "Usage:\n"
-"  pt-example --protocol-translator-name <name> [--endpoint-postfix <name>] [--edge-domain-socket <domain-socket>] [--color-log]\n"
+"  pt-example --protocol-translator-name <name> [--endpoint-postfix <name>] [--edge-domain-socket <domain-socket>] [--sample-period-ms <milliseconds>] [--sample-jitter-ms <milliseconds>] [--host-sensors] [--firmware-dir <directory>] [--color-log]\n"
 "  pt-example --help";
 
 typedef struct {
@@ -284,15 +292,26 @@ int elems_to_args(Elements *elements, DocoptArgs *args, bool help,
             args->color_log = option->value;
         } else if (!strcmp(option->olong, "--help")) {
             args->help = option->value;
+        } else if (!strcmp(option->olong, "--host-sensors")) {
+            args->host_sensors = option->value;
         } else if (!strcmp(option->olong, "--edge-domain-socket")) {
             if (option->argument)
                 args->edge_domain_socket = option->argument;
         } else if (!strcmp(option->olong, "--endpoint-postfix")) {
             if (option->argument)
                 args->endpoint_postfix = option->argument;
+        } else if (!strcmp(option->olong, "--firmware-dir")) {
+            if (option->argument)
+                args->firmware_dir = option->argument;
         } else if (!strcmp(option->olong, "--protocol-translator-name")) {
             if (option->argument)
                 args->protocol_translator_name = option->argument;
+        } else if (!strcmp(option->olong, "--sample-jitter-ms")) {
+            if (option->argument)
+                args->sample_jitter_ms = option->argument;
+        } else if (!strcmp(option->olong, "--sample-period-ms")) {
+            if (option->argument)
+                args->sample_period_ms = option->argument;
         }
     }
     /* commands */
@@ -313,7 +332,8 @@ int elems_to_args(Elements *elements, DocoptArgs *args, bool help,
 
 DocoptArgs docopt(int argc, char *argv[], bool help, const char *version) {
     DocoptArgs args = {
-        0, 0, (char*) "/tmp/edge.sock", (char*) "-0", NULL,
+        0, 0, 0, (char*) "/tmp/edge.sock", (char*) "-0", (char*) ".", NULL,
+        (char*) "0", (char*) "5000",
         usage_pattern, help_message
     };
     Tokens ts;
@@ -324,11 +344,15 @@ DocoptArgs docopt(int argc, char *argv[], bool help, const char *version) {
     Option options[] = {
         {NULL, "--color-log", 0, 0, NULL},
         {"-h", "--help", 0, 0, NULL},
+        {NULL, "--host-sensors", 0, 0, NULL},
         {NULL, "--edge-domain-socket", 1, 0, NULL},
         {"-e", "--endpoint-postfix", 1, 0, NULL},
-        {"-n", "--protocol-translator-name", 1, 0, NULL}
+        {"-f", "--firmware-dir", 1, 0, NULL},
+        {"-n", "--protocol-translator-name", 1, 0, NULL},
+        {"-j", "--sample-jitter-ms", 1, 0, NULL},
+        {"-p", "--sample-period-ms", 1, 0, NULL}
     };
-    Elements elements = {0, 0, 5, commands, arguments, options};
+    Elements elements = {0, 0, 9, commands, arguments, options};
 
     ts = tokens_new(argc, argv);
     if (parse_args(&ts, &elements))
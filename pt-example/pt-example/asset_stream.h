@@ -0,0 +1,79 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef PT_EXAMPLE_ASSET_STREAM_H
+#define PT_EXAMPLE_ASSET_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pt-example/sha256.h"
+
+/* Size of the copy buffer, the asset is never held in memory as a whole */
+#define ASSET_STREAM_CHUNK_SIZE (64 * 1024)
+/* Progress is written to the checkpoint file after this many bytes */
+#define ASSET_STREAM_CHECKPOINT_INTERVAL (4 * 1024 * 1024)
+
+typedef struct asset_stream_result {
+    uint64_t bytes;
+    uint64_t resumed_from;
+    double seconds;
+    bool linked; /* stored as a hard link, nothing was copied and the digest is not set */
+    uint8_t digest[SHA256_DIGEST_SIZE];
+} asset_stream_result_t;
+
+/**
+ * \brief Stores a downloaded asset to `destination`.
+ *
+ *        If `destination` is on the same file system as `source`, the asset is stored as a
+ *        hard link, so the disk space is not used twice. Otherwise it is streamed through a
+ *        fixed size buffer and its SHA-256 is computed on the way. The manifest does not carry
+ *        the hash of the payload, so the digest is only reported, not verified.
+ *
+ *        The offset and the hash state are checkpointed to `<destination>.ckpt`. If the
+ *        stream is interrupted, a later call with the same unchanged source continues
+ *        from the last checkpoint instead of starting over. The checkpoint is removed
+ *        when the stream completes.
+ *
+ *        The copy stops between two chunks when `*keep_running` turns false. The
+ *        progress is checkpointed first, so the stream can be resumed later.
+ *
+ * \param source Path of the downloaded asset.
+ * \param destination Path where the asset is stored.
+ * \param expected_size Size announced in the manifest, 0 to skip the size check.
+ * \param keep_running Checked before each chunk, NULL if the copy cannot be stopped.
+ * \param result Filled with the byte count, hash and timing on success.
+ * \return true on success, false on failure or if the copy was stopped.
+ */
+bool asset_stream_copy(const char *source,
+                       const char *destination,
+                       uint64_t expected_size,
+                       const volatile bool *keep_running,
+                       asset_stream_result_t *result);
+
+/**
+ * \brief Formats a digest as a lowercase hex string.
+ *
+ * \param digest The digest.
+ * \param out Buffer of at least `2 * SHA256_DIGEST_SIZE + 1` bytes.
+ */
+void asset_stream_digest_to_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char *out);
+
+#endif /* PT_EXAMPLE_ASSET_STREAM_H */
@@ -0,0 +1,83 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef PT_EXAMPLE_SAMPLER_H
+#define PT_EXAMPLE_SAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \file sampler.h
+ * \brief Event driven sensor sampling for the protocol translator example.
+ *
+ * Each sampling source has its own timerfd so that sources can run with different
+ * periods. All timers and a shutdown eventfd are waited on with a single epoll instance.
+ * The flush callback is called once per wake-up, and only if a source reported a change.
+ */
+
+typedef struct sampler sampler_t;
+
+/**
+ * \brief Reads a source and stores the value to the device.
+ *
+ * \param userdata The userdata given in `sampler_add_source()`.
+ * \return true if the value changed and should be sent to Edge Core.
+ */
+typedef bool (*sampler_sample_cb)(void *userdata);
+
+/**
+ * \brief Sends the changed values to Edge Core.
+ *
+ * \param userdata The userdata given in `sampler_run()`.
+ */
+typedef void (*sampler_flush_cb)(void *userdata);
+
+sampler_t *sampler_create(void);
+
+/**
+ * \brief Adds a sampling source.
+ *
+ * \param sampler The sampler.
+ * \param period_ms The sampling period in milliseconds.
+ * \param jitter_ms Each period is randomized by +/- `jitter_ms` to spread the sampling of many sources.
+ * \param sample_cb The callback reading the source.
+ * \param userdata The userdata passed to `sample_cb`.
+ * \return true on success, false on failure.
+ */
+bool sampler_add_source(sampler_t *sampler,
+                        uint32_t period_ms,
+                        uint32_t jitter_ms,
+                        sampler_sample_cb sample_cb,
+                        void *userdata);
+
+/**
+ * \brief Runs the sampling loop until `sampler_stop()` is called.
+ */
+void sampler_run(sampler_t *sampler, sampler_flush_cb flush_cb, void *userdata);
+
+/**
+ * \brief Stops the sampling loop. Safe to call from a signal handler and from other threads.
+ */
+void sampler_stop(sampler_t *sampler);
+
+void sampler_free(sampler_t *sampler);
+
+#endif /* PT_EXAMPLE_SAMPLER_H */
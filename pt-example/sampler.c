@@ -0,0 +1,207 @@
+/*
+ * ----------------------------------------------------------------------------
+ * Copyright 2018 ARM Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "ns_list.h"
+#include "pt-example/sampler.h"
+#include "mbed-trace/mbed_trace.h"
+
+#define TRACE_GROUP "sampler"
+#define SAMPLER_MAX_EVENTS 64
+
+typedef struct sampler_source {
+    ns_list_link_t link;
+    int timer_fd;
+    uint32_t period_ms;
+    uint32_t jitter_ms;
+    sampler_sample_cb sample_cb;
+    void *userdata;
+} sampler_source_t;
+
+typedef NS_LIST_HEAD(sampler_source_t, link) sampler_source_list_t;
+
+struct sampler {
+    int epoll_fd;
+    int stop_fd;
+    sampler_source_list_t sources;
+};
+
+static bool sampler_arm_source(sampler_source_t *source)
+{
+    int64_t timeout_ms = source->period_ms;
+    struct itimerspec spec;
+    if (source->jitter_ms) {
+        timeout_ms += (int64_t)(rand() % (2 * source->jitter_ms + 1)) - source->jitter_ms;
+    }
+    if (timeout_ms < 1) {
+        timeout_ms = 1;
+    }
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = timeout_ms / 1000;
+    spec.it_value.tv_nsec = (timeout_ms % 1000) * 1000000;
+    if (timerfd_settime(source->timer_fd, 0, &spec, NULL) != 0) {
+        tr_err("timerfd_settime failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+sampler_t *sampler_create(void)
+{
+    sampler_t *sampler = calloc(1, sizeof(sampler_t));
+    if (!sampler) {
+        tr_err("Could not allocate sampler.");
+        return NULL;
+    }
+    ns_list_init(&sampler->sources);
+    sampler->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    sampler->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (sampler->epoll_fd < 0 || sampler->stop_fd < 0) {
+        tr_err("Could not create sampler file descriptors: %s", strerror(errno));
+        sampler_free(sampler);
+        return NULL;
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_ctl(sampler->epoll_fd, EPOLL_CTL_ADD, sampler->stop_fd, &event) != 0) {
+        tr_err("Could not add the stop event to epoll: %s", strerror(errno));
+        sampler_free(sampler);
+        return NULL;
+    }
+    return sampler;
+}
+
+bool sampler_add_source(sampler_t *sampler,
+                        uint32_t period_ms,
+                        uint32_t jitter_ms,
+                        sampler_sample_cb sample_cb,
+                        void *userdata)
+{
+    if (!sampler || !sample_cb || period_ms == 0) {
+        return false;
+    }
+    sampler_source_t *source = calloc(1, sizeof(sampler_source_t));
+    if (!source) {
+        tr_err("Could not allocate sampler source.");
+        return false;
+    }
+    source->period_ms = period_ms;
+    source->jitter_ms = jitter_ms < period_ms ? jitter_ms : period_ms - 1;
+    source->sample_cb = sample_cb;
+    source->userdata = userdata;
+    source->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (source->timer_fd < 0) {
+        tr_err("Could not create timerfd: %s", strerror(errno));
+        free(source);
+        return false;
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = source};
+    if (epoll_ctl(sampler->epoll_fd, EPOLL_CTL_ADD, source->timer_fd, &event) != 0) {
+        tr_err("Could not add timerfd to epoll: %s", strerror(errno));
+        close(source->timer_fd);
+        free(source);
+        return false;
+    }
+    ns_list_add_to_end(&sampler->sources, source);
+    return true;
+}
+
+void sampler_run(sampler_t *sampler, sampler_flush_cb flush_cb, void *userdata)
+{
+    struct epoll_event events[SAMPLER_MAX_EVENTS];
+    bool running = true;
+
+    /* Sample everything once right away, then follow the periods */
+    bool changed = false;
+    ns_list_foreach(sampler_source_t, source, &sampler->sources) {
+        changed |= source->sample_cb(source->userdata);
+        sampler_arm_source(source);
+    }
+    if (changed && flush_cb) {
+        flush_cb(userdata);
+    }
+
+    while (running) {
+        int count = epoll_wait(sampler->epoll_fd, events, SAMPLER_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tr_err("epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        changed = false;
+        for (int i = 0; i < count; i++) {
+            sampler_source_t *source = events[i].data.ptr;
+            uint64_t expirations;
+            if (!source) {
+                running = false;
+                continue;
+            }
+            if (read(source->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                continue;
+            }
+            changed |= source->sample_cb(source->userdata);
+            sampler_arm_source(source);
+        }
+        /* One update for all sources which changed during this wake-up */
+        if (running && changed && flush_cb) {
+            flush_cb(userdata);
+        }
+    }
+    tr_debug("Sampler stopped.");
+}
+
+void sampler_stop(sampler_t *sampler)
+{
+    uint64_t value = 1;
+    if (sampler && sampler->stop_fd >= 0) {
+        /* write() is async-signal-safe */
+        if (write(sampler->stop_fd, &value, sizeof(value)) != sizeof(value)) {
+            // Counter is already set, the loop will wake up anyway.
+        }
+    }
+}
+
+void sampler_free(sampler_t *sampler)
+{
+    if (!sampler) {
+        return;
+    }
+    ns_list_foreach_safe(sampler_source_t, source, &sampler->sources) {
+        ns_list_remove(&sampler->sources, source);
+        close(source->timer_fd);
+        free(source);
+    }
+    if (sampler->stop_fd >= 0) {
+        close(sampler->stop_fd);
+    }
+    if (sampler->epoll_fd >= 0) {
+        close(sampler->epoll_fd);
+    }
+    free(sampler);
+}